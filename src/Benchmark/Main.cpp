@@ -0,0 +1,311 @@
+#include <BlackBone/Process/Process.h>
+#include <BlackBone/Process/RPC/RemoteFunction.hpp>
+#include <BlackBone/Misc/PerfCounter.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace blackbone;
+
+using fnRtlComputeCrc32 = ULONG( NTAPI* )(ULONG, const UCHAR*, ULONG);
+
+// Remote execution modes under test
+enum eBenchMode
+{
+    Bench_NewThread,    // ExecInNewThread
+    Bench_Worker,       // ExecInWorkerThread, APC worker
+    Bench_Ring,         // ExecInWorkerThread, command ring worker
+    Bench_AnyThread,    // ExecInAnyThread, hijacked thread
+    Bench_Direct,       // ExecDirect
+
+    Bench_Count
+};
+
+const wchar_t* g_modeNames[] = { L"NewThread", L"Worker", L"Ring", L"AnyThread", L"Direct" };
+
+// Out-of-line argument sizes
+const size_t g_payloads[] = { 0, 0x40, 0x1000, 0x10000, 0x100000 };
+
+// Latency histogram buckets: [0, 1) us, then power of 2 ranges up to [512, 1024) us, then the rest
+constexpr size_t HistogramBuckets = 12;
+
+/// <summary>
+/// Benchmark settings
+/// </summary>
+struct BenchConfig
+{
+    DWORD pid = 0;                  // Target process, 0 - self
+    uint32_t iterations = 1000;     // Measured calls per mode and payload
+    uint32_t warmup = 20;           // Calls excluded from statistics
+    std::wstring tracePath;         // Stage trace file prefix, empty - tracing is off
+};
+
+/// <summary>
+/// Latency distribution of a single mode and payload
+/// </summary>
+struct BenchResult
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    double p50 = 0.0;               // Median latency, microseconds
+    double p99 = 0.0;               // 99th percentile latency, microseconds
+    double p999 = 0.0;              // 99.9th percentile latency, microseconds
+    double max = 0.0;               // Worst latency, microseconds
+    double throughput = 0.0;        // Calls per second
+    std::array<uint32_t, HistogramBuckets> histogram = {};  // Sample count per latency bucket
+};
+
+/// <summary>
+/// Get histogram bucket of latency sample
+/// </summary>
+/// <param name="us">Latency, microseconds</param>
+/// <returns>Bucket index</returns>
+size_t HistogramBucket( double us )
+{
+    size_t bucket = 0;
+    for (double bound = 1.0; bucket < HistogramBuckets - 1 && us >= bound; bound *= 2)
+        bucket++;
+
+    return bucket;
+}
+
+/// <summary>
+/// Print non-empty histogram buckets
+/// </summary>
+/// <param name="histogram">Sample count per bucket</param>
+void PrintHistogram( const std::array<uint32_t, HistogramBuckets>& histogram )
+{
+    wprintf( L"%19ls", L"" );
+    for (size_t i = 0; i < HistogramBuckets; i++)
+    {
+        if (histogram[i] == 0)
+            continue;
+
+        if (i == 0)
+            wprintf( L"  <1:%u", histogram[i] );
+        else if (i == HistogramBuckets - 1)
+            wprintf( L"  >=%u:%u", 1u << (i - 1), histogram[i] );
+        else
+            wprintf( L"  %u-%u:%u", 1u << (i - 1), 1u << i, histogram[i] );
+    }
+
+    wprintf( L"\n" );
+}
+
+/// <summary>
+/// Get percentile of sorted samples
+/// </summary>
+/// <param name="samples">Sorted samples</param>
+/// <param name="permille">Percentile, 1/1000</param>
+/// <returns>Sample value</returns>
+double Percentile( const std::vector<double>& samples, size_t permille )
+{
+    return samples[min( samples.size() - 1, samples.size() * permille / 1000 )];
+}
+
+/// <summary>
+/// Measure remote call latency for single mode and payload size
+/// </summary>
+/// <param name="process">Target process</param>
+/// <param name="mode">Execution mode</param>
+/// <param name="payload">Argument payload size</param>
+/// <param name="config">Benchmark settings</param>
+/// <param name="hijack">Thread to use for ExecInAnyThread</param>
+/// <returns>Latency distribution</returns>
+BenchResult Run( Process& process, eBenchMode mode, size_t payload, const BenchConfig& config, ThreadPtr hijack )
+{
+    BenchResult result;
+    auto& remote = process.remote();
+
+    // Payload is passed as in/out buffer, so it's both copied and read back
+    std::vector<uint8_t> buf( payload, 0xAB );
+    auto crc = process.modules().GetNtdllExport( "RtlComputeCrc32" );
+    auto trivial = process.modules().GetNtdllExport( "RtlNtStatusToDosError" );
+    if (!crc || !trivial)
+    {
+        result.status = STATUS_NOT_FOUND;
+        return result;
+    }
+
+    auto pFN = MakeRemoteFunction<fnRtlComputeCrc32>( process, crc->procAddress );
+
+    // ExecDirect passes single pointer to thread routine, payload is transferred by hand
+    MemBlock direct;
+    if (mode == Bench_Direct && payload != 0)
+    {
+        auto mem = process.memory().Allocate( payload, PAGE_READWRITE );
+        if (!mem)
+        {
+            result.status = mem.status;
+            return result;
+        }
+
+        direct = std::move( mem.result() );
+    }
+
+    ThreadPtr thread;
+    if (mode == Bench_Worker || mode == Bench_Ring)
+        thread = remote.getWorker();
+    else if (mode == Bench_AnyThread)
+        thread = hijack;
+
+    auto call = [&]() -> NTSTATUS
+    {
+        if (mode != Bench_Direct)
+            return pFN.Call( { 0ul, AsmVariant( buf.data(), payload ), static_cast<ULONG>(payload) }, thread ).status;
+
+        NTSTATUS status = STATUS_SUCCESS;
+        if (payload != 0 && !NT_SUCCESS( status = direct.Write( 0, payload, buf.data() ) ))
+            return status;
+
+        remote.ExecDirect( trivial->procAddress, direct.ptr() );
+        return payload != 0 ? direct.Read( 0, payload, buf.data() ) : STATUS_SUCCESS;
+    };
+
+    for (uint32_t i = 0; i < config.warmup; i++)
+    {
+        if (!NT_SUCCESS( result.status = call() ))
+            return result;
+    }
+
+    std::vector<double> samples;
+    samples.reserve( config.iterations );
+
+    auto begin = PerfCounter::now();
+    for (uint32_t i = 0; i < config.iterations; i++)
+    {
+        auto start = PerfCounter::now();
+        if (!NT_SUCCESS( result.status = call() ))
+            return result;
+
+        samples.emplace_back( PerfCounter::toNanoseconds( PerfCounter::now() - start ) / 1000.0 );
+        result.histogram[HistogramBucket( samples.back() )]++;
+    }
+
+    auto total = PerfCounter::toNanoseconds( PerfCounter::now() - begin );
+    std::sort( samples.begin(), samples.end() );
+
+    result.p50 = Percentile( samples, 500 );
+    result.p99 = Percentile( samples, 990 );
+    result.p999 = Percentile( samples, 999 );
+    result.max = samples.back();
+    result.throughput = total != 0 ? samples.size() * 1e9 / total : 0.0;
+
+    return result;
+}
+
+/// <summary>
+/// Benchmark all payload sizes for execution mode
+/// </summary>
+/// <param name="mode">Execution mode</param>
+/// <param name="config">Benchmark settings</param>
+/// <param name="hijackId">Thread to use for ExecInAnyThread, 0 - most executed thread</param>
+void RunMode( eBenchMode mode, const BenchConfig& config, DWORD hijackId )
+{
+    Process process;
+    NTSTATUS status = process.Attach( config.pid != 0 ? config.pid : GetCurrentProcessId() );
+    if (!NT_SUCCESS( status ))
+    {
+        wprintf( L"%-10ls attach failed: 0x%08X\n", g_modeNames[mode], status );
+        return;
+    }
+
+    auto& remote = process.remote();
+    switch (mode)
+    {
+    case Bench_Worker:
+        status = remote.CreateRPCEnvironment( Worker_CreateNew, true );
+        break;
+
+    case Bench_Ring:
+        status = remote.CreateRPCEnvironment( Worker_Ring, true );
+        break;
+
+    case Bench_AnyThread:
+        status = remote.CreateRPCEnvironment( Worker_None, true );
+        break;
+
+    default:
+        break;
+    }
+
+    if (!NT_SUCCESS( status ))
+    {
+        wprintf( L"%-10ls environment setup failed: 0x%08X\n", g_modeNames[mode], status );
+        return;
+    }
+
+    auto hijack = hijackId != 0 ? process.threads().get( hijackId ) : process.threads().getMostExecuted();
+
+    if (!config.tracePath.empty())
+        remote.trace().Enable( (config.warmup + config.iterations) * _countof( g_payloads ) );
+
+    for (auto payload : g_payloads)
+    {
+        auto result = Run( process, mode, payload, config, hijack );
+        if (!NT_SUCCESS( result.status ))
+        {
+            wprintf( L"%-10ls %8zu  failed: 0x%08X\n", g_modeNames[mode], payload, result.status );
+            continue;
+        }
+
+        wprintf(
+            L"%-10ls %8zu %10.1f %10.1f %10.1f %10.1f %12.0f\n",
+            g_modeNames[mode], payload, result.p50, result.p99, result.p999, result.max, result.throughput
+        );
+
+        PrintHistogram( result.histogram );
+    }
+
+    if (!config.tracePath.empty())
+    {
+        auto path = config.tracePath + L"." + g_modeNames[mode] + L".csv";
+        if (!NT_SUCCESS( status = remote.trace().Dump( path ) ))
+            wprintf( L"Failed to write '%ls': 0x%08X\n", path.c_str(), status );
+    }
+}
+
+/// <summary>
+/// Usage: Benchmark [pid [iterations [trace file prefix]]]
+/// </summary>
+int wmain( int argc, wchar_t* argv[] )
+{
+    BenchConfig config;
+    if (argc > 1)
+        config.pid = wcstoul( argv[1], nullptr, 0 );
+    if (argc > 2)
+        config.iterations = max( wcstoul( argv[2], nullptr, 0 ), 1ul );
+    if (argc > 3)
+        config.tracePath = argv[3];
+
+    // Idle thread to hijack when benchmarking against self
+    std::atomic<bool> stop = false;
+    std::thread idle;
+    DWORD hijackId = 0;
+    if (config.pid == 0)
+    {
+        idle = std::thread( [&stop]()
+        {
+            while (!stop)
+                SwitchToThread();
+        } );
+
+        hijackId = GetThreadId( idle.native_handle() );
+    }
+
+    wprintf( L"%-10ls %8ls %10ls %10ls %10ls %10ls %12ls\n", L"Mode", L"Payload", L"p50, us", L"p99, us", L"p999, us", L"max, us", L"calls/s" );
+
+    for (int mode = 0; mode < Bench_Count; mode++)
+        RunMode( static_cast<eBenchMode>(mode), config, hijackId );
+
+    if (idle.joinable())
+    {
+        stop = true;
+        idle.join();
+    }
+
+    return 0;
+}
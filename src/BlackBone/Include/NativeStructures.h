@@ -44,6 +44,16 @@ struct _UNICODE_STRING_T
     T Buffer;
 };
 
+template <typename T>
+struct _ANSI_STRING_T
+{
+    using type = T;
+
+    uint16_t Length;
+    uint16_t MaximumLength;
+    T Buffer;
+};
+
 template <typename T>
 struct _NT_TIB_T
 {
@@ -48,6 +48,14 @@ enum eModSeachType
     PEHeaders,      // Scan for PE headers in memory
 };
 
+// PE header scan filters
+enum ePEScanFilter
+{
+    PEScanAll        = 0,   // All committed allocations
+    PEScanExecutable = 1,   // Allocations containing executable pages
+    PEScanPrivate    = 2,   // Private allocations, e.g. manually mapped images
+};
+
 // Switch created wow64 thread to long mode
 enum eThreadModeSwitch
 {
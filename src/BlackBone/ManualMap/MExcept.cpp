@@ -5,6 +5,8 @@
 #include "../Symbols/SymbolData.h"
 #include "../Asm/LDasm.h"
 
+#include <algorithm>
+
 namespace blackbone
 {
 
@@ -162,41 +164,60 @@ LONG CALLBACK VectoredHandler( PEXCEPTION_POINTERS ExceptionInfo )
     // for SEH RtlAddFunctionTable is enough
     if (ExceptionInfo->ExceptionRecord->ExceptionCode == EH_EXCEPTION_NUMBER)
     {
-        ModuleTable* pTable = reinterpret_cast<ModuleTable*>(0xDEADBEEFDEADBEEF);
-        for (ptr_t i = 0; i < pTable->count; i++)
+        ModuleTableHeader* pHeader = reinterpret_cast<ModuleTableHeader*>(0xDEADBEEFDEADBEEF);
+        InterlockedIncrement64( &pHeader->readers );
+
+        ModuleTable* pTable = reinterpret_cast<ModuleTable*>(pHeader->table);
+        if (pTable == nullptr)
+        {
+            InterlockedDecrement64( &pHeader->readers );
+            return EXCEPTION_CONTINUE_SEARCH;
+        }
+
+        // Find last module with base <= exception site
+        ptr_t address = ExceptionInfo->ExceptionRecord->ExceptionInformation[2];
+        ptr_t lo = 0, hi = pTable->count;
+        while (lo < hi)
+        {
+            ptr_t mid = (lo + hi) / 2;
+            if (pTable->entry[mid].base > address)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+
+        // Check exception site image boundaries
+        if (lo != 0 && address <= pTable->entry[lo - 1].base + pTable->entry[lo - 1].size)
         {
-            // Check exception site image boundaries
-            if (ExceptionInfo->ExceptionRecord->ExceptionInformation[2] >= pTable->entry[i].base &&
-                ExceptionInfo->ExceptionRecord->ExceptionInformation[2] <= pTable->entry[i].base + pTable->entry[i].size)
+            // Assume that's our exception because ImageBase = 0 and not suitable magic number
+            if (ExceptionInfo->ExceptionRecord->ExceptionInformation[0] == EH_PURE_MAGIC_NUMBER1
+                && ExceptionInfo->ExceptionRecord->ExceptionInformation[3] == 0)
             {
-                // Assume that's our exception because ImageBase = 0 and not suitable magic number
-                if (ExceptionInfo->ExceptionRecord->ExceptionInformation[0] == EH_PURE_MAGIC_NUMBER1
-                    && ExceptionInfo->ExceptionRecord->ExceptionInformation[3] == 0)
-                {
-                    // CRT magic number
-                    ExceptionInfo->ExceptionRecord->ExceptionInformation[0] = (ULONG_PTR)EH_MAGIC_NUMBER1;
+                // CRT magic number
+                ExceptionInfo->ExceptionRecord->ExceptionInformation[0] = (ULONG_PTR)EH_MAGIC_NUMBER1;
 
-                    // fix exception image base
-                    ExceptionInfo->ExceptionRecord->ExceptionInformation[3] = (ULONG_PTR)pTable->entry[i].base;
-                }
+                // fix exception image base
+                ExceptionInfo->ExceptionRecord->ExceptionInformation[3] = (ULONG_PTR)pTable->entry[lo - 1].base;
             }
         }
+
+        InterlockedDecrement64( &pHeader->readers );
     }
 
     return EXCEPTION_CONTINUE_SEARCH;
 }*/
 uint8_t MExcept::_handler64[] =
 {
-    0x48, 0x83, 0xEC, 0x08, 0x48, 0x8B, 0x01, 0x4C, 0x8B, 0xD9, 0x81, 0x38, 0x63, 0x73, 0x6D, 0xE0, 
-    0x0F, 0x85, 0x7C, 0x00, 0x00, 0x00, 0x48, 0x89, 0x1C, 0x24, 0x45, 0x33, 0xC9, 0x48, 0xBB, 0xEF, 
-    0xBE, 0xAD, 0xDE, 0xEF, 0xBE, 0xAD, 0xDE, 0x4C, 0x39, 0x0B, 0x76, 0x5B, 0x48, 0xB8, 0xF7, 0xBE, 
-    0xAD, 0xDE, 0xEF, 0xBE, 0xAD, 0xDE, 0x66, 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x4D, 0x8B, 0x03, 0x48, 0x8B, 0x10, 0x4D, 0x8B, 0x50, 0x30, 0x4C, 0x3B, 0xD2, 0x72, 0x2C, 0x48, 
-    0x03, 0x50, 0x08, 0x4C, 0x3B, 0xD2, 0x77, 0x23, 0x49, 0x81, 0x78, 0x20, 0x00, 0x40, 0x99, 0x01,
-    0x75, 0x19, 0x49, 0x83, 0x78, 0x38, 0x00, 0x75, 0x12, 0x49, 0xC7, 0x40, 0x20, 0x20, 0x05, 0x93, 
-    0x19, 0x49, 0x8B, 0x13, 0x48, 0x8B, 0x08, 0x48, 0x89, 0x4A, 0x38, 0x49, 0xFF, 0xC1, 0x48, 0x83, 
-    0xC0, 0x10, 0x4C, 0x3B, 0x0B, 0x72, 0xB9, 0x33, 0xC0, 0x48, 0x8B, 0x1C, 0x24, 0x48, 0x83, 0xC4, 
-    0x08, 0xC3, 0x33, 0xC0, 0x48, 0x83, 0xC4, 0x08, 0xC3
+    0x48, 0x8B, 0x01, 0x81, 0x38, 0x63, 0x73, 0x6D, 0xE0, 0x0F, 0x85, 0x87, 0x00, 0x00, 0x00, 0x49,
+    0xBB, 0xEF, 0xBE, 0xAD, 0xDE, 0xEF, 0xBE, 0xAD, 0xDE, 0xF0, 0x49, 0xFF, 0x43, 0x08, 0x49, 0x8B,
+    0x13, 0x48, 0x85, 0xD2, 0x74, 0x6B, 0x4C, 0x8B, 0x40, 0x30, 0x45, 0x31, 0xC9, 0x4C, 0x8B, 0x12,
+    0x4D, 0x39, 0xD1, 0x73, 0x22, 0x4B, 0x8D, 0x0C, 0x11, 0x48, 0xD1, 0xE9, 0x48, 0xD1, 0xE1, 0x4C,
+    0x39, 0x44, 0xCA, 0x08, 0x77, 0x09, 0x48, 0xD1, 0xE9, 0x4C, 0x8D, 0x49, 0x01, 0xEB, 0xE1, 0x48,
+    0xD1, 0xE9, 0x49, 0x89, 0xCA, 0xEB, 0xD9, 0x4D, 0x85, 0xC9, 0x74, 0x35, 0x49, 0xC1, 0xE1, 0x04,
+    0x4A, 0x8D, 0x4C, 0x0A, 0xF8, 0x48, 0x8B, 0x11, 0x49, 0x89, 0xD1, 0x4C, 0x03, 0x49, 0x08, 0x4D,
+    0x39, 0xC8, 0x77, 0x1D, 0x48, 0x81, 0x78, 0x20, 0x00, 0x40, 0x99, 0x01, 0x75, 0x13, 0x48, 0x83,
+    0x78, 0x38, 0x00, 0x75, 0x0C, 0x48, 0xC7, 0x40, 0x20, 0x20, 0x05, 0x93, 0x19, 0x48, 0x89, 0x50,
+    0x38, 0xF0, 0x49, 0xFF, 0x4B, 0x08, 0x31, 0xC0, 0xC3
 };
 
 /// <summary>
@@ -224,15 +245,18 @@ NTSTATUS MExcept::CreateVEH( Process& proc, ModuleData& mod, bool partial )
             _pModTable = std::move( mem.result() );
         }
 
-        ModuleTable table = { };
-        _pModTable.Read ( 0, table );
+        // Keep table sorted by module base
+        auto iter = std::lower_bound( _modules.begin(), _modules.end(), mod.baseAddress,
+            []( const ExceptionModule& entry, ptr_t base ) { return entry.base < base; } );
 
-        // Add new entry to the table
-        table.entry[table.count].base = mod.baseAddress;
-        table.entry[table.count].size = mod.size;
-        table.count++;
+        if (iter != _modules.end() && iter->base == mod.baseAddress)
+            iter->size = mod.size;
+        else
+            _modules.insert( iter, ExceptionModule{ mod.baseAddress, mod.size } );
 
-        _pModTable.Write( 0, table );
+        auto status = UpdateModuleTable( proc );
+        if (!NT_SUCCESS( status ))
+            return status;
     }
 
     // No handler required
@@ -273,7 +297,6 @@ NTSTATUS MExcept::CreateVEH( Process& proc, ModuleData& mod, bool partial )
         memcpy( newHandler, _handler64, handlerSize );
 
         replaceStub( newHandler, handlerSize, 0xDEADBEEFDEADBEEF, _pModTable.ptr() );
-        replaceStub( newHandler, handlerSize, 0xDEADBEEFDEADBEF7, _pModTable.ptr() + sizeof( ptr_t ) );    
     }
     else
     {
@@ -353,10 +376,124 @@ NTSTATUS MExcept::RemoveVEH( Process& proc, bool partial, eModType mt )
         _pVEHCode.Free();
         _hVEH = 0;
 
-        _pModTable.Free();
+        reset();
     }        
 
     return STATUS_SUCCESS;
 }
 
+/// <summary>
+/// Remove module from x64 module table
+/// </summary>
+/// <param name="proc">Target process</param>
+/// <param name="base">Module base</param>
+/// <returns>Status code</returns>
+NTSTATUS MExcept::RemoveModule( Process& proc, ptr_t base )
+{
+    auto iter = std::lower_bound( _modules.begin(), _modules.end(), base,
+        []( const ExceptionModule& entry, ptr_t modBase ) { return entry.base < modBase; } );
+
+    if (iter == _modules.end() || iter->base != base)
+        return STATUS_NOT_FOUND;
+
+    _modules.erase( iter );
+    return UpdateModuleTable( proc );
+}
+
+/// <summary>
+/// Reset data
+/// </summary>
+void MExcept::reset()
+{
+    _pModTable.Free();
+
+    for (auto& block : _tables)
+        block.Free();
+
+    for (auto& block : _retired)
+        block.Free();
+
+    _published = 0;
+    _retired.clear();
+    _modules.clear();
+}
+
+/// <summary>
+/// Build new x64 module table from local module list and publish it.
+/// Tables are double buffered: new table is written into spare buffer and its address is written into table header.
+/// Previous table becomes spare once VEH calls that could see it are finished
+/// </summary>
+/// <param name="proc">Target process</param>
+/// <returns>Status code</returns>
+NTSTATUS MExcept::UpdateModuleTable( Process& proc )
+{
+    if (!_pModTable.valid())
+        return STATUS_SUCCESS;
+
+    size_t tableSize = FIELD_OFFSET( ModuleTable, entry ) + _modules.size() * sizeof( ExceptionModule );
+    auto& spare = _tables[_published ^ 1];
+
+    // Spare buffer isn't visible to VEH, so it can be replaced freely
+    if (!spare.valid() || spare.size() < tableSize)
+    {
+        size_t newSize = spare.valid() ? spare.size() * 2 : 0x1000;
+        while (newSize < tableSize)
+            newSize *= 2;
+
+        auto mem = proc.memory().Allocate( newSize, PAGE_READWRITE, 0, false );
+        if (!mem)
+            return mem.status;
+
+        spare.Free();
+        spare = std::move( mem.result() );
+    }
+
+    std::vector<uint8_t> buf( tableSize );
+    auto pTable = reinterpret_cast<ModuleTable*>(buf.data());
+
+    pTable->count = _modules.size();
+    if (!_modules.empty())
+        memcpy( pTable->entry, _modules.data(), _modules.size() * sizeof( ExceptionModule ) );
+
+    auto status = spare.Write( 0, tableSize, buf.data() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    // Publish new table
+    status = _pModTable.Write( FIELD_OFFSET( ModuleTableHeader, table ), spare.ptr() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    _published ^= 1;
+
+    // Previous table is still used, keep it until VEH removal and allocate new spare next time
+    auto& previous = _tables[_published ^ 1];
+    if (previous.valid() && !WaitTableReaders())
+        _retired.emplace_back( std::move( previous ) );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Wait until VEH calls that could see previous table are finished
+/// </summary>
+/// <returns>true if table readers have drained</returns>
+bool MExcept::WaitTableReaders()
+{
+    // VEH takes only a few instructions, so any delay here means constant stream of exceptions
+    constexpr DWORD drainTimeout = 100;
+
+    for (auto start = GetTickCount64();;)
+    {
+        auto readers = _pModTable.Read<ptr_t>( FIELD_OFFSET( ModuleTableHeader, readers ), 1 );
+        if (readers == 0)
+            return true;
+
+        if (GetTickCount64() - start >= drainTimeout)
+            return false;
+
+        Sleep( 1 );
+    }
+}
+
 }
@@ -3,6 +3,8 @@
 #include "../Include/Winheaders.h"
 #include "../Process/MemBlock.h"
 
+#include <vector>
+
 namespace blackbone
 {
 
@@ -17,12 +19,23 @@ struct ExceptionModule
 
 
 /// <summary>
-/// x64 module table
+/// x64 module table, sorted by module base
 /// </summary>
 struct ModuleTable
 {
     ptr_t count;                    // Number of used entries
-    ExceptionModule entry[250];     // Module data
+    ExceptionModule entry[1];       // Module data, 'count' entries
+};
+
+/// <summary>
+/// x64 module table header.
+/// Current table address is published here, so any update is visible to VEH as a single pointer swap.
+/// VEH holds reader counter while it uses the table, so previous table can be reused once counter drops to 0
+/// </summary>
+struct ModuleTableHeader
+{
+    ptr_t table;                    // Current ModuleTable address
+    ptr_t readers;                  // Number of VEH calls using the table
 };
 
 /// <summary>
@@ -56,15 +69,47 @@ public:
     /// <returns>Status code</returns>
     BLACKBONE_API NTSTATUS RemoveVEH( class Process& proc, bool partial, eModType mt );
 
+    /// <summary>
+    /// Remove module from x64 module table
+    /// </summary>
+    /// <param name="proc">Target process</param>
+    /// <param name="base">Module base</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS RemoveModule( class Process& proc, ptr_t base );
+
     /// <summary>
     /// Reset data
     /// </summary>
-    BLACKBONE_API void reset() { _pModTable.Free(); }
+    BLACKBONE_API void reset();
+
+    /// <summary>
+    /// Get x64 module table header address
+    /// </summary>
+    /// <returns>ModuleTableHeader address, 0 if not created</returns>
+    BLACKBONE_API ptr_t table() const { return _pModTable.ptr(); }
+
+private:
+    /// <summary>
+    /// Build new x64 module table from local module list and publish it
+    /// </summary>
+    /// <param name="proc">Target process</param>
+    /// <returns>Status code</returns>
+    NTSTATUS UpdateModuleTable( class Process& proc );
+
+    /// <summary>
+    /// Wait until VEH calls that could see previous table are finished
+    /// </summary>
+    /// <returns>true if table readers have drained</returns>
+    bool WaitTableReaders();
 
 private:
-    MemBlock _pVEHCode;    // VEH function codecave
-    MemBlock _pModTable;   // x64 module address range table
-    uint64_t _hVEH = 0;    // VEH handle
+    MemBlock _pVEHCode;                     // VEH function codecave
+    MemBlock _pModTable;                    // x64 module table header, see ModuleTableHeader
+    MemBlock _tables[2];                    // x64 module tables, published one and spare one
+    size_t   _published = 0;               // Index of published table
+    std::vector<MemBlock> _retired;         // Tables that VEH didn't release in time, freed with VEH
+    std::vector<ExceptionModule> _modules;  // Local copy of module table
+    uint64_t _hVEH = 0;                     // VEH handle
 
     static uint8_t _handler32[];
     static uint8_t _handler64[];
@@ -7,12 +7,18 @@
 #include "../DriverControl/DriverControl.h"
 
 #include <random>
+#include <algorithm>
+#include <intrin.h>
 #include <3rd_party/VersionApi.h>
 
 #ifndef STATUS_INVALID_EXCEPTION_HANDLER
 #define STATUS_INVALID_EXCEPTION_HANDLER ((NTSTATUS)0xC00001A5L)
 #endif
 
+#ifndef PF_XSAVE_ENABLED
+#define PF_XSAVE_ENABLED 17
+#endif
+
 namespace blackbone
 {
 
@@ -33,16 +39,18 @@ MMap::~MMap(void)
 /// <param name="flags">Image mapping flags</param>
 /// <param name="mapCallback">Mapping callback. Triggers for each mapped module</param>
 /// <param name="context">User-supplied callback context</param>
+/// <param name="pStats">Optional per-phase mapping statistics</param>
 /// <returns>Mapped image info </returns>
 call_result_t<ModuleDataPtr> MMap::MapImage(
     const std::wstring& path,
     eLoadFlags flags /*= NoFlags*/,
     MapCallback mapCallback /*= nullptr*/,
     void* context /*= nullptr*/,
-    CustomArgs_t* pCustomArgs /*= nullptr*/
+    CustomArgs_t* pCustomArgs /*= nullptr*/,
+    MapStats* pStats /*= nullptr*/
     )
 {
-    return MapImageInternal( path, nullptr, 0, false, flags, mapCallback, context, pCustomArgs );
+    return MapImageInternal( path, nullptr, 0, false, flags, mapCallback, context, pCustomArgs, pStats );
 }
 
 /// <summary>
@@ -54,6 +62,7 @@ call_result_t<ModuleDataPtr> MMap::MapImage(
 /// <param name="flags">Image mapping flags</param>
 /// <param name="mapCallback">Mapping callback. Triggers for each mapped module</param>
 /// <param name="context">User-supplied callback context</param>
+/// <param name="pStats">Optional per-phase mapping statistics</param>
 /// <returns>Mapped image info</returns>
 call_result_t<ModuleDataPtr> MMap::MapImage(
     size_t size, void* buffer,
@@ -61,14 +70,15 @@ call_result_t<ModuleDataPtr> MMap::MapImage(
     eLoadFlags flags /*= NoFlags*/,
     MapCallback mapCallback /*= nullptr*/,
     void* context /*= nullptr*/,
-    CustomArgs_t* pCustomArgs /*= nullptr*/
+    CustomArgs_t* pCustomArgs /*= nullptr*/,
+    MapStats* pStats /*= nullptr*/
     )
 {
     // Create fake path
     wchar_t path[64];
     wsprintfW( path, L"MemoryImage_0x%p", buffer );
 
-    return MapImageInternal( path, buffer, size, asImage, flags, mapCallback, context, pCustomArgs );
+    return MapImageInternal( path, buffer, size, asImage, flags, mapCallback, context, pCustomArgs, pStats );
 }
 
 /// <summary>
@@ -81,6 +91,7 @@ call_result_t<ModuleDataPtr> MMap::MapImage(
 /// <param name="flags">Image mapping flags</param>
 /// <param name="mapCallback">Mapping callback. Triggers for each mapped module</param>
 /// <param name="context">User-supplied callback context</param>
+/// <param name="pStats">Optional per-phase mapping statistics</param>
 /// <returns>Mapped image info</returns>
 call_result_t<ModuleDataPtr> MMap::MapImageInternal(
     const std::wstring& path,
@@ -89,9 +100,12 @@ call_result_t<ModuleDataPtr> MMap::MapImageInternal(
     eLoadFlags flags /*= NoFlags*/,
     MapCallback mapCallback /*= nullptr*/,
     void* context /*= nullptr*/,
-    CustomArgs_t* pCustomArgs /*= nullptr*/
+    CustomArgs_t* pCustomArgs /*= nullptr*/,
+    MapStats* pStats /*= nullptr*/
     )
 {
+    auto statsSession = _stats.Start( pStats, _process.memory() );
+
     if (!(flags & ForceRemap))
     {
         // Already loaded
@@ -101,7 +115,12 @@ call_result_t<ModuleDataPtr> MMap::MapImageInternal(
 
     // Prepare target process
     auto mode = (flags & NoThreads) ? Worker_UseExisting : Worker_CreateNew;
-    auto status = _process.remote().CreateRPCEnvironment( mode, true );
+    NTSTATUS status = STATUS_SUCCESS;
+    {
+        auto phase = _stats.Phase( MapStatsCollector::npos, MapPhase_Environment );
+        status = _process.remote().CreateRPCEnvironment( mode, true );
+    }
+
     if (!NT_SUCCESS( status ))
     {
         Cleanup();
@@ -187,6 +206,8 @@ call_result_t<ModuleDataPtr> MMap::MapImageInternal(
         // Init once
         if (!img->initialized)
         {
+            auto phase = _stats.Phase( img->statsIdx, MapPhase_Initializers );
+
             // Hack for IL dlls
             if (!img->peImage.isExe() && img->peImage.pureIL())
             {
@@ -286,6 +307,9 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
     ldrEntry.fullPath = Utils::ToLower( path );
     ldrEntry.name = Utils::StripPath( ldrEntry.fullPath );
     pImage->flags = flags;
+    pImage->statsIdx = _stats.AddImage( ldrEntry.name );
+
+    auto phase = _stats.Phase( pImage->statsIdx, MapPhase_LoadImage );
 
     // Load and parse image
     status = buffer ? pImage->peImage.Load( buffer, size, !asImage ) : pImage->peImage.Load( path, flags & NoSxS ? true : false );
@@ -317,6 +341,7 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
     BLACKBONE_TRACE( L"ManualMap: Loading new image '%ls'", path.c_str() );
 
     ldrEntry.type = pImage->peImage.mType();
+    phase.next( MapPhase_Allocate );
 
     // Try to map image in high (>4GB) memory range
     if (flags & MapInHighMem)
@@ -378,6 +403,9 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
     ldrEntry.baseAddress = pImage->imgMem.ptr();
     ldrEntry.size = pImage->peImage.imageSize();
 
+    if (auto pStats = _stats.image( pImage->statsIdx ))
+        pStats->baseAddress = ldrEntry.baseAddress;
+
     BLACKBONE_TRACE( L"ManualMap: Image base allocated at 0x%016llx", pImage->imgMem.ptr() );
 
     // Create Activation context for SxS
@@ -386,6 +414,7 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
 
     if (!(flags & NoSxS))
     {
+        phase.next( MapPhase_CreateActx );
         status = CreateActx( pImage->peImage );
         if (!NT_SUCCESS( status ))
         {
@@ -395,12 +424,14 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
     }
 
     // Core image mapping operations
+    phase.next( MapPhase_CopyImage );
     if (!NT_SUCCESS( status = CopyImage( pImage ) ))
     {
         pImage->peImage.Release();
         return status;
     }
 
+    phase.next( MapPhase_Relocate );
     if (!NT_SUCCESS( status = RelocateImage( pImage ) ))
     {
         pImage->peImage.Release();
@@ -420,6 +451,7 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
         bool fsRedirect = !(flags & IsDependency) && mt == mt_mod64 && _process.barrier().sourceWow64;
 
         FsRedirector fsr( fsRedirect );
+        phase.next( MapPhase_ResolveImport );
 
         // Import
         if (!NT_SUCCESS( status = ResolveImport( pImage ) ))
@@ -439,12 +471,14 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
     }
 
     // Apply proper memory protection for sections
+    phase.next( MapPhase_Protect );
     if (!(flags & HideVAD))
         ProtectImageMemory( pImage );
 
     // Make exception handling possible (C and C++)
     if (!(flags & NoExceptions))
     {
+        phase.next( MapPhase_Exceptions );
         if (!NT_SUCCESS( status = EnableExceptions( pImage ) ) && status != STATUS_NOT_FOUND)
         {
             BLACKBONE_TRACE( L"ManualMap: Failed to enable exception handling for image %ls", ldrEntry.name.c_str() );
@@ -455,6 +489,7 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
     }
 
     // Initialize security cookie
+    phase.next( MapPhase_Finalize );
     if (!NT_SUCCESS ( status = InitializeCookie( pImage ) ))
     {
         BLACKBONE_TRACE( L"ManualMap: Failed to initialize cookie for image %ls", ldrEntry.name.c_str() );
@@ -503,17 +538,396 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapModule(
     // Fill TLS callbacks
     pImage->peImage.GetTLSCallbacks( pImage->imgMem.ptr<ptr_t>(), pImage->tlsCallbacks );
 
+    // Store header layout for future reload. Exports are read from target image only on reload
+    pImage->layout = GetImageLayout( pImage->peImage );
+
     // Unload local copy
     pImage->peImage.Release();
 
-    // Release ownership of image memory block
+    // Release ownership of image memory block and lazy binding thunks
     pImage->imgMem.Release();
+    for (auto& thunks : pImage->lazyThunks)
+        thunks.Release();
 
     // Store image
     _images.emplace_back( std::move( pImage ) );
     return pMod;
 }
 
+/// <summary>
+/// Replace code and read-only data of manually mapped image with a new build of the same image.
+/// New image is prepared locally at existing base and only changed pages are written.
+/// Writable sections are left intact to preserve module state.
+/// Missing dependencies of the new image are loaded by native loader.
+/// </summary>
+/// <param name="pMod">Module mapped by this MMap instance</param>
+/// <param name="newPath">New image path</param>
+/// <returns>
+/// Number of written pages.
+/// STATUS_REVISION_MISMATCH if section layout, TLS, exception directory or existing exports have changed,
+/// image must be remapped with ForceRemap in that case
+/// </returns>
+call_result_t<uint32_t> MMap::ReloadImage( ModuleDataPtr pMod, const std::wstring& newPath )
+{
+    if (!pMod)
+        return STATUS_INVALID_PARAMETER;
+
+    auto iter = std::find_if( _images.begin(), _images.end(), [&pMod]( const ImageContextPtr& img ) 
+    {
+        return img->ldrEntry.baseAddress == pMod->baseAddress;
+    } );
+
+    if (iter == _images.end())
+    {
+        BLACKBONE_TRACE( L"ManualMap: Image at 0x%016llx wasn't mapped by this instance", pMod->baseAddress );
+        return STATUS_NOT_FOUND;
+    }
+
+    auto pMapped = *iter;
+    const auto& ldrEntry = pMapped->ldrEntry;
+
+    // New image shares target memory and loader data with mapped one.
+    // There is no initializer pass, so missing dependencies can't be mapped manually
+    ImageContextPtr pImage( new ImageContext() );
+    pImage->ldrEntry = ldrEntry;
+    pImage->flags = pMapped->flags & ~ManualImports;
+
+    BLACKBONE_TRACE( L"ManualMap: Reloading image '%ls' from '%ls'", ldrEntry.name.c_str(), newPath.c_str() );
+
+    auto status = pImage->peImage.Load( newPath, pImage->flags & NoSxS ? true : false );
+    if (!NT_SUCCESS( status ))
+    {
+        BLACKBONE_TRACE( L"ManualMap: Failed to load image '%ls'. Status 0x%X", newPath.c_str(), status );
+        return status;
+    }
+
+    if (pImage->peImage.pureIL())
+    {
+        BLACKBONE_TRACE( L"ManualMap: Can't reload pure IL image '%ls'", newPath.c_str() );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    auto layout = GetImageLayout( pImage->peImage );
+    if (pImage->peImage.mType() != ldrEntry.type || !LayoutCompatible( pMapped->layout, layout ))
+    {
+        BLACKBONE_TRACE( L"ManualMap: Image '%ls' layout has changed, remap is required", newPath.c_str() );
+        return STATUS_REVISION_MISMATCH;
+    }
+
+    // Existing exports may already be bound by other modules
+    pe::vecExports oldExports, newExports;
+    if (!NT_SUCCESS( status = GetMappedExports( pMapped, oldExports ) ))
+    {
+        BLACKBONE_TRACE( L"ManualMap: Failed to get exports of mapped image '%ls', status 0x%X", ldrEntry.name.c_str(), status );
+        return STATUS_REVISION_MISMATCH;
+    }
+
+    pImage->peImage.GetExports( newExports );
+    for (auto& exp : oldExports)
+    {
+        auto expIter = std::lower_bound( newExports.begin(), newExports.end(), exp.name,
+            []( const pe::ExportData& data, const std::string& name ) { return data.name < name; } );
+
+        if (expIter == newExports.end() || expIter->name != exp.name || expIter->RVA != exp.RVA)
+        {
+            BLACKBONE_TRACE( "ManualMap: Export '%s' has changed, remap is required", exp.name.c_str() );
+            return STATUS_REVISION_MISMATCH;
+        }
+    }
+
+    // Prepare local image copy
+    std::unique_ptr<uint8_t[]> localImage( new uint8_t[ldrEntry.size]() );
+    auto pLocal = localImage.get();
+
+    memcpy( pLocal, pImage->peImage.base(), min( pImage->peImage.headersSize(), static_cast<size_t>(ldrEntry.size) ) );
+
+    for (auto& section : pImage->peImage.sections())
+    {
+        if (section.SizeOfRawData == 0 || section.VirtualAddress >= ldrEntry.size)
+            continue;
+
+        auto pSource = reinterpret_cast<const uint8_t*>(pImage->peImage.ResolveRVAToVA( section.VirtualAddress ));
+        memcpy( pLocal + section.VirtualAddress, pSource, min( section.SizeOfRawData, ldrEntry.size - section.VirtualAddress ) );
+    }
+
+    status = ApplyRelocations( pImage->peImage, pLocal, ldrEntry.baseAddress );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    {
+        // Handle x64 system32 dlls for wow64 process
+        bool fsRedirect = !(pImage->flags & IsDependency) && ldrEntry.type == mt_mod64 && _process.barrier().sourceWow64;
+        FsRedirector fsr( fsRedirect );
+
+        _mapCallback = nullptr;
+        _userContext = nullptr;
+
+        status = BindImports( pImage, pImage->peImage.GetImports(), pLocal );
+        if (NT_SUCCESS( status ) && !(pImage->flags & NoDelayLoad))
+            status = BindImports( pImage, pImage->peImage.GetImports( true ), pLocal );
+
+        if (!NT_SUCCESS( status ))
+            return status;
+    }
+
+    // Header and read-only sections. Writable and discarded ones hold module state or nothing at all
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    if (!(pImage->flags & WipeHeader))
+        ranges.emplace_back( 0, static_cast<uint32_t>(Align( pImage->peImage.headersSize(), 0x1000 )) );
+
+    for (auto& section : pImage->peImage.sections())
+    {
+        if (section.Characteristics & (IMAGE_SCN_MEM_WRITE | IMAGE_SCN_MEM_DISCARDABLE))
+            continue;
+
+        if (GetSectionProt( section.Characteristics ) == PAGE_NOACCESS)
+            continue;
+
+        ranges.emplace_back( section.VirtualAddress, static_cast<uint32_t>(Align( section.Misc.VirtualSize, 0x1000 )) );
+    }
+
+    uint32_t pages = 0;
+    std::vector<uint8_t> mapped;
+
+    for (auto& range : ranges)
+    {
+        auto rva = range.first;
+        auto size = min( range.second, ldrEntry.size - rva );
+        ptr_t address = ldrEntry.baseAddress + rva;
+
+        mapped.resize( size );
+        if (pImage->flags & HideVAD)
+            status = Driver().ReadMem( _process.pid(), address, size, mapped.data() );
+        else
+            status = _process.memory().Read( address, size, mapped.data() );
+
+        if (!NT_SUCCESS( status ))
+        {
+            BLACKBONE_TRACE( L"ManualMap: Failed to read mapped image at offset 0x%x. Status = 0x%x", rva, status );
+            return status;
+        }
+
+        auto changed = [&]( uint32_t offset )
+        {
+            auto len = min( 0x1000u, size - offset );
+            return memcmp( mapped.data() + offset, pLocal + rva + offset, len ) != 0;
+        };
+
+        // Write continuous runs of changed pages
+        for (uint32_t offset = 0; offset < size;)
+        {
+            if (!changed( offset ))
+            {
+                offset += 0x1000;
+                continue;
+            }
+
+            uint32_t end = offset + 0x1000;
+            while (end < size && changed( end ))
+                end += 0x1000;
+
+            end = min( end, size );
+
+            if (pImage->flags & HideVAD)
+            {
+                status = Driver().WriteMem( _process.pid(), address + offset, end - offset, pLocal + rva + offset );
+            }
+            else
+            {
+                DWORD flOld = 0;
+                status = _process.memory().Protect( address + offset, end - offset, PAGE_EXECUTE_READWRITE, &flOld );
+                if (NT_SUCCESS( status ))
+                {
+                    status = _process.memory().Write( address + offset, end - offset, pLocal + rva + offset );
+                    _process.memory().Protect( address + offset, end - offset, flOld );
+                }
+            }
+
+            if (!NT_SUCCESS( status ))
+            {
+                BLACKBONE_TRACE( L"ManualMap: Failed to patch image at offset 0x%x. Status = 0x%x", rva + offset, status );
+                return status;
+            }
+
+            pages += (end - offset + 0xFFF) / 0x1000;
+            offset = end;
+        }
+    }
+
+    if (pages != 0)
+        FlushInstructionCache( _process.core().handle(), reinterpret_cast<LPCVOID>(ldrEntry.baseAddress), ldrEntry.size );
+
+    // Update mapped image data
+    auto entryPoint = pImage->peImage.entryPoint( ldrEntry.baseAddress );
+    if (entryPoint != ldrEntry.entryPoint)
+    {
+        pMapped->ldrEntry.entryPoint = entryPoint;
+        if (!NT_SUCCESS( status = _process.nativeLdr().UpdateEntryPoint( pMapped->ldrEntry ) ))
+            BLACKBONE_TRACE( L"ManualMap: Failed to update loader entry point of image '%ls', status 0x%X", ldrEntry.name.c_str(), status );
+    }
+
+    pMapped->tlsCallbacks.clear();
+    pImage->peImage.GetTLSCallbacks( ldrEntry.baseAddress, pMapped->tlsCallbacks );
+    pMapped->layout = std::move( layout );
+
+    BLACKBONE_TRACE( L"ManualMap: Image '%ls' reloaded, %d pages written", ldrEntry.name.c_str(), pages );
+    return pages;
+}
+
+/// <summary>
+/// Get image layout properties
+/// </summary>
+/// <param name="image">Loaded image</param>
+/// <returns>Image layout</returns>
+ImageLayout MMap::GetImageLayout( pe::PEImage& image )
+{
+    ImageLayout layout;
+    layout.imageSize = image.imageSize();
+
+    for (auto& section : image.sections())
+    {
+        ImageLayout::Section sec;
+        sec.rva = section.VirtualAddress;
+        sec.size = section.Misc.VirtualSize;
+        sec.characteristics = section.Characteristics;
+
+        layout.sections.emplace_back( sec );
+    }
+
+    layout.excDirRVA = static_cast<uint32_t>(image.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_EXCEPTION, pe::RVA ));
+    layout.excDirSize = static_cast<uint32_t>(image.DirectorySize( IMAGE_DIRECTORY_ENTRY_EXCEPTION ));
+    layout.expDirRVA = static_cast<uint32_t>(image.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_EXPORT, pe::RVA ));
+    layout.expDirSize = static_cast<uint32_t>(image.DirectorySize( IMAGE_DIRECTORY_ENTRY_EXPORT ));
+
+    if (auto pTls = image.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_TLS ))
+    {
+        ptr_t index = 0, rawSize = 0;
+        if (image.mType() == mt_mod64)
+        {
+            auto pTls64 = reinterpret_cast<const IMAGE_TLS_DIRECTORY64*>(pTls);
+            index = pTls64->AddressOfIndex;
+            rawSize = pTls64->EndAddressOfRawData - pTls64->StartAddressOfRawData + pTls64->SizeOfZeroFill;
+        }
+        else
+        {
+            auto pTls32 = reinterpret_cast<const IMAGE_TLS_DIRECTORY32*>(pTls);
+            index = pTls32->AddressOfIndex;
+            rawSize = pTls32->EndAddressOfRawData - pTls32->StartAddressOfRawData + pTls32->SizeOfZeroFill;
+        }
+
+        std::vector<ptr_t> callbacks;
+        layout.tlsIndexRVA = index ? static_cast<uint32_t>(index - image.imageBase()) : 0;
+        layout.tlsDataSize = static_cast<uint32_t>(rawSize);
+        layout.tlsCallbacks = image.GetTLSCallbacks( image.imageBase(), callbacks );
+    }
+
+    return layout;
+}
+
+/// <summary>
+/// Check if image with new layout can replace mapped one in place
+/// </summary>
+/// <param name="oldLayout">Mapped image layout</param>
+/// <param name="newLayout">New image layout</param>
+/// <returns>true if compatible</returns>
+bool MMap::LayoutCompatible( const ImageLayout& oldLayout, const ImageLayout& newLayout )
+{
+    if (oldLayout.imageSize != newLayout.imageSize || oldLayout.sections.size() != newLayout.sections.size())
+        return false;
+
+    // Sections must occupy same pages. Writable sections aren't updated, so their size must match exactly
+    for (size_t i = 0; i < oldLayout.sections.size(); i++)
+    {
+        auto& oldSec = oldLayout.sections[i];
+        auto& newSec = newLayout.sections[i];
+
+        if (oldSec.rva != newSec.rva || oldSec.characteristics != newSec.characteristics)
+            return false;
+
+        if (oldSec.characteristics & IMAGE_SCN_MEM_WRITE)
+        {
+            if (oldSec.size != newSec.size)
+                return false;
+        }
+        else if (Align( oldSec.size, 0x1000 ) != Align( newSec.size, 0x1000 ))
+            return false;
+    }
+
+    // Registered exception table and static TLS slot can't be moved
+    if (oldLayout.excDirRVA != newLayout.excDirRVA || oldLayout.excDirSize != newLayout.excDirSize)
+        return false;
+
+    if (oldLayout.tlsIndexRVA != newLayout.tlsIndexRVA
+        || oldLayout.tlsDataSize != newLayout.tlsDataSize
+        || oldLayout.tlsCallbacks != newLayout.tlsCallbacks)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Read named exports of mapped image from target memory.
+/// Names and tables are expected inside export directory, as placed by linker
+/// </summary>
+/// <param name="pImage">Mapped image</param>
+/// <param name="exports">Found exports, sorted by name</param>
+/// <returns>Status code</returns>
+NTSTATUS MMap::GetMappedExports( ImageContextPtr pImage, pe::vecExports& exports )
+{
+    exports.clear();
+
+    const auto& layout = pImage->layout;
+    if (layout.expDirRVA == 0)
+        return STATUS_SUCCESS;
+
+    if (layout.expDirSize < sizeof( IMAGE_EXPORT_DIRECTORY ))
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    std::vector<uint8_t> buf( layout.expDirSize );
+    ptr_t address = pImage->ldrEntry.baseAddress + layout.expDirRVA;
+
+    NTSTATUS status = STATUS_SUCCESS;
+    if (pImage->flags & HideVAD)
+        status = Driver().ReadMem( _process.pid(), address, buf.size(), buf.data() );
+    else
+        status = _process.memory().Read( address, buf.size(), buf.data() );
+
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    // Get directory data by RVA
+    auto dirData = [&]( uint32_t rva, size_t size ) -> const uint8_t*
+    {
+        if (rva < layout.expDirRVA || rva - layout.expDirRVA > buf.size() || size > buf.size() - (rva - layout.expDirRVA))
+            return nullptr;
+
+        return buf.data() + (rva - layout.expDirRVA);
+    };
+
+    auto pExport = reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(buf.data());
+    auto pNames = reinterpret_cast<const DWORD*>(dirData( pExport->AddressOfNames, pExport->NumberOfNames * sizeof( DWORD ) ));
+    auto pOrds  = reinterpret_cast<const WORD*> (dirData( pExport->AddressOfNameOrdinals, pExport->NumberOfNames * sizeof( WORD ) ));
+    auto pFuncs = reinterpret_cast<const DWORD*>(dirData( pExport->AddressOfFunctions, pExport->NumberOfFunctions * sizeof( DWORD ) ));
+
+    if (pExport->NumberOfNames != 0 && (!pNames || !pOrds || !pFuncs))
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    for (DWORD i = 0; i < pExport->NumberOfNames; ++i)
+    {
+        auto pName = reinterpret_cast<const char*>(dirData( pNames[i], 1 ));
+        if (!pName || pOrds[i] >= pExport->NumberOfFunctions)
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        size_t maxLen = buf.size() - (pNames[i] - layout.expDirRVA);
+        exports.push_back( pe::ExportData( std::string( pName, strnlen( pName, maxLen ) ), pFuncs[pOrds[i]] ) );
+    }
+
+    std::sort( exports.begin(), exports.end() );
+    return STATUS_SUCCESS;
+}
+
 /// <summary>
 /// Unmap all manually mapped modules
 /// </summary>
@@ -541,6 +955,9 @@ NTSTATUS MMap::UnmapAllModules()
         // Free memory
         pImage->imgMem.Free();
 
+        for (auto& thunks : pImage->lazyThunks)
+            thunks.Free();
+
         // Remove reference from local modules list
         _process.modules().RemoveManualModule( pImage->ldrEntry.name, pImage->peImage.mType() );
     } 
@@ -663,6 +1080,24 @@ NTSTATUS MMap::ProtectImageMemory( ImageContextPtr pImage )
         }
     }
 
+    // IAT slots bound on first call must stay writable
+    for (auto rva : pImage->lazyIatPages)
+    {
+        DWORD prot = PAGE_READWRITE;
+        for (auto& section : pImage->peImage.sections())
+        {
+            if (rva >= section.VirtualAddress && rva < section.VirtualAddress + section.Misc.VirtualSize)
+            {
+                if (section.Characteristics & IMAGE_SCN_MEM_EXECUTE)
+                    prot = PAGE_EXECUTE_READWRITE;
+
+                break;
+            }
+        }
+
+        pImage->imgMem.Protect( prot, rva, 0x1000 );
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -676,38 +1111,74 @@ NTSTATUS MMap::RelocateImage( ImageContextPtr pImage )
     NTSTATUS status = STATUS_SUCCESS;
     BLACKBONE_TRACE( L"ManualMap: Relocating image '%ls'", pImage->ldrEntry.fullPath.c_str() );
 
-    // Reloc delta
-    ptr_t Delta = pImage->imgMem.ptr() - pImage->peImage.imageBase();
-
     // No need to relocate
-    if (Delta == 0)
+    if (pImage->imgMem.ptr() == pImage->peImage.imageBase())
     {
         BLACKBONE_TRACE( L"ManualMap: No need for relocation" );
         return STATUS_SUCCESS;
     }
 
+    // No relocatable data
+    if (pImage->peImage.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_BASERELOC ) == 0
+        && (pImage->peImage.DllCharacteristics() & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE))
+    {
+        BLACKBONE_TRACE( L"ManualMap: Image does not use relocations" );
+        return STATUS_SUCCESS;
+    }
+
+    // Read whole image to process it locally
+    std::unique_ptr<uint8_t[]> localImage( new uint8_t[pImage->ldrEntry.size] );
+    auto pLocal = localImage.get();
+    _process.memory().Read( pImage->imgMem.ptr(), pImage->ldrEntry.size, pLocal );
+
+    status = ApplyRelocations( pImage->peImage, pLocal, pImage->imgMem.ptr() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    // Apply relocations, skip header
+    if (pImage->flags & HideVAD)
+        status = Driver().WriteMem( _process.pid(), pImage->ldrEntry.baseAddress + 0x1000, pImage->ldrEntry.size - 0x1000, pLocal + 0x1000 );
+    else
+        status = _process.memory().Write( pImage->ldrEntry.baseAddress + 0x1000, pImage->ldrEntry.size - 0x1000, pLocal + 0x1000 );
+
+    if (!NT_SUCCESS( status ))
+    {
+        BLACKBONE_TRACE( L"ManualMap: Failed to apply relocations. Status = 0x%x", status );
+    }
+
+    return status;
+}
+
+/// <summary>
+/// Fix relocations of local image copy for a new image base
+/// </summary>
+/// <param name="image">Source image</param>
+/// <param name="pLocal">Local image copy</param>
+/// <param name="base">Target image base</param>
+/// <returns>Status code</returns>
+NTSTATUS MMap::ApplyRelocations( const pe::PEImage& image, uint8_t* pLocal, ptr_t base )
+{
+    // Reloc delta
+    ptr_t Delta = base - image.imageBase();
+
+    // No need to relocate
+    if (Delta == 0)
+        return STATUS_SUCCESS;
+
     // Dll can't be relocated
-    if (!(pImage->peImage.DllCharacteristics() & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE))
+    if (!(image.DllCharacteristics() & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE))
     {
         BLACKBONE_TRACE( L"ManualMap: Can't relocate image, no relocation flag" );
         return STATUS_INVALID_IMAGE_HASH;
     }
 
-    auto start = pImage->peImage.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_BASERELOC );
-    auto end = start + pImage->peImage.DirectorySize( IMAGE_DIRECTORY_ENTRY_BASERELOC );
+    auto start = image.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_BASERELOC );
+    auto end = start + image.DirectorySize( IMAGE_DIRECTORY_ENTRY_BASERELOC );
     auto fixrec = reinterpret_cast<pe::RelocData*>(start);
 
     // No relocatable data
     if (fixrec == nullptr)
-    {
-        BLACKBONE_TRACE( L"ManualMap: Image does not use relocations" );
         return STATUS_SUCCESS;
-    }
-
-    // Read whole image to process it locally
-    std::unique_ptr<uint8_t[]> localImage( new uint8_t[pImage->ldrEntry.size] );
-    auto pLocal = localImage.get();
-    _process.memory().Read( pImage->imgMem.ptr(), pImage->ldrEntry.size, pLocal );
 
     while ((uintptr_t)fixrec < end && fixrec->BlockSize)
     {
@@ -726,7 +1197,7 @@ NTSTATUS MMap::RelocateImage( ImageContextPtr pImage )
             if (fixtype == IMAGE_REL_BASED_HIGHLOW || fixtype == IMAGE_REL_BASED_DIR64)
             {
                 uintptr_t fixRVA = fixoffset + fixrec->PageRVA;
-                if (pImage->ldrEntry.type == mt_mod64)
+                if (image.mType() == mt_mod64)
                 {
                     uint64_t val = *reinterpret_cast<uint64_t*>(pLocal + fixRVA) + Delta;
                     *reinterpret_cast<uint64_t*>(pLocal + fixRVA) = val;
@@ -749,18 +1220,7 @@ NTSTATUS MMap::RelocateImage( ImageContextPtr pImage )
         fixrec = reinterpret_cast<pe::RelocData*>(reinterpret_cast<uintptr_t>(fixrec) + fixrec->BlockSize);
     }
 
-    // Apply relocations, skip header
-    if (pImage->flags & HideVAD)
-        status = Driver().WriteMem( _process.pid(), pImage->ldrEntry.baseAddress + 0x1000, pImage->ldrEntry.size - 0x1000, pLocal + 0x1000 );
-    else
-        status = _process.memory().Write( pImage->ldrEntry.baseAddress + 0x1000, pImage->ldrEntry.size - 0x1000, pLocal + 0x1000 );
-
-    if (!NT_SUCCESS( status ))
-    {
-        BLACKBONE_TRACE( L"ManualMap: Failed to apply relocations. Status = 0x%x", status );
-    }
-
-    return status;
+    return STATUS_SUCCESS;
 }
 
 /// <summary>
@@ -797,6 +1257,7 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapDependency( ImageContextPtr pImage,
     // Do remote SxS probe
     if (status == STATUS_SXS_IDENTITIES_DIFFERENT)
     {
+        auto phase = _stats.Phase( pImage->statsIdx, MapPhase_ProbeSxS );
         status = ProbeRemoteSxS( path );
     }
 
@@ -822,13 +1283,21 @@ call_result_t<ModuleDataPtr> MMap::FindOrMapDependency( ImageContextPtr pImage,
         data = _mapCallback( PreCallback, _userContext, _process, tmpData );
     }
 
+    auto pStats = _stats.image( pImage->statsIdx );
+
     // Loading method
     if (data.mtype == MT_Manual || (data.mtype == MT_Default && pImage->flags & ManualImports))
     {
+        if (pStats)
+            pStats->mappedDependencies++;
+
         return FindOrMapModule( path, nullptr, 0, false, pImage->flags | NoSxS | NoDelayLoad | PartialExcept | IsDependency );
     }
     else if (data.mtype != MT_None)
     {
+        if (pStats)
+            pStats->nativeDependencies++;
+
         return _process.modules().Inject( path );
     }
     // Aborted by user
@@ -850,11 +1319,74 @@ NTSTATUS MMap::ResolveImport( ImageContextPtr pImage, bool useDelayed /*= false
     if (imports.empty())
         return STATUS_SUCCESS;
 
+    if (auto pStats = _stats.image( pImage->statsIdx ))
+    {
+        pStats->dependencies += static_cast<uint32_t>(imports.size());
+        for (auto& importMod : imports)
+            pStats->imports += static_cast<uint32_t>(importMod.second.size());
+    }
+
     // Read whole image to process it locally
     std::unique_ptr<uint8_t[]> localImage( new uint8_t[pImage->ldrEntry.size] );
     auto pLocal = localImage.get();
     _process.memory().Read( pImage->imgMem.ptr(), pImage->ldrEntry.size, pLocal );
 
+    std::vector<LazyImport> lazyImports;
+    auto status = BindImports( pImage, imports, pLocal, (pImage->flags & LazyBinding) ? &lazyImports : nullptr );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    if (!lazyImports.empty())
+    {
+        if (auto pStats = _stats.image( pImage->statsIdx ))
+            pStats->lazyImports += static_cast<uint32_t>(lazyImports.size());
+
+        status = CALL_64_86( pImage->ldrEntry.type == mt_mod64, CreateLazyThunks, pImage, lazyImports, pLocal );
+        if (!NT_SUCCESS( status ))
+        {
+            BLACKBONE_TRACE( L"ManualMap: Failed to create lazy import thunks. Status 0x%x", status );
+            return status;
+        }
+    }
+
+    // Apply imports, skip header
+    if (pImage->flags & HideVAD)
+    {
+        status = Driver().WriteMem(
+            _process.pid(),
+            pImage->ldrEntry.baseAddress + 0x1000,
+            pImage->ldrEntry.size - 0x1000,
+            pLocal + 0x1000
+        );
+    }
+    else
+    {
+        status = _process.memory().Write(
+            pImage->ldrEntry.baseAddress + 0x1000,
+            pImage->ldrEntry.size - 0x1000,
+            pLocal + 0x1000
+        );
+    }
+
+    // Write function address
+    if (!NT_SUCCESS( status ))
+    {
+        BLACKBONE_TRACE( L"ManualMap: Failed to write import function. Status 0x%x", status );
+    }
+
+    return status;
+}
+
+/// <summary>
+/// Resolve import functions and fill IAT of local image copy
+/// </summary>
+/// <param name="pImage">Image data</param>
+/// <param name="imports">Image import or delayed import</param>
+/// <param name="pLocal">Local image copy</param>
+/// <param name="pLazy">If not nullptr - imports from native modules are stored here instead of binding</param>
+/// <returns>Status code</returns>
+NTSTATUS MMap::BindImports( ImageContextPtr pImage, const pe::mapImports& imports, uint8_t* pLocal, std::vector<LazyImport>* pLazy /*= nullptr*/ )
+{
     // Traverse entries
     for (auto& importMod : imports)
     {
@@ -868,6 +1400,25 @@ NTSTATUS MMap::ResolveImport( ImageContextPtr pImage, bool useDelayed /*= false
             return hMod.status;
         }
 
+        // Native loader can resolve exports and forwarders in target on first call
+        if (pLazy != nullptr && !hMod.result()->manual)
+        {
+            for (auto& importFn : importMod.second)
+            {
+                LazyImport lazy;
+                lazy.module = hMod.result()->baseAddress;
+                lazy.ptrRVA = importFn.ptrRVA;
+                lazy.ordinal = importFn.importOrdinal;
+
+                if (!importFn.importByOrd)
+                    lazy.name = importFn.importName;
+
+                pLazy->emplace_back( std::move( lazy ) );
+            }
+
+            continue;
+        }
+
         for (auto& importFn : importMod.second)
         {
             call_result_t<exportData> expData;
@@ -932,34 +1483,318 @@ NTSTATUS MMap::ResolveImport( ImageContextPtr pImage, bool useDelayed /*= false
         }
     }
 
-    auto status = STATUS_SUCCESS;
+    return STATUS_SUCCESS;
+}
 
-    // Apply imports, skip header
-    if (pImage->flags & HideVAD)
+/// <summary>
+/// Remote lazy import entry
+/// </summary>
+template<typename T>
+struct LazyImportEntry
+{
+    T module;       // Exporting module base
+    T iatSlot;      // IAT slot address
+    T name;         // Function name ANSI_STRING address, 0 if imported by ordinal
+    T ordinal;      // Function ordinal
+    T resolved;     // Resolved function address
+};
+
+// Extended state saved by lazy binding resolver: x87, SSE, AVX, MPX and AVX-512.
+// AMX tile data is left out, it would push save area past the stack guard page
+constexpr uint32_t LazyXStateMask = 0xFF;
+
+/// <summary>
+/// Get size of standard format XSAVE area for LazyXStateMask components enabled by OS
+/// </summary>
+/// <returns>Area size, 0 if XSAVE isn't enabled</returns>
+static uint32_t LazyXStateSize()
+{
+    if (!IsProcessorFeaturePresent( PF_XSAVE_ENABLED ))
+        return 0;
+
+    // Legacy region and header
+    uint32_t size = 0x240;
+    auto enabled = _xgetbv( 0 ) & LazyXStateMask;
+    for (int i = 2; i < 32; i++)
     {
-        status = Driver().WriteMem(
-            _process.pid(),
-            pImage->ldrEntry.baseAddress + 0x1000,
-            pImage->ldrEntry.size - 0x1000,
-            pLocal + 0x1000
-        );
+        if (!(enabled & (1ull << i)))
+            continue;
+
+        // EAX - component size, EBX - component offset
+        int regs[4] = { };
+        __cpuidex( regs, 0xD, i );
+        size = max( size, static_cast<uint32_t>(regs[0] + regs[1]) );
+    }
+
+    return size;
+}
+
+/// <summary>
+/// Create lazy binding thunks and point IAT slots of local image copy to them.
+/// Target memory layout:
+/// ---------------------------------------------------
+/// | entries | ANSI_STRINGs | names | resolver | stubs |
+/// ---------------------------------------------------
+/// Each stub pushes entry index and jumps to resolver. Resolver calls LdrGetProcedureAddress,
+/// patches IAT slot and jumps to resolved function.
+/// Resolver keeps argument registers intact. If OS enabled XSAVE, the whole extended state
+/// is saved, so vector arguments in upper YMM/ZMM halves survive. Otherwise x64 resolver
+/// saves only XMM0-XMM5 and x86 one saves no vector registers at all.
+/// </summary>
+/// <param name="pImage">Image data</param>
+/// <param name="imports">Imports to bind on first call</param>
+/// <param name="pLocal">Local image copy</param>
+/// <returns>Status code</returns>
+template<typename T>
+NTSTATUS MMap::CreateLazyThunks( ImageContextPtr pImage, const std::vector<LazyImport>& imports, uint8_t* pLocal )
+{
+    using Entry = LazyImportEntry<T>;
+    using AnsiString = _ANSI_STRING_T<T>;
+
+    auto pGetProc = _process.modules().GetNtdllExport( "LdrGetProcedureAddress", pImage->ldrEntry.type );
+    if (!pGetProc)
+        return pGetProc.status;
+
+    auto pRaise = _process.modules().GetNtdllExport( "RtlRaiseStatus", pImage->ldrEntry.type );
+    if (!pRaise)
+        return pRaise.status;
+
+    size_t namesOfs = imports.size() * sizeof( Entry );
+    size_t charsOfs = namesOfs + imports.size() * sizeof( AnsiString );
+    size_t charsSize = 0;
+
+    for (auto& imp : imports)
+        if (!imp.name.empty())
+            charsSize += imp.name.length() + 1;
+
+    // Resolver is ~0x150 bytes, each stub is at most 10 bytes
+    size_t codeOfs = Align( charsOfs + charsSize, 0x10 );
+    size_t blockSize = codeOfs + 0x200 + imports.size() * 0x10;
+
+    // Block is owned until image is mapped successfully
+    auto mem = _process.memory().Allocate( blockSize, PAGE_EXECUTE_READWRITE );
+    if (!mem)
+        return mem.status;
+
+    ptr_t base = mem->ptr();
+
+    // Entries and names
+    std::vector<uint8_t> data( codeOfs );
+    auto pEntries = reinterpret_cast<Entry*>(data.data());
+    auto pNames = reinterpret_cast<AnsiString*>(data.data() + namesOfs);
+    size_t charPos = charsOfs;
+
+    for (size_t i = 0; i < imports.size(); i++)
+    {
+        auto& imp = imports[i];
+
+        pEntries[i].module = static_cast<T>(imp.module);
+        pEntries[i].iatSlot = static_cast<T>(pImage->ldrEntry.baseAddress + imp.ptrRVA);
+        pEntries[i].ordinal = imp.ordinal;
+
+        if (!imp.name.empty())
+        {
+            pNames[i].Length = static_cast<uint16_t>(imp.name.length());
+            pNames[i].MaximumLength = pNames[i].Length + 1;
+            pNames[i].Buffer = static_cast<T>(base + charPos);
+            memcpy( data.data() + charPos, imp.name.c_str(), imp.name.length() + 1 );
+
+            pEntries[i].name = static_cast<T>(base + namesOfs + i * sizeof( AnsiString ));
+            charPos += imp.name.length() + 1;
+        }
+    }
+
+    // Stubs and resolver
+    auto a = AsmFactory::GetAssembler( pImage->ldrEntry.type );
+    asmjit::Label l_resolver = (*a)->newLabel();
+    asmjit::Label l_fail = (*a)->newLabel();
+    std::vector<size_t> stubOffsets;
+
+    for (size_t i = 0; i < imports.size(); i++)
+    {
+        stubOffsets.emplace_back( (*a)->getOffset() );
+        (*a)->push( static_cast<uint32_t>(i) );
+        (*a)->jmp( l_resolver );
+    }
+
+    (*a)->bind( l_resolver );
+
+    // XSAVE area must be 64 byte aligned, XSAVE header must be zeroed for XRSTOR
+    uint32_t xstateSize = LazyXStateSize();
+    int32_t xstateOfs = pImage->ldrEntry.type == mt_mod64 ? 0x40 : 0;
+    auto saveXState = [&]( const asmjit::X86GpReg& sp, bool save )
+    {
+        if (save)
+        {
+            (*a)->sub( sp, xstateSize + xstateOfs );
+            (*a)->and_( sp, -0x40 );
+            for (int32_t ofs = 0x208; ofs < 0x240; ofs += 4)
+                (*a)->mov( asmjit::host::dword_ptr( sp, xstateOfs + ofs ), 0 );
+        }
+
+        (*a)->mov( asmjit::host::eax, LazyXStateMask );
+        (*a)->xor_( asmjit::host::edx, asmjit::host::edx );
+
+        auto area = asmjit::host::ptr( sp, xstateOfs );
+        if (pImage->ldrEntry.type == mt_mod64)
+            save ? (*a)->xsave64( area ) : (*a)->xrstor64( area );
+        else
+            save ? (*a)->xsave( area ) : (*a)->xrstor( area );
+    };
+
+    if (pImage->ldrEntry.type == mt_mod64)
+    {
+        // Preserve argument registers, index is at [rbp + 0x48]
+        (*a)->push( asmjit::host::rax );
+        (*a)->push( asmjit::host::rcx );
+        (*a)->push( asmjit::host::rdx );
+        (*a)->push( asmjit::host::r8 );
+        (*a)->push( asmjit::host::r9 );
+        (*a)->push( asmjit::host::r10 );
+        (*a)->push( asmjit::host::r11 );
+        (*a)->push( asmjit::host::rbx );
+        (*a)->push( asmjit::host::rbp );
+        (*a)->mov( asmjit::host::rbp, asmjit::host::rsp );
+
+        if (xstateSize != 0)
+        {
+            saveXState( asmjit::host::rsp, true );
+        }
+        else
+        {
+            (*a)->sub( asmjit::host::rsp, 0x80 );
+            (*a)->and_( asmjit::host::rsp, -0x10 );
+            (*a)->movups( asmjit::host::oword_ptr( asmjit::host::rsp, 0x20 ), asmjit::host::xmm0 );
+            (*a)->movups( asmjit::host::oword_ptr( asmjit::host::rsp, 0x30 ), asmjit::host::xmm1 );
+            (*a)->movups( asmjit::host::oword_ptr( asmjit::host::rsp, 0x40 ), asmjit::host::xmm2 );
+            (*a)->movups( asmjit::host::oword_ptr( asmjit::host::rsp, 0x50 ), asmjit::host::xmm3 );
+            (*a)->movups( asmjit::host::oword_ptr( asmjit::host::rsp, 0x60 ), asmjit::host::xmm4 );
+            (*a)->movups( asmjit::host::oword_ptr( asmjit::host::rsp, 0x70 ), asmjit::host::xmm5 );
+        }
+
+        (*a)->mov( asmjit::host::rbx, asmjit::host::qword_ptr( asmjit::host::rbp, 0x48 ) );
+        (*a)->imul( asmjit::host::rbx, asmjit::host::rbx, sizeof( Entry ) );
+        (*a)->mov( asmjit::host::rax, base );
+        (*a)->add( asmjit::host::rbx, asmjit::host::rax );
+
+        // LdrGetProcedureAddress( module, name, ordinal, &resolved )
+        (*a)->mov( asmjit::host::rcx, asmjit::host::qword_ptr( asmjit::host::rbx, FIELD_OFFSET( Entry, module ) ) );
+        (*a)->mov( asmjit::host::rdx, asmjit::host::qword_ptr( asmjit::host::rbx, FIELD_OFFSET( Entry, name ) ) );
+        (*a)->mov( asmjit::host::r8, asmjit::host::qword_ptr( asmjit::host::rbx, FIELD_OFFSET( Entry, ordinal ) ) );
+        (*a)->lea( asmjit::host::r9, asmjit::host::qword_ptr( asmjit::host::rbx, FIELD_OFFSET( Entry, resolved ) ) );
+        (*a)->mov( asmjit::host::rax, pGetProc->procAddress );
+        (*a)->call( asmjit::host::rax );
+        (*a)->test( asmjit::host::eax, asmjit::host::eax );
+        (*a)->js( l_fail );
+
+        // Patch IAT and replace index with return target
+        (*a)->mov( asmjit::host::rax, asmjit::host::qword_ptr( asmjit::host::rbx, FIELD_OFFSET( Entry, resolved ) ) );
+        (*a)->mov( asmjit::host::rcx, asmjit::host::qword_ptr( asmjit::host::rbx, FIELD_OFFSET( Entry, iatSlot ) ) );
+        (*a)->mov( asmjit::host::qword_ptr( asmjit::host::rcx ), asmjit::host::rax );
+        (*a)->mov( asmjit::host::qword_ptr( asmjit::host::rbp, 0x48 ), asmjit::host::rax );
+
+        if (xstateSize != 0)
+        {
+            saveXState( asmjit::host::rsp, false );
+        }
+        else
+        {
+            (*a)->movups( asmjit::host::xmm0, asmjit::host::oword_ptr( asmjit::host::rsp, 0x20 ) );
+            (*a)->movups( asmjit::host::xmm1, asmjit::host::oword_ptr( asmjit::host::rsp, 0x30 ) );
+            (*a)->movups( asmjit::host::xmm2, asmjit::host::oword_ptr( asmjit::host::rsp, 0x40 ) );
+            (*a)->movups( asmjit::host::xmm3, asmjit::host::oword_ptr( asmjit::host::rsp, 0x50 ) );
+            (*a)->movups( asmjit::host::xmm4, asmjit::host::oword_ptr( asmjit::host::rsp, 0x60 ) );
+            (*a)->movups( asmjit::host::xmm5, asmjit::host::oword_ptr( asmjit::host::rsp, 0x70 ) );
+        }
+
+        (*a)->mov( asmjit::host::rsp, asmjit::host::rbp );
+        (*a)->pop( asmjit::host::rbp );
+        (*a)->pop( asmjit::host::rbx );
+        (*a)->pop( asmjit::host::r11 );
+        (*a)->pop( asmjit::host::r10 );
+        (*a)->pop( asmjit::host::r9 );
+        (*a)->pop( asmjit::host::r8 );
+        (*a)->pop( asmjit::host::rdx );
+        (*a)->pop( asmjit::host::rcx );
+        (*a)->pop( asmjit::host::rax );
+        (*a)->ret();
+
+        // RtlRaiseStatus( status )
+        (*a)->bind( l_fail );
+        (*a)->mov( asmjit::host::ecx, asmjit::host::eax );
+        (*a)->mov( asmjit::host::rax, pRaise->procAddress );
+        (*a)->call( asmjit::host::rax );
     }
     else
     {
-        status = _process.memory().Write(
-            pImage->ldrEntry.baseAddress + 0x1000,
-            pImage->ldrEntry.size - 0x1000,
-            pLocal + 0x1000
-        );
+        // Preserve all registers, index is at [ebp + 0x24]
+        (*a)->pusha();
+        (*a)->push( asmjit::host::ebp );
+        (*a)->mov( asmjit::host::ebp, asmjit::host::esp );
+
+        if (xstateSize != 0)
+            saveXState( asmjit::host::esp, true );
+
+        (*a)->mov( asmjit::host::ebx, asmjit::host::dword_ptr( asmjit::host::ebp, 0x24 ) );
+        (*a)->imul( asmjit::host::ebx, asmjit::host::ebx, sizeof( Entry ) );
+        (*a)->add( asmjit::host::ebx, static_cast<uint32_t>(base) );
+
+        // LdrGetProcedureAddress( module, name, ordinal, &resolved )
+        (*a)->lea( asmjit::host::eax, asmjit::host::dword_ptr( asmjit::host::ebx, FIELD_OFFSET( Entry, resolved ) ) );
+        (*a)->push( asmjit::host::eax );
+        (*a)->push( asmjit::host::dword_ptr( asmjit::host::ebx, FIELD_OFFSET( Entry, ordinal ) ) );
+        (*a)->push( asmjit::host::dword_ptr( asmjit::host::ebx, FIELD_OFFSET( Entry, name ) ) );
+        (*a)->push( asmjit::host::dword_ptr( asmjit::host::ebx, FIELD_OFFSET( Entry, module ) ) );
+        (*a)->mov( asmjit::host::eax, static_cast<uint32_t>(pGetProc->procAddress) );
+        (*a)->call( asmjit::host::eax );
+        (*a)->test( asmjit::host::eax, asmjit::host::eax );
+        (*a)->js( l_fail );
+
+        // Patch IAT and replace index with return target
+        (*a)->mov( asmjit::host::eax, asmjit::host::dword_ptr( asmjit::host::ebx, FIELD_OFFSET( Entry, resolved ) ) );
+        (*a)->mov( asmjit::host::ecx, asmjit::host::dword_ptr( asmjit::host::ebx, FIELD_OFFSET( Entry, iatSlot ) ) );
+        (*a)->mov( asmjit::host::dword_ptr( asmjit::host::ecx ), asmjit::host::eax );
+        (*a)->mov( asmjit::host::dword_ptr( asmjit::host::ebp, 0x24 ), asmjit::host::eax );
+
+        if (xstateSize != 0)
+            saveXState( asmjit::host::esp, false );
+
+        (*a)->mov( asmjit::host::esp, asmjit::host::ebp );
+        (*a)->pop( asmjit::host::ebp );
+        (*a)->popa();
+        (*a)->ret();
+
+        // RtlRaiseStatus( status )
+        (*a)->bind( l_fail );
+        (*a)->push( asmjit::host::eax );
+        (*a)->mov( asmjit::host::eax, static_cast<uint32_t>(pRaise->procAddress) );
+        (*a)->call( asmjit::host::eax );
     }
 
-    // Write function address
+    auto codeSize = (*a)->getCodeSize();
+    if (codeOfs + codeSize > blockSize)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    data.resize( codeOfs + codeSize );
+    (*a)->relocCode( data.data() + codeOfs, base + codeOfs );
+
+    auto status = mem->Write( 0, data.size(), data.data() );
     if (!NT_SUCCESS( status ))
+        return status;
+
+    // Point IAT slots to stubs
+    for (size_t i = 0; i < imports.size(); i++)
     {
-        BLACKBONE_TRACE( L"ManualMap: Failed to write import function. Status 0x%x", status );
+        *reinterpret_cast<T*>(pLocal + imports[i].ptrRVA) = static_cast<T>(base + codeOfs + stubOffsets[i]);
+        pImage->lazyIatPages.emplace_back( static_cast<uint32_t>(imports[i].ptrRVA & ~0xFFFull) );
     }
 
-    return status;
+    std::sort( pImage->lazyIatPages.begin(), pImage->lazyIatPages.end() );
+    pImage->lazyIatPages.erase( std::unique( pImage->lazyIatPages.begin(), pImage->lazyIatPages.end() ), pImage->lazyIatPages.end() );
+    pImage->lazyThunks.emplace_back( std::move( mem.result() ) );
+
+    BLACKBONE_TRACE( L"ManualMap: %d imports of '%ls' will be bound on first call", imports.size(), pImage->ldrEntry.name.c_str() );
+    return STATUS_SUCCESS;
 }
 
 /// <summary>
@@ -1054,6 +1889,9 @@ NTSTATUS MMap::DisableExceptions( ImageContextPtr pImage )
         auto status = _process.remote().ExecInWorkerThread( (*a)->make(), (*a)->getCodeSize(), result );
         if (!NT_SUCCESS( status ))
             return status;
+
+        // Image may be absent if exceptions were handled without VEH
+        _expMgr.RemoveModule( _process, pImage->ldrEntry.baseAddress );
     }
 
     partial = (pImage->flags & PartialExcept) != 0;
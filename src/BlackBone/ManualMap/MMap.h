@@ -8,6 +8,7 @@
 #include "../Process/MemBlock.h"
 #include "../ManualMap/Native/NtLoader.h"
 #include "MExcept.h"
+#include "MapStats.h"
 
 #include <array>
 #include <vector>
@@ -108,6 +109,7 @@ enum eLoadFlags
     NoSxS           = 0x08000,  // Do not apply SxS activation context
     NoTLS           = 0x10000,  // Skip TLS initialization and don't execute TLS callbacks
     IsDependency    = 0x20000,  // Module is a dependency
+    LazyBinding     = 0x40000,  // Bind imports from natively loaded modules on first call
 };
 
 ENUM_OPS( eLoadFlags )
@@ -143,6 +145,41 @@ enum CallbackType
 using MapCallback = LoadData( *)(CallbackType type, void* context, Process& process, const ModuleData& modInfo);
 
 
+/// <summary>
+/// Import entry bound on first call
+/// </summary>
+struct LazyImport
+{
+    ptr_t module = 0;           // Exporting module base
+    uintptr_t ptrRVA = 0;       // IAT slot RVA
+    std::string name;           // Function name, empty if imported by ordinal
+    WORD ordinal = 0;           // Function ordinal
+};
+
+/// <summary>
+/// Image layout properties that must be preserved by in-place reload.
+/// Only header data is kept, existing exports are read from mapped image on reload
+/// </summary>
+struct ImageLayout
+{
+    struct Section
+    {
+        uint32_t rva = 0;               // Section RVA
+        uint32_t size = 0;              // Section virtual size
+        uint32_t characteristics = 0;   // Section characteristics
+    };
+
+    uint32_t imageSize = 0;             // Image size
+    std::vector<Section> sections;      // Section layout
+    uint32_t excDirRVA = 0;             // Exception directory RVA
+    uint32_t excDirSize = 0;            // Exception directory size
+    uint32_t expDirRVA = 0;             // Export directory RVA
+    uint32_t expDirSize = 0;            // Export directory size
+    uint32_t tlsIndexRVA = 0;           // TLS index RVA
+    uint32_t tlsDataSize = 0;           // Static TLS template size, including zero fill
+    uint32_t tlsCallbacks = 0;          // Number of TLS callbacks
+};
+
 /// <summary>
 /// Image data
 /// </summary>
@@ -154,9 +191,13 @@ struct ImageContext
     MemBlock       imgMem;                  // Target image memory region
     NtLdrEntry     ldrEntry;                // Native loader module information
     vecPtr         tlsCallbacks;            // TLS callback routines
+    ImageLayout    layout;                  // Image layout, used to validate reload
+    std::vector<uint32_t> lazyIatPages;     // IAT pages patched by lazy binding thunks
+    std::vector<MemBlock> lazyThunks;       // Lazy binding thunk blocks, released on unmap
     ptr_t          pExpTableAddr = 0;       // Exception table address (amd64 only)
     eLoadFlags     flags = NoFlags;         // Image loader flags
     bool           initialized = false;     // Image entry point was called
+    size_t         statsIdx = MapStatsCollector::npos;  // Image index in MapStats
 };
 
 using ImageContextPtr = std::shared_ptr<ImageContext>;
@@ -178,13 +219,15 @@ public:
     /// <param name="flags">Image mapping flags</param>
     /// <param name="mapCallback">Mapping callback. Triggers for each mapped module</param>
     /// <param name="context">User-supplied callback context</param>
+    /// <param name="pStats">Optional per-phase mapping statistics</param>
     /// <returns>Mapped image info </returns>
     BLACKBONE_API call_result_t<ModuleDataPtr> MapImage(
         const std::wstring& path,
         eLoadFlags flags = NoFlags,
         MapCallback mapCallback = nullptr,
         void* context = nullptr,
-        CustomArgs_t* pCustomArgs_t = nullptr
+        CustomArgs_t* pCustomArgs_t = nullptr,
+        MapStats* pStats = nullptr
         );
 
     /// <summary>
@@ -196,6 +239,7 @@ public:
     /// <param name="flags">Image mapping flags</param>
     /// <param name="mapCallback">Mapping callback. Triggers for each mapped module</param>
     /// <param name="context">User-supplied callback context</param>
+    /// <param name="pStats">Optional per-phase mapping statistics</param>
     /// <returns>Mapped image info</returns>
     BLACKBONE_API call_result_t<ModuleDataPtr> MapImage(
         size_t size, void* buffer,
@@ -203,9 +247,25 @@ public:
         eLoadFlags flags = NoFlags,
         MapCallback mapCallback = nullptr,
         void* context = nullptr,
-        CustomArgs_t* pCustomArgs_t = nullptr
+        CustomArgs_t* pCustomArgs_t = nullptr,
+        MapStats* pStats = nullptr
         );
 
+    /// <summary>
+    /// Replace code and read-only data of manually mapped image with a new build of the same image.
+    /// New image is prepared locally at existing base and only changed pages are written.
+    /// Writable sections are left intact to preserve module state.
+    /// Missing dependencies of the new image are loaded by native loader.
+    /// </summary>
+    /// <param name="pMod">Module mapped by this MMap instance</param>
+    /// <param name="newPath">New image path</param>
+    /// <returns>
+    /// Number of written pages.
+    /// STATUS_REVISION_MISMATCH if section layout, TLS, exception directory or existing exports have changed,
+    /// image must be remapped with ForceRemap in that case
+    /// </returns>
+    BLACKBONE_API call_result_t<uint32_t> ReloadImage( ModuleDataPtr pMod, const std::wstring& newPath );
+
     /// <summary>
     /// Unmap all manually mapped modules
     /// </summary>
@@ -233,6 +293,7 @@ private:
     /// <param name="flags">Image mapping flags</param>
     /// <param name="mapCallback">Mapping callback. Triggers for each mapped module</param>
     /// <param name="context">User-supplied callback context</param>
+    /// <param name="pStats">Optional per-phase mapping statistics</param>
     /// <returns>Mapped image info</returns>
     call_result_t<ModuleDataPtr> MapImageInternal(
         const std::wstring& path,
@@ -241,7 +302,8 @@ private:
         eLoadFlags flags = NoFlags,
         MapCallback ldrCallback = nullptr,
         void* ldrContext = nullptr,
-        CustomArgs_t* pCustomArgs_t = nullptr
+        CustomArgs_t* pCustomArgs_t = nullptr,
+        MapStats* pStats = nullptr
         );
  
     /// <summary>
@@ -298,6 +360,15 @@ private:
     /// <returns>true on success</returns>
     NTSTATUS RelocateImage( ImageContextPtr pImage );
 
+    /// <summary>
+    /// Fix relocations of local image copy for a new image base
+    /// </summary>
+    /// <param name="image">Source image</param>
+    /// <param name="pLocal">Local image copy</param>
+    /// <param name="base">Target image base</param>
+    /// <returns>Status code</returns>
+    NTSTATUS ApplyRelocations( const pe::PEImage& image, uint8_t* pLocal, ptr_t base );
+
     /// <summary>
     /// Resolves image import or delayed image import
     /// </summary>
@@ -306,6 +377,56 @@ private:
     /// <returns>Status code</returns>
     NTSTATUS ResolveImport( ImageContextPtr pImage, bool useDelayed = false );
 
+    /// <summary>
+    /// Resolve import functions and fill IAT of local image copy
+    /// </summary>
+    /// <param name="pImage">Image data</param>
+    /// <param name="imports">Image import or delayed import</param>
+    /// <param name="pLocal">Local image copy</param>
+    /// <param name="pLazy">If not nullptr - imports from native modules are stored here instead of binding</param>
+    /// <returns>Status code</returns>
+    NTSTATUS BindImports( ImageContextPtr pImage, const pe::mapImports& imports, uint8_t* pLocal, std::vector<LazyImport>* pLazy = nullptr );
+
+    /// <summary>
+    /// Create lazy binding thunks and point IAT slots of local image copy to them.
+    /// Target memory layout:
+    /// ---------------------------------------------------
+    /// | entries | ANSI_STRINGs | names | resolver | stubs |
+    /// ---------------------------------------------------
+    /// Each stub pushes entry index and jumps to resolver. Resolver calls LdrGetProcedureAddress,
+    /// patches IAT slot and jumps to resolved function.
+    /// </summary>
+    /// <param name="pImage">Image data</param>
+    /// <param name="imports">Imports to bind on first call</param>
+    /// <param name="pLocal">Local image copy</param>
+    /// <returns>Status code</returns>
+    template<typename T>
+    NTSTATUS CreateLazyThunks( ImageContextPtr pImage, const std::vector<LazyImport>& imports, uint8_t* pLocal );
+
+    /// <summary>
+    /// Get image layout properties
+    /// </summary>
+    /// <param name="image">Loaded image</param>
+    /// <returns>Image layout</returns>
+    ImageLayout GetImageLayout( pe::PEImage& image );
+
+    /// <summary>
+    /// Check if image with new layout can replace mapped one in place
+    /// </summary>
+    /// <param name="oldLayout">Mapped image layout</param>
+    /// <param name="newLayout">New image layout</param>
+    /// <returns>true if compatible</returns>
+    bool LayoutCompatible( const ImageLayout& oldLayout, const ImageLayout& newLayout );
+
+    /// <summary>
+    /// Read named exports of mapped image from target memory.
+    /// Names and tables are expected inside export directory, as placed by linker
+    /// </summary>
+    /// <param name="pImage">Mapped image</param>
+    /// <param name="exports">Found exports, sorted by name</param>
+    /// <returns>Status code</returns>
+    NTSTATUS GetMappedExports( ImageContextPtr pImage, pe::vecExports& exports );
+
     /// <summary>
     /// Resolve static TLS storage
     /// </summary>
@@ -391,6 +512,7 @@ private:
     MemBlock        _pAContext;             // SxS activation context memory address
     MapCallback     _mapCallback = nullptr; // Loader callback for adding image into loader lists
     void*           _userContext = nullptr; // user context for _ldrCallback       
+    MapStatsCollector _stats;               // Mapping statistics of current MapImage call
 
     std::vector<std::pair<ptr_t, size_t>> _usedBlocks;   // Used memory blocks 
 };
@@ -0,0 +1,208 @@
+#include "MapStats.h"
+#include "../Misc/PerfCounter.hpp"
+
+namespace blackbone
+{
+
+/// <summary>
+/// Get phase display name
+/// </summary>
+/// <param name="phase">Mapping phase</param>
+/// <returns>Phase name</returns>
+const wchar_t* MapStats::PhaseName( eMapPhase phase )
+{
+    static const wchar_t* names[] =
+    {
+        L"Environment",
+        L"LoadImage",
+        L"Allocate",
+        L"CreateActx",
+        L"CopyImage",
+        L"Relocate",
+        L"ResolveImport",
+        L"ProbeSxS",
+        L"Protect",
+        L"Exceptions",
+        L"Finalize",
+        L"Initializers",
+    };
+
+    static_assert(_countof( names ) == MapPhase_Count, "Phase name table mismatch");
+    return phase < MapPhase_Count ? names[phase] : L"Unknown";
+}
+
+/// <summary>
+/// Start statistics collection
+/// </summary>
+/// <param name="pStats">Output statistics. If nullptr - collection is disabled</param>
+/// <param name="memory">Process memory routines to take operation counters from</param>
+/// <returns>Collection session</returns>
+MapStatsCollector::Session MapStatsCollector::Start( MapStats* pStats, ProcessMemory& memory )
+{
+    // Disabled or nested call
+    if (pStats == nullptr || _pStats != nullptr)
+        return Session( nullptr );
+
+    *pStats = MapStats();
+
+    _pStats = pStats;
+    _memory = &memory;
+    _stack.clear();
+    _ticks.clear();
+    _callTicks = { };
+    _callMemory = MemoryStats();
+    _lastMemory = memory.stats();
+    _startTick = _lastTick = PerfCounter::now();
+
+    return Session( this );
+}
+
+/// <summary>
+/// Register new image
+/// </summary>
+/// <param name="name">Image name</param>
+/// <returns>Image index</returns>
+size_t MapStatsCollector::AddImage( const std::wstring& name )
+{
+    if (!active())
+        return npos;
+
+    ImageMapStats img;
+    img.name = name;
+
+    _pStats->images.emplace_back( std::move( img ) );
+    _ticks.emplace_back( PhaseTicks{ } );
+
+    return _pStats->images.size() - 1;
+}
+
+/// <summary>
+/// Get image stats
+/// </summary>
+/// <param name="idx">Image index</param>
+/// <returns>Image stats, nullptr if collection is inactive or index is invalid</returns>
+ImageMapStats* MapStatsCollector::image( size_t idx )
+{
+    if (!active() || idx >= _pStats->images.size())
+        return nullptr;
+
+    return &_pStats->images[idx];
+}
+
+/// <summary>
+/// Start phase timer
+/// </summary>
+/// <param name="idx">Image index, npos to attribute phase to call itself</param>
+/// <param name="phase">Mapping phase</param>
+/// <returns>Scoped phase guard</returns>
+MapStatsCollector::PhaseGuard MapStatsCollector::Phase( size_t idx, eMapPhase phase )
+{
+    if (!active())
+        return PhaseGuard( nullptr );
+
+    Flush();
+
+    if (idx >= _ticks.size())
+        idx = npos;
+
+    _stack.push_back( { idx, phase } );
+    return PhaseGuard( this );
+}
+
+/// <summary>
+/// End current phase and resume enclosing one
+/// </summary>
+void MapStatsCollector::Leave()
+{
+    if (!active() || _stack.empty())
+        return;
+
+    Flush();
+    _stack.pop_back();
+}
+
+/// <summary>
+/// End current phase and start next one for the same image
+/// </summary>
+/// <param name="phase">Next phase</param>
+void MapStatsCollector::Switch( eMapPhase phase )
+{
+    if (!active() || _stack.empty())
+        return;
+
+    Flush();
+    _stack.back().phase = phase;
+}
+
+/// <summary>
+/// Attribute time and memory operations since last transition to current top frame
+/// </summary>
+void MapStatsCollector::Flush()
+{
+    auto tick = PerfCounter::now();
+    auto memory = _memory->stats();
+    auto memDelta = memory - _lastMemory;
+
+    if (!_stack.empty())
+    {
+        auto& top = _stack.back();
+        if (top.image != npos)
+        {
+            _ticks[top.image][top.phase] += tick - _lastTick;
+            _pStats->images[top.image].memory += memDelta;
+        }
+        else
+        {
+            _callTicks[top.phase] += tick - _lastTick;
+            _callMemory += memDelta;
+        }
+    }
+    else
+    {
+        _callMemory += memDelta;
+    }
+
+    _lastTick = tick;
+    _lastMemory = memory;
+}
+
+/// <summary>
+/// Finalize statistics
+/// </summary>
+void MapStatsCollector::Finish()
+{
+    if (!active())
+        return;
+
+    Flush();
+
+    // Phases are exclusive and ticks are truncated to microseconds,
+    // so sum of phase times never exceeds total time
+    auto& stats = *_pStats;
+    for (size_t phase = 0; phase < MapPhase_Count; phase++)
+        stats.phaseTime[phase] = PerfCounter::toMicroseconds( _callTicks[phase] );
+
+    stats.memory = _callMemory;
+
+    for (size_t i = 0; i < stats.images.size(); i++)
+    {
+        auto& img = stats.images[i];
+        for (size_t phase = 0; phase < MapPhase_Count; phase++)
+        {
+            img.phaseTime[phase] = PerfCounter::toMicroseconds( _ticks[i][phase] );
+            img.totalTime += img.phaseTime[phase];
+            stats.phaseTime[phase] += img.phaseTime[phase];
+        }
+
+        stats.memory += img.memory;
+    }
+
+    stats.totalTime = PerfCounter::toMicroseconds( _lastTick - _startTick );
+
+    _pStats = nullptr;
+    _memory = nullptr;
+    _stack.clear();
+    _ticks.clear();
+}
+
+}
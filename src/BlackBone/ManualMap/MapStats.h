@@ -0,0 +1,207 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+#include "../Process/ProcessMemory.h"
+
+#include <array>
+#include <vector>
+#include <string>
+
+namespace blackbone
+{
+
+// Manual mapping phases
+enum eMapPhase
+{
+    MapPhase_Environment,   // RPC environment creation
+    MapPhase_LoadImage,     // Local image load and parsing
+    MapPhase_Allocate,      // Target image memory allocation
+    MapPhase_CreateActx,    // SxS activation context creation
+    MapPhase_CopyImage,     // Header and sections copy
+    MapPhase_Relocate,      // Base relocations
+    MapPhase_ResolveImport, // Import and delayed import resolution
+    MapPhase_ProbeSxS,      // Remote SxS dependency path probing
+    MapPhase_Protect,       // Section memory protection
+    MapPhase_Exceptions,    // Exception support
+    MapPhase_Finalize,      // Security cookie, VAD, loader references and static TLS
+    MapPhase_Initializers,  // TLS callbacks and entry point
+
+    MapPhase_Count
+};
+
+using MapPhaseTimes = std::array<uint64_t, MapPhase_Count>;
+
+/// <summary>
+/// Mapping statistics of a single image
+/// </summary>
+struct ImageMapStats
+{
+    std::wstring name;                  // Image name
+    ptr_t baseAddress = 0;              // Mapped image base
+    uint64_t totalTime = 0;             // Sum of phase times, microseconds
+    MapPhaseTimes phaseTime = { };      // Exclusive phase wall time, microseconds
+    MemoryStats memory;                 // Remote memory operations issued for this image
+    uint32_t dependencies = 0;          // Number of imported modules
+    uint32_t mappedDependencies = 0;    // Number of dependencies manually mapped for this image
+    uint32_t nativeDependencies = 0;    // Number of dependencies loaded by native loader for this image
+    uint32_t imports = 0;               // Number of resolved import entries
+    uint32_t lazyImports = 0;           // Number of import entries bound on first call
+};
+
+/// <summary>
+/// MMap::MapImage call statistics
+/// </summary>
+struct MapStats
+{
+    std::vector<ImageMapStats> images;  // Per-image stats, in mapping order
+    uint64_t totalTime = 0;             // Whole call wall time, microseconds
+    MapPhaseTimes phaseTime = { };      // Phase times summed over all images, microseconds
+    MemoryStats memory;                 // All remote memory operations issued during the call
+
+    /// <summary>
+    /// Get phase display name
+    /// </summary>
+    /// <param name="phase">Mapping phase</param>
+    /// <returns>Phase name</returns>
+    BLACKBONE_API static const wchar_t* PhaseName( eMapPhase phase );
+};
+
+/// <summary>
+/// Collects MapStats with exclusive per-phase accounting.
+/// Nested phases (e.g. dependency mapping inside ResolveImport) pause the enclosing one.
+/// All calls are no-op unless collection was started with valid MapStats pointer.
+/// </summary>
+class MapStatsCollector
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /// <summary>
+    /// Scoped phase timer
+    /// </summary>
+    class PhaseGuard
+    {
+    public:
+        PhaseGuard( MapStatsCollector* owner )
+            : _owner( owner ) { }
+
+        PhaseGuard( PhaseGuard&& rhs )
+            : _owner( rhs._owner ) { rhs._owner = nullptr; }
+
+        ~PhaseGuard()
+        {
+            if (_owner)
+                _owner->Leave();
+        }
+
+        /// <summary>
+        /// End current phase and start next one for the same image
+        /// </summary>
+        /// <param name="phase">Next phase</param>
+        void next( eMapPhase phase )
+        {
+            if (_owner)
+                _owner->Switch( phase );
+        }
+
+    private:
+        PhaseGuard( const PhaseGuard& ) = delete;
+        PhaseGuard& operator =( const PhaseGuard& ) = delete;
+        PhaseGuard& operator =( PhaseGuard&& ) = delete;
+
+    private:
+        MapStatsCollector* _owner;
+    };
+
+    /// <summary>
+    /// Collection session. Finalizes statistics on scope exit
+    /// </summary>
+    class Session
+    {
+    public:
+        Session( MapStatsCollector* owner )
+            : _owner( owner ) { }
+
+        Session( Session&& rhs )
+            : _owner( rhs._owner ) { rhs._owner = nullptr; }
+
+        ~Session()
+        {
+            if (_owner)
+                _owner->Finish();
+        }
+
+    private:
+        Session( const Session& ) = delete;
+        Session& operator =( const Session& ) = delete;
+        Session& operator =( Session&& ) = delete;
+
+    private:
+        MapStatsCollector* _owner;
+    };
+
+public:
+    /// <summary>
+    /// Start statistics collection
+    /// </summary>
+    /// <param name="pStats">Output statistics. If nullptr - collection is disabled</param>
+    /// <param name="memory">Process memory routines to take operation counters from</param>
+    /// <returns>Collection session</returns>
+    Session Start( MapStats* pStats, ProcessMemory& memory );
+
+    /// <summary>
+    /// Register new image
+    /// </summary>
+    /// <param name="name">Image name</param>
+    /// <returns>Image index</returns>
+    size_t AddImage( const std::wstring& name );
+
+    /// <summary>
+    /// Get image stats
+    /// </summary>
+    /// <param name="idx">Image index</param>
+    /// <returns>Image stats, nullptr if collection is inactive or index is invalid</returns>
+    ImageMapStats* image( size_t idx );
+
+    /// <summary>
+    /// Start phase timer
+    /// </summary>
+    /// <param name="idx">Image index, npos to attribute phase to call itself</param>
+    /// <param name="phase">Mapping phase</param>
+    /// <returns>Scoped phase guard</returns>
+    PhaseGuard Phase( size_t idx, eMapPhase phase );
+
+    inline bool active() const { return _pStats != nullptr; }
+
+private:
+    struct Frame
+    {
+        size_t image;
+        eMapPhase phase;
+    };
+
+    using PhaseTicks = std::array<int64_t, MapPhase_Count>;
+
+    void Leave();
+    void Switch( eMapPhase phase );
+    void Finish();
+
+    /// <summary>
+    /// Attribute time and memory operations since last transition to current top frame
+    /// </summary>
+    void Flush();
+
+private:
+    MapStats* _pStats = nullptr;        // Output statistics
+    ProcessMemory* _memory = nullptr;   // Source of memory counters
+    std::vector<Frame> _stack;          // Active phases
+    std::vector<PhaseTicks> _ticks;     // Per-image phase ticks
+    PhaseTicks _callTicks = { };        // Phase ticks not bound to any image
+    MemoryStats _callMemory;            // Memory operations not bound to any image
+    MemoryStats _lastMemory;            // Memory counters at last transition
+    int64_t _lastTick = 0;              // Last transition time
+    int64_t _startTick = 0;             // Session start time
+};
+
+}
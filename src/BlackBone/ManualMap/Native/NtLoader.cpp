@@ -372,6 +372,23 @@ NTSTATUS NtLdr::UnloadTLS( const NtLdrEntry& mod, bool noThread /*= false*/ )
     return STATUS_SUCCESS;
 }
 
+/// <summary>
+/// Update entry point in module loader entry
+/// </summary>
+/// <param name="mod">Module data</param>
+/// <returns>Status code</returns>
+NTSTATUS NtLdr::UpdateEntryPoint( const NtLdrEntry& mod )
+{
+    // No loader entry was created
+    if (mod.ldrPtr == 0)
+        return STATUS_SUCCESS;
+
+    if (mod.type == mt_mod64)
+        return _process.memory().Write( fieldPtr( mod.ldrPtr, &_LDR_DATA_TABLE_ENTRY_BASE64::EntryPoint ), mod.entryPoint );
+    else
+        return _process.memory().Write( fieldPtr( mod.ldrPtr, &_LDR_DATA_TABLE_ENTRY_BASE32::EntryPoint ), static_cast<uint32_t>(mod.entryPoint) );
+}
+
 /// <summary>
 ///  Initialize OS-specific module entry
 /// </summary>
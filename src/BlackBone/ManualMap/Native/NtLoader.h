@@ -73,6 +73,13 @@ public:
     /// <returns>Status code</returns>
     BLACKBONE_API NTSTATUS UnloadTLS( const NtLdrEntry& mod, bool noThread = false );
 
+    /// <summary>
+    /// Update entry point in module loader entry
+    /// </summary>
+    /// <param name="mod">Module data</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS UpdateEntryPoint( const NtLdrEntry& mod );
+
     /// <summary>
     /// Unlink module from Ntdll loader
     /// </summary>
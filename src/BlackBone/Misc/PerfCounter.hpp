@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include <stdint.h>
+
+namespace blackbone
+{
+
+/// <summary>
+/// QueryPerformanceCounter wrapper
+/// </summary>
+class PerfCounter
+{
+public:
+    /// <summary>
+    /// Get current tick count
+    /// </summary>
+    /// <returns>Performance counter value</returns>
+    static inline int64_t now()
+    {
+        LARGE_INTEGER value = { };
+        QueryPerformanceCounter( &value );
+        return value.QuadPart;
+    }
+
+    /// <summary>
+    /// Get performance counter frequency
+    /// </summary>
+    /// <returns>Ticks per second</returns>
+    static inline int64_t frequency()
+    {
+        static const int64_t freq = []()
+        {
+            LARGE_INTEGER value = { };
+            QueryPerformanceFrequency( &value );
+            return value.QuadPart;
+        }();
+
+        return freq;
+    }
+
+    /// <summary>
+    /// Convert tick delta into microseconds
+    /// </summary>
+    /// <param name="ticks">Tick delta</param>
+    /// <returns>Microseconds</returns>
+    static inline uint64_t toMicroseconds( int64_t ticks )
+    {
+        const auto freq = frequency();
+        return static_cast<uint64_t>((ticks / freq) * 1000000 + (ticks % freq) * 1000000 / freq);
+    }
+
+    /// <summary>
+    /// Convert tick delta into nanoseconds
+    /// </summary>
+    /// <param name="ticks">Tick delta</param>
+    /// <returns>Nanoseconds</returns>
+    static inline uint64_t toNanoseconds( int64_t ticks )
+    {
+        const auto freq = frequency();
+        return static_cast<uint64_t>((ticks / freq) * 1000000000 + (ticks % freq) * 1000000000 / freq);
+    }
+};
+
+}
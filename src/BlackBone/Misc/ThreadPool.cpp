@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+
+namespace blackbone
+{
+
+/// <summary>
+/// Create pool
+/// </summary>
+/// <param name="threads">Number of workers, 0 - number of logical CPUs</param>
+ThreadPool::ThreadPool( size_t threads /*= 0*/ )
+    : _size( threads != 0 ? threads : max( std::thread::hardware_concurrency(), 1u ) )
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    Stop();
+}
+
+/// <summary>
+/// Wait until all queued tasks are finished
+/// </summary>
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lck( _lock );
+    _idle.wait( lck, [this]() { return _queue.empty() && _active == 0; } );
+}
+
+/// <summary>
+/// Change number of workers. Waits for queued tasks
+/// </summary>
+/// <param name="threads">Number of workers, 0 - number of logical CPUs</param>
+void ThreadPool::Resize( size_t threads )
+{
+    Wait();
+    Stop();
+
+    std::lock_guard<std::mutex> lck( _lock );
+    _size = threads != 0 ? threads : max( std::thread::hardware_concurrency(), 1u );
+}
+
+size_t ThreadPool::pending()
+{
+    std::lock_guard<std::mutex> lck( _lock );
+    return _queue.size() + _active;
+}
+
+/// <summary>
+/// Add task to queue, start workers if needed
+/// </summary>
+/// <param name="task">Task</param>
+void ThreadPool::Enqueue( std::function<void()>&& task )
+{
+    {
+        std::lock_guard<std::mutex> lck( _lock );
+
+        _stop = false;
+        _queue.emplace_back( std::move( task ) );
+
+        while (_threads.size() < _size)
+            _threads.emplace_back( &ThreadPool::Worker, this );
+    }
+
+    _wake.notify_one();
+}
+
+/// <summary>
+/// Stop and join all workers
+/// </summary>
+void ThreadPool::Stop()
+{
+    // Workers are joined outside of lock, they need it to drain the queue
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lck( _lock );
+        _stop = true;
+        threads.swap( _threads );
+    }
+
+    _wake.notify_all();
+
+    for (auto& thread : threads)
+        if (thread.joinable())
+            thread.join();
+}
+
+/// <summary>
+/// Worker thread routine
+/// </summary>
+void ThreadPool::Worker()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lck( _lock );
+            _wake.wait( lck, [this]() { return _stop || !_queue.empty(); } );
+
+            // Queue is drained before exit
+            if (_queue.empty())
+                return;
+
+            task = std::move( _queue.front() );
+            _queue.pop_front();
+            _active++;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lck( _lock );
+            _active--;
+            if (_queue.empty() && _active == 0)
+                _idle.notify_all();
+        }
+    }
+}
+
+}
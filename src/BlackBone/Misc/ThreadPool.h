@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Fixed-size pool of local worker threads.
+/// Threads are started on first Submit, so unused pool costs nothing.
+/// </summary>
+class ThreadPool
+{
+public:
+    /// <summary>
+    /// Create pool
+    /// </summary>
+    /// <param name="threads">Number of workers, 0 - number of logical CPUs</param>
+    BLACKBONE_API ThreadPool( size_t threads = 0 );
+    BLACKBONE_API ~ThreadPool();
+
+    /// <summary>
+    /// Queue task
+    /// </summary>
+    /// <param name="fn">Task</param>
+    /// <returns>Task result</returns>
+    template<typename Fn>
+    auto Submit( Fn&& fn ) -> std::future<decltype(fn())>
+    {
+        using R = decltype(fn());
+
+        auto task = std::make_shared<std::packaged_task<R()>>( std::forward<Fn>( fn ) );
+        auto result = task->get_future();
+
+        Enqueue( [task]() { (*task)(); } );
+        return result;
+    }
+
+    /// <summary>
+    /// Wait until all queued tasks are finished
+    /// </summary>
+    BLACKBONE_API void Wait();
+
+    /// <summary>
+    /// Change number of workers. Waits for queued tasks
+    /// </summary>
+    /// <param name="threads">Number of workers, 0 - number of logical CPUs</param>
+    BLACKBONE_API void Resize( size_t threads );
+
+    BLACKBONE_API size_t size() const { return _size; }
+    BLACKBONE_API size_t pending();
+
+private:
+    /// <summary>
+    /// Add task to queue, start workers if needed
+    /// </summary>
+    /// <param name="task">Task</param>
+    BLACKBONE_API void Enqueue( std::function<void()>&& task );
+
+    /// <summary>
+    /// Stop and join all workers
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Worker thread routine
+    /// </summary>
+    void Worker();
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator =( const ThreadPool& ) = delete;
+
+private:
+    size_t _size = 0;                           // Number of workers
+    size_t _active = 0;                         // Tasks being executed
+    bool _stop = false;                         // Shutdown flag
+    std::vector<std::thread> _threads;          // Workers
+    std::deque<std::function<void()>> _queue;   // Queued tasks
+    std::mutex _lock;                           // Queue lock
+    std::condition_variable _wake;              // Task queued or shutdown
+    std::condition_variable _idle;              // Queue drained
+};
+
+}
@@ -339,21 +339,27 @@ mapImports& PEImage::GetImports( bool useDelayed /*= false*/ )
 void PEImage::GetExports( vecExports& exports )
 {
     exports.clear();
-    Reload();
 
-    auto pExport = reinterpret_cast<PIMAGE_EXPORT_DIRECTORY>(DirectoryAddress( IMAGE_DIRECTORY_ENTRY_EXPORT ));
-    if (pExport == 0)
+    // Reopen released image, keep loaded one intact
+    bool reload = !_pFileBase;
+    if (reload && !NT_SUCCESS( Reload() ))
         return;
 
-    DWORD *pAddressOfNames = reinterpret_cast<DWORD*>(pExport->AddressOfNames + reinterpret_cast<uintptr_t>(_pFileBase.get()));
-    DWORD *pAddressOfFuncs = reinterpret_cast<DWORD*>(pExport->AddressOfFunctions + reinterpret_cast<uintptr_t>(_pFileBase.get()));
-    WORD  *pAddressOfOrds  = reinterpret_cast<WORD*> (pExport->AddressOfNameOrdinals + reinterpret_cast<size_t>(_pFileBase.get()));
+    auto pExport = reinterpret_cast<PIMAGE_EXPORT_DIRECTORY>(DirectoryAddress( IMAGE_DIRECTORY_ENTRY_EXPORT ));
+    if (pExport != nullptr)
+    {
+        DWORD *pAddressOfNames = reinterpret_cast<DWORD*>(ResolveRVAToVA( pExport->AddressOfNames ));
+        DWORD *pAddressOfFuncs = reinterpret_cast<DWORD*>(ResolveRVAToVA( pExport->AddressOfFunctions ));
+        WORD  *pAddressOfOrds  = reinterpret_cast<WORD*> (ResolveRVAToVA( pExport->AddressOfNameOrdinals ));
 
-    for (DWORD i = 0; i < pExport->NumberOfNames; ++i)
-        exports.push_back( ExportData( reinterpret_cast<const char*>(_pFileBase.get())+pAddressOfNames[i], pAddressOfFuncs[pAddressOfOrds[i]] ) );
+        for (DWORD i = 0; i < pExport->NumberOfNames; ++i)
+            exports.push_back( ExportData( reinterpret_cast<const char*>(ResolveRVAToVA( pAddressOfNames[i] )), pAddressOfFuncs[pAddressOfOrds[i]] ) );
+
+        std::sort( exports.begin(), exports.end() );
+    }
 
-    std::sort( exports.begin(), exports.end() );
-    return Release( true );
+    if (reload)
+        Release( true );
 }
 
 /// <summary>
@@ -224,21 +224,16 @@ bool PatternSearch::SearchRemoteWholeWithHandler(
     MatchHandler handler
     ) const
 {
-    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
     size_t  bufsize = 1 * 1024 * 1024;  // 1 MB
     uint8_t *buf = reinterpret_cast<uint8_t*>(VirtualAlloc( 0, bufsize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ));
 
-    auto native = remote.core().native();
-
     bool running = true;
-    for (ptr_t memptr = native->minAddr(); memptr < native->maxAddr()  &&  running; memptr = mbi.BaseAddress + mbi.RegionSize)
+    for (auto& mbi : remote.memory().EnumRegions())
     {
-        auto status = remote.core().native()->VirtualQueryExT( memptr, &mbi );
-
-        if (status == STATUS_INVALID_PARAMETER || status == STATUS_ACCESS_DENIED)
+        if (!running)
             break;
-        else if (status != STATUS_SUCCESS)
-            continue;
+
+        ptr_t memptr = mbi.BaseAddress;
 
         // Filter regions
         if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS/*|| !(mbi.Protect & PAGE_READWRITE)*/)
@@ -252,8 +247,12 @@ bool PatternSearch::SearchRemoteWholeWithHandler(
             buf = reinterpret_cast<uint8_t*>(VirtualAlloc( 0, bufsize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ));
         }
 
+        // Layout has changed since last map update
         if (remote.memory().Read( memptr, static_cast<size_t>(mbi.RegionSize), buf ) != STATUS_SUCCESS)
+        {
+            remote.memory().regions().MarkDirty( memptr, static_cast<size_t>(mbi.RegionSize) );
             continue;
+        }
 
         if (useWildcard)
         	running = !SearchWithHandler( wildcard, buf, static_cast<size_t>(mbi.RegionSize), handler, memptr );
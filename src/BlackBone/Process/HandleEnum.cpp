@@ -0,0 +1,427 @@
+#include "HandleEnum.h"
+#include "ProcessCore.h"
+#include "../Include/NativeStructures.h"
+#include "../Misc/DynImport.h"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+#define SystemHandleInformation (SYSTEM_INFORMATION_CLASS)16
+#define ObjectNameInformation   (OBJECT_INFORMATION_CLASS)1
+
+// Enough for any UNICODE_STRING
+constexpr size_t handleNameBufSize = sizeof( UNICODE_STRING ) + 0x10000;
+
+// Time to wait for terminated worker thread to exit, ms
+constexpr DWORD workerExitTimeout = 1000;
+
+/// <summary>
+/// Query thread. Everything it touches during query is preallocated,
+/// so it can be terminated at any moment without leaving heap locked
+/// </summary>
+struct HandleEnumerator::Worker
+{
+    Handle thread;                                  // Thread handle
+    Handle start;                                   // Request event
+    Handle done;                                    // Completion event
+
+    fnNtQueryObject pQueryObject = nullptr;
+    fnNtQuerySection pQuerySection = nullptr;
+
+    // Request
+    HANDLE object = NULL;                           // Local handle copy
+    bool queryName = false;                         // Query object name
+    bool querySection = false;                      // Query section info
+    bool exit = false;                              // Stop thread
+
+    // Result
+    NTSTATUS nameStatus = STATUS_NOT_FOUND;
+    NTSTATUS sectionStatus = STATUS_NOT_FOUND;
+    SECTION_BASIC_INFORMATION_T section = { 0 };
+    std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>( handleNameBufSize );
+
+    // Supervisor state
+    bool busy = false;
+    size_t job = 0;
+    uint64_t deadline = 0;
+};
+
+HandleEnumerator::HandleEnumerator( ProcessCore& core )
+    : _core( core )
+{
+}
+
+HandleEnumerator::~HandleEnumerator()
+{
+    Reset();
+}
+
+/// <summary>
+/// Enumerate process handles
+/// </summary>
+/// <param name="filter">Handle filter</param>
+/// <returns>Found handles or status code</returns>
+call_result_t<std::vector<HandleInfo>> HandleEnumerator::Enumerate( const HandleFilter& filter /*= HandleFilter()*/ )
+{
+    CSLock lck( _lock );
+
+    if (_buffer.empty())
+        _buffer.resize( 0x10000 );
+
+    ULONG returnLength = 0;
+    NTSTATUS status = STATUS_SUCCESS;
+    for (;;)
+    {
+        status = SAFE_NATIVE_CALL(
+            NtQuerySystemInformation, SystemHandleInformation,
+            _buffer.data(), static_cast<ULONG>(_buffer.size()), &returnLength
+            );
+
+        if (status != STATUS_INFO_LENGTH_MISMATCH)
+            break;
+
+        _buffer.resize( _buffer.size() * 2 );
+    }
+
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    std::vector<HandleInfo> result;
+    std::vector<std::pair<HANDLE, size_t>> jobs;
+
+    auto handleInfo = reinterpret_cast<const SYSTEM_HANDLE_INFORMATION_T*>(_buffer.data());
+    for (ULONG i = 0; i < handleInfo->HandleCount; i++)
+    {
+        auto& entry = handleInfo->Handles[i];
+        if (entry.ProcessId != _core.pid())
+            continue;
+
+        if (filter.access != 0 && (entry.GrantedAccess & filter.access) != filter.access)
+            continue;
+
+        // Known type can be filtered without touching the handle
+        auto iter = _types.find( entry.ObjectTypeNumber );
+        if (iter != _types.end() && !TypeMatch( filter, iter->second ))
+            continue;
+
+        ProcessHandle hLocal;
+        status = SAFE_NATIVE_CALL(
+            NtDuplicateObject,
+            _core.handle(),
+            reinterpret_cast<HANDLE>(entry.Handle),
+            GetCurrentProcess(),
+            &hLocal, 0, 0, DUPLICATE_SAME_ACCESS
+            );
+
+        if (!NT_SUCCESS( status ))
+            continue;
+
+        auto pType = ResolveType( entry.ObjectTypeNumber, hLocal );
+        if (pType == nullptr || !TypeMatch( filter, *pType ))
+            continue;
+
+        HandleInfo info;
+        info.handle    = reinterpret_cast<HANDLE>(entry.Handle);
+        info.access    = entry.GrantedAccess;
+        info.flags     = entry.Flags;
+        info.typeIndex = entry.ObjectTypeNumber;
+        info.pObject   = entry.Object;
+        info.typeName  = *pType;
+
+        bool isSection = _wcsicmp( pType->c_str(), L"Section" ) == 0;
+        if (filter.names || isSection)
+            jobs.emplace_back( hLocal.release(), result.size() );
+
+        result.emplace_back( std::move( info ) );
+    }
+
+    QueryObjects( filter, jobs, result );
+    return result;
+}
+
+/// <summary>
+/// Get cached type name
+/// </summary>
+/// <param name="index">Object type index</param>
+/// <returns>Type name, empty if type wasn't seen yet</returns>
+std::wstring HandleEnumerator::typeName( uint32_t index )
+{
+    CSLock lck( _lock );
+
+    auto iter = _types.find( index );
+    return iter != _types.end() ? iter->second : std::wstring();
+}
+
+/// <summary>
+/// Stop query threads
+/// </summary>
+void HandleEnumerator::Reset()
+{
+    CSLock lck( _lock );
+
+    for (auto& worker : _workers)
+    {
+        worker->exit = true;
+        SetEvent( worker->start );
+
+        if (WaitForSingleObject( worker->thread, workerExitTimeout ) == WAIT_OBJECT_0)
+            continue;
+
+        TerminateThread( worker->thread, 0 );
+
+        // Thread that didn't exit can still access its worker, so it is left allocated
+        if (WaitForSingleObject( worker->thread, workerExitTimeout ) != WAIT_OBJECT_0)
+            worker.release();
+    }
+
+    _workers.clear();
+}
+
+/// <summary>
+/// Get type name from cache or by querying object
+/// </summary>
+/// <param name="index">Object type index</param>
+/// <param name="hLocal">Local handle copy, used if type isn't cached</param>
+/// <returns>Type name</returns>
+const std::wstring* HandleEnumerator::ResolveType( uint32_t index, HANDLE hLocal )
+{
+    auto iter = _types.find( index );
+    if (iter != _types.end())
+        return &iter->second;
+
+    uint8_t buf[0x1000] = { 0 };
+    auto pTypeInfo = reinterpret_cast<OBJECT_TYPE_INFORMATION_T*>(buf);
+    if (!NT_SUCCESS( SAFE_NATIVE_CALL( NtQueryObject, hLocal, ObjectTypeInformation, pTypeInfo, sizeof( buf ), nullptr ) ))
+        return nullptr;
+
+    std::wstring name;
+    if (pTypeInfo->Name.Length)
+        name.assign( reinterpret_cast<wchar_t*>(pTypeInfo->Name.Buffer), pTypeInfo->Name.Length / sizeof( wchar_t ) );
+
+    return &_types.emplace( index, name ).first->second;
+}
+
+/// <summary>
+/// Check type against filter
+/// </summary>
+/// <param name="filter">Handle filter</param>
+/// <param name="type">Type name</param>
+/// <returns>true if type passes</returns>
+bool HandleEnumerator::TypeMatch( const HandleFilter& filter, const std::wstring& type )
+{
+    if (filter.types.empty())
+        return true;
+
+    for (auto& name : filter.types)
+        if (_wcsicmp( name.c_str(), type.c_str() ) == 0)
+            return true;
+
+    return false;
+}
+
+/// <summary>
+/// Query names and section info for collected handles
+/// </summary>
+/// <param name="filter">Handle filter</param>
+/// <param name="jobs">Local handle copy and result index</param>
+/// <param name="result">Handles</param>
+void HandleEnumerator::QueryObjects( const HandleFilter& filter, std::vector<std::pair<HANDLE, size_t>>& jobs, std::vector<HandleInfo>& result )
+{
+    if (jobs.empty())
+        return;
+
+    auto pQueryObject = GET_IMPORT( NtQueryObject );
+    auto pQuerySection = GET_IMPORT( NtQuerySection );
+
+    size_t count = min( static_cast<size_t>(filter.workers), jobs.size() );
+    count = min( max( count, size_t( 1 ) ), size_t( MAXIMUM_WAIT_OBJECTS ) );
+    while (_workers.size() < count)
+    {
+        auto worker = std::make_unique<Worker>();
+        if (!StartWorker( *worker ))
+            break;
+
+        _workers.emplace_back( std::move( worker ) );
+    }
+
+    // Collect finished query
+    auto complete = [&]( Worker& worker )
+    {
+        auto& info = result[jobs[worker.job].second];
+
+        auto pName = reinterpret_cast<UNICODE_STRING*>(worker.buffer.get());
+        if (worker.queryName && NT_SUCCESS( worker.nameStatus ) && pName->Length)
+            info.name.assign( pName->Buffer, pName->Length / sizeof( wchar_t ) );
+
+        if (worker.querySection && NT_SUCCESS( worker.sectionStatus ))
+        {
+            info.section = std::make_shared<SectionInfo>();
+            info.section->size = worker.section.Size.QuadPart;
+            info.section->attrib = worker.section.Attributes;
+        }
+
+        worker.busy = false;
+    };
+
+    size_t next = 0, active = 0;
+    while (next < jobs.size() || active != 0)
+    {
+        // Feed idle workers
+        for (auto& worker : _workers)
+        {
+            if (worker->busy || next >= jobs.size())
+                continue;
+
+            auto& info = result[jobs[next].second];
+
+            worker->pQueryObject = pQueryObject;
+            worker->pQuerySection = pQuerySection;
+            worker->object = jobs[next].first;
+            worker->queryName = filter.names;
+            worker->querySection = _wcsicmp( info.typeName.c_str(), L"Section" ) == 0;
+            worker->job = next++;
+            worker->deadline = filter.timeout != 0 ? GetTickCount64() + filter.timeout : MAXULONG64;
+            worker->busy = true;
+
+            active++;
+            SetEvent( worker->start );
+        }
+
+        // Failed to start any worker
+        if (active == 0)
+            break;
+
+        HANDLE events[MAXIMUM_WAIT_OBJECTS] = { 0 };
+        Worker* pending[MAXIMUM_WAIT_OBJECTS] = { 0 };
+        DWORD waitCount = 0;
+        uint64_t nearest = MAXULONG64;
+
+        for (auto& worker : _workers)
+        {
+            if (!worker->busy || waitCount == MAXIMUM_WAIT_OBJECTS)
+                continue;
+
+            events[waitCount] = worker->done;
+            pending[waitCount++] = worker.get();
+            nearest = min( nearest, worker->deadline );
+        }
+
+        uint64_t now = GetTickCount64();
+        DWORD waitTime = INFINITE;
+        if (nearest != MAXULONG64)
+            waitTime = nearest > now ? static_cast<DWORD>(nearest - now) : 0;
+
+        DWORD code = WaitForMultipleObjects( waitCount, events, FALSE, waitTime );
+        if (code < WAIT_OBJECT_0 + waitCount)
+        {
+            complete( *pending[code - WAIT_OBJECT_0] );
+            active--;
+            continue;
+        }
+
+        // Replace threads stuck past deadline
+        now = GetTickCount64();
+        for (DWORD i = 0; i < waitCount; i++)
+        {
+            auto& worker = *pending[i];
+            if (WaitForSingleObject( worker.done, 0 ) == WAIT_OBJECT_0)
+            {
+                complete( worker );
+                active--;
+            }
+            else if (worker.deadline <= now)
+            {
+                TerminateThread( worker.thread, STATUS_TIMEOUT );
+                bool exited = WaitForSingleObject( worker.thread, workerExitTimeout ) == WAIT_OBJECT_0;
+
+                _timeouts++;
+                worker.busy = false;
+                active--;
+
+                // Query could have completed right before termination
+                ResetEvent( worker.start );
+                ResetEvent( worker.done );
+
+                if (!exited || !StartWorker( worker ))
+                {
+                    worker.exit = true;
+                    auto iter = std::find_if( _workers.begin(), _workers.end(), [&worker]( auto& val ) { return val.get() == &worker; } );
+
+                    // Thread that didn't exit can still access its worker, so it is left allocated
+                    if (!exited)
+                        iter->release();
+
+                    _workers.erase( iter );
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto& job : jobs)
+        CloseHandle( job.first );
+}
+
+/// <summary>
+/// Start worker thread
+/// </summary>
+/// <param name="worker">Worker</param>
+/// <returns>true on success</returns>
+bool HandleEnumerator::StartWorker( Worker& worker )
+{
+    if (!worker.start)
+        worker.start = CreateEventW( nullptr, FALSE, FALSE, nullptr );
+    if (!worker.done)
+        worker.done = CreateEventW( nullptr, FALSE, FALSE, nullptr );
+
+    if (!worker.start || !worker.done)
+        return false;
+
+    worker.exit = false;
+    worker.thread = CreateThread( nullptr, 0, &HandleEnumerator::WorkerProc, &worker, 0, nullptr );
+    return worker.thread.valid();
+}
+
+/// <summary>
+/// Worker thread routine
+/// </summary>
+/// <param name="lpParam">Worker</param>
+/// <returns>0</returns>
+DWORD CALLBACK HandleEnumerator::WorkerProc( LPVOID lpParam )
+{
+    auto& worker = *reinterpret_cast<Worker*>(lpParam);
+
+    for (;;)
+    {
+        WaitForSingleObject( worker.start, INFINITE );
+        if (worker.exit)
+            break;
+
+        worker.nameStatus = STATUS_NOT_FOUND;
+        worker.sectionStatus = STATUS_NOT_FOUND;
+
+        if (worker.queryName && worker.pQueryObject)
+        {
+            worker.nameStatus = worker.pQueryObject(
+                worker.object, ObjectNameInformation,
+                worker.buffer.get(), static_cast<ULONG>(handleNameBufSize), nullptr
+                );
+        }
+
+        if (worker.querySection && worker.pQuerySection)
+        {
+            worker.sectionStatus = static_cast<NTSTATUS>(worker.pQuerySection(
+                worker.object, SectionBasicInformation,
+                &worker.section, static_cast<ULONG>(sizeof( worker.section )), nullptr
+                ));
+        }
+
+        SetEvent( worker.done );
+    }
+
+    return 0;
+}
+
+}
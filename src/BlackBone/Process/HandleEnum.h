@@ -0,0 +1,141 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+#include "../Include/CallResult.h"
+#include "../Misc/Utils.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Section object information
+/// </summary>
+struct SectionInfo
+{
+    ptr_t size = 0;
+    uint32_t attrib = 0;
+};
+
+/// <summary>
+/// Process handle information
+/// </summary>
+struct HandleInfo
+{
+    HANDLE handle = nullptr;
+    uint32_t access = 0;
+    uint32_t flags = 0;
+    uint32_t typeIndex = 0;
+    ptr_t pObject = 0;
+
+    std::wstring typeName;
+    std::wstring name;
+
+    // Object-specific info
+    std::shared_ptr<SectionInfo> section;
+};
+
+/// <summary>
+/// Handle enumeration filter. Applied to system handle table before any per-handle work
+/// </summary>
+struct HandleFilter
+{
+    std::vector<std::wstring> types;    // Object type names, empty - any type
+    uint32_t access = 0;                // Required access bits, 0 - any access
+    bool names = true;                  // Query object names
+    uint32_t timeout = 200;             // Name query timeout, ms
+    uint32_t workers = 4;               // Name query threads
+};
+
+/// <summary>
+/// Process handle enumerator.
+/// Object type names are cached by type index, so type filter is applied without duplicating handles.
+/// Name and section queries run on dedicated threads with fixed buffers;
+/// a thread stuck in query (e.g. synchronous pipe) is terminated after timeout and replaced.
+/// </summary>
+class HandleEnumerator
+{
+public:
+    BLACKBONE_API HandleEnumerator( class ProcessCore& core );
+    BLACKBONE_API ~HandleEnumerator();
+
+    /// <summary>
+    /// Enumerate process handles
+    /// </summary>
+    /// <param name="filter">Handle filter</param>
+    /// <returns>Found handles or status code</returns>
+    BLACKBONE_API call_result_t<std::vector<HandleInfo>> Enumerate( const HandleFilter& filter = HandleFilter() );
+
+    /// <summary>
+    /// Get cached type name
+    /// </summary>
+    /// <param name="index">Object type index</param>
+    /// <returns>Type name, empty if type wasn't seen yet</returns>
+    BLACKBONE_API std::wstring typeName( uint32_t index );
+
+    /// <summary>
+    /// Stop query threads
+    /// </summary>
+    BLACKBONE_API void Reset();
+
+    BLACKBONE_API uint64_t timeouts() const { return _timeouts; }
+
+private:
+    struct Worker;
+
+    /// <summary>
+    /// Get type name from cache or by querying object
+    /// </summary>
+    /// <param name="index">Object type index</param>
+    /// <param name="hLocal">Local handle copy, used if type isn't cached</param>
+    /// <returns>Type name</returns>
+    const std::wstring* ResolveType( uint32_t index, HANDLE hLocal );
+
+    /// <summary>
+    /// Check type against filter
+    /// </summary>
+    /// <param name="filter">Handle filter</param>
+    /// <param name="type">Type name</param>
+    /// <returns>true if type passes</returns>
+    static bool TypeMatch( const HandleFilter& filter, const std::wstring& type );
+
+    /// <summary>
+    /// Query names and section info for collected handles
+    /// </summary>
+    /// <param name="filter">Handle filter</param>
+    /// <param name="jobs">Local handle copy and result index</param>
+    /// <param name="result">Handles</param>
+    void QueryObjects( const HandleFilter& filter, std::vector<std::pair<HANDLE, size_t>>& jobs, std::vector<HandleInfo>& result );
+
+    /// <summary>
+    /// Start worker thread
+    /// </summary>
+    /// <param name="worker">Worker</param>
+    /// <returns>true on success</returns>
+    static bool StartWorker( Worker& worker );
+
+    /// <summary>
+    /// Worker thread routine
+    /// </summary>
+    /// <param name="lpParam">Worker</param>
+    /// <returns>0</returns>
+    static DWORD CALLBACK WorkerProc( LPVOID lpParam );
+
+    HandleEnumerator( const HandleEnumerator& ) = delete;
+    HandleEnumerator& operator =( const HandleEnumerator& ) = delete;
+
+private:
+    class ProcessCore& _core;                       // Core process functions
+    std::map<uint32_t, std::wstring> _types;        // Type index -> name
+    std::vector<std::unique_ptr<Worker>> _workers;  // Query threads
+    std::vector<uint8_t> _buffer;                   // System handle table buffer
+    uint64_t _timeouts = 0;                         // Terminated queries
+    CriticalSection _lock;                          // Enumeration lock
+};
+
+}
@@ -0,0 +1,299 @@
+#include "LoaderSnapshot.h"
+#include "Process.h"
+#include "../Include/Macro.h"
+#include "../Misc/Trace.hpp"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+constexpr ptr_t ldrPageMask = ~static_cast<ptr_t>(0xFFF);
+
+// Upper bound of loader list length, protects from looped list
+constexpr size_t maxLdrEntries = 0x4000;
+
+LoaderSnapshot::LoaderSnapshot( Process& proc )
+    : _proc( proc )
+{
+}
+
+/// <summary>
+/// Take new snapshot and compare it with previous one. Subscribers are notified about non-empty changes
+/// </summary>
+/// <param name="type">Loader list type</param>
+/// <returns>Changes since previous snapshot</returns>
+call_result_t<LoaderDelta> LoaderSnapshot::Update( eModType type /*= mt_default*/ )
+{
+    LoaderDelta delta;
+    std::vector<std::pair<uint32_t, fnDelta>> subscribers;
+
+    {
+        CSLock lck( _lock );
+
+        type = ResolveType( type );
+        _lastReads = 0;
+
+        std::vector<ModuleDataPtr> current;
+        auto status = CALL_64_86( type == mt_mod64, Walk, current );
+        _pages.clear();
+
+        if (!NT_SUCCESS( status ))
+            return status;
+
+        delta.type = type;
+
+        auto& previous = _snapshots[type];
+        std::map<ptr_t, ModuleDataPtr> old;
+        for (auto& mod : previous)
+            old.emplace( mod->baseAddress, mod );
+
+        for (auto& mod : current)
+        {
+            auto iter = old.find( mod->baseAddress );
+            if (iter != old.end() && iter->second->ldrPtr == mod->ldrPtr && iter->second->size == mod->size && iter->second->fullPath == mod->fullPath)
+            {
+                // Keep module data identity for unchanged entries
+                mod = iter->second;
+                old.erase( iter );
+            }
+            else
+                delta.loaded.emplace_back( mod );
+        }
+
+        for (auto& mod : old)
+            delta.unloaded.emplace_back( mod.second );
+
+        previous = std::move( current );
+
+        if (!delta.empty())
+            subscribers = _subscribers;
+    }
+
+    // Subscribers take their own locks, so they are called outside of snapshot lock
+    for (auto& subscriber : subscribers)
+        subscriber.second( delta );
+
+    return delta;
+}
+
+/// <summary>
+/// Get modules from last snapshot
+/// </summary>
+/// <param name="type">Loader list type</param>
+/// <returns>Modules in load order</returns>
+std::vector<ModuleDataPtr> LoaderSnapshot::modules( eModType type /*= mt_default*/ )
+{
+    CSLock lck( _lock );
+
+    auto iter = _snapshots.find( ResolveType( type ) );
+    return iter != _snapshots.end() ? iter->second : std::vector<ModuleDataPtr>();
+}
+
+/// <summary>
+/// Check if snapshot of given list was taken
+/// </summary>
+/// <param name="type">Loader list type</param>
+/// <returns>true if snapshot exists</returns>
+bool LoaderSnapshot::valid( eModType type /*= mt_default*/ )
+{
+    CSLock lck( _lock );
+    return _snapshots.count( ResolveType( type ) ) != 0;
+}
+
+/// <summary>
+/// Register change callback
+/// </summary>
+/// <param name="callback">Callback</param>
+/// <returns>Subscription ID</returns>
+uint32_t LoaderSnapshot::Subscribe( fnDelta callback )
+{
+    CSLock lck( _lock );
+
+    auto id = _nextId++;
+    _subscribers.emplace_back( id, std::move( callback ) );
+
+    return id;
+}
+
+/// <summary>
+/// Remove change callback
+/// </summary>
+/// <param name="id">Subscription ID</param>
+void LoaderSnapshot::Unsubscribe( uint32_t id )
+{
+    CSLock lck( _lock );
+
+    _subscribers.erase(
+        std::remove_if( _subscribers.begin(), _subscribers.end(), [id]( const auto& val ) { return val.first == id; } ),
+        _subscribers.end()
+    );
+}
+
+/// <summary>
+/// Drop snapshots. Subscriptions are kept
+/// </summary>
+void LoaderSnapshot::Reset()
+{
+    CSLock lck( _lock );
+
+    _snapshots.clear();
+    _pages.clear();
+}
+
+/// <summary>
+/// Walk loader list
+/// </summary>
+/// <param name="result">Modules in load order</param>
+/// <returns>Status code</returns>
+template<typename T>
+NTSTATUS LoaderSnapshot::Walk( std::vector<ModuleDataPtr>& result )
+{
+    _PEB_T<T> peb = { };
+    _PEB_LDR_DATA2_T<T> ldr = { };
+
+    _lastReads++;
+    if (_proc.core().peb( &peb ) == 0 || peb.Ldr == 0)
+    {
+        BLACKBONE_TRACE( L"LoaderSnapshot: Failed to get PEB/LDR address. Not yet initialized" );
+        return STATUS_NOT_FOUND;
+    }
+
+    auto status = Fetch( peb.Ldr, sizeof( ldr ), &ldr );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    // Entry contains next link, so single read per entry is enough; most of them come from already read pages
+    std::vector<_LDR_DATA_TABLE_ENTRY_BASE_T<T>> entries;
+    std::vector<ptr_t> entryPtrs;
+
+    ptr_t listHead = peb.Ldr + FIELD_OFFSET( _PEB_LDR_DATA2_T<T>, InLoadOrderModuleList );
+    for (ptr_t head = ldr.InLoadOrderModuleList.Flink; head != listHead && head != 0 && entries.size() < maxLdrEntries;)
+    {
+        _LDR_DATA_TABLE_ENTRY_BASE_T<T> entry = { { 0 } };
+        if (!NT_SUCCESS( Fetch( head, sizeof( entry ), &entry ) ))
+            break;
+
+        entries.emplace_back( entry );
+        entryPtrs.emplace_back( head );
+        head = entry.InLoadOrderLinks.Flink;
+    }
+
+    // Read all names not covered by prefetched pages at once
+    std::vector<std::wstring> paths( entries.size() );
+    std::vector<MemIoVec> ops;
+    std::vector<size_t> opIndex;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        auto& name = entries[i].FullDllName;
+        paths[i].resize( name.Length / sizeof( wchar_t ) );
+        if (paths[i].empty())
+            continue;
+
+        if (Prefetched( name.Buffer, name.Length ))
+        {
+            Fetch( name.Buffer, name.Length, &paths[i][0] );
+        }
+        else
+        {
+            ops.emplace_back( name.Buffer, name.Length, &paths[i][0] );
+            opIndex.emplace_back( i );
+        }
+    }
+
+    if (!ops.empty())
+    {
+        _lastReads++;
+        _proc.memory().ReadV( ops );
+
+        for (size_t i = 0; i < ops.size(); i++)
+            if (!NT_SUCCESS( ops[i].status ))
+                paths[opIndex[i]].clear();
+    }
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        ModuleData data;
+
+        data.baseAddress = entries[i].DllBase;
+        data.size = entries[i].SizeOfImage;
+        data.fullPath = Utils::ToLower( paths[i] );
+        data.name = Utils::StripPath( data.fullPath );
+        data.type = (sizeof( T ) < sizeof( uint64_t )) ? mt_mod32 : mt_mod64;
+        data.ldrPtr = entryPtrs[i];
+        data.manual = false;
+
+        result.emplace_back( std::make_shared<const ModuleData>( data ) );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Copy remote data, reading and keeping whole pages
+/// </summary>
+/// <param name="address">Data address</param>
+/// <param name="size">Data size</param>
+/// <param name="pResult">Output buffer</param>
+/// <returns>Status code</returns>
+NTSTATUS LoaderSnapshot::Fetch( ptr_t address, size_t size, void* pResult )
+{
+    auto pOut = reinterpret_cast<uint8_t*>(pResult);
+    ptr_t end = address + size;
+
+    for (ptr_t page = address & ldrPageMask; page < end; page += 0x1000)
+    {
+        auto iter = _pages.find( page );
+        if (iter == _pages.end())
+        {
+            auto buf = std::make_unique<uint8_t[]>( 0x1000 );
+
+            _lastReads++;
+            if (!NT_SUCCESS( _proc.memory().Read( page, 0x1000, buf.get() ) ))
+            {
+                // Let exact read decide
+                _lastReads++;
+                return _proc.memory().Read( address, size, pResult );
+            }
+
+            iter = _pages.emplace( page, std::move( buf ) ).first;
+        }
+
+        ptr_t from = max( page, address );
+        ptr_t to = min( page + 0x1000, end );
+        memcpy( pOut + (from - address), iter->second.get() + (from - page), static_cast<size_t>(to - from) );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Check if range is already prefetched
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size</param>
+/// <returns>true if all range pages are present</returns>
+bool LoaderSnapshot::Prefetched( ptr_t address, size_t size ) const
+{
+    for (ptr_t page = address & ldrPageMask; page < address + size; page += 0x1000)
+        if (_pages.count( page ) == 0)
+            return false;
+
+    return true;
+}
+
+/// <summary>
+/// Resolve list type
+/// </summary>
+/// <param name="type">Requested type</param>
+/// <returns>mt_mod32 or mt_mod64</returns>
+eModType LoaderSnapshot::ResolveType( eModType type )
+{
+    if (type == mt_default)
+        type = _proc.barrier().targetWow64 ? mt_mod32 : mt_mod64;
+
+    return type;
+}
+
+}
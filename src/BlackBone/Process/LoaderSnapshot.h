@@ -0,0 +1,132 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+#include "../Include/CallResult.h"
+#include "../Misc/Utils.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Loader list changes between two snapshots
+/// </summary>
+struct LoaderDelta
+{
+    eModType type = mt_default;             // Loader list type
+    std::vector<ModuleDataPtr> loaded;      // New modules
+    std::vector<ModuleDataPtr> unloaded;    // Removed modules
+
+    inline bool empty() const { return loaded.empty() && unloaded.empty(); }
+};
+
+/// <summary>
+/// Snapshot of process loader list (InLoadOrderModuleList).
+/// Loader entries are prefetched by whole pages, so neighbouring entries cost no extra reads,
+/// and all module names are read with a single vectored read.
+/// </summary>
+class LoaderSnapshot
+{
+public:
+    using fnDelta = std::function<void( const LoaderDelta& )>;
+
+public:
+    BLACKBONE_API LoaderSnapshot( class Process& proc );
+    BLACKBONE_API ~LoaderSnapshot() = default;
+
+    /// <summary>
+    /// Take new snapshot and compare it with previous one. Subscribers are notified about non-empty changes
+    /// </summary>
+    /// <param name="type">Loader list type</param>
+    /// <returns>Changes since previous snapshot</returns>
+    BLACKBONE_API call_result_t<LoaderDelta> Update( eModType type = mt_default );
+
+    /// <summary>
+    /// Get modules from last snapshot
+    /// </summary>
+    /// <param name="type">Loader list type</param>
+    /// <returns>Modules in load order</returns>
+    BLACKBONE_API std::vector<ModuleDataPtr> modules( eModType type = mt_default );
+
+    /// <summary>
+    /// Check if snapshot of given list was taken
+    /// </summary>
+    /// <param name="type">Loader list type</param>
+    /// <returns>true if snapshot exists</returns>
+    BLACKBONE_API bool valid( eModType type = mt_default );
+
+    /// <summary>
+    /// Register change callback
+    /// </summary>
+    /// <param name="callback">Callback</param>
+    /// <returns>Subscription ID</returns>
+    BLACKBONE_API uint32_t Subscribe( fnDelta callback );
+
+    /// <summary>
+    /// Remove change callback
+    /// </summary>
+    /// <param name="id">Subscription ID</param>
+    BLACKBONE_API void Unsubscribe( uint32_t id );
+
+    /// <summary>
+    /// Drop snapshots. Subscriptions are kept
+    /// </summary>
+    BLACKBONE_API void Reset();
+
+    /// <summary>
+    /// Remote reads issued by last Update
+    /// </summary>
+    BLACKBONE_API uint32_t lastReads() const { return _lastReads; }
+
+private:
+    /// <summary>
+    /// Walk loader list
+    /// </summary>
+    /// <param name="result">Modules in load order</param>
+    /// <returns>Status code</returns>
+    template<typename T>
+    NTSTATUS Walk( std::vector<ModuleDataPtr>& result );
+
+    /// <summary>
+    /// Copy remote data, reading and keeping whole pages
+    /// </summary>
+    /// <param name="address">Data address</param>
+    /// <param name="size">Data size</param>
+    /// <param name="pResult">Output buffer</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Fetch( ptr_t address, size_t size, void* pResult );
+
+    /// <summary>
+    /// Check if range is already prefetched
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size</param>
+    /// <returns>true if all range pages are present</returns>
+    bool Prefetched( ptr_t address, size_t size ) const;
+
+    /// <summary>
+    /// Resolve list type
+    /// </summary>
+    /// <param name="type">Requested type</param>
+    /// <returns>mt_mod32 or mt_mod64</returns>
+    eModType ResolveType( eModType type );
+
+    LoaderSnapshot( const LoaderSnapshot& ) = delete;
+    LoaderSnapshot& operator =( const LoaderSnapshot& ) = delete;
+
+private:
+    class Process& _proc;                                               // Target process
+    std::map<eModType, std::vector<ModuleDataPtr>> _snapshots;          // Last snapshot per list type
+    std::map<ptr_t, std::unique_ptr<uint8_t[]>> _pages;                 // Prefetched pages of current walk
+    std::vector<std::pair<uint32_t, fnDelta>> _subscribers;             // Change callbacks
+    uint32_t _nextId = 1;                                               // Subscription ID counter
+    uint32_t _lastReads = 0;                                            // Reads made by last Update
+    CriticalSection _lock;                                              // Snapshot lock
+};
+
+}
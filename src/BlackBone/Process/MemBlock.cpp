@@ -99,13 +99,17 @@ call_result_t<MemBlock> MemBlock::Allocate(
         desired64 = 0;
         status = process.core().native()->VirtualAllocExT( desired64, size, MEM_COMMIT, finalProt );
         if (NT_SUCCESS( status ))
+        {
+            process.regions().MarkDirty( desired64, Align( size, 0x10000 ) );
             return call_result_t<MemBlock>( MemBlock( &process, desired64, size, protection, own ), STATUS_IMAGE_NOT_AT_BASE );
+        }
         else
             return status;
     }
 #ifdef _DEBUG
     BLACKBONE_TRACE(L"Allocate: Allocating at address 0x%p (0x%X bytes)", static_cast<uintptr_t>(desired64), size);
 #endif
+    process.regions().MarkDirty( desired64, Align( size, 0x10000 ) );
     return MemBlock( &process, desired64, size, protection, own );
 }
 
@@ -150,6 +154,7 @@ call_result_t<MemBlock> MemBlock::AllocateClosest(
     		if (minfo.State == MEM_FREE  &&  minfo.RegionSize >= size)
     		{
     			status = process.core().native()->VirtualAllocExT( left, size, MEM_RESERVE | MEM_COMMIT, finalProt );
+				process.regions().MarkDirty( left, Align( size, 0x10000 ) );
 				if (NT_SUCCESS( status ))
 				{
 					buf = MemBlock( &process, left, size, protection, own );
@@ -170,6 +175,7 @@ call_result_t<MemBlock> MemBlock::AllocateClosest(
     		if (minfo.State == MEM_FREE  &&  minfo.RegionSize >= size)
     		{
     			status = process.core().native()->VirtualAllocExT( right, size, MEM_RESERVE | MEM_COMMIT, finalProt );
+    			process.regions().MarkDirty( right, Align( size, 0x10000 ) );
     			if (NT_SUCCESS( status ))
     			{
     				buf = MemBlock( &process, right, size, protection, own );
@@ -216,6 +222,8 @@ call_result_t<ptr_t> MemBlock::Realloc( size_t size, ptr_t desired /*= 0*/, DWOR
         status = STATUS_IMAGE_NOT_AT_BASE;
     }
 
+    _pImpl->_memory->regions().MarkDirty( desired64, Align( size, 0x10000 ) );
+
     // Replace current instance
     if (desired64)
     {
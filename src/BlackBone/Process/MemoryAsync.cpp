@@ -0,0 +1,224 @@
+#include "MemoryAsync.h"
+#include "ProcessMemory.h"
+#include "ProcessCore.h"
+
+namespace blackbone
+{
+
+constexpr ptr_t asyncPageMask = ~static_cast<ptr_t>(0xFFF);
+
+MemoryAsync::MemoryAsync( ProcessMemory* memory )
+    : _memory( memory )
+    , _pool( 4 )
+{
+}
+
+MemoryAsync::~MemoryAsync()
+{
+    Wait();
+}
+
+/// <summary>
+/// Read data
+/// </summary>
+/// <param name="address">Memory address</param>
+/// <param name="size">Data size</param>
+/// <returns>Pending read</returns>
+AsyncRead MemoryAsync::Read( ptr_t address, size_t size )
+{
+    if (address == 0 || size == 0)
+    {
+        std::promise<AsyncPageBlock> failed;
+        AsyncPageBlock block;
+        block.address = address;
+        block.status = address == 0 ? STATUS_INVALID_ADDRESS : STATUS_INVALID_PARAMETER;
+        failed.set_value( std::move( block ) );
+
+        return AsyncRead( failed.get_future().share(), address, 0 );
+    }
+
+    ptr_t first = address & asyncPageMask;
+    ptr_t end = (address + size + 0xFFF) & asyncPageMask;
+
+    CSLock lck( _lock );
+    _stats.reads++;
+
+    // Same pages are already being read. Pending read is either issued after
+    // every overlapping pending write or was dropped from the list by that write
+    auto iter = _reads.upper_bound( first );
+    if (iter != _reads.begin() && (--iter)->second.end >= end)
+    {
+        _stats.shared++;
+        return AsyncRead( iter->second.block, address, size );
+    }
+
+    uint64_t id = ++_nextId;
+    auto writes = PendingWrites( first, end );
+    auto block = _pool.Submit( [this, first, end, id, writes = std::move( writes )]()
+    {
+        for (auto& write : writes)
+            write.wait();
+
+        AsyncPageBlock block;
+        block.address = first;
+        block.data.resize( static_cast<size_t>(end - first) );
+        block.status = _memory->core().native()->ReadProcessMemoryT( first, block.data.data(), block.data.size() );
+
+        CSLock lck( _lock );
+        auto iter = _reads.find( first );
+        if (iter != _reads.end() && iter->second.id == id)
+            _reads.erase( iter );
+
+        return block;
+    } ).share();
+
+    _reads[first] = PendingRead{ end, id, block };
+    return AsyncRead( block, address, size );
+}
+
+/// <summary>
+/// Write data. Data is copied, so buffer may be released right away
+/// </summary>
+/// <param name="address">Memory address</param>
+/// <param name="size">Data size</param>
+/// <param name="data">Data to write</param>
+/// <returns>Write status</returns>
+std::shared_future<NTSTATUS> MemoryAsync::Write( ptr_t address, size_t size, const void* data )
+{
+    if (address == 0)
+    {
+        std::promise<NTSTATUS> failed;
+        failed.set_value( STATUS_INVALID_ADDRESS );
+        return failed.get_future().share();
+    }
+
+    ptr_t first = address & asyncPageMask;
+    ptr_t end = (address + size + 0xFFF) & asyncPageMask;
+
+    CSLock lck( _lock );
+    _stats.writes++;
+
+    // Reads issued before this write must not see written data,
+    // reads issued after it must not share data read before it
+    std::vector<std::shared_future<AsyncPageBlock>> reads;
+    for (auto iter = _reads.begin(); iter != _reads.end();)
+    {
+        if (iter->first < end && iter->second.end > first)
+        {
+            reads.emplace_back( iter->second.block );
+            iter = _reads.erase( iter );
+        }
+        else
+            ++iter;
+    }
+
+    uint64_t id = ++_nextId;
+    auto writes = PendingWrites( first, end );
+
+    std::vector<uint8_t> buf( reinterpret_cast<const uint8_t*>(data), reinterpret_cast<const uint8_t*>(data) + size );
+    auto result = _pool.Submit( [this, address, id, buf = std::move( buf ), reads = std::move( reads ), writes = std::move( writes )]()
+    {
+        for (auto& read : reads)
+            read.wait();
+        for (auto& write : writes)
+            write.wait();
+
+        auto status = _memory->core().native()->WriteProcessMemoryT( address, buf.data(), buf.size() );
+        if (NT_SUCCESS( status ))
+            _memory->cache().Update( address, buf.size(), buf.data() );
+
+        CSLock lck( _lock );
+        _writes.erase( id );
+
+        return status;
+    } ).share();
+
+    _writes.emplace( id, PendingWrite{ first, end, result } );
+    return result;
+}
+
+/// <summary>
+/// Get memory region info
+/// </summary>
+/// <param name="address">Memory address</param>
+/// <returns>Region info</returns>
+std::shared_future<call_result_t<MEMORY_BASIC_INFORMATION64>> MemoryAsync::Query( ptr_t address )
+{
+    ptr_t page = address & asyncPageMask;
+
+    CSLock lck( _lock );
+    _stats.queries++;
+
+    auto iter = _queries.find( page );
+    if (iter != _queries.end())
+    {
+        _stats.shared++;
+        return iter->second;
+    }
+
+    auto result = _pool.Submit( [this, page]() -> call_result_t<MEMORY_BASIC_INFORMATION64>
+    {
+        MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+        auto status = _memory->core().native()->VirtualQueryExT( page, &mbi );
+
+        {
+            CSLock lck( _lock );
+            _queries.erase( page );
+        }
+
+        if (!NT_SUCCESS( status ))
+            return status;
+
+        return mbi;
+    } ).share();
+
+    _queries.emplace( page, result );
+    return result;
+}
+
+/// <summary>
+/// Wait until all pending requests are finished
+/// </summary>
+void MemoryAsync::Wait()
+{
+    _pool.Wait();
+}
+
+/// <summary>
+/// Get counters
+/// </summary>
+/// <returns>Counters snapshot</returns>
+MemoryAsyncStats MemoryAsync::stats()
+{
+    CSLock lck( _lock );
+    return _stats;
+}
+
+/// <summary>
+/// Reset counters
+/// </summary>
+void MemoryAsync::resetStats()
+{
+    CSLock lck( _lock );
+    _stats = MemoryAsyncStats();
+}
+
+/// <summary>
+/// Get pending writes that overlap page range. Must be called under lock.
+/// Pool runs tasks in FIFO order, so task waiting for earlier requests
+/// only waits for tasks that are already running on other workers
+/// </summary>
+/// <param name="first">First page</param>
+/// <param name="end">Page range end</param>
+/// <returns>Pending write results</returns>
+std::vector<std::shared_future<NTSTATUS>> MemoryAsync::PendingWrites( ptr_t first, ptr_t end ) const
+{
+    std::vector<std::shared_future<NTSTATUS>> writes;
+    for (auto& write : _writes)
+        if (write.second.first < end && write.second.end > first)
+            writes.emplace_back( write.second.status );
+
+    return writes;
+}
+
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+#include "../Include/CallResult.h"
+#include "../Misc/Utils.h"
+#include "../Misc/ThreadPool.h"
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Page-aligned data read by async worker
+/// </summary>
+struct AsyncPageBlock
+{
+    ptr_t address = 0;                      // First page address
+    NTSTATUS status = STATUS_UNSUCCESSFUL;  // Read status
+    std::vector<uint8_t> data;              // Page data
+};
+
+/// <summary>
+/// Pending asynchronous read.
+/// Several reads of the same pages share single page block.
+/// </summary>
+class AsyncRead
+{
+public:
+    BLACKBONE_API AsyncRead() = default;
+    BLACKBONE_API AsyncRead( std::shared_future<AsyncPageBlock> block, ptr_t address, size_t size )
+        : _block( std::move( block ) )
+        , _address( address )
+        , _size( size ) { }
+
+    BLACKBONE_API inline bool valid() const { return _block.valid(); }
+    BLACKBONE_API inline bool ready() const { return wait_for( 0 ); }
+    BLACKBONE_API inline void wait() const { _block.wait(); }
+
+    /// <summary>
+    /// Wait for completion
+    /// </summary>
+    /// <param name="ms">Timeout in milliseconds</param>
+    /// <returns>true if read is finished</returns>
+    BLACKBONE_API inline bool wait_for( uint32_t ms ) const
+    {
+        return _block.wait_for( std::chrono::milliseconds( ms ) ) == std::future_status::ready;
+    }
+
+    /// <summary>
+    /// Wait for completion and copy data
+    /// </summary>
+    /// <param name="pResult">Output buffer</param>
+    /// <returns>Read status</returns>
+    BLACKBONE_API inline NTSTATUS get( void* pResult ) const
+    {
+        auto& block = _block.get();
+        if (NT_SUCCESS( block.status ))
+            memcpy( pResult, block.data.data() + (_address - block.address), _size );
+
+        return block.status;
+    }
+
+    /// <summary>
+    /// Wait for completion and get data
+    /// </summary>
+    /// <returns>Read data</returns>
+    BLACKBONE_API inline call_result_t<std::vector<uint8_t>> get() const
+    {
+        std::vector<uint8_t> data( _size );
+        auto status = get( data.data() );
+        if (!NT_SUCCESS( status ))
+            return status;
+
+        return data;
+    }
+
+    /// <summary>
+    /// Wait for completion and get data
+    /// </summary>
+    /// <returns>Read value</returns>
+    template<typename T>
+    inline call_result_t<T> get_as() const
+    {
+        T data;
+        auto status = _size >= sizeof( T ) ? get( &data ) : STATUS_INVALID_PARAMETER;
+        if (!NT_SUCCESS( status ))
+            return status;
+
+        return data;
+    }
+
+private:
+    std::shared_future<AsyncPageBlock> _block;  // Shared page block
+    ptr_t _address = 0;                         // Requested address
+    size_t _size = 0;                           // Requested size
+};
+
+/// <summary>
+/// Async request counters
+/// </summary>
+struct MemoryAsyncStats
+{
+    uint64_t reads = 0;         // Read requests
+    uint64_t writes = 0;        // Write requests
+    uint64_t queries = 0;       // Query requests
+    uint64_t shared = 0;        // Requests served by already pending operation
+};
+
+/// <summary>
+/// Asynchronous memory operations.
+/// Native calls are made by local worker pool, so independent requests overlap each other and caller's work.
+/// Reads are done by whole pages; reads and queries of pages that are already pending are not issued again.
+/// Reads and writes touching the same pages are executed in request order.
+/// </summary>
+class MemoryAsync
+{
+public:
+    BLACKBONE_API MemoryAsync( class ProcessMemory* memory );
+    BLACKBONE_API ~MemoryAsync();
+
+    /// <summary>
+    /// Read data
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <param name="size">Data size</param>
+    /// <returns>Pending read</returns>
+    BLACKBONE_API AsyncRead Read( ptr_t address, size_t size );
+
+    /// <summary>
+    /// Write data. Data is copied, so buffer may be released right away
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <param name="size">Data size</param>
+    /// <param name="data">Data to write</param>
+    /// <returns>Write status</returns>
+    BLACKBONE_API std::shared_future<NTSTATUS> Write( ptr_t address, size_t size, const void* data );
+
+    /// <summary>
+    /// Get memory region info
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <returns>Region info</returns>
+    BLACKBONE_API std::shared_future<call_result_t<MEMORY_BASIC_INFORMATION64>> Query( ptr_t address );
+
+    /// <summary>
+    /// Wait until all pending requests are finished
+    /// </summary>
+    BLACKBONE_API void Wait();
+
+    /// <summary>
+    /// Set number of worker threads. Waits for pending requests
+    /// </summary>
+    /// <param name="threads">Number of workers, 0 - number of logical CPUs</param>
+    BLACKBONE_API void workers( size_t threads ) { _pool.Resize( threads ); }
+
+    /// <summary>
+    /// Get counters
+    /// </summary>
+    /// <returns>Counters snapshot</returns>
+    BLACKBONE_API MemoryAsyncStats stats();
+
+    /// <summary>
+    /// Reset counters
+    /// </summary>
+    BLACKBONE_API void resetStats();
+
+    BLACKBONE_API size_t workers() const { return _pool.size(); }
+
+private:
+    /// <summary>
+    /// Pending page read
+    /// </summary>
+    struct PendingRead
+    {
+        ptr_t end;                                  // Page range end
+        uint64_t id;                                // Request ID
+        std::shared_future<AsyncPageBlock> block;   // Result
+    };
+
+    /// <summary>
+    /// Pending write
+    /// </summary>
+    struct PendingWrite
+    {
+        ptr_t first;                                // First page
+        ptr_t end;                                  // Page range end
+        std::shared_future<NTSTATUS> status;        // Result
+    };
+
+    /// <summary>
+    /// Get pending writes that overlap page range. Must be called under lock
+    /// </summary>
+    /// <param name="first">First page</param>
+    /// <param name="end">Page range end</param>
+    /// <returns>Pending write results</returns>
+    std::vector<std::shared_future<NTSTATUS>> PendingWrites( ptr_t first, ptr_t end ) const;
+
+    MemoryAsync( const MemoryAsync& ) = delete;
+    MemoryAsync& operator =( const MemoryAsync& ) = delete;
+
+private:
+    class ProcessMemory* _memory;               // Process memory routines
+    std::map<ptr_t, PendingRead> _reads;        // Pending reads, keyed by first page
+    std::map<uint64_t, PendingWrite> _writes;   // Pending writes, keyed by request ID
+    std::map<ptr_t, std::shared_future<call_result_t<MEMORY_BASIC_INFORMATION64>>> _queries;    // Pending queries, keyed by page
+    uint64_t _nextId = 0;                       // Request ID counter
+    MemoryAsyncStats _stats;                    // Counters
+    CriticalSection _lock;                      // Pending request lock
+    ThreadPool _pool;                           // Workers
+};
+
+}
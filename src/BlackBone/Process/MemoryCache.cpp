@@ -0,0 +1,275 @@
+#include "MemoryCache.h"
+
+namespace blackbone
+{
+
+/// <summary>
+/// Enable caching
+/// </summary>
+/// <param name="budget">Max cached data size in bytes</param>
+void MemoryCache::Enable( size_t budget /*= 4 * 1024 * 1024*/ )
+{
+    CSLock lck( _lock );
+
+    _maxPages = max( budget / pageSize, static_cast<size_t>(1) );
+    while (_lru.size() > _maxPages)
+    {
+        _index.erase( _lru.back().address );
+        _lru.pop_back();
+    }
+}
+
+/// <summary>
+/// Disable caching and release all pages
+/// </summary>
+void MemoryCache::Disable()
+{
+    CSLock lck( _lock );
+
+    _maxPages = 0;
+    _lru.clear();
+    _index.clear();
+}
+
+/// <summary>
+/// Release all pages and volatile ranges, keeping cache budget.
+/// Used when owning object is re-attached to another process
+/// </summary>
+void MemoryCache::Clear()
+{
+    CSLock lck( _lock );
+
+    _lru.clear();
+    _index.clear();
+    _volatile.clear();
+    _epoch++;
+}
+
+/// <summary>
+/// Start new epoch. All pages cached before this call are considered stale
+/// </summary>
+void MemoryCache::BeginEpoch()
+{
+    CSLock lck( _lock );
+    _epoch++;
+}
+
+/// <summary>
+/// Drop cached pages in range
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size</param>
+void MemoryCache::Invalidate( ptr_t address, size_t size )
+{
+    CSLock lck( _lock );
+    if (_index.empty() || size == 0)
+        return;
+
+    ptr_t first = address & pageMask;
+    ptr_t last = (address + size - 1) & pageMask;
+
+    // Huge range, cheaper to check every cached page
+    if ((last - first) / pageSize >= _index.size())
+    {
+        for (auto iter = _lru.begin(); iter != _lru.end();)
+        {
+            if (iter->address >= first && iter->address <= last)
+            {
+                _index.erase( iter->address );
+                iter = _lru.erase( iter );
+            }
+            else
+                ++iter;
+        }
+
+        return;
+    }
+
+    for (ptr_t page = first; page <= last; page += pageSize)
+    {
+        auto iter = _index.find( page );
+        if (iter != _index.end())
+        {
+            _lru.erase( iter->second );
+            _index.erase( iter );
+        }
+    }
+}
+
+/// <summary>
+/// Mark range as volatile. Reads touching volatile range are never cached
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size</param>
+void MemoryCache::AddVolatile( ptr_t address, size_t size )
+{
+    CSLock lck( _lock );
+    _volatile[address] = address + size;
+}
+
+/// <summary>
+/// Remove volatile range
+/// </summary>
+/// <param name="address">Range start, as passed to AddVolatile</param>
+void MemoryCache::RemoveVolatile( ptr_t address )
+{
+    CSLock lck( _lock );
+    _volatile.erase( address );
+}
+
+/// <summary>
+/// Check if read of given range should go through cache
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size</param>
+/// <returns>true if range can be cached</returns>
+bool MemoryCache::Cacheable( ptr_t address, size_t size )
+{
+    CSLock lck( _lock );
+    if (_maxPages == 0)
+        return false;
+
+    // Large reads would only flush useful pages
+    bool cacheable = size != 0 && size <= budget() / 4;
+
+    // Volatile ranges are few, linear scan is fine
+    for (auto iter = _volatile.begin(); cacheable && iter != _volatile.end() && iter->first < address + size; ++iter)
+    {
+        if (iter->second > address)
+            cacheable = false;
+    }
+
+    if (!cacheable)
+        _stats.bypassed++;
+
+    return cacheable;
+}
+
+/// <summary>
+/// Copy data from cached page
+/// </summary>
+/// <param name="page">Page address</param>
+/// <param name="offset">Offset inside page</param>
+/// <param name="size">Data size, must not cross page boundary</param>
+/// <param name="pResult">Output buffer</param>
+/// <returns>false if page isn't cached</returns>
+bool MemoryCache::Fetch( ptr_t page, size_t offset, size_t size, void* pResult )
+{
+    CSLock lck( _lock );
+
+    auto iter = Find( page );
+    if (iter == _lru.end())
+        return false;
+
+    _lru.splice( _lru.begin(), _lru, iter );
+    memcpy( pResult, iter->data.get() + offset, size );
+
+    _stats.hits++;
+    return true;
+}
+
+/// <summary>
+/// Check if page is cached in current epoch without touching LRU order or counters
+/// </summary>
+/// <param name="page">Page address</param>
+/// <returns>true if cached</returns>
+bool MemoryCache::Contains( ptr_t page )
+{
+    CSLock lck( _lock );
+    return Find( page ) != _lru.end();
+}
+
+/// <summary>
+/// Store pages
+/// </summary>
+/// <param name="page">First page address</param>
+/// <param name="count">Number of pages</param>
+/// <param name="data">Page data</param>
+void MemoryCache::Insert( ptr_t page, size_t count, const uint8_t* data )
+{
+    CSLock lck( _lock );
+    if (_maxPages == 0)
+        return;
+
+    _stats.misses += count;
+    for (size_t i = 0; i < count; i++, page += pageSize, data += pageSize)
+    {
+        auto iter = _index.find( page );
+        if (iter != _index.end())
+        {
+            _lru.splice( _lru.begin(), _lru, iter->second );
+        }
+        else
+        {
+            // Reuse least recently used page buffer
+            if (_lru.size() >= _maxPages)
+            {
+                _index.erase( _lru.back().address );
+                _lru.splice( _lru.begin(), _lru, std::prev( _lru.end() ) );
+                _stats.evictions++;
+            }
+            else
+            {
+                _lru.emplace_front( Page{ 0, 0, std::make_unique<uint8_t[]>( pageSize ) } );
+            }
+
+            _index[page] = _lru.begin();
+        }
+
+        auto& entry = _lru.front();
+        entry.address = page;
+        entry.epoch = _epoch;
+        memcpy( entry.data.get(), data, pageSize );
+    }
+}
+
+/// <summary>
+/// Apply written data to cached pages
+/// </summary>
+/// <param name="address">Write address</param>
+/// <param name="size">Write size</param>
+/// <param name="data">Written data</param>
+void MemoryCache::Update( ptr_t address, size_t size, const void* data )
+{
+    CSLock lck( _lock );
+    if (_index.empty())
+        return;
+
+    auto src = reinterpret_cast<const uint8_t*>(data);
+    for (ptr_t ptr = address; ptr < address + size;)
+    {
+        ptr_t page = ptr & pageMask;
+        size_t offset = static_cast<size_t>(ptr - page);
+        size_t chunk = static_cast<size_t>(min( static_cast<ptr_t>(pageSize - offset), address + size - ptr ));
+
+        auto iter = Find( page );
+        if (iter != _lru.end())
+            memcpy( iter->data.get() + offset, src + (ptr - address), chunk );
+
+        ptr += chunk;
+    }
+}
+
+/// <summary>
+/// Get cached page of current epoch
+/// </summary>
+/// <param name="page">Page address</param>
+/// <returns>Page iterator, _lru.end() if not found</returns>
+MemoryCache::PageList::iterator MemoryCache::Find( ptr_t page )
+{
+    auto iter = _index.find( page );
+    if (iter == _index.end())
+        return _lru.end();
+
+    // Stale page
+    if (iter->second->epoch != _epoch)
+    {
+        _lru.erase( iter->second );
+        _index.erase( iter );
+        return _lru.end();
+    }
+
+    return iter->second;
+}
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+#include "../Misc/Utils.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Page cache counters
+/// </summary>
+struct MemoryCacheStats
+{
+    uint64_t hits = 0;          // Pages served from cache
+    uint64_t misses = 0;        // Pages read from target process into cache
+    uint64_t evictions = 0;     // Pages dropped due to budget limit
+    uint64_t bypassed = 0;      // Reads that skipped cache
+};
+
+/// <summary>
+/// Page-granular LRU cache of remote memory.
+/// Target process may change its memory at any time, so cached data is valid only until
+/// next BeginEpoch() call. Ranges that are changed constantly should be marked volatile.
+/// </summary>
+class MemoryCache
+{
+public:
+    static constexpr size_t pageSize = 0x1000;
+    static constexpr ptr_t pageMask = ~static_cast<ptr_t>(pageSize - 1);
+
+public:
+    BLACKBONE_API MemoryCache() = default;
+    BLACKBONE_API ~MemoryCache() = default;
+
+    /// <summary>
+    /// Enable caching
+    /// </summary>
+    /// <param name="budget">Max cached data size in bytes</param>
+    BLACKBONE_API void Enable( size_t budget = 4 * 1024 * 1024 );
+
+    /// <summary>
+    /// Disable caching and release all pages
+    /// </summary>
+    BLACKBONE_API void Disable();
+
+    /// <summary>
+    /// Release all pages and volatile ranges, keeping cache budget
+    /// </summary>
+    BLACKBONE_API void Clear();
+
+    /// <summary>
+    /// Start new epoch. All pages cached before this call are considered stale
+    /// </summary>
+    BLACKBONE_API void BeginEpoch();
+
+    /// <summary>
+    /// Drop cached pages in range
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size</param>
+    BLACKBONE_API void Invalidate( ptr_t address, size_t size );
+
+    /// <summary>
+    /// Mark range as volatile. Reads touching volatile range are never cached
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size</param>
+    BLACKBONE_API void AddVolatile( ptr_t address, size_t size );
+
+    /// <summary>
+    /// Remove volatile range
+    /// </summary>
+    /// <param name="address">Range start, as passed to AddVolatile</param>
+    BLACKBONE_API void RemoveVolatile( ptr_t address );
+
+    /// <summary>
+    /// Check if read of given range should go through cache
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size</param>
+    /// <returns>true if range can be cached</returns>
+    BLACKBONE_API bool Cacheable( ptr_t address, size_t size );
+
+    /// <summary>
+    /// Copy data from cached page
+    /// </summary>
+    /// <param name="page">Page address</param>
+    /// <param name="offset">Offset inside page</param>
+    /// <param name="size">Data size, must not cross page boundary</param>
+    /// <param name="pResult">Output buffer</param>
+    /// <returns>false if page isn't cached</returns>
+    BLACKBONE_API bool Fetch( ptr_t page, size_t offset, size_t size, void* pResult );
+
+    /// <summary>
+    /// Check if page is cached in current epoch without touching LRU order or counters
+    /// </summary>
+    /// <param name="page">Page address</param>
+    /// <returns>true if cached</returns>
+    BLACKBONE_API bool Contains( ptr_t page );
+
+    /// <summary>
+    /// Store pages
+    /// </summary>
+    /// <param name="page">First page address</param>
+    /// <param name="count">Number of pages</param>
+    /// <param name="data">Page data</param>
+    BLACKBONE_API void Insert( ptr_t page, size_t count, const uint8_t* data );
+
+    /// <summary>
+    /// Apply written data to cached pages
+    /// </summary>
+    /// <param name="address">Write address</param>
+    /// <param name="size">Write size</param>
+    /// <param name="data">Written data</param>
+    BLACKBONE_API void Update( ptr_t address, size_t size, const void* data );
+
+    BLACKBONE_API inline bool enabled() const { return _maxPages != 0; }
+    BLACKBONE_API inline size_t budget() const { return _maxPages * pageSize; }
+    BLACKBONE_API inline uint64_t epoch() const { return _epoch; }
+    BLACKBONE_API inline const MemoryCacheStats& stats() const { return _stats; }
+    BLACKBONE_API inline void resetStats() { _stats = MemoryCacheStats(); }
+
+private:
+    struct Page
+    {
+        ptr_t address;
+        uint64_t epoch;
+        std::unique_ptr<uint8_t[]> data;
+    };
+
+    using PageList = std::list<Page>;
+
+    /// <summary>
+    /// Get cached page of current epoch
+    /// </summary>
+    /// <param name="page">Page address</param>
+    /// <returns>Page iterator, _lru.end() if not found</returns>
+    PageList::iterator Find( ptr_t page );
+
+    MemoryCache( const MemoryCache& ) = delete;
+    MemoryCache& operator =( const MemoryCache& ) = delete;
+
+private:
+    PageList _lru;                                          // Pages, most recently used first
+    std::unordered_map<ptr_t, PageList::iterator> _index;   // Page address -> LRU entry
+    std::map<ptr_t, ptr_t> _volatile;                       // Volatile ranges, start -> end
+    size_t _maxPages = 0;                                   // Budget in pages, 0 if disabled
+    uint64_t _epoch = 0;                                    // Current epoch
+    MemoryCacheStats _stats;                                // Counters
+    CriticalSection _lock;                                  // Cache lock
+};
+
+}
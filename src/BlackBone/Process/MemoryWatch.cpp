@@ -0,0 +1,365 @@
+#include "MemoryWatch.h"
+#include "ProcessMemory.h"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+constexpr ptr_t watchPageMask = ~static_cast<ptr_t>(0xFFF);
+
+constexpr uint64_t prime1 = 11400714785074694791ull;
+constexpr uint64_t prime2 = 14029467366897019727ull;
+constexpr uint64_t prime3 = 1609587929392839161ull;
+constexpr uint64_t prime4 = 9650029242287828579ull;
+constexpr uint64_t prime5 = 2870177450012600261ull;
+
+inline uint64_t Rotl64( uint64_t value, int shift )
+{
+    return (value << shift) | (value >> (64 - shift));
+}
+
+inline uint64_t Load64( const uint8_t* ptr )
+{
+    uint64_t value;
+    memcpy( &value, ptr, sizeof( value ) );
+    return value;
+}
+
+inline uint32_t Load32( const uint8_t* ptr )
+{
+    uint32_t value;
+    memcpy( &value, ptr, sizeof( value ) );
+    return value;
+}
+
+inline uint64_t HashRound( uint64_t acc, uint64_t input )
+{
+    acc += input * prime2;
+    acc = Rotl64( acc, 31 );
+    return acc * prime1;
+}
+
+inline uint64_t HashMerge( uint64_t acc, uint64_t value )
+{
+    acc ^= HashRound( 0, value );
+    return acc * prime1 + prime4;
+}
+
+/// <summary>
+/// Find changed byte spans
+/// </summary>
+/// <param name="prev">Old data</param>
+/// <param name="cur">New data</param>
+/// <param name="size">Data size</param>
+/// <param name="base">Data address</param>
+/// <param name="spans">Found spans</param>
+static void DiffSpans( const uint8_t* prev, const uint8_t* cur, size_t size, ptr_t base, std::vector<std::pair<ptr_t, size_t>>& spans )
+{
+    for (size_t i = 0; i < size;)
+    {
+        // Skip identical qwords
+        while (i + sizeof( uint64_t ) <= size && Load64( prev + i ) == Load64( cur + i ))
+            i += sizeof( uint64_t );
+
+        while (i < size && prev[i] == cur[i])
+            i++;
+
+        if (i >= size)
+            break;
+
+        size_t start = i;
+        while (i < size && prev[i] != cur[i])
+            i++;
+
+        spans.emplace_back( base + start, i - start );
+    }
+}
+
+MemoryWatch::MemoryWatch( ProcessMemory* memory )
+    : _memory( memory )
+{
+}
+
+/// <summary>
+/// Start watching range. Baseline is taken on first poll
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size</param>
+/// <param name="intervalMs">Poll interval</param>
+/// <param name="diffSpans">Keep shadow copy to report exact changed bytes</param>
+/// <returns>Watch ID, 0 on failure</returns>
+uint32_t MemoryWatch::Add( ptr_t address, size_t size, uint32_t intervalMs /*= 50*/, bool diffSpans /*= false*/ )
+{
+    if (address == 0 || size == 0)
+        return 0;
+
+    size_t pages = static_cast<size_t>((((address + size - 1) & watchPageMask) - (address & watchPageMask)) / 0x1000 + 1);
+
+    Range range;
+    range.address = address;
+    range.size = size;
+    range.interval = intervalMs;
+    range.diffSpans = diffSpans;
+    range.hashes.assign( pages, 0 );
+    range.valid.assign( pages, false );
+    if (diffSpans)
+        range.shadow.resize( size );
+
+    CSLock lck( _lock );
+
+    uint32_t id = _nextId++;
+    _ranges.emplace( id, std::move( range ) );
+
+    return id;
+}
+
+/// <summary>
+/// Stop watching range
+/// </summary>
+/// <param name="id">Watch ID</param>
+/// <returns>false if not found</returns>
+bool MemoryWatch::Remove( uint32_t id )
+{
+    CSLock lck( _lock );
+    return _ranges.erase( id ) != 0;
+}
+
+/// <summary>
+/// Remove all watches
+/// </summary>
+void MemoryWatch::Clear()
+{
+    CSLock lck( _lock );
+
+    _ranges.clear();
+    _cursor = 0;
+}
+
+/// <summary>
+/// Read ranges that are due and report changed pages.
+/// At most pageBudget() pages are processed per call, remaining ranges are polled next time.
+/// </summary>
+/// <param name="force">Ignore poll intervals</param>
+/// <returns>Changed pages</returns>
+std::vector<MemoryWatchChange> MemoryWatch::Poll( bool force /*= false*/ )
+{
+    std::vector<MemoryWatchChange> changes;
+
+    CSLock lck( _lock );
+    if (_ranges.empty())
+        return changes;
+
+    // Select due ranges, starting where previous budget-limited poll stopped
+    uint64_t now = GetTickCount64();
+    std::vector<std::pair<uint32_t, Range*>> due;
+    size_t pages = 0;
+
+    auto start = _ranges.lower_bound( _cursor );
+    auto iter = start;
+    _cursor = 0;
+
+    do
+    {
+        if (iter == _ranges.end())
+            iter = _ranges.begin();
+
+        auto& range = iter->second;
+        if (force || range.due <= now)
+        {
+            if (_pageBudget != 0 && !due.empty() && pages + range.hashes.size() > _pageBudget)
+            {
+                _stats.deferred++;
+                _cursor = iter->first;
+                break;
+            }
+
+            pages += range.hashes.size();
+            due.emplace_back( iter->first, &range );
+        }
+
+        ++iter;
+    } while (iter != start && !(iter == _ranges.end() && start == _ranges.begin()));
+
+    std::sort( due.begin(), due.end(), []( const auto& l, const auto& r ) { return l.second->address < r.second->address; } );
+
+    // Read nearby ranges at once
+    std::vector<uint8_t> buf;
+    std::vector<bool> spanValid, rangeValid;
+    size_t gap = _memory->ioMergeGap();
+
+    for (size_t first = 0; first < due.size();)
+    {
+        ptr_t spanStart = due[first].second->address;
+        ptr_t spanEnd = spanStart + due[first].second->size;
+
+        size_t last = first + 1;
+        for (; last < due.size() && due[last].second->address <= spanEnd + gap; last++)
+            spanEnd = max( spanEnd, due[last].second->address + due[last].second->size );
+
+        buf.resize( static_cast<size_t>(spanEnd - spanStart) );
+        _memory->ReadSparse( spanStart, buf.size(), buf.data(), spanValid );
+
+        for (size_t i = first; i < last; i++)
+        {
+            auto& range = *due[i].second;
+            size_t pageIdx = static_cast<size_t>(((range.address & watchPageMask) - (spanStart & watchPageMask)) / 0x1000);
+
+            rangeValid.assign( spanValid.begin() + pageIdx, spanValid.begin() + pageIdx + range.hashes.size() );
+            Update( due[i].first, range, buf.data() + (range.address - spanStart), rangeValid, changes );
+
+            range.due = now + range.interval;
+            _stats.polls++;
+        }
+
+        first = last;
+    }
+
+    return changes;
+}
+
+/// <summary>
+/// Get time until next range is due
+/// </summary>
+/// <returns>Time in milliseconds, INFINITE if nothing is watched</returns>
+uint32_t MemoryWatch::nextDue()
+{
+    CSLock lck( _lock );
+    if (_ranges.empty())
+        return INFINITE;
+
+    uint64_t now = GetTickCount64();
+    uint64_t next = UINT64_MAX;
+    for (auto& range : _ranges)
+        next = min( next, range.second.due );
+
+    return next <= now ? 0 : static_cast<uint32_t>(next - now);
+}
+
+/// <summary>
+/// Compare new range data with stored state
+/// </summary>
+/// <param name="id">Watch ID</param>
+/// <param name="range">Range</param>
+/// <param name="data">Range data</param>
+/// <param name="valid">Readable pages of range</param>
+/// <param name="changes">Changed pages</param>
+void MemoryWatch::Update( uint32_t id, Range& range, const uint8_t* data, const std::vector<bool>& valid, std::vector<MemoryWatchChange>& changes )
+{
+    ptr_t firstPage = range.address & watchPageMask;
+    ptr_t end = range.address + range.size;
+
+    for (size_t i = 0; i < range.hashes.size(); i++)
+    {
+        ptr_t page = firstPage + i * 0x1000;
+        ptr_t from = max( page, range.address );
+        ptr_t to = min( page + 0x1000, end );
+        size_t offset = static_cast<size_t>(from - range.address);
+        size_t size = static_cast<size_t>(to - from);
+
+        uint64_t hash = valid[i] ? Hash( data + offset, size ) : 0;
+        _stats.pages++;
+
+        if (range.primed && hash == range.hashes[i] && valid[i] == range.valid[i])
+            continue;
+
+        if (range.primed)
+        {
+            MemoryWatchChange change;
+            change.id = id;
+            change.page = page;
+            change.readable = valid[i];
+
+            if (range.diffSpans && valid[i] && range.valid[i])
+                DiffSpans( range.shadow.data() + offset, data + offset, size, from, change.spans );
+            else
+                change.spans.emplace_back( from, size );
+
+            _stats.changed++;
+            changes.emplace_back( std::move( change ) );
+
+            // Cached copy is outdated as well
+            _memory->cache().Invalidate( page, 0x1000 );
+        }
+
+        if (range.diffSpans)
+            memcpy( range.shadow.data() + offset, data + offset, size );
+
+        range.hashes[i] = hash;
+        range.valid[i] = valid[i];
+    }
+
+    range.primed = true;
+}
+
+/// <summary>
+/// 64-bit data hash (XXH64).
+/// Four independent accumulators keep the main loop free of dependency chains.
+/// </summary>
+/// <param name="data">Data</param>
+/// <param name="size">Data size</param>
+/// <param name="seed">Hash seed</param>
+/// <returns>Hash value</returns>
+uint64_t MemoryWatch::Hash( const void* data, size_t size, uint64_t seed /*= 0*/ )
+{
+    auto ptr = reinterpret_cast<const uint8_t*>(data);
+    auto end = ptr + size;
+    uint64_t hash = 0;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+
+        for (; ptr + 32 <= end; ptr += 32)
+        {
+            v1 = HashRound( v1, Load64( ptr ) );
+            v2 = HashRound( v2, Load64( ptr + 8 ) );
+            v3 = HashRound( v3, Load64( ptr + 16 ) );
+            v4 = HashRound( v4, Load64( ptr + 24 ) );
+        }
+
+        hash = Rotl64( v1, 1 ) + Rotl64( v2, 7 ) + Rotl64( v3, 12 ) + Rotl64( v4, 18 );
+        hash = HashMerge( hash, v1 );
+        hash = HashMerge( hash, v2 );
+        hash = HashMerge( hash, v3 );
+        hash = HashMerge( hash, v4 );
+    }
+    else
+    {
+        hash = seed + prime5;
+    }
+
+    hash += size;
+
+    for (; ptr + 8 <= end; ptr += 8)
+    {
+        hash ^= HashRound( 0, Load64( ptr ) );
+        hash = Rotl64( hash, 27 ) * prime1 + prime4;
+    }
+
+    if (ptr + 4 <= end)
+    {
+        hash ^= static_cast<uint64_t>(Load32( ptr )) * prime1;
+        hash = Rotl64( hash, 23 ) * prime2 + prime3;
+        ptr += 4;
+    }
+
+    for (; ptr < end; ptr++)
+    {
+        hash ^= *ptr * prime5;
+        hash = Rotl64( hash, 11 ) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+}
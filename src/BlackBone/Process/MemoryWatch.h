@@ -0,0 +1,142 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+#include "../Misc/Utils.h"
+
+#include <map>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Change detected in watched range
+/// </summary>
+struct MemoryWatchChange
+{
+    uint32_t id = 0;                                // Watch ID
+    ptr_t page = 0;                                 // Changed page address
+    bool readable = true;                           // Page could be read
+    std::vector<std::pair<ptr_t, size_t>> spans;    // Changed bytes (address, size)
+};
+
+/// <summary>
+/// Watch counters
+/// </summary>
+struct MemoryWatchStats
+{
+    uint64_t polls = 0;         // Range polls
+    uint64_t pages = 0;         // Hashed pages
+    uint64_t changed = 0;       // Changed pages
+    uint64_t deferred = 0;      // Range polls postponed due to page budget
+};
+
+/// <summary>
+/// Polling monitor of remote memory ranges.
+/// Only 64-bit hash per page is kept by default, so memory cost doesn't depend on data layout.
+/// Byte-exact diff spans require shadow copy of range, it can be enabled per range.
+/// </summary>
+class MemoryWatch
+{
+public:
+    BLACKBONE_API MemoryWatch( class ProcessMemory* memory );
+    BLACKBONE_API ~MemoryWatch() = default;
+
+    /// <summary>
+    /// Start watching range. Baseline is taken on first poll
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size</param>
+    /// <param name="intervalMs">Poll interval</param>
+    /// <param name="diffSpans">Keep shadow copy to report exact changed bytes</param>
+    /// <returns>Watch ID, 0 on failure</returns>
+    BLACKBONE_API uint32_t Add( ptr_t address, size_t size, uint32_t intervalMs = 50, bool diffSpans = false );
+
+    /// <summary>
+    /// Stop watching range
+    /// </summary>
+    /// <param name="id">Watch ID</param>
+    /// <returns>false if not found</returns>
+    BLACKBONE_API bool Remove( uint32_t id );
+
+    /// <summary>
+    /// Remove all watches
+    /// </summary>
+    BLACKBONE_API void Clear();
+
+    /// <summary>
+    /// Read ranges that are due and report changed pages.
+    /// At most pageBudget() pages are processed per call, remaining ranges are polled next time.
+    /// </summary>
+    /// <param name="force">Ignore poll intervals</param>
+    /// <returns>Changed pages</returns>
+    BLACKBONE_API std::vector<MemoryWatchChange> Poll( bool force = false );
+
+    /// <summary>
+    /// Get time until next range is due
+    /// </summary>
+    /// <returns>Time in milliseconds, INFINITE if nothing is watched</returns>
+    BLACKBONE_API uint32_t nextDue();
+
+    /// <summary>
+    /// Set max pages hashed by single Poll call
+    /// </summary>
+    /// <param name="pages">Page count, 0 - unlimited</param>
+    BLACKBONE_API void pageBudget( size_t pages ) { _pageBudget = pages; }
+
+    BLACKBONE_API size_t pageBudget() const { return _pageBudget; }
+    BLACKBONE_API size_t size() const { return _ranges.size(); }
+    BLACKBONE_API const MemoryWatchStats& stats() const { return _stats; }
+    BLACKBONE_API void resetStats() { _stats = MemoryWatchStats(); }
+
+    /// <summary>
+    /// 64-bit data hash (XXH64)
+    /// </summary>
+    /// <param name="data">Data</param>
+    /// <param name="size">Data size</param>
+    /// <param name="seed">Hash seed</param>
+    /// <returns>Hash value</returns>
+    BLACKBONE_API static uint64_t Hash( const void* data, size_t size, uint64_t seed = 0 );
+
+private:
+    /// <summary>
+    /// Watched range
+    /// </summary>
+    struct Range
+    {
+        ptr_t address = 0;
+        size_t size = 0;
+        uint32_t interval = 0;
+        uint64_t due = 0;               // Next poll tick
+        bool primed = false;            // Baseline taken
+        bool diffSpans = false;         // Keep shadow copy
+        std::vector<uint64_t> hashes;   // Per-page hash
+        std::vector<bool> valid;        // Per-page readability
+        std::vector<uint8_t> shadow;    // Last seen data
+    };
+
+    /// <summary>
+    /// Compare new range data with stored state
+    /// </summary>
+    /// <param name="id">Watch ID</param>
+    /// <param name="range">Range</param>
+    /// <param name="data">Range data</param>
+    /// <param name="valid">Readable pages of range</param>
+    /// <param name="changes">Changed pages</param>
+    void Update( uint32_t id, Range& range, const uint8_t* data, const std::vector<bool>& valid, std::vector<MemoryWatchChange>& changes );
+
+    MemoryWatch( const MemoryWatch& ) = delete;
+    MemoryWatch& operator =( const MemoryWatch& ) = delete;
+
+private:
+    class ProcessMemory* _memory;       // Process memory routines
+    std::map<uint32_t, Range> _ranges;  // Watched ranges
+    uint32_t _nextId = 1;               // Next watch ID
+    uint32_t _cursor = 0;               // First watch ID to poll, for round-robin with page budget
+    size_t _pageBudget = 0;             // Max pages per poll
+    MemoryWatchStats _stats;            // Counters
+    CriticalSection _lock;              // Watch lock
+};
+
+}
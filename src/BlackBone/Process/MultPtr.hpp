@@ -1,5 +1,6 @@
 #pragma once
 #include "Process.h"
+#include "PointerChainSet.h"
 #include "../Misc/Trace.hpp"
 
 #include <stdint.h>
@@ -113,6 +114,18 @@ public:
         return _proc->memory().Write( ptr, sizeof( _data ), &_data );
     }
 
+    /// <summary>
+    /// Resolve pointer as part of chain set.
+    /// Afterwards pointer address is taken from last PointerChainSet::Resolve result
+    /// instead of walking the chain on every access
+    /// </summary>
+    /// <param name="set">Chain set of the same process</param>
+    void bind( PointerChainSet& set )
+    {
+        _set = &set;
+        _chain = set.Add( multi_ptr<T>::_base, multi_ptr<T>::_offsets, multi_ptr<T>::type_is_ptr );
+    }
+
 private:
     /// <summary>
     /// Read object from pointer
@@ -133,6 +146,9 @@ private:
     /// <returns>Pointer value or 0 if chain is invalid</returns>
     uintptr_t get_ptr()
     {
+        if (_set != nullptr)
+            return static_cast<uintptr_t>(_set->address( _chain ));
+
         uintptr_t ptr = multi_ptr<T>::_base;
         if (!NT_SUCCESS( _proc->memory().Read( ptr, ptr ) ))
             return 0;
@@ -155,6 +171,8 @@ private:
 
 private:
     Process* _proc = nullptr;       // Target process
+    PointerChainSet* _set = nullptr;// Chain set this pointer is bound to
+    size_t _chain = 0;              // Chain index in set
     multi_ptr<T>::type _data;     // Local object copy
 };
 }
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "PatchTransaction.h"
+#include "ProcessMemory.h"
+#include "ProcessCore.h"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Check if page protection allows writing
+/// </summary>
+/// <param name="protection">Protection flags</param>
+/// <returns>true if writable</returns>
+static bool IsWritable( DWORD protection )
+{
+    switch (protection & 0xFF)
+    {
+        case PAGE_READWRITE:
+        case PAGE_WRITECOPY:
+        case PAGE_EXECUTE_READWRITE:
+        case PAGE_EXECUTE_WRITECOPY:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/// <summary>
+/// Check if page protection allows execution
+/// </summary>
+/// <param name="protection">Protection flags</param>
+/// <returns>true if executable</returns>
+static bool IsExecutable( DWORD protection )
+{
+    return (protection & (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) != 0;
+}
+
+PatchTransaction::PatchTransaction( ProcessMemory& memory )
+    : _memory( &memory )
+{
+}
+
+/// <summary>
+/// Queue write. Previously committed transaction is dropped
+/// </summary>
+/// <param name="address">Memory address</param>
+/// <param name="size">Data size</param>
+/// <param name="data">Data to write</param>
+void PatchTransaction::Write( ptr_t address, size_t size, const void* data )
+{
+    if (_committed)
+        Clear();
+
+    if (size == 0)
+        return;
+
+    Run patch;
+    patch.address = address;
+    patch.data.assign( reinterpret_cast<const uint8_t*>(data), reinterpret_cast<const uint8_t*>(data) + size );
+
+    _patches.emplace_back( std::move( patch ) );
+}
+
+/// <summary>
+/// Apply all queued writes
+/// </summary>
+/// <param name="flushICache">Flush instruction cache for patched range</param>
+/// <returns>Status code</returns>
+NTSTATUS PatchTransaction::Commit( bool flushICache /*= true*/ )
+{
+    if (_committed || _patches.empty())
+        return STATUS_SUCCESS;
+
+    BuildRuns();
+
+    // Save overwritten bytes
+    std::vector<MemIoVec> ops;
+    for (auto& run : _runs)
+    {
+        run.original.resize( run.data.size() );
+        ops.emplace_back( run.address, run.original.size(), run.original.data() );
+    }
+
+    auto status = _memory->ReadV( ops );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    status = Apply( false, flushICache );
+    _committed = NT_SUCCESS( status );
+
+    return status;
+}
+
+/// <summary>
+/// Restore memory overwritten by last successful Commit
+/// </summary>
+/// <param name="flushICache">Flush instruction cache for patched range</param>
+/// <returns>Status code</returns>
+NTSTATUS PatchTransaction::Rollback( bool flushICache /*= true*/ )
+{
+    if (!_committed)
+        return STATUS_NOT_FOUND;
+
+    auto status = Apply( true, flushICache );
+    if (NT_SUCCESS( status ))
+        _committed = false;
+
+    return status;
+}
+
+/// <summary>
+/// Drop queued writes and saved original data
+/// </summary>
+void PatchTransaction::Clear()
+{
+    _patches.clear();
+    _runs.clear();
+    _committed = false;
+}
+
+/// <summary>
+/// Merge queued writes into non-overlapping runs
+/// </summary>
+void PatchTransaction::BuildRuns()
+{
+    std::vector<size_t> order( _patches.size() );
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::stable_sort( order.begin(), order.end(), [this]( size_t l, size_t r ) { return _patches[l].address < _patches[r].address; } );
+
+    _runs.clear();
+    std::vector<size_t> members;
+
+    auto flush = [&]()
+    {
+        if (members.empty())
+            return;
+
+        ptr_t start = _patches[members.front()].address, end = start;
+        for (auto idx : members)
+            end = max( end, _patches[idx].address + _patches[idx].data.size() );
+
+        // Later writes override earlier ones
+        std::sort( members.begin(), members.end() );
+
+        Run run;
+        run.address = start;
+        run.data.resize( static_cast<size_t>(end - start) );
+        for (auto idx : members)
+            std::copy( _patches[idx].data.begin(), _patches[idx].data.end(), run.data.begin() + static_cast<size_t>(_patches[idx].address - start) );
+
+        _runs.emplace_back( std::move( run ) );
+        members.clear();
+    };
+
+    ptr_t runEnd = 0;
+    for (auto idx : order)
+    {
+        auto& patch = _patches[idx];
+        if (!members.empty() && patch.address > runEnd)
+            flush();
+
+        if (members.empty())
+            runEnd = 0;
+
+        members.emplace_back( idx );
+        runEnd = max( runEnd, patch.address + patch.data.size() );
+    }
+
+    flush();
+}
+
+/// <summary>
+/// Write run data
+/// </summary>
+/// <param name="original">Write original bytes instead of new ones</param>
+/// <param name="flushICache">Flush instruction cache for patched range</param>
+/// <returns>Status code</returns>
+NTSTATUS PatchTransaction::Apply( bool original, bool flushICache )
+{
+    std::vector<ProtectedRange> changed;
+    auto status = Unprotect( changed );
+
+    if (NT_SUCCESS( status ))
+    {
+        size_t written = 0;
+        for (; written < _runs.size(); written++)
+        {
+            auto& bytes = original ? _runs[written].original : _runs[written].data;
+            status = _memory->Write( _runs[written].address, bytes.size(), bytes.data() );
+            if (!NT_SUCCESS( status ))
+                break;
+        }
+
+        // Undo everything written so far, including partially written run
+        if (!NT_SUCCESS( status ))
+        {
+            for (size_t i = 0; i <= written && i < _runs.size(); i++)
+            {
+                auto& bytes = original ? _runs[i].data : _runs[i].original;
+                _memory->Write( _runs[i].address, bytes.size(), bytes.data() );
+            }
+        }
+    }
+
+    Reprotect( changed );
+
+    if (NT_SUCCESS( status ) && flushICache && !_runs.empty())
+    {
+        ptr_t start = _runs.front().address;
+        ptr_t end = _runs.back().address + _runs.back().data.size();
+        FlushInstructionCache( _memory->core().handle(), reinterpret_cast<LPCVOID>(start), static_cast<SIZE_T>(end - start) );
+    }
+
+    return status;
+}
+
+/// <summary>
+/// Make pages of all runs writable
+/// </summary>
+/// <param name="changed">Ranges whose protection was changed</param>
+/// <returns>Status code</returns>
+NTSTATUS PatchTransaction::Unprotect( std::vector<ProtectedRange>& changed )
+{
+    constexpr ptr_t pageMask = ~static_cast<ptr_t>(0xFFF);
+
+    // Merge runs into page runs
+    std::vector<std::pair<ptr_t, ptr_t>> pageRuns;
+    for (auto& run : _runs)
+    {
+        ptr_t first = run.address & pageMask;
+        ptr_t last = (run.address + run.data.size() + 0xFFF) & pageMask;
+
+        if (!pageRuns.empty() && first <= pageRuns.back().second)
+            pageRuns.back().second = max( pageRuns.back().second, last );
+        else
+            pageRuns.emplace_back( first, last );
+    }
+
+    // Pending protection change, may cover several regions of one allocation
+    ptr_t pendingStart = 0, pendingEnd = 0, pendingAlloc = 0;
+    DWORD pendingProt = 0;
+
+    auto flush = [&]() -> NTSTATUS
+    {
+        if (pendingEnd == pendingStart)
+            return STATUS_SUCCESS;
+
+        DWORD old = 0;
+        auto status = _memory->Protect( pendingStart, static_cast<size_t>(pendingEnd - pendingStart), pendingProt, &old );
+        pendingStart = pendingEnd = 0;
+        return status;
+    };
+
+    for (auto& range : pageRuns)
+    {
+        MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+        for (ptr_t ptr = range.first; ptr < range.second; ptr = mbi.BaseAddress + mbi.RegionSize)
+        {
+            auto status = _memory->Query( ptr, &mbi );
+            if (!NT_SUCCESS( status ))
+                return status;
+
+            if (mbi.State != MEM_COMMIT)
+                return STATUS_INVALID_ADDRESS;
+
+            ptr_t end = min( mbi.BaseAddress + mbi.RegionSize, range.second );
+            if (IsWritable( mbi.Protect ))
+            {
+                if (!NT_SUCCESS( status = flush() ))
+                    return status;
+
+                continue;
+            }
+
+            DWORD newProt = IsExecutable( mbi.Protect ) ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+            if (pendingEnd != ptr || pendingAlloc != mbi.AllocationBase || pendingProt != newProt)
+            {
+                if (!NT_SUCCESS( status = flush() ))
+                    return status;
+
+                pendingStart = ptr;
+                pendingAlloc = mbi.AllocationBase;
+                pendingProt = newProt;
+            }
+
+            pendingEnd = end;
+            changed.push_back( { ptr, end - ptr, mbi.Protect } );
+        }
+
+        auto status = flush();
+        if (!NT_SUCCESS( status ))
+            return status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Restore original page protection
+/// </summary>
+/// <param name="changed">Ranges whose protection was changed</param>
+void PatchTransaction::Reprotect( const std::vector<ProtectedRange>& changed )
+{
+    for (auto& range : changed)
+        _memory->Protect( range.address, static_cast<size_t>(range.size), range.protection );
+}
+
+}
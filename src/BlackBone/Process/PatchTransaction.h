@@ -0,0 +1,119 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Batched memory patch.
+/// Queued writes are merged and applied with a single protection change per page run.
+/// If any step fails, already written ranges are restored.
+/// </summary>
+class PatchTransaction
+{
+public:
+    BLACKBONE_API PatchTransaction( class ProcessMemory& memory );
+    BLACKBONE_API ~PatchTransaction() = default;
+
+    BLACKBONE_API PatchTransaction( PatchTransaction&& ) = default;
+
+    /// <summary>
+    /// Queue write
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <param name="size">Data size</param>
+    /// <param name="data">Data to write</param>
+    BLACKBONE_API void Write( ptr_t address, size_t size, const void* data );
+
+    /// <summary>
+    /// Queue write
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <param name="data">Data to write</param>
+    template<typename T>
+    inline void Write( ptr_t address, const T& data )
+    {
+        Write( address, sizeof( data ), &data );
+    }
+
+    /// <summary>
+    /// Apply all queued writes
+    /// </summary>
+    /// <param name="flushICache">Flush instruction cache for patched range</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Commit( bool flushICache = true );
+
+    /// <summary>
+    /// Restore memory overwritten by last successful Commit
+    /// </summary>
+    /// <param name="flushICache">Flush instruction cache for patched range</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Rollback( bool flushICache = true );
+
+    /// <summary>
+    /// Drop queued writes and saved original data
+    /// </summary>
+    BLACKBONE_API void Clear();
+
+    BLACKBONE_API inline bool empty() const { return _patches.empty(); }
+    BLACKBONE_API inline bool committed() const { return _committed; }
+
+private:
+    /// <summary>
+    /// Contiguous patched range
+    /// </summary>
+    struct Run
+    {
+        ptr_t address = 0;
+        std::vector<uint8_t> data;      // New bytes
+        std::vector<uint8_t> original;  // Overwritten bytes
+    };
+
+    /// <summary>
+    /// Region with uniform protection
+    /// </summary>
+    struct ProtectedRange
+    {
+        ptr_t address = 0;
+        ptr_t size = 0;
+        DWORD protection = 0;
+    };
+
+    /// <summary>
+    /// Merge queued writes into non-overlapping runs
+    /// </summary>
+    void BuildRuns();
+
+    /// <summary>
+    /// Write run data
+    /// </summary>
+    /// <param name="original">Write original bytes instead of new ones</param>
+    /// <param name="flushICache">Flush instruction cache for patched range</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Apply( bool original, bool flushICache );
+
+    /// <summary>
+    /// Make pages of all runs writable
+    /// </summary>
+    /// <param name="changed">Ranges whose protection was changed</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Unprotect( std::vector<ProtectedRange>& changed );
+
+    /// <summary>
+    /// Restore original page protection
+    /// </summary>
+    /// <param name="changed">Ranges whose protection was changed</param>
+    void Reprotect( const std::vector<ProtectedRange>& changed );
+
+private:
+    class ProcessMemory* _memory;       // Process memory routines
+    std::vector<Run> _patches;          // Queued writes, in order
+    std::vector<Run> _runs;             // Merged writes
+    bool _committed = false;            // Last commit succeeded
+};
+
+}
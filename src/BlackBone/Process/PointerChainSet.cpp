@@ -0,0 +1,183 @@
+#include "PointerChainSet.h"
+#include "ProcessMemory.h"
+#include "Process.h"
+
+namespace blackbone
+{
+
+PointerChainSet::PointerChainSet( ProcessMemory& memory )
+    : _memory( memory )
+{
+}
+
+/// <summary>
+/// Add chain. Semantics match multi_ptr:
+/// base is dereferenced, then every offset but the last one is added and dereferenced, then the last offset is added
+/// </summary>
+/// <param name="base">Base address</param>
+/// <param name="offsets">Offsets</param>
+/// <param name="derefLast">Dereference final address as well</param>
+/// <returns>Chain index</returns>
+size_t PointerChainSet::Add( ptr_t base, const vecOffsets& offsets /*= vecOffsets()*/, bool derefLast /*= false*/ )
+{
+    Chain chain;
+    chain.node = GetNode( noParent, base, 0 );
+
+    if (!offsets.empty())
+    {
+        for (size_t i = 0; i < offsets.size() - 1; i++)
+            chain.node = GetNode( chain.node, static_cast<ptr_t>(offsets[i]), i + 1 );
+
+        if (derefLast)
+            chain.node = GetNode( chain.node, static_cast<ptr_t>(offsets.back()), offsets.size() );
+        else
+            chain.tail = static_cast<ptr_t>(offsets.back());
+    }
+
+    _nodes[chain.node].leaf = true;
+    _chains.emplace_back( chain );
+
+    return _chains.size() - 1;
+}
+
+/// <summary>
+/// Resolve all chains
+/// </summary>
+/// <returns>STATUS_SUCCESS if all chains were resolved, status of first broken chain otherwise</returns>
+NTSTATUS PointerChainSet::Resolve()
+{
+    auto& barrier = _memory.process()->barrier();
+    size_t ptrSize = (barrier.targetWow64 || barrier.x86OS) ? sizeof( uint32_t ) : sizeof( uint64_t );
+
+    std::vector<MemIoVec> ops;
+    std::vector<uint32_t> pending;
+
+    for (auto& level : _levels)
+    {
+        ops.clear();
+        pending.clear();
+
+        for (auto id : level)
+        {
+            auto& node = _nodes[id];
+            if (_keepNodes && !node.leaf && node.generation == _generation)
+            {
+                _stats.reused++;
+                continue;
+            }
+
+            node.generation = _generation;
+            node.value = 0;
+
+            // Broken prefix
+            if (node.parent != noParent && !NT_SUCCESS( _nodes[node.parent].status ))
+            {
+                node.status = _nodes[node.parent].status;
+                continue;
+            }
+
+            ptr_t address = node.offset;
+            if (node.parent != noParent)
+                address += _nodes[node.parent].value;
+
+            ops.emplace_back( address, ptrSize, &node.value );
+            pending.emplace_back( id );
+        }
+
+        if (ops.empty())
+            continue;
+
+        _memory.ReadV( ops );
+        _stats.reads++;
+        _stats.nodes += ops.size();
+
+        for (size_t i = 0; i < ops.size(); i++)
+        {
+            auto& node = _nodes[pending[i]];
+            node.status = ops[i].status;
+            if (!NT_SUCCESS( node.status ))
+                node.value = 0;
+        }
+    }
+
+    for (size_t i = 0; i < _chains.size(); i++)
+    {
+        auto status = this->status( i );
+        if (!NT_SUCCESS( status ))
+            return status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Remove all chains
+/// </summary>
+void PointerChainSet::Clear()
+{
+    _nodes.clear();
+    _levels.clear();
+    _index.clear();
+    _chains.clear();
+}
+
+/// <summary>
+/// Get chain address from last Resolve
+/// </summary>
+/// <param name="chain">Chain index</param>
+/// <returns>Final address, 0 if chain is broken or wasn't resolved</returns>
+ptr_t PointerChainSet::address( size_t chain ) const
+{
+    if (chain >= _chains.size())
+        return 0;
+
+    auto& node = _nodes[_chains[chain].node];
+    if (node.generation == 0 || !NT_SUCCESS( node.status ))
+        return 0;
+
+    return node.value + _chains[chain].tail;
+}
+
+/// <summary>
+/// Get chain status from last Resolve
+/// </summary>
+/// <param name="chain">Chain index</param>
+/// <returns>Status of first failed dereference</returns>
+NTSTATUS PointerChainSet::status( size_t chain ) const
+{
+    if (chain >= _chains.size())
+        return STATUS_NOT_FOUND;
+
+    return _nodes[_chains[chain].node].status;
+}
+
+/// <summary>
+/// Get existing node or create new one
+/// </summary>
+/// <param name="parent">Parent node</param>
+/// <param name="offset">Offset from parent value</param>
+/// <param name="depth">Node depth</param>
+/// <returns>Node index</returns>
+uint32_t PointerChainSet::GetNode( uint32_t parent, ptr_t offset, size_t depth )
+{
+    auto key = std::make_pair( parent, offset );
+    auto iter = _index.find( key );
+    if (iter != _index.end())
+        return iter->second;
+
+    Node node;
+    node.parent = parent;
+    node.offset = offset;
+
+    auto id = static_cast<uint32_t>(_nodes.size());
+    _nodes.emplace_back( node );
+    _index.emplace( key, id );
+
+    if (_levels.size() <= depth)
+        _levels.resize( depth + 1 );
+
+    _levels[depth].emplace_back( id );
+    return id;
+}
+
+}
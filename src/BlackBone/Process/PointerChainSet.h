@@ -0,0 +1,135 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+
+#include <map>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Chain set counters
+/// </summary>
+struct PointerChainStats
+{
+    uint64_t reads = 0;         // Vectored reads, one per resolved level
+    uint64_t nodes = 0;         // Dereferenced nodes
+    uint64_t reused = 0;        // Nodes taken from previous resolve
+};
+
+/// <summary>
+/// Set of remote multi-level pointers resolved together.
+/// Chains are stored as a tree, so common prefixes are dereferenced once.
+/// All nodes of the same depth are read with a single ProcessMemory::ReadV call.
+/// </summary>
+class PointerChainSet
+{
+public:
+    using vecOffsets = std::vector<intptr_t>;
+
+public:
+    BLACKBONE_API PointerChainSet( class ProcessMemory& memory );
+    BLACKBONE_API ~PointerChainSet() = default;
+
+    /// <summary>
+    /// Add chain. Semantics match multi_ptr:
+    /// base is dereferenced, then every offset but the last one is added and dereferenced, then the last offset is added
+    /// </summary>
+    /// <param name="base">Base address</param>
+    /// <param name="offsets">Offsets</param>
+    /// <param name="derefLast">Dereference final address as well</param>
+    /// <returns>Chain index</returns>
+    BLACKBONE_API size_t Add( ptr_t base, const vecOffsets& offsets = vecOffsets(), bool derefLast = false );
+
+    /// <summary>
+    /// Resolve all chains
+    /// </summary>
+    /// <returns>STATUS_SUCCESS if all chains were resolved, status of first broken chain otherwise</returns>
+    BLACKBONE_API NTSTATUS Resolve();
+
+    /// <summary>
+    /// Start new generation. Intermediate nodes are read again on next Resolve
+    /// </summary>
+    BLACKBONE_API void NextGeneration() { _generation++; }
+
+    /// <summary>
+    /// Remove all chains
+    /// </summary>
+    BLACKBONE_API void Clear();
+
+    /// <summary>
+    /// Get chain address from last Resolve
+    /// </summary>
+    /// <param name="chain">Chain index</param>
+    /// <returns>Final address, 0 if chain is broken or wasn't resolved</returns>
+    BLACKBONE_API ptr_t address( size_t chain ) const;
+
+    /// <summary>
+    /// Get chain status from last Resolve
+    /// </summary>
+    /// <param name="chain">Chain index</param>
+    /// <returns>Status of first failed dereference</returns>
+    BLACKBONE_API NTSTATUS status( size_t chain ) const;
+
+    /// <summary>
+    /// Keep intermediate nodes between Resolve calls until NextGeneration.
+    /// Last node of every chain is always read again
+    /// </summary>
+    /// <param name="keep">Keep nodes</param>
+    BLACKBONE_API void keepNodes( bool keep ) { _keepNodes = keep; }
+
+    BLACKBONE_API bool keepNodes() const { return _keepNodes; }
+    BLACKBONE_API size_t size() const { return _chains.size(); }
+    BLACKBONE_API size_t nodes() const { return _nodes.size(); }
+    BLACKBONE_API uint64_t generation() const { return _generation; }
+    BLACKBONE_API const PointerChainStats& stats() const { return _stats; }
+    BLACKBONE_API void resetStats() { _stats = PointerChainStats(); }
+
+private:
+    static constexpr uint32_t noParent = 0xFFFFFFFF;
+
+    /// <summary>
+    /// Single dereference: value = *(parent value + offset)
+    /// </summary>
+    struct Node
+    {
+        uint32_t parent = noParent;         // Parent node, noParent for chain base
+        ptr_t offset = 0;                   // Offset from parent value or base address
+        bool leaf = false;                  // Last node of some chain
+        uint64_t generation = 0;            // Generation of value
+        NTSTATUS status = STATUS_UNSUCCESSFUL;
+        ptr_t value = 0;                    // Dereferenced value
+    };
+
+    /// <summary>
+    /// Chain: last node plus final offset
+    /// </summary>
+    struct Chain
+    {
+        uint32_t node = 0;
+        ptr_t tail = 0;
+    };
+
+    /// <summary>
+    /// Get existing node or create new one
+    /// </summary>
+    /// <param name="parent">Parent node</param>
+    /// <param name="offset">Offset from parent value</param>
+    /// <param name="depth">Node depth</param>
+    /// <returns>Node index</returns>
+    uint32_t GetNode( uint32_t parent, ptr_t offset, size_t depth );
+
+private:
+    class ProcessMemory& _memory;                               // Process memory routines
+    std::vector<Node> _nodes;                                   // Dereference tree
+    std::vector<std::vector<uint32_t>> _levels;                 // Nodes by depth
+    std::map<std::pair<uint32_t, ptr_t>, uint32_t> _index;      // (parent, offset) -> node
+    std::vector<Chain> _chains;                                 // Registered chains
+    uint64_t _generation = 1;                                   // Current generation
+    bool _keepNodes = true;                                     // Cache intermediate nodes
+    PointerChainStats _stats;                                   // Counters
+};
+
+}
@@ -6,9 +6,6 @@
 
 namespace blackbone
 {
-#define SystemHandleInformation (SYSTEM_INFORMATION_CLASS)16
-#define ObjectNameInformation   (OBJECT_INFORMATION_CLASS)1
-
 Process::Process()
     : _core()
     , _modules( *this )
@@ -19,6 +16,7 @@ Process::Process()
     , _remote( *this )
     , _mmap( *this )
     , _nativeLdr( *this )
+    , _handles( _core )
 {
     // Ensure InitOnce is called
     InitializeOnce();
@@ -128,6 +126,7 @@ NTSTATUS Process::Detach()
     // Reset data
     _memory.reset();
     _modules.reset();
+    _threads.reset();
     _remote.reset();
     _mmap.reset();
     _hooks.reset();
@@ -198,121 +197,17 @@ NTSTATUS Process::Terminate( uint32_t code /*= 0*/ )
 /// <returns>Found handles or status code</returns>
 call_result_t<std::vector<HandleInfo>> Process::EnumHandles()
 {
-    ULONG bufSize = 0x10000;
-    uint8_t* buffer = (uint8_t*)VirtualAlloc( NULL, bufSize, MEM_COMMIT, PAGE_READWRITE );
-    ULONG returnLength = 0;
-    std::vector<HandleInfo> handles;
-
-    // Query handle list
-    NTSTATUS status = SAFE_NATIVE_CALL( NtQuerySystemInformation, SystemHandleInformation, buffer, bufSize, &returnLength );
-    while (status == STATUS_INFO_LENGTH_MISMATCH)
-    {
-        bufSize *= 2;
-        VirtualFree( buffer, 0, MEM_RELEASE );
-        buffer = (uint8_t*)VirtualAlloc( NULL, bufSize, MEM_COMMIT, PAGE_READWRITE );
-
-        status = SAFE_NATIVE_CALL( NtQuerySystemInformation, SystemHandleInformation, buffer, bufSize, &returnLength );
-    }
-
-    if (!NT_SUCCESS( status ))
-    {
-        VirtualFree( buffer, 0, MEM_RELEASE );
-        return status;
-    }
-
-    SYSTEM_HANDLE_INFORMATION_T* handleInfo = (SYSTEM_HANDLE_INFORMATION_T*)buffer;
-    for (ULONG i = 0; i < handleInfo->HandleCount; i++)
-    {
-        HandleInfo info;
-        ProcessHandle hLocal;
-        OBJECT_TYPE_INFORMATION_T* pTypeInfo = nullptr;
-        PVOID pNameInfo = nullptr;
-        UNICODE_STRING objectName = { 0 };
-
-        // Filter process
-        if (handleInfo->Handles[i].ProcessId != _core._pid)
-            continue;
-
-        // Get local handle copy
-        status = SAFE_NATIVE_CALL(
-            NtDuplicateObject,
-            _core._hProcess,
-            reinterpret_cast<HANDLE>(handleInfo->Handles[i].Handle),
-            GetCurrentProcess(),
-            &hLocal, 0, 0, DUPLICATE_SAME_ACCESS
-            );
-
-        if (!NT_SUCCESS( status ))
-            continue;
-
-        // 
-        // Get type information
-        //
-        pTypeInfo = (OBJECT_TYPE_INFORMATION_T*)malloc( 0x1000 );
-        status = SAFE_NATIVE_CALL( NtQueryObject, hLocal, ObjectTypeInformation, pTypeInfo, 0x1000, nullptr );
-        if (!NT_SUCCESS( status ))
-        {
-            continue;
-        }
-
-        //
-        // Obtain object name
-        //
-        pNameInfo = malloc( 0x1000 );
-        status = SAFE_NATIVE_CALL( NtQueryObject, hLocal, ObjectNameInformation, pNameInfo, 0x1000, &returnLength);
-        if (!NT_SUCCESS( status ))
-        {
-            pNameInfo = realloc( pNameInfo, returnLength );
-            status = SAFE_NATIVE_CALL( NtQueryObject, hLocal, ObjectNameInformation, pNameInfo, returnLength, nullptr );
-            if (!NT_SUCCESS( status ))
-            {
-                free( pTypeInfo );
-                free( pNameInfo );
-                continue;
-            }
-        }
-
-        objectName = *(PUNICODE_STRING)pNameInfo;
-
-        //
-        // Fill handle info structure
-        //
-        info.handle   = reinterpret_cast<HANDLE>(handleInfo->Handles[i].Handle);
-        info.access   = handleInfo->Handles[i].GrantedAccess;
-        info.flags    = handleInfo->Handles[i].Flags;
-        info.pObject  = handleInfo->Handles[i].Object;
-
-        if (pTypeInfo->Name.Length)
-            info.typeName = (wchar_t*)pTypeInfo->Name.Buffer;
-
-        if (objectName.Length)
-            info.name = objectName.Buffer;
-
-        //
-        // Type-specific info
-        //
-        if (_wcsicmp( info.typeName.c_str(), L"Section" ) == 0)
-        {
-            SECTION_BASIC_INFORMATION_T secInfo = { 0 };
-
-            status = SAFE_NATIVE_CALL( NtQuerySection, hLocal, SectionBasicInformation, &secInfo, (ULONG)sizeof( secInfo ), nullptr );
-            if (NT_SUCCESS( status ))
-            {
-                info.section.reset( new SectionInfo() );
-
-                info.section->size = secInfo.Size.QuadPart;
-                info.section->attrib = secInfo.Attributes;
-            }
-        }
-
-        handles.emplace_back( info );
-
-        free( pTypeInfo );
-        free( pNameInfo );
-    }
+    return _handles.Enumerate();
+}
 
-    VirtualFree( buffer, 0, MEM_RELEASE );
-    return call_result_t<std::vector<HandleInfo>>( handles, status );
+/// <summary>
+/// Enumerate open handles matching filter
+/// </summary>
+/// <param name="filter">Handle filter</param>
+/// <returns>Found handles or status code</returns>
+call_result_t<std::vector<HandleInfo>> Process::EnumHandles( const HandleFilter& filter )
+{
+    return _handles.Enumerate( filter );
 }
 
 /// <summary>
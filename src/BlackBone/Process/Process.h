@@ -3,6 +3,7 @@
 #include "ProcessCore.h"
 #include "ProcessMemory.h"
 #include "ProcessModules.h"
+#include "HandleEnum.h"
 #include "Threads/Threads.h"
 #include "RPC/RemoteExec.h"
 #include "RPC/RemoteHook.h"
@@ -45,32 +46,6 @@ struct ProcessInfo
     }
 };
 
-/// <summary>
-/// Section object information
-/// </summary>
-struct SectionInfo
-{
-    ptr_t size = 0;
-    uint32_t attrib = 0;
-};
-
-/// <summary>
-/// Process handle information
-/// </summary>
-struct HandleInfo
-{
-    HANDLE handle = nullptr;
-    uint32_t access = 0;
-    uint32_t flags = 0;
-    ptr_t pObject = 0;
-
-    std::wstring typeName;
-    std::wstring name;
-
-    // Object-specific info
-    std::shared_ptr<SectionInfo> section;
-};
-
 #define DEFAULT_ACCESS_P  PROCESS_QUERY_INFORMATION | \
                           PROCESS_VM_READ           | \
                           PROCESS_VM_WRITE          | \
@@ -177,6 +152,13 @@ public:
     /// <returns>Found handles or status code</returns>
     BLACKBONE_API call_result_t<std::vector<HandleInfo>> EnumHandles();
 
+    /// <summary>
+    /// Enumerate open handles matching filter
+    /// </summary>
+    /// <param name="filter">Handle filter</param>
+    /// <returns>Found handles or status code</returns>
+    BLACKBONE_API call_result_t<std::vector<HandleInfo>> EnumHandles( const HandleFilter& filter );
+
     /// <summary>
     /// Search for process by executable name
     /// </summary>
@@ -228,6 +210,7 @@ private:
     RemoteExec      _remote;        // Remote code execution
     MMap            _mmap;          // Manual module mapping
     NtLdr           _nativeLdr;     // Native loader routines
+    HandleEnumerator _handles;      // Handle enumeration
 };
 
 }
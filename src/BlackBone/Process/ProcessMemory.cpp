@@ -2,6 +2,8 @@
 #include "Process.h"
 #include "../Misc/Trace.hpp"
 
+#include <algorithm>
+
 namespace blackbone
 {
 
@@ -9,6 +11,8 @@ ProcessMemory::ProcessMemory( Process* process )
     : RemoteMemory( process )
     , _process( process )
     , _core( process->core() )  
+    , _watch( this )
+    , _async( this )
 {
 }
 
@@ -26,11 +30,13 @@ ProcessMemory::~ProcessMemory()
 /// <returns>Memory block. If failed - returned block will be invalid</returns>
 call_result_t<MemBlock> ProcessMemory::Allocate( size_t size, DWORD protection /*= PAGE_EXECUTE_READWRITE*/, ptr_t desired /*= 0*/, bool own /*= true*/ )
 {
+    _stats.allocations++;
     return MemBlock::Allocate( *this, size, desired, protection, own );
 }
 
 call_result_t<MemBlock> ProcessMemory::AllocateClosest( size_t size, DWORD protection /*= PAGE_EXECUTE_READWRITE*/, ptr_t desired /*= 0*/, bool own /*= true*/ )
 {
+    _stats.allocations++;
     return MemBlock::AllocateClosest( *this, size, desired, protection, own );
 }
 
@@ -51,6 +57,22 @@ NTSTATUS ProcessMemory::Free( ptr_t pAddr, size_t size /*= 0*/, DWORD freeType /
         BLACKBONE_TRACE( L"Free: Free at address 0x%p", static_cast<uintptr_t>(pAddr) );
     }
 #endif
+    if (_cache.enabled())
+    {
+        // Whole allocation is released
+        if (size == 0)
+        {
+            MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+            for (ptr_t ptr = pAddr; NT_SUCCESS( Query( ptr, &mbi ) ) && mbi.AllocationBase == pAddr; ptr = mbi.BaseAddress + mbi.RegionSize)
+                size = static_cast<size_t>(mbi.BaseAddress + mbi.RegionSize - pAddr);
+        }
+
+        _cache.Invalidate( pAddr, size );
+    }
+
+    regions().MarkDirty( pAddr, size );
+
+    _stats.frees++;
     return _core.native()->VirtualFreeExT( pAddr, size, freeType );
 }
 
@@ -83,6 +105,11 @@ NTSTATUS ProcessMemory::Protect( ptr_t pAddr, size_t size, DWORD flProtect, DWOR
     if (_casting == MemProtectionCasting::useDep)
         finalProt = CastProtection( flProtect, _core.DEP() );
 
+    // Page may become unreadable or guarded
+    _cache.Invalidate( pAddr, size );
+    regions().MarkDirty( pAddr, size );
+
+    _stats.protects++;
     return _core.native()->VirtualProtectExT( pAddr, size, finalProt, pOld );
 }
 
@@ -103,31 +130,47 @@ NTSTATUS ProcessMemory::Read( ptr_t dwAddress, size_t dwSize, PVOID pResult, boo
     if (dwAddress == 0)
         return STATUS_INVALID_ADDRESS;
 
+    // Cached read
+    if (!handleHoles && _cache.Cacheable( dwAddress, dwSize ))
+    {
+        return ReadCached( dwAddress, dwSize, pResult );
+    }
     // Simple read
-    if (!handleHoles)
+    else if (!handleHoles)
     {
+        _stats.reads++;
+        _stats.bytesRead += dwSize;
         return _core.native()->ReadProcessMemoryT( dwAddress, pResult, dwSize, &dwRead );
     }
     // Read all committed memory regions
     else
     {
+        ptr_t end = dwAddress + dwSize;
         MEMORY_BASIC_INFORMATION64 mbi = { 0 };
 
-        for (ptr_t memptr = dwAddress; memptr < dwAddress + dwSize; memptr = mbi.BaseAddress + mbi.RegionSize)
+        // Live query, cached layout may miss changes made by target
+        for (ptr_t memptr = dwAddress; memptr < end; memptr = mbi.BaseAddress + mbi.RegionSize)
         {
-            if (_core.native()->VirtualQueryExT( memptr, &mbi ) != STATUS_SUCCESS)
+            if (_core.native()->VirtualQueryExT( memptr, &mbi ) != STATUS_SUCCESS || mbi.RegionSize == 0)
+            {
+                mbi.BaseAddress = memptr & ~static_cast<ptr_t>(0xFFF);
+                mbi.RegionSize = 0x1000;
                 continue;
+            }
 
             // Filter empty regions
             if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS)
                 continue;
 
-            uint64_t region_ptr = memptr - dwAddress;
+            ptr_t from = max( mbi.BaseAddress, dwAddress );
+            ptr_t to = min( mbi.BaseAddress + mbi.RegionSize, end );
 
+            _stats.reads++;
+            _stats.bytesRead += to - from;
             auto status = _core.native()->ReadProcessMemoryT(
-                mbi.BaseAddress,
-                reinterpret_cast<uint8_t*>(pResult) + region_ptr,
-                static_cast<size_t>(mbi.RegionSize),
+                from,
+                reinterpret_cast<uint8_t*>(pResult) + (from - dwAddress),
+                static_cast<size_t>(to - from),
                 &dwRead
             );
 
@@ -139,6 +182,65 @@ NTSTATUS ProcessMemory::Read( ptr_t dwAddress, size_t dwSize, PVOID pResult, boo
     return STATUS_SUCCESS;
 }
 
+/// <summary>
+/// Read data through page cache
+/// </summary>
+/// <param name="dwAddress">Memory address to read from</param>
+/// <param name="dwSize">Size of data to read</param>
+/// <param name="pResult">Output buffer</param>
+/// <returns>Status</returns>
+NTSTATUS ProcessMemory::ReadCached( ptr_t dwAddress, size_t dwSize, PVOID pResult )
+{
+    constexpr size_t pageSize = MemoryCache::pageSize;
+
+    DWORD64 dwRead = 0;
+    auto pOut = reinterpret_cast<uint8_t*>(pResult);
+    ptr_t end = dwAddress + dwSize;
+    ptr_t last = (end - 1) & MemoryCache::pageMask;
+    std::vector<uint8_t> buf;
+
+    for (ptr_t page = dwAddress & MemoryCache::pageMask; page <= last;)
+    {
+        ptr_t from = max( page, dwAddress );
+        ptr_t to = min( page + pageSize, end );
+        if (_cache.Fetch( page, static_cast<size_t>(from - page), static_cast<size_t>(to - from), pOut + (from - dwAddress) ))
+        {
+            page += pageSize;
+            continue;
+        }
+
+        // Read all adjacent missing pages at once
+        ptr_t runEnd = page + pageSize;
+        while (runEnd <= last && !_cache.Contains( runEnd ))
+            runEnd += pageSize;
+
+        buf.resize( static_cast<size_t>(runEnd - page) );
+
+        _stats.reads++;
+        _stats.bytesRead += buf.size();
+        auto status = _core.native()->ReadProcessMemoryT( page, buf.data(), buf.size(), &dwRead );
+        to = min( runEnd, end );
+        if (NT_SUCCESS( status ))
+        {
+            _cache.Insert( page, buf.size() / pageSize, buf.data() );
+            memcpy( pOut + (from - dwAddress), buf.data() + (from - page), static_cast<size_t>(to - from) );
+        }
+        // Let native read report exact error for requested part
+        else
+        {
+            _stats.reads++;
+            _stats.bytesRead += to - from;
+            status = _core.native()->ReadProcessMemoryT( from, pOut + (from - dwAddress), static_cast<size_t>(to - from), &dwRead );
+            if (!NT_SUCCESS( status ))
+                return status;
+        }
+
+        page = runEnd;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 /// <summary>
 /// Read data
 /// </summary>
@@ -166,6 +268,136 @@ NTSTATUS ProcessMemory::Read( const std::vector<ptr_t>& adrList, size_t dwSize,
     return Read( ptr + adrList.back(), dwSize, pResult, handleHoles );
 }
 
+/// <summary>
+/// Read all readable pages in range. Unreadable pages are zeroed.
+/// </summary>
+/// <param name="dwAddress">Memory address to read from</param>
+/// <param name="dwSize">Size of data to read</param>
+/// <param name="pResult">Output buffer</param>
+/// <param name="validPages">Per-page validity, first entry corresponds to page containing dwAddress</param>
+/// <returns>STATUS_SUCCESS if all pages were read, STATUS_PARTIAL_COPY if some were read, error code otherwise</returns>
+NTSTATUS ProcessMemory::ReadSparse( ptr_t dwAddress, size_t dwSize, PVOID pResult, std::vector<bool>& validPages )
+{
+    constexpr ptr_t pageMask = ~static_cast<ptr_t>(0xFFF);
+
+    validPages.clear();
+    if (dwAddress == 0)
+        return STATUS_INVALID_ADDRESS;
+    if (dwSize == 0)
+        return STATUS_SUCCESS;
+
+    ptr_t end = dwAddress + dwSize;
+    auto pOut = reinterpret_cast<uint8_t*>(pResult);
+
+    validPages.assign( static_cast<size_t>((((end - 1) & pageMask) - (dwAddress & pageMask)) / 0x1000 + 1), false );
+    memset( pResult, 0, dwSize );
+
+    NTSTATUS lastError = STATUS_MEMORY_NOT_ALLOCATED;
+    for (auto& mbi : regions().Enumerate( dwAddress, end ))
+    {
+        if (mbi.State != MEM_COMMIT || mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD))
+            continue;
+
+        ptr_t from = max( mbi.BaseAddress, dwAddress );
+        ptr_t to = min( mbi.BaseAddress + mbi.RegionSize, end );
+
+        auto status = ReadSplit( from, to, dwAddress, pOut, validPages );
+        if (!NT_SUCCESS( status ))
+        {
+            // Cached layout is outdated
+            regions().MarkDirty( mbi.BaseAddress, static_cast<size_t>(mbi.RegionSize) );
+            lastError = status;
+        }
+    }
+
+    // Holes may have been committed by target since layout was cached, check them with live query
+    ptr_t firstPage = dwAddress & pageMask;
+    for (size_t i = 0; i < validPages.size();)
+    {
+        if (validPages[i])
+        {
+            i++;
+            continue;
+        }
+
+        size_t holeEnd = i + 1;
+        while (holeEnd < validPages.size() && !validPages[holeEnd])
+            holeEnd++;
+
+        ptr_t from = max( firstPage + i * 0x1000, dwAddress );
+        MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+        if (_core.native()->VirtualQueryExT( from, &mbi ) != STATUS_SUCCESS || mbi.RegionSize == 0)
+        {
+            i = holeEnd;
+            continue;
+        }
+
+        ptr_t to = min( min( mbi.BaseAddress + mbi.RegionSize, firstPage + holeEnd * 0x1000 ), end );
+        if (mbi.State == MEM_COMMIT && !(mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD)))
+        {
+            regions().MarkDirty( from, static_cast<size_t>(to - from) );
+
+            auto status = ReadSplit( from, to, dwAddress, pOut, validPages );
+            if (!NT_SUCCESS( status ))
+                lastError = status;
+        }
+
+        i = static_cast<size_t>((((to - 1) & pageMask) - firstPage) / 0x1000 + 1);
+    }
+
+    auto valid = std::count( validPages.begin(), validPages.end(), true );
+    if (valid == static_cast<ptrdiff_t>(validPages.size()))
+        return STATUS_SUCCESS;
+
+    return valid != 0 ? STATUS_PARTIAL_COPY : lastError;
+}
+
+/// <summary>
+/// Read range, splitting it in halves on failure until single unreadable pages are isolated
+/// </summary>
+/// <param name="from">Range start</param>
+/// <param name="to">Range end</param>
+/// <param name="base">ReadSparse start address</param>
+/// <param name="pResult">ReadSparse output buffer</param>
+/// <param name="validPages">ReadSparse page validity</param>
+/// <returns>Last read failure status, STATUS_SUCCESS if whole range was read</returns>
+NTSTATUS ProcessMemory::ReadSplit( ptr_t from, ptr_t to, ptr_t base, uint8_t* pResult, std::vector<bool>& validPages )
+{
+    constexpr ptr_t pageMask = ~static_cast<ptr_t>(0xFFF);
+
+    DWORD64 dwRead = 0;
+    auto pOut = pResult + (from - base);
+    size_t size = static_cast<size_t>(to - from);
+
+    _stats.reads++;
+    _stats.bytesRead += size;
+    auto status = _core.native()->ReadProcessMemoryT( from, pOut, size, &dwRead );
+
+    ptr_t firstPage = from & pageMask, lastPage = (to - 1) & pageMask;
+    size_t firstIdx = static_cast<size_t>((firstPage - (base & pageMask)) / 0x1000);
+
+    if (NT_SUCCESS( status ))
+    {
+        for (ptr_t page = firstPage; page <= lastPage; page += 0x1000)
+            validPages[firstIdx + static_cast<size_t>((page - firstPage) / 0x1000)] = true;
+
+        return STATUS_SUCCESS;
+    }
+
+    // Partial read may leave garbage
+    memset( pOut, 0, size );
+
+    // Single page can't be split further
+    if (firstPage == lastPage)
+        return status;
+
+    ptr_t middle = firstPage + ((lastPage - firstPage) / 0x1000 + 1) / 2 * 0x1000;
+    auto statusLeft = ReadSplit( from, middle, base, pResult, validPages );
+    auto statusRight = ReadSplit( middle, to, base, pResult, validPages );
+
+    return !NT_SUCCESS( statusRight ) ? statusRight : statusLeft;
+}
+
 /// <summary>
 /// Write data
 /// </summary>
@@ -175,7 +407,17 @@ NTSTATUS ProcessMemory::Read( const std::vector<ptr_t>& adrList, size_t dwSize,
 /// <returns>Status</returns>
 NTSTATUS ProcessMemory::Write( ptr_t pAddress, size_t dwSize, const void* pData )
 {
-    return _core.native()->WriteProcessMemoryT( pAddress, pData, dwSize );
+    _stats.writes++;
+    _stats.bytesWritten += dwSize;
+    auto status = _core.native()->WriteProcessMemoryT( pAddress, pData, dwSize );
+
+    // Write-through
+    if (NT_SUCCESS( status ))
+        _cache.Update( pAddress, dwSize, pData );
+    else
+        _cache.Invalidate( pAddress, dwSize );
+
+    return status;
 }
 
 /// <summary>
@@ -201,6 +443,145 @@ NTSTATUS ProcessMemory::Write( const std::vector<ptr_t>& adrList, size_t dwSize,
     return Write( ptr + adrList.back(), dwSize, pData );
 }
 
+/// <summary>
+/// Read multiple memory ranges.
+/// Descriptors closer than ioMergeGap() bytes to each other are read with a single native call
+/// </summary>
+/// <param name="ops">Read descriptors. Status of each descriptor is updated</param>
+/// <returns>Status of first failed descriptor, STATUS_SUCCESS if all succeeded</returns>
+NTSTATUS ProcessMemory::ReadV( std::vector<MemIoVec>& ops )
+{
+    std::vector<uint8_t> buf;
+
+    for (auto& run : MergeIoVec( ops, _ioMergeGap ))
+    {
+        auto& first = ops[run.front()];
+        ptr_t start = first.address, end = first.address + first.size;
+        for (auto idx : run)
+            end = max( end, ops[idx].address + ops[idx].size );
+
+        // Single descriptor
+        if (run.size() == 1)
+        {
+            first.status = Read( first.address, first.size, first.buffer );
+            continue;
+        }
+
+        buf.resize( static_cast<size_t>(end - start) );
+        auto status = Read( start, buf.size(), buf.data() );
+
+        // Scatter results
+        if (NT_SUCCESS( status ))
+        {
+            for (auto idx : run)
+            {
+                auto& op = ops[idx];
+                memcpy( op.buffer, buf.data() + (op.address - start), op.size );
+                op.status = STATUS_SUCCESS;
+            }
+        }
+        // Some page in range is inaccessible, read separately
+        else
+        {
+            for (auto idx : run)
+                ops[idx].status = Read( ops[idx].address, ops[idx].size, ops[idx].buffer );
+        }
+    }
+
+    for (auto& op : ops)
+        if (!NT_SUCCESS( op.status ))
+            return op.status;
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Write multiple memory ranges.
+/// Only contiguous or overlapping descriptors are merged, so memory between them is never touched.
+/// Overlapping descriptors are applied in order
+/// </summary>
+/// <param name="ops">Write descriptors. Status of each descriptor is updated</param>
+/// <returns>Status of first failed descriptor, STATUS_SUCCESS if all succeeded</returns>
+NTSTATUS ProcessMemory::WriteV( std::vector<MemIoVec>& ops )
+{
+    std::vector<uint8_t> buf;
+
+    for (auto& run : MergeIoVec( ops, 0 ))
+    {
+        auto& first = ops[run.front()];
+        ptr_t start = first.address, end = first.address + first.size;
+        for (auto idx : run)
+            end = max( end, ops[idx].address + ops[idx].size );
+
+        if (run.size() == 1)
+        {
+            first.status = Write( first.address, first.size, first.buffer );
+            continue;
+        }
+
+        // Gather in original order, so later descriptors override earlier ones
+        std::sort( run.begin(), run.end() );
+
+        buf.resize( static_cast<size_t>(end - start) );
+        for (auto idx : run)
+            memcpy( buf.data() + (ops[idx].address - start), ops[idx].buffer, ops[idx].size );
+
+        auto status = Write( start, buf.size(), buf.data() );
+        for (auto idx : run)
+            ops[idx].status = status;
+    }
+
+    for (auto& op : ops)
+        if (!NT_SUCCESS( op.status ))
+            return op.status;
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Group vectored descriptors into runs of nearby ranges
+/// </summary>
+/// <param name="ops">Descriptors</param>
+/// <param name="gap">Max distance between merged descriptors</param>
+/// <returns>Runs of descriptor indexes, sorted by address</returns>
+std::vector<std::vector<size_t>> ProcessMemory::MergeIoVec( std::vector<MemIoVec>& ops, size_t gap )
+{
+    std::vector<size_t> order;
+    std::vector<std::vector<size_t>> runs;
+
+    order.reserve( ops.size() );
+    for (size_t i = 0; i < ops.size(); i++)
+    {
+        auto& op = ops[i];
+        if (op.address == 0)
+            op.status = STATUS_INVALID_ADDRESS;
+        else if (op.size != 0 && op.buffer == nullptr)
+            op.status = STATUS_INVALID_PARAMETER;
+        else if (op.size == 0)
+            op.status = STATUS_SUCCESS;
+        else
+            order.emplace_back( i );
+    }
+
+    std::stable_sort( order.begin(), order.end(), [&ops]( size_t l, size_t r ) { return ops[l].address < ops[r].address; } );
+
+    ptr_t runEnd = 0;
+    for (auto idx : order)
+    {
+        auto& op = ops[idx];
+        if (runs.empty() || op.address > runEnd + gap)
+        {
+            runs.emplace_back();
+            runEnd = 0;
+        }
+
+        runs.back().emplace_back( idx );
+        runEnd = max( runEnd, op.address + op.size );
+    }
+
+    return runs;
+}
+
 /// <summary>
 /// Enumerate valid memory regions
 /// </summary>
@@ -211,4 +592,26 @@ std::vector<MEMORY_BASIC_INFORMATION64> ProcessMemory::EnumRegions( bool include
     return _core.native()->EnumRegions( includeFree );
 }
 
+/// <summary>
+/// Finish pending async operations, drop watches and cached pages, release remote memory resources
+/// </summary>
+void ProcessMemory::reset()
+{
+    _async.Wait();
+    _watch.Clear();
+    _cache.Clear();
+
+    RemoteMemory::reset();
+}
+
+/// <summary>
+/// Get cached address space layout.
+/// Allocations, releases and protection changes made through this object are tracked automatically
+/// </summary>
+/// <returns>Region map</returns>
+RegionMap& ProcessMemory::regions()
+{
+    return _core.native()->regions();
+}
+
 }
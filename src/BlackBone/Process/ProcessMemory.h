@@ -3,9 +3,15 @@
 #include "../Include/Winheaders.h"
 #include "RPC/RemoteMemory.h"
 #include "MemBlock.h"
+#include "MemoryCache.h"
+#include "PatchTransaction.h"
+#include "MemoryWatch.h"
+#include "MemoryAsync.h"
+#include "../Subsystem/RegionMap.h"
 
 #include <vector>
 #include <list>
+#include <atomic>
 
 namespace blackbone
 {
@@ -17,6 +23,95 @@ enum class MemProtectionCasting
     useDep  // Strip executable flag if DEP is off
 };
 
+/// <summary>
+/// Remote memory operation counters
+/// </summary>
+struct MemoryStats
+{
+    uint64_t reads = 0;         // ReadProcessMemory calls
+    uint64_t writes = 0;        // WriteProcessMemory calls
+    uint64_t protects = 0;      // VirtualProtect calls
+    uint64_t allocations = 0;   // VirtualAlloc calls
+    uint64_t frees = 0;         // VirtualFree calls
+    uint64_t bytesRead = 0;     // Total bytes read
+    uint64_t bytesWritten = 0;  // Total bytes written
+
+    MemoryStats& operator +=( const MemoryStats& rhs )
+    {
+        reads += rhs.reads;
+        writes += rhs.writes;
+        protects += rhs.protects;
+        allocations += rhs.allocations;
+        frees += rhs.frees;
+        bytesRead += rhs.bytesRead;
+        bytesWritten += rhs.bytesWritten;
+        return *this;
+    }
+
+    MemoryStats operator -( const MemoryStats& rhs ) const
+    {
+        MemoryStats res;
+        res.reads = reads - rhs.reads;
+        res.writes = writes - rhs.writes;
+        res.protects = protects - rhs.protects;
+        res.allocations = allocations - rhs.allocations;
+        res.frees = frees - rhs.frees;
+        res.bytesRead = bytesRead - rhs.bytesRead;
+        res.bytesWritten = bytesWritten - rhs.bytesWritten;
+        return res;
+    }
+};
+
+/// <summary>
+/// Remote memory operation counters, updated from scan and remote worker threads
+/// </summary>
+struct MemoryStatsCounters
+{
+    std::atomic<uint64_t> reads{ 0 };
+    std::atomic<uint64_t> writes{ 0 };
+    std::atomic<uint64_t> protects{ 0 };
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> frees{ 0 };
+    std::atomic<uint64_t> bytesRead{ 0 };
+    std::atomic<uint64_t> bytesWritten{ 0 };
+
+    MemoryStats load() const
+    {
+        MemoryStats res;
+        res.reads = reads;
+        res.writes = writes;
+        res.protects = protects;
+        res.allocations = allocations;
+        res.frees = frees;
+        res.bytesRead = bytesRead;
+        res.bytesWritten = bytesWritten;
+        return res;
+    }
+
+    void reset()
+    {
+        reads = writes = protects = allocations = frees = bytesRead = bytesWritten = 0;
+    }
+};
+
+/// <summary>
+/// Vectored read/write descriptor
+/// </summary>
+struct MemIoVec
+{
+    ptr_t address = 0;                  // Remote address
+    size_t size = 0;                    // Data size
+    void* buffer = nullptr;             // Local buffer
+    NTSTATUS status = STATUS_SUCCESS;   // Operation status
+
+    MemIoVec() = default;
+
+    MemIoVec( ptr_t address_, size_t size_, void* buffer_ )
+        : address( address_ )
+        , size( size_ )
+        , buffer( buffer_ ) { }
+};
+
 class ProcessMemory : public RemoteMemory
 {
 public:
@@ -96,6 +191,16 @@ public:
     /// <returns>Status</returns>
     BLACKBONE_API NTSTATUS Read( const std::vector<ptr_t>& adrList, size_t dwSize, PVOID pResult, bool handleHoles = false );
 
+    /// <summary>
+    /// Read all readable pages in range. Unreadable pages are zeroed.
+    /// </summary>
+    /// <param name="dwAddress">Memory address to read from</param>
+    /// <param name="dwSize">Size of data to read</param>
+    /// <param name="pResult">Output buffer</param>
+    /// <param name="validPages">Per-page validity, first entry corresponds to page containing dwAddress</param>
+    /// <returns>STATUS_SUCCESS if all pages were read, STATUS_PARTIAL_COPY if some were read, error code otherwise</returns>
+    BLACKBONE_API NTSTATUS ReadSparse( ptr_t dwAddress, size_t dwSize, PVOID pResult, std::vector<bool>& validPages );
+
     /// <summary>
     /// Write data
     /// </summary>
@@ -114,6 +219,47 @@ public:
     /// <returns>Status</returns>
     BLACKBONE_API NTSTATUS Write( const std::vector<ptr_t>& adrList, size_t dwSize, const void* pData );
 
+    /// <summary>
+    /// Read multiple memory ranges.
+    /// Descriptors closer than ioMergeGap() bytes to each other are read with a single native call
+    /// </summary>
+    /// <param name="ops">Read descriptors. Status of each descriptor is updated</param>
+    /// <returns>Status of first failed descriptor, STATUS_SUCCESS if all succeeded</returns>
+    BLACKBONE_API NTSTATUS ReadV( std::vector<MemIoVec>& ops );
+
+    /// <summary>
+    /// Write multiple memory ranges.
+    /// Only contiguous or overlapping descriptors are merged, so memory between them is never touched.
+    /// Overlapping descriptors are applied in order
+    /// </summary>
+    /// <param name="ops">Write descriptors. Status of each descriptor is updated</param>
+    /// <returns>Status of first failed descriptor, STATUS_SUCCESS if all succeeded</returns>
+    BLACKBONE_API NTSTATUS WriteV( std::vector<MemIoVec>& ops );
+
+    /// <summary>
+    /// Read data on worker thread
+    /// </summary>
+    /// <param name="dwAddress">Memory address to read from</param>
+    /// <param name="dwSize">Size of data to read</param>
+    /// <returns>Pending read</returns>
+    BLACKBONE_API AsyncRead ReadAsync( ptr_t dwAddress, size_t dwSize ) { return _async.Read( dwAddress, dwSize ); }
+
+    /// <summary>
+    /// Write data on worker thread
+    /// </summary>
+    /// <param name="pAddress">Memory address to write to</param>
+    /// <param name="dwSize">Size of data to write</param>
+    /// <param name="pData">Buffer to write, copied before return</param>
+    /// <returns>Write status</returns>
+    BLACKBONE_API std::shared_future<NTSTATUS> WriteAsync( ptr_t pAddress, size_t dwSize, const void* pData ) { return _async.Write( pAddress, dwSize, pData ); }
+
+    /// <summary>
+    /// Get memory region info on worker thread
+    /// </summary>
+    /// <param name="pAddr">Memory address</param>
+    /// <returns>Region info</returns>
+    BLACKBONE_API std::shared_future<call_result_t<MEMORY_BASIC_INFORMATION64>> QueryAsync( ptr_t pAddr ) { return _async.Query( pAddr ); }
+
     /// <summary>
     /// Read data
     /// </summary>
@@ -195,6 +341,12 @@ public:
     /// <returns>Found regions</returns>
     BLACKBONE_API std::vector<MEMORY_BASIC_INFORMATION64> EnumRegions( bool includeFree = false );
 
+    /// <summary>
+    /// Start batched patch. Queued writes are applied by PatchTransaction::Commit
+    /// </summary>
+    /// <returns>Empty transaction</returns>
+    BLACKBONE_API PatchTransaction BeginPatch() { return PatchTransaction( *this ); }
+
     /// <summary>
     /// Get memory protection casting behavior 
     /// </summary>
@@ -207,6 +359,61 @@ public:
     /// <param name="flag">new behavior</param>
     BLACKBONE_API void protectionCasting( MemProtectionCasting casting ) { _casting = casting; }
 
+    /// <summary>
+    /// Get max distance between ReadV descriptors that are read with a single call
+    /// </summary>
+    /// <returns>Gap size in bytes</returns>
+    BLACKBONE_API size_t ioMergeGap() const { return _ioMergeGap; }
+
+    /// <summary>
+    /// Set max distance between ReadV descriptors that are read with a single call
+    /// </summary>
+    /// <param name="gap">Gap size in bytes</param>
+    BLACKBONE_API void ioMergeGap( size_t gap ) { _ioMergeGap = gap; }
+
+    /// <summary>
+    /// Get cached address space layout.
+    /// Allocations, releases and protection changes made through this object are tracked automatically
+    /// </summary>
+    /// <returns>Region map</returns>
+    BLACKBONE_API RegionMap& regions();
+
+    /// <summary>
+    /// Get page read cache. Cache is disabled by default.
+    /// Writes, protection changes and releases made through this object are applied to cache automatically,
+    /// changes made by target process require MemoryCache::BeginEpoch or MemoryCache::Invalidate call.
+    /// </summary>
+    /// <returns>Page cache</returns>
+    BLACKBONE_API MemoryCache& cache() { return _cache; }
+
+    /// <summary>
+    /// Get change monitor of watched ranges
+    /// </summary>
+    /// <returns>Memory watch</returns>
+    BLACKBONE_API MemoryWatch& watch() { return _watch; }
+
+    /// <summary>
+    /// Get asynchronous operation dispatcher
+    /// </summary>
+    /// <returns>Async dispatcher</returns>
+    BLACKBONE_API MemoryAsync& async() { return _async; }
+
+    /// <summary>
+    /// Get remote memory operation counters
+    /// </summary>
+    /// <returns>Counters accumulated since object creation or last reset</returns>
+    BLACKBONE_API MemoryStats stats() const { return _stats.load(); }
+
+    /// <summary>
+    /// Reset remote memory operation counters
+    /// </summary>
+    BLACKBONE_API void resetStats() { _stats.reset(); }
+
+    /// <summary>
+    /// Finish pending async operations, drop watches and cached pages, release remote memory resources
+    /// </summary>
+    BLACKBONE_API void reset();
+
     BLACKBONE_API inline class ProcessCore& core() { return _core; }
     BLACKBONE_API inline class Process* process()  { return _process; }
 
@@ -214,10 +421,43 @@ private:
     ProcessMemory( const ProcessMemory& ) = delete;
     ProcessMemory& operator =( const ProcessMemory& ) = delete;
 
+    /// <summary>
+    /// Group vectored descriptors into runs of nearby ranges
+    /// </summary>
+    /// <param name="ops">Descriptors</param>
+    /// <param name="gap">Max distance between merged descriptors</param>
+    /// <returns>Runs of descriptor indexes, sorted by address</returns>
+    std::vector<std::vector<size_t>> MergeIoVec( std::vector<MemIoVec>& ops, size_t gap );
+
+    /// <summary>
+    /// Read data through page cache
+    /// </summary>
+    /// <param name="dwAddress">Memory address to read from</param>
+    /// <param name="dwSize">Size of data to read</param>
+    /// <param name="pResult">Output buffer</param>
+    /// <returns>Status</returns>
+    NTSTATUS ReadCached( ptr_t dwAddress, size_t dwSize, PVOID pResult );
+
+    /// <summary>
+    /// Read range, splitting it in halves on failure until single unreadable pages are isolated
+    /// </summary>
+    /// <param name="from">Range start</param>
+    /// <param name="to">Range end</param>
+    /// <param name="base">ReadSparse start address</param>
+    /// <param name="pResult">ReadSparse output buffer</param>
+    /// <param name="validPages">ReadSparse page validity</param>
+    /// <returns>Last read failure status, STATUS_SUCCESS if whole range was read</returns>
+    NTSTATUS ReadSplit( ptr_t from, ptr_t to, ptr_t base, uint8_t* pResult, std::vector<bool>& validPages );
+
 private:
     class Process* _process;    // Owning process object
     class ProcessCore& _core;   // Core routines
     MemProtectionCasting _casting = MemProtectionCasting::useDep;
+    MemoryStatsCounters _stats; // Remote operation counters
+    size_t _ioMergeGap = 0x1000;// Max distance between merged ReadV descriptors
+    MemoryCache _cache;         // Page read cache
+    MemoryWatch _watch;         // Watched ranges monitor
+    MemoryAsync _async;         // Asynchronous operations
 };
 
 }
@@ -24,8 +24,10 @@ ProcessModules::ProcessModules( class Process& proc )
     : _proc( proc )
     , _memory( _proc.memory() )
     , _core( _proc.core() )
+    , _loader( proc )
     , _ldrPatched( false )
 {
+    _loader.Subscribe( [this]( const LoaderDelta& delta ) { ApplyLoaderDelta( delta ); } );
 }
 
 ProcessModules::~ProcessModules()
@@ -164,6 +166,18 @@ const ProcessModules::mapModules& ProcessModules::GetAllModules( eModSeachType s
     eModType mt = _core.isWow64() ? mt_mod32 : mt_mod64;
     CSLock lck( _modGuard );
 
+    if (search == LdrList)
+    {
+        UpdateModuleCache( search, mt );
+
+        // Do additional search in case of loader lists
+        // This, however won't search for 32 bit modules in native x64 process
+        if (mt == mt_mod32)
+            UpdateModuleCache( search, mt_mod64 );
+
+        return _modules;
+    }
+
     // Remove non-manual modules
     for (auto iter = _modules.begin(); iter != _modules.end();)
     {
@@ -174,12 +188,6 @@ const ProcessModules::mapModules& ProcessModules::GetAllModules( eModSeachType s
     }
 
     UpdateModuleCache( search, mt );
-
-    // Do additional search in case of loader lists
-    // This, however won't search for 32 bit modules in native x64 process
-    if (search == LdrList && mt == mt_mod32)
-        UpdateModuleCache( search, mt_mod64 );
-
     return _modules;
 }
 
@@ -401,7 +409,6 @@ call_result_t<ModuleDataPtr> ProcessModules::Inject( const std::wstring& path, T
     ModuleDataPtr mod;
     pe::PEImage img;
     uint32_t ustrSize = 0;
-    ptr_t res = 0;    
 
     img.Load( path, true );
     img.Release();
@@ -448,67 +455,303 @@ call_result_t<ModuleDataPtr> ProcessModules::Inject( const std::wstring& path, T
     if (!_proc.core().isWow64() && img.mType() == mt_mod32)
         return STATUS_INVALID_IMAGE_WIN_32;
 
-    auto switchMode = NoSwitch;
-    if (_proc.core().isWow64() && img.mType() == mt_mod64)
-        switchMode = ForceSwitch;
-
     auto pLdrLoadDll = GetNtdllExport( "LdrLoadDll", img.mType(), Sections );
     if (!pLdrLoadDll)
         return pLdrLoadDll.status;
 
-    // Patch LdrFindOrMapDll to enable kernel32.dll loading
-    if (switchMode == ForceSwitch && !_ldrPatched && IsWindows7OrGreater() && !IsWindows8OrGreater())
+    auto a = AsmFactory::GetAssembler( img.mType() );
+
+    a->GenCall( pLdrLoadDll->procAddress, { 0, 0, modName->ptr(), modName->ptr() + 0x800 } );
+    (*a)->ret();
+
+    status = ExecLoader( *a, img.mType(), pThread );
+
+    // Retry with LoadLibrary if possible
+    if (!NT_SUCCESS(status) && pLoadLibrary && sameArch)
+    {
+        auto result = _proc.remote().ExecDirect( pLoadLibrary->procAddress, modName->ptr() + ustrSize );
+        if (result == 0)
+        {
+            return status;
+        }
+    }
+
+    return GetModule( path, LdrList, img.mType() );
+}
+
+/// <summary>
+/// Inject multiple images into target process.
+/// Images are loaded in order by a single remote call, failed image doesn't stop the rest
+/// </summary>
+/// <param name="paths">Full-qualified image paths</param>
+/// <param name="pThread">Thread to execute load in, nullptr - new thread</param>
+/// <returns>Module info and load status of every image, in the same order as paths</returns>
+call_result_t<std::vector<call_result_t<ModuleDataPtr>>> ProcessModules::Inject(
+    const std::vector<std::wstring>& paths,
+    ThreadPtr pThread /*= nullptr*/
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    std::vector<call_result_t<ModuleDataPtr>> results( paths.size() );
+    std::map<eModType, std::vector<size_t>> batches;
+
+    for (size_t i = 0; i < paths.size(); i++)
     {
-        uint8_t patch[] = { 0x90, 0x90, 0x90, 0x90, 0x90, 0x90 };
-        auto patchBase = g_symbols.LdrKernel32PatchAddress;
+        pe::PEImage img;
+        img.Load( paths[i], true );
+        img.Release();
+
+        if (img.mType() != mt_mod32 && img.mType() != mt_mod64)
+            results[i] = STATUS_INVALID_IMAGE_FORMAT;
+        // Can't inject 32bit dll into native process
+        else if (!_core.isWow64() && img.mType() == mt_mod32)
+            results[i] = STATUS_INVALID_IMAGE_WIN_32;
+        else if (paths[i].size() * sizeof( wchar_t ) > UNICODE_STRING_MAX_BYTES - sizeof( wchar_t ))
+            results[i] = STATUS_NAME_TOO_LONG;
+        else
+            batches[img.mType()].emplace_back( i );
+    }
 
-        if (patchBase != 0)
+    for (auto& [type, indices] : batches)
+    {
+        // Skip already loaded images, loader list is walked once per image type
         {
-            DWORD flOld = 0;
-            _memory.Protect( patchBase, sizeof( patch ), PAGE_EXECUTE_READWRITE, &flOld );
-            _memory.Write( patchBase, sizeof( patch ), patch );
-            _memory.Protect( patchBase, sizeof( patch ), flOld, nullptr );
+            CSLock lck( _modGuard );
+            UpdateModuleCache( LdrList, type );
+
+            std::vector<size_t> pending;
+            for (auto idx : indices)
+            {
+                auto iter = _modules.find( std::make_pair( Utils::ToLower( Utils::StripPath( paths[idx] ) ), type ) );
+                if (iter != _modules.end() && (iter->second->manual || ValidateModule( iter->second->baseAddress )))
+                    results[idx] = call_result_t<ModuleDataPtr>( iter->second, STATUS_IMAGE_ALREADY_LOADED );
+                else
+                    pending.emplace_back( idx );
+            }
+
+            indices = std::move( pending );
         }
 
-        _ldrPatched = true;
+        if (indices.empty())
+            continue;
+
+        NTSTATUS batchStatus = type == mt_mod32
+            ? InjectBatch<uint32_t>( paths, indices, type, pThread, results )
+            : InjectBatch<uint64_t>( paths, indices, type, pThread, results );
+
+        if (!NT_SUCCESS( batchStatus ))
+        {
+            for (auto idx : indices)
+                results[idx] = batchStatus;
+
+            if (NT_SUCCESS( status ))
+                status = batchStatus;
+        }
     }
 
-    auto a = AsmFactory::GetAssembler( img.mType() );
+    return call_result_t<std::vector<call_result_t<ModuleDataPtr>>>( std::move( results ), status );
+}
 
-    a->GenCall( pLdrLoadDll->procAddress, { 0, 0, modName->ptr(), modName->ptr() + 0x800 } );
+/// <summary>
+/// Per-image output of batch load stub
+/// </summary>
+struct BatchLoadRecord
+{
+    uint64_t base;      // Image base, written by LdrLoadDll
+    uint64_t ldrEntry;  // Loader entry, written by LdrFindEntryForAddress
+    uint32_t status;    // LdrLoadDll status
+    uint32_t size;      // Image size, copied from loader entry
+};
+
+/// <summary>
+/// Load images of the same type with a single LdrLoadDll stub
+/// </summary>
+/// <param name="paths">Image paths</param>
+/// <param name="indices">Indices of paths to load</param>
+/// <param name="type">Image type</param>
+/// <param name="pThread">Thread to execute load in, nullptr - new thread</param>
+/// <param name="results">Per-image results, indexed as paths</param>
+/// <returns>Status code</returns>
+template<typename T>
+NTSTATUS ProcessModules::InjectBatch(
+    const std::vector<std::wstring>& paths,
+    const std::vector<size_t>& indices,
+    eModType type,
+    ThreadPtr pThread,
+    std::vector<call_result_t<ModuleDataPtr>>& results
+    )
+{
+    using namespace asmjit::host;
+    using ustr_t = _UNICODE_STRING_T<T>;
+
+    NTSTATUS status = STATUS_SUCCESS;
+
+    auto pLdrLoadDll = GetNtdllExport( "LdrLoadDll", type, Sections );
+    if (!pLdrLoadDll)
+        return pLdrLoadDll.status;
+
+    auto pFindEntry = GetNtdllExport( "LdrFindEntryForAddress", type, Sections );
+    if (!pFindEntry)
+        return pFindEntry.status;
+
+    // Block layout: load records, UNICODE_STRINGs, path buffers
+    const size_t count = indices.size();
+    const size_t ustrOffset = count * sizeof( BatchLoadRecord );
+    const size_t textOffset = ustrOffset + count * sizeof( ustr_t );
+
+    size_t size = textOffset;
+    for (auto idx : indices)
+        size += Align( (paths[idx].size() + 1) * sizeof( wchar_t ), sizeof( uint64_t ) );
+
+    auto block = _memory.Allocate( size, PAGE_READWRITE );
+    if (!block)
+        return block.status;
+
+    // Records are zeroed, so pointer fields of 32 bit images are valid 64 bit values
+    std::vector<uint8_t> image( size, 0 );
+    auto ustrs = reinterpret_cast<ustr_t*>(image.data() + ustrOffset);
+
+    for (size_t i = 0, offset = textOffset; i < count; i++)
+    {
+        auto& path = paths[indices[i]];
+
+        ustrs[i].Buffer = static_cast<T>(block->ptr() + offset);
+        ustrs[i].Length = ustrs[i].MaximumLength = static_cast<uint16_t>(path.size() * sizeof( wchar_t ));
+        memcpy( image.data() + offset, path.c_str(), path.size() * sizeof( wchar_t ) );
+
+        offset += Align( (path.size() + 1) * sizeof( wchar_t ), sizeof( uint64_t ) );
+    }
+
+    if (!NT_SUCCESS( status = block->Write( 0, size, image.data() ) ))
+        return status;
+
+    auto a = AsmFactory::GetAssembler( type );
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ptr_t record = block->ptr() + i * sizeof( BatchLoadRecord );
+        auto l_next = (*a)->newLabel();
+
+        // status = LdrLoadDll( NULL, 0, &name, &base );
+        a->GenCall( pLdrLoadDll->procAddress, { 0, 0, block->ptr() + ustrOffset + i * sizeof( ustr_t ), record + offsetof( BatchLoadRecord, base ) } );
+        (*a)->mov( (*a)->zdx, record );
+        (*a)->mov( dword_ptr( (*a)->zdx, offsetof( BatchLoadRecord, status ) ), eax );
+        (*a)->test( eax, eax );
+        (*a)->js( l_next );
+
+        // LdrFindEntryForAddress( base, &entry ); size = entry->SizeOfImage;
+        (*a)->mov( (*a)->zax, (*a)->intptr_ptr( (*a)->zdx, offsetof( BatchLoadRecord, base ) ) );
+        a->GenCall( pFindEntry->procAddress, { (*a)->zax, record + offsetof( BatchLoadRecord, ldrEntry ) } );
+        (*a)->mov( (*a)->zdx, record );
+        (*a)->mov( (*a)->zax, (*a)->intptr_ptr( (*a)->zdx, offsetof( BatchLoadRecord, ldrEntry ) ) );
+        (*a)->test( (*a)->zax, (*a)->zax );
+        (*a)->jz( l_next );
+        (*a)->mov( eax, dword_ptr( (*a)->zax, FIELD_OFFSET( _LDR_DATA_TABLE_ENTRY_BASE_T<T>, SizeOfImage ) ) );
+        (*a)->mov( dword_ptr( (*a)->zdx, offsetof( BatchLoadRecord, size ) ), eax );
+        (*a)->bind( l_next );
+    }
+
+    // Per-image statuses are in records
+    (*a)->xor_( eax, eax );
     (*a)->ret();
 
+    if (!NT_SUCCESS( status = ExecLoader( *a, type, pThread ) ))
+        return status;
+
+    std::vector<BatchLoadRecord> records( count );
+    if (!NT_SUCCESS( status = block->Read( 0, count * sizeof( BatchLoadRecord ), records.data() ) ))
+        return status;
+
+    // Add loaded images to cache directly, next loader snapshot update will only confirm them
+    CSLock lck( _modGuard );
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto& record = records[i];
+        auto idx = indices[i];
+
+        NTSTATUS loadStatus = static_cast<NTSTATUS>(record.status);
+        if (!NT_SUCCESS( loadStatus ))
+        {
+            results[idx] = loadStatus;
+            continue;
+        }
+
+        ModuleData data = {};
+        data.baseAddress = record.base;
+        data.size = record.size;
+        data.ldrPtr = record.ldrEntry;
+        data.type = type;
+        data.fullPath = Utils::ToLower( paths[idx] );
+        data.name = Utils::StripPath( data.fullPath );
+        data.manual = false;
+
+        auto mod = std::make_shared<const ModuleData>( data );
+        _modules[std::make_pair( data.name, type )] = mod;
+        results[idx] = call_result_t<ModuleDataPtr>( mod, loadStatus );
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Execute LdrLoadDll stub
+/// </summary>
+/// <param name="a">Assembled stub</param>
+/// <param name="type">Image type</param>
+/// <param name="pThread">Thread to execute stub in, nullptr - new thread</param>
+/// <returns>Stub return value or execution status</returns>
+NTSTATUS ProcessModules::ExecLoader( IAsmHelper& a, eModType type, ThreadPtr pThread )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    uint64_t res = 0;
+
+    auto switchMode = NoSwitch;
+    if (_proc.core().isWow64() && type == mt_mod64)
+    {
+        switchMode = ForceSwitch;
+        PatchLdrKernel32();
+    }
+
     _proc.remote().CreateRPCEnvironment( Worker_None, true );
 
     // Execute call
     if (pThread != nullptr)
     {
         if (pThread == _proc.remote().getWorker())
-            status = _proc.remote().ExecInWorkerThread( (*a)->make(), (*a)->getCodeSize(), res );
+            status = _proc.remote().ExecInWorkerThread( a->make(), a->getCodeSize(), res );
         else
-            status = _proc.remote().ExecInAnyThread( (*a)->make(), (*a)->getCodeSize(), res, pThread );
-
-        if (NT_SUCCESS( status ))
-            status = static_cast<NTSTATUS>(res);
+            status = _proc.remote().ExecInAnyThread( a->make(), a->getCodeSize(), res, pThread );
     }
     else
-    {
-        status = _proc.remote().ExecInNewThread( (*a)->make(), (*a)->getCodeSize(), res, switchMode );
-        if (NT_SUCCESS( status ))
-            status = static_cast<NTSTATUS>(res);
-    }
+        status = _proc.remote().ExecInNewThread( a->make(), a->getCodeSize(), res, switchMode );
 
-    // Retry with LoadLibrary if possible
-    if (!NT_SUCCESS(status) && pLoadLibrary && sameArch)
+    if (NT_SUCCESS( status ))
+        status = static_cast<NTSTATUS>(res);
+
+    return status;
+}
+
+/// <summary>
+/// Patch LdrFindOrMapDll to enable 64 bit kernel32.dll loading in WOW64 process on Win7
+/// </summary>
+void ProcessModules::PatchLdrKernel32()
+{
+    if (_ldrPatched || !IsWindows7OrGreater() || IsWindows8OrGreater())
+        return;
+
+    uint8_t patch[] = { 0x90, 0x90, 0x90, 0x90, 0x90, 0x90 };
+    auto patchBase = g_symbols.LdrKernel32PatchAddress;
+
+    if (patchBase != 0)
     {
-        auto result = _proc.remote().ExecDirect( pLoadLibrary->procAddress, modName->ptr() + ustrSize );
-        if (result == 0)
-        {
-            return status;
-        }
+        DWORD flOld = 0;
+        _memory.Protect( patchBase, sizeof( patch ), PAGE_EXECUTE_READWRITE, &flOld );
+        _memory.Write( patchBase, sizeof( patch ), patch );
+        _memory.Protect( patchBase, sizeof( patch ), flOld, nullptr );
     }
 
-    return GetModule( path, LdrList, img.mType() );
+    _ldrPatched = true;
 }
 
 /// <summary>
@@ -627,10 +870,55 @@ void ProcessModules::RemoveManualModule( const std::wstring& filename, eModType
 
 void ProcessModules::UpdateModuleCache( eModSeachType search, eModType type )
 {
+    if (search == LdrList)
+    {
+        _loader.Update( type );
+
+        // Entries found by other search methods aren't part of the snapshot
+        // and wouldn't be replaced by an empty delta, so rebuild them from the snapshot
+        for (auto iter = _modules.begin(); iter != _modules.end();)
+        {
+            if (!iter->second->manual && iter->first.second == type)
+                iter = _modules.erase( iter );
+            else
+                ++iter;
+        }
+
+        for (const auto& mod : _loader.modules( type ))
+            _modules.emplace( std::make_pair( mod->name, mod->type ), mod );
+
+        return;
+    }
+
     for (const auto& mod : _core.native()->EnumModules( search, type ))
         _modules.emplace( std::make_pair( mod->name, mod->type ), mod );
 }
 
+/// <summary>
+/// Apply loader list changes to module cache
+/// </summary>
+/// <param name="delta">Loader list changes</param>
+void ProcessModules::ApplyLoaderDelta( const LoaderDelta& delta )
+{
+    CSLock lck( _modGuard );
+
+    for (const auto& mod : delta.unloaded)
+    {
+        auto iter = _modules.find( std::make_pair( mod->name, mod->type ) );
+        if (iter != _modules.end() && !iter->second->manual && iter->second->baseAddress == mod->baseAddress)
+            _modules.erase( iter );
+    }
+
+    for (const auto& mod : delta.loaded)
+    {
+        auto iter = _modules.find( std::make_pair( mod->name, mod->type ) );
+        if (iter == _modules.end())
+            _modules.emplace( std::make_pair( mod->name, mod->type ), mod );
+        else if (!iter->second->manual)
+            iter->second = mod;
+    }
+}
+
 
 using namespace asmjit;
 using namespace asmjit::host;
@@ -956,6 +1244,7 @@ void ProcessModules::reset()
     CSLock lck( _modGuard );
 
     _modules.clear(); 
+    _loader.Reset();
     _ldrPatched = false;
 }
 
@@ -7,8 +7,10 @@
 #include "../PE/PEImage.h"
 #include "../Misc/Utils.h"
 #include "Threads/Thread.h"
+#include "LoaderSnapshot.h"
 
 #include <string>
+#include <vector>
 #include <map>
 #include <unordered_map>
 #include <algorithm>
@@ -167,6 +169,18 @@ public:
     /// <returns>Module info. nullptr if failed</returns>
     BLACKBONE_API call_result_t<ModuleDataPtr> Inject( const std::wstring& path, ThreadPtr pThread = nullptr );
 
+    /// <summary>
+    /// Inject multiple images into target process.
+    /// Images are loaded in order by a single remote call, failed image doesn't stop the rest
+    /// </summary>
+    /// <param name="paths">Full-qualified image paths</param>
+    /// <param name="pThread">Thread to execute load in, nullptr - new thread</param>
+    /// <returns>Module info and load status of every image, in the same order as paths</returns>
+    BLACKBONE_API call_result_t<std::vector<call_result_t<ModuleDataPtr>>> Inject(
+        const std::vector<std::wstring>& paths,
+        ThreadPtr pThread = nullptr
+        );
+
 #ifdef COMPILER_MSVC
     /// <summary>
     /// Inject pure IL image.
@@ -235,18 +249,63 @@ public:
     /// </summary>
     BLACKBONE_API void reset();
 
+    /// <summary>
+    /// Get loader list snapshot. Module cache follows every snapshot update
+    /// </summary>
+    /// <returns>Loader snapshot</returns>
+    BLACKBONE_API LoaderSnapshot& loader() { return _loader; }
+
 private:
     ProcessModules( const ProcessModules& ) = delete;
     ProcessModules operator =(const ProcessModules&) = delete;
 
     void UpdateModuleCache( eModSeachType search, eModType type );
 
+    /// <summary>
+    /// Load images of the same type with a single LdrLoadDll stub
+    /// </summary>
+    /// <param name="paths">Image paths</param>
+    /// <param name="indices">Indices of paths to load</param>
+    /// <param name="type">Image type</param>
+    /// <param name="pThread">Thread to execute load in, nullptr - new thread</param>
+    /// <param name="results">Per-image results, indexed as paths</param>
+    /// <returns>Status code</returns>
+    template<typename T>
+    NTSTATUS InjectBatch(
+        const std::vector<std::wstring>& paths,
+        const std::vector<size_t>& indices,
+        eModType type,
+        ThreadPtr pThread,
+        std::vector<call_result_t<ModuleDataPtr>>& results
+        );
+
+    /// <summary>
+    /// Execute LdrLoadDll stub
+    /// </summary>
+    /// <param name="a">Assembled stub</param>
+    /// <param name="type">Image type</param>
+    /// <param name="pThread">Thread to execute stub in, nullptr - new thread</param>
+    /// <returns>Stub return value or execution status</returns>
+    NTSTATUS ExecLoader( class IAsmHelper& a, eModType type, ThreadPtr pThread );
+
+    /// <summary>
+    /// Patch LdrFindOrMapDll to enable 64 bit kernel32.dll loading in WOW64 process on Win7
+    /// </summary>
+    void PatchLdrKernel32();
+
+    /// <summary>
+    /// Apply loader list changes to module cache
+    /// </summary>
+    /// <param name="delta">Loader list changes</param>
+    void ApplyLoaderDelta( const LoaderDelta& delta );
+
 private:
     class Process&       _proc;
     class ProcessMemory& _memory;
     class ProcessCore&   _core;
 
     mapModules _modules;            // Fast lookup cache
+    LoaderSnapshot _loader;         // Loader list snapshot
     CriticalSection _modGuard;      // Module guard        
     bool _ldrPatched;               // Win7 loader patch flag
 };
@@ -0,0 +1,242 @@
+#include "ArgumentArena.h"
+#include "../ProcessMemory.h"
+#include "../../Include/Macro.h"
+
+namespace blackbone
+{
+
+ArgumentArena::ArgumentArena( ProcessMemory& memory )
+    : _memory( memory )
+{
+}
+
+/// <summary>
+/// Lay out argument data and write it into remote block.
+/// Sets new_imm_val of dataPtr and dataStruct arguments
+/// </summary>
+/// <param name="args">Function arguments</param>
+/// <param name="x86">Target code is 32 bit</param>
+/// <returns>Status code</returns>
+NTSTATUS ArgumentArena::Marshal( std::vector<AsmVariant>& args, bool x86 )
+{
+    _readBegin = _readEnd = 0;
+
+    // Offsets first, block may move while growing
+    _image.resize( Layout( args, x86, 0 ) );
+    if (_image.empty())
+        return STATUS_SUCCESS;
+
+    NTSTATUS status = Reserve( _image.size() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    Store( args );
+    return _block.Write( 0, _image.size(), _image.data() );
+}
+
+/// <summary>
+/// Lay out data of several argument lists into one remote block and write it.
+/// Block starts with zeroed header reserved for caller, header is read back by Unmarshal
+/// </summary>
+/// <param name="lists">Argument lists</param>
+/// <param name="x86">Target code is 32 bit</param>
+/// <param name="header">Header size</param>
+/// <returns>Status code</returns>
+NTSTATUS ArgumentArena::Marshal( const std::vector<std::vector<AsmVariant>*>& lists, bool x86, size_t header /*= 0*/ )
+{
+    _readBegin = _readEnd = 0;
+
+    size_t offset = header;
+    for (auto args : lists)
+        offset = Layout( *args, x86, offset );
+
+    if (header != 0)
+    {
+        _readBegin = 0;
+        _readEnd = max( _readEnd, header );
+    }
+
+    _image.resize( offset );
+    if (_image.empty())
+        return STATUS_SUCCESS;
+
+    NTSTATUS status = Reserve( _image.size() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    memset( _image.data(), 0, header );
+    for (auto args : lists)
+        Store( *args );
+
+    return _block.Write( 0, _image.size(), _image.data() );
+}
+
+/// <summary>
+/// Copy dataPtr arguments back from remote block
+/// </summary>
+/// <param name="args">Arguments previously passed to Marshal</param>
+/// <returns>Status code</returns>
+NTSTATUS ArgumentArena::Unmarshal( const std::vector<AsmVariant>& args )
+{
+    NTSTATUS status = ReadBack();
+    if (NT_SUCCESS( status ))
+        Load( args );
+
+    return status;
+}
+
+/// <summary>
+/// Copy dataPtr arguments and block header back from remote block
+/// </summary>
+/// <param name="lists">Argument lists previously passed to Marshal</param>
+/// <returns>Status code</returns>
+NTSTATUS ArgumentArena::Unmarshal( const std::vector<std::vector<AsmVariant>*>& lists )
+{
+    NTSTATUS status = ReadBack();
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    for (auto args : lists)
+        Load( *args );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Release remote block
+/// </summary>
+void ArgumentArena::reset()
+{
+    _block.Reset();
+    _image.clear();
+    _readBegin = _readEnd = 0;
+}
+
+/// <summary>
+/// Assign block offsets to argument data
+/// </summary>
+/// <param name="args">Function arguments</param>
+/// <param name="x86">Target code is 32 bit</param>
+/// <param name="offset">First free block offset</param>
+/// <returns>Next free block offset</returns>
+size_t ArgumentArena::Layout( std::vector<AsmVariant>& args, bool x86, size_t offset )
+{
+    for (auto& arg : args)
+    {
+        // Transform 64 bit imm values
+        if (arg.type == AsmVariant::imm && arg.size > sizeof( uint32_t ) && x86)
+        {
+            arg.type = AsmVariant::dataStruct;
+            arg.buf.resize( arg.size );
+            memcpy( arg.buf.data(), &arg.imm_val64, arg.size );
+            arg.imm_val64 = reinterpret_cast<uint64_t>(arg.buf.data());
+        }
+
+        if (arg.type != AsmVariant::dataStruct && arg.type != AsmVariant::dataPtr)
+            continue;
+
+        offset = Align( offset, Alignment( arg, x86 ) );
+        arg.new_imm_val = offset;
+
+        if (arg.type == AsmVariant::dataPtr)
+        {
+            if (_readEnd == 0)
+                _readBegin = offset;
+
+            _readEnd = offset + arg.size;
+        }
+
+        offset += arg.size;
+    }
+
+    return offset;
+}
+
+/// <summary>
+/// Copy argument data into local block image and relocate it to remote block
+/// </summary>
+/// <param name="args">Function arguments, see Layout</param>
+void ArgumentArena::Store( std::vector<AsmVariant>& args )
+{
+    for (auto& arg : args)
+    {
+        if (arg.type != AsmVariant::dataStruct && arg.type != AsmVariant::dataPtr)
+            continue;
+
+        memcpy( _image.data() + arg.new_imm_val, reinterpret_cast<const void*>(arg.imm_val), arg.size );
+        arg.new_imm_val += _block.ptr();
+    }
+}
+
+/// <summary>
+/// Copy dataPtr arguments from local block image
+/// </summary>
+/// <param name="args">Function arguments</param>
+void ArgumentArena::Load( const std::vector<AsmVariant>& args )
+{
+    for (auto& arg : args)
+        if (arg.type == AsmVariant::dataPtr)
+            memcpy( reinterpret_cast<void*>(arg.imm_val), _image.data() + (arg.new_imm_val - _block.ptr()), arg.size );
+}
+
+/// <summary>
+/// Read output buffers into local block image
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS ArgumentArena::ReadBack()
+{
+    if (_readEnd <= _readBegin)
+        return STATUS_SUCCESS;
+
+    return _block.Read( _readBegin, _readEnd - _readBegin, _image.data() + _readBegin );
+}
+
+/// <summary>
+/// Ensure remote block can hold requested size
+/// </summary>
+/// <param name="size">Required size</param>
+/// <returns>Status code</returns>
+NTSTATUS ArgumentArena::Reserve( size_t size )
+{
+    if (!_block.valid())
+    {
+        auto mem = _memory.Allocate( Align( max( size, size_t( 0x1000 ) ), 0x1000 ), PAGE_READWRITE );
+        if (!mem)
+            return mem.status;
+
+        _block = std::move( mem.result() );
+        return STATUS_SUCCESS;
+    }
+
+    if (size <= _block.size())
+        return STATUS_SUCCESS;
+
+    size_t newSize = _block.size();
+    while (newSize < size)
+        newSize *= 2;
+
+    auto res = _block.Realloc( newSize, 0, PAGE_READWRITE );
+    return res.status;
+}
+
+/// <summary>
+/// Get argument data alignment
+/// </summary>
+/// <param name="arg">Argument</param>
+/// <param name="x86">Target code is 32 bit</param>
+/// <returns>Alignment</returns>
+size_t ArgumentArena::Alignment( const AsmVariant& arg, bool x86 )
+{
+    // Copy of by-value structure must be 16 byte aligned
+    if (arg.type == AsmVariant::dataStruct && !x86)
+        return 0x10;
+
+    // Natural alignment
+    size_t align = 1;
+    while (align < arg.size && align < 0x10)
+        align <<= 1;
+
+    return align;
+}
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../../Include/Winheaders.h"
+#include "../../Asm/AsmVariant.hpp"
+#include "../MemBlock.h"
+
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Remote buffer for out-of-line call arguments: strings, pointed data and structures passed by value.
+/// All argument data is laid out contiguously and written with one call;
+/// output buffers are copied back with one read covering all of them.
+/// Block grows by doubling, so it is reallocated only a few times over its lifetime.
+///
+/// Alignment follows callee ABI:
+///  - x64 structure passed by value is passed by pointer to a 16 byte aligned copy
+///  - other data is aligned on its natural boundary, up to 16 bytes
+/// 64 bit immediate values can't be passed in x86 registers, so they are turned into by-value structures.
+/// </summary>
+class ArgumentArena
+{
+public:
+    BLACKBONE_API ArgumentArena( class ProcessMemory& memory );
+    BLACKBONE_API ~ArgumentArena() = default;
+
+    BLACKBONE_API ArgumentArena( ArgumentArena&& ) = default;
+
+    /// <summary>
+    /// Lay out argument data and write it into remote block.
+    /// Sets new_imm_val of dataPtr and dataStruct arguments
+    /// </summary>
+    /// <param name="args">Function arguments</param>
+    /// <param name="x86">Target code is 32 bit</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Marshal( std::vector<AsmVariant>& args, bool x86 );
+
+    /// <summary>
+    /// Lay out data of several argument lists into one remote block and write it.
+    /// Block starts with zeroed header reserved for caller, header is read back by Unmarshal
+    /// </summary>
+    /// <param name="lists">Argument lists</param>
+    /// <param name="x86">Target code is 32 bit</param>
+    /// <param name="header">Header size</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Marshal( const std::vector<std::vector<AsmVariant>*>& lists, bool x86, size_t header = 0 );
+
+    /// <summary>
+    /// Copy dataPtr arguments back from remote block
+    /// </summary>
+    /// <param name="args">Arguments previously passed to Marshal</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Unmarshal( const std::vector<AsmVariant>& args );
+
+    /// <summary>
+    /// Copy dataPtr arguments and block header back from remote block
+    /// </summary>
+    /// <param name="lists">Argument lists previously passed to Marshal</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Unmarshal( const std::vector<std::vector<AsmVariant>*>& lists );
+
+    /// <summary>
+    /// Release remote block
+    /// </summary>
+    BLACKBONE_API void reset();
+
+    BLACKBONE_API ptr_t ptr() const { return _block.ptr(); }
+    BLACKBONE_API size_t size() const { return _block.size(); }
+    BLACKBONE_API size_t used() const { return _image.size(); }
+    BLACKBONE_API const uint8_t* data() const { return _image.data(); }
+
+private:
+    /// <summary>
+    /// Assign block offsets to argument data
+    /// </summary>
+    /// <param name="args">Function arguments</param>
+    /// <param name="x86">Target code is 32 bit</param>
+    /// <param name="offset">First free block offset</param>
+    /// <returns>Next free block offset</returns>
+    size_t Layout( std::vector<AsmVariant>& args, bool x86, size_t offset );
+
+    /// <summary>
+    /// Copy argument data into local block image and relocate it to remote block
+    /// </summary>
+    /// <param name="args">Function arguments, see Layout</param>
+    void Store( std::vector<AsmVariant>& args );
+
+    /// <summary>
+    /// Copy dataPtr arguments from local block image
+    /// </summary>
+    /// <param name="args">Function arguments</param>
+    void Load( const std::vector<AsmVariant>& args );
+
+    /// <summary>
+    /// Read output buffers into local block image
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS ReadBack();
+
+    /// <summary>
+    /// Ensure remote block can hold requested size
+    /// </summary>
+    /// <param name="size">Required size</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Reserve( size_t size );
+
+    /// <summary>
+    /// Get argument data alignment
+    /// </summary>
+    /// <param name="arg">Argument</param>
+    /// <param name="x86">Target code is 32 bit</param>
+    /// <returns>Alignment</returns>
+    static size_t Alignment( const AsmVariant& arg, bool x86 );
+
+    ArgumentArena( const ArgumentArena& ) = delete;
+    ArgumentArena& operator =( const ArgumentArena& ) = delete;
+
+private:
+    class ProcessMemory& _memory;
+    MemBlock _block;                    // Remote argument block
+    std::vector<uint8_t> _image;        // Local block image
+    size_t _readBegin = 0;              // Start of output buffers
+    size_t _readEnd = 0;                // End of output buffers
+};
+
+}
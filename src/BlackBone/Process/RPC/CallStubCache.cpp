@@ -0,0 +1,318 @@
+#include "CallStubCache.h"
+#include "RemoteExec.h"
+#include "../ProcessMemory.h"
+#include "../../Asm/AsmFactory.h"
+
+namespace blackbone
+{
+
+// Marker values can't be encoded as short immediates
+constexpr uint32_t StubMarker32 = 0xB1ACA500;
+constexpr uint64_t StubMarker64 = 0xB1ACB1ACA5A50000ull;
+
+// Stub code is carved from pools of this size
+constexpr size_t StubPoolSize = 0x10000;
+
+CallStubCache::CallStubCache( RemoteExec& remote, ProcessMemory& memory )
+    : _remote( remote )
+    , _memory( memory )
+{
+}
+
+/// <summary>
+/// Get stub for call signature and patch its slots with argument values
+/// </summary>
+/// <param name="pfn">Remote function pointer</param>
+/// <param name="args">Prepared function arguments, see RemoteExec::PrepareCallArguments</param>
+/// <param name="cc">Calling convention</param>
+/// <param name="retType">Return type</param>
+/// <param name="x86">Target code is 32 bit</param>
+/// <param name="bufferIdx">User buffer index stub is bound to</param>
+/// <returns>Remote stub address, STATUS_NOT_SUPPORTED if arguments can't be relocated</returns>
+call_result_t<ptr_t> CallStubCache::Get(
+    ptr_t pfn,
+    const std::vector<AsmVariant>& args,
+    eCalligConvention cc,
+    eReturnType retType,
+    bool x86,
+    int bufferIdx
+    )
+{
+    Key key;
+    if (!MakeKey( args, cc, retType, x86, bufferIdx, key ))
+        return STATUS_NOT_SUPPORTED;
+
+    NTSTATUS status = STATUS_SUCCESS;
+    auto iter = _stubs.find( key );
+    if (iter == _stubs.end())
+    {
+        _misses++;
+
+        // Signatures that can't be relocated are remembered as invalid
+        iter = _stubs.emplace( key, Stub() ).first;
+        if (!NT_SUCCESS( status = Build( iter->second, args, cc, retType, x86 ) ))
+        {
+            if (status != STATUS_NOT_SUPPORTED)
+                _stubs.erase( iter );
+
+            return status;
+        }
+
+        status = Patch( iter->second, pfn, args, true );
+    }
+    else if (!iter->second.valid)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+    else
+    {
+        _hits++;
+        status = Patch( iter->second, pfn, args, false );
+    }
+
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    return iter->second.address;
+}
+
+/// <summary>
+/// Release all stubs
+/// </summary>
+void CallStubCache::reset()
+{
+    _stubs.clear();
+    _pools.clear();
+    _poolUsed = 0;
+    _hits = _misses = 0;
+}
+
+/// <summary>
+/// Build signature key
+/// </summary>
+/// <returns>false if arguments can't be relocated</returns>
+bool CallStubCache::MakeKey(
+    const std::vector<AsmVariant>& args,
+    eCalligConvention cc,
+    eReturnType retType,
+    bool x86,
+    int bufferIdx,
+    Key& key
+    )
+{
+    key = { x86, static_cast<uint64_t>(cc), static_cast<uint64_t>(retType), static_cast<uint64_t>(bufferIdx), args.size() };
+
+    for (auto& arg : args)
+    {
+        switch (arg.type)
+        {
+        case AsmVariant::imm:
+        case AsmVariant::imm_float:
+        case AsmVariant::imm_double:
+        case AsmVariant::dataStruct:
+        case AsmVariant::structRet:
+            // Size affects stack layout and cleanup
+            key.emplace_back( arg.type );
+            key.emplace_back( arg.size );
+            break;
+
+        case AsmVariant::dataPtr:
+            key.emplace_back( arg.type );
+            break;
+
+        // Registers and stack variables aren't relocatable
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Assemble stub and locate its relocation slots
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS CallStubCache::Build(
+    Stub& stub,
+    const std::vector<AsmVariant>& args,
+    eCalligConvention cc,
+    eReturnType retType,
+    bool x86
+    )
+{
+    std::vector<std::pair<uint64_t, Slot>> markers;
+    auto marker = [&markers]( int32_t arg, uint32_t width, uint32_t shift = 0 ) -> uint64_t
+    {
+        auto id = static_cast<uint32_t>(markers.size());
+        uint64_t value = width == sizeof( uint32_t ) ? StubMarker32 + id : StubMarker64 + id;
+
+        Slot slot;
+        slot.width = width;
+        slot.arg = arg;
+        slot.shift = shift;
+
+        markers.emplace_back( value, slot );
+        return value;
+    };
+
+    // Replace every value with a marker
+    uint32_t ptrSize = x86 ? sizeof( uint32_t ) : sizeof( uint64_t );
+    auto pfnMarker = marker( -1, ptrSize );
+
+    auto marked = args;
+    for (int32_t i = 0; i < static_cast<int32_t>(marked.size()); i++)
+    {
+        auto& arg = marked[i];
+        switch (arg.type)
+        {
+        case AsmVariant::imm:
+        case AsmVariant::structRet:
+            arg.imm_val64 = marker( i, ptrSize );
+            break;
+
+        case AsmVariant::dataPtr:
+        case AsmVariant::dataStruct:
+            arg.new_imm_val = marker( i, ptrSize );
+            break;
+
+        case AsmVariant::imm_float:
+            arg.imm_val64 = 0;
+            arg.imm_val32 = static_cast<uint32_t>(marker( i, sizeof( uint32_t ) ));
+            break;
+
+        // x86 pushes double as two dwords
+        case AsmVariant::imm_double:
+            if (x86)
+            {
+                uint64_t low = marker( i, sizeof( uint32_t ) );
+                uint64_t high = marker( i, sizeof( uint32_t ), 32 );
+                arg.imm_val64 = (high << 32) | low;
+            }
+            else
+                arg.imm_val64 = marker( i, sizeof( uint64_t ) );
+            break;
+
+        default:
+            return STATUS_NOT_SUPPORTED;
+        }
+    }
+
+    auto a = AsmFactory::GetAssembler( x86 );
+    NTSTATUS status = _remote.AssembleCall( *a, pfnMarker, marked, cc, retType );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    auto pCode = reinterpret_cast<const uint8_t*>((*a)->make());
+    stub.image.assign( pCode, pCode + (*a)->getCodeSize() );
+
+    // Each marker must be found exactly once, otherwise slot is ambiguous
+    stub.patchBegin = stub.image.size();
+    for (auto& [value, slot] : markers)
+    {
+        size_t found = 0;
+        for (size_t i = 0; i + slot.width <= stub.image.size(); i++)
+        {
+            if (memcmp( stub.image.data() + i, &value, slot.width ) == 0)
+            {
+                slot.offset = static_cast<uint32_t>(i);
+                found++;
+            }
+        }
+
+        if (found != 1)
+            return STATUS_NOT_SUPPORTED;
+
+        stub.slots.emplace_back( slot );
+        stub.patchBegin = min( stub.patchBegin, static_cast<size_t>(slot.offset) );
+        stub.patchEnd = max( stub.patchEnd, static_cast<size_t>(slot.offset + slot.width) );
+    }
+
+    auto address = Reserve( stub.image.size() );
+    if (!address)
+        return address.status;
+
+    stub.address = address.result();
+    stub.valid = true;
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Write new slot values into remote stub
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS CallStubCache::Patch( Stub& stub, ptr_t pfn, const std::vector<AsmVariant>& args, bool force )
+{
+    bool changed = force;
+
+    for (auto& slot : stub.slots)
+    {
+        uint64_t value = pfn;
+        if (slot.arg >= 0)
+        {
+            auto& arg = args[slot.arg];
+            switch (arg.type)
+            {
+            case AsmVariant::dataPtr:
+            case AsmVariant::dataStruct:
+                value = arg.new_imm_val;
+                break;
+
+            case AsmVariant::imm_float:
+                value = arg.getImm_float();
+                break;
+
+            case AsmVariant::imm_double:
+                value = arg.getImm_double() >> slot.shift;
+                break;
+
+            default:
+                value = arg.imm_val64;
+                break;
+            }
+        }
+
+        auto pSlot = stub.image.data() + slot.offset;
+        if (memcmp( pSlot, &value, slot.width ) != 0)
+        {
+            memcpy( pSlot, &value, slot.width );
+            changed = true;
+        }
+    }
+
+    if (force)
+        return _memory.Write( stub.address, stub.image.size(), stub.image.data() );
+
+    // Single write covering all slots
+    if (changed && stub.patchEnd > stub.patchBegin)
+        return _memory.Write( stub.address + stub.patchBegin, stub.patchEnd - stub.patchBegin, stub.image.data() + stub.patchBegin );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Reserve remote executable memory for stub
+/// </summary>
+/// <param name="size">Stub size</param>
+/// <returns>Stub address</returns>
+call_result_t<ptr_t> CallStubCache::Reserve( size_t size )
+{
+    size = Align( size, 0x10 );
+
+    if (_pools.empty() || _poolUsed + size > _pools.back().size())
+    {
+        auto mem = _memory.Allocate( max( size, StubPoolSize ) );
+        if (!mem)
+            return mem.status;
+
+        _pools.emplace_back( std::move( mem.result() ) );
+        _poolUsed = 0;
+    }
+
+    ptr_t address = _pools.back().ptr() + _poolUsed;
+    _poolUsed += size;
+
+    return address;
+}
+
+}
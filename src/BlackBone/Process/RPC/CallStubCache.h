@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../../Include/Winheaders.h"
+#include "../../Include/CallResult.h"
+#include "../../Asm/IAsmHelper.h"
+#include "../MemBlock.h"
+
+#include <map>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Cache of remote call stubs keyed by call signature:
+/// target architecture, calling convention, argument kinds, return type and user buffer index.
+///
+/// Stub is assembled once with unique marker values in place of function pointer and argument values.
+/// Marker locations in generated code become relocation slots, so subsequent calls with the same
+/// signature only rewrite slot bytes in already written remote code. Slots that didn't change aren't written at all.
+/// Stubs are identical for every execution mode, so thread mode isn't a part of the key.
+/// </summary>
+class CallStubCache
+{
+public:
+    BLACKBONE_API CallStubCache( class RemoteExec& remote, class ProcessMemory& memory );
+    BLACKBONE_API ~CallStubCache() = default;
+
+    /// <summary>
+    /// Get stub for call signature and patch its slots with argument values
+    /// </summary>
+    /// <param name="pfn">Remote function pointer</param>
+    /// <param name="args">Prepared function arguments, see RemoteExec::PrepareCallArguments</param>
+    /// <param name="cc">Calling convention</param>
+    /// <param name="retType">Return type</param>
+    /// <param name="x86">Target code is 32 bit</param>
+    /// <param name="bufferIdx">User buffer index stub is bound to</param>
+    /// <returns>Remote stub address, STATUS_NOT_SUPPORTED if arguments can't be relocated</returns>
+    BLACKBONE_API call_result_t<ptr_t> Get(
+        ptr_t pfn,
+        const std::vector<AsmVariant>& args,
+        eCalligConvention cc,
+        eReturnType retType,
+        bool x86,
+        int bufferIdx
+    );
+
+    /// <summary>
+    /// Release all stubs
+    /// </summary>
+    BLACKBONE_API void reset();
+
+    BLACKBONE_API size_t size() const { return _stubs.size(); }
+    BLACKBONE_API uint64_t hits() const { return _hits; }
+    BLACKBONE_API uint64_t misses() const { return _misses; }
+
+private:
+    using Key = std::vector<uint64_t>;
+
+    /// <summary>
+    /// Relocation slot
+    /// </summary>
+    struct Slot
+    {
+        uint32_t offset = 0;        // Offset in stub code
+        uint32_t width = 0;         // Immediate size
+        int32_t arg = -1;           // Argument index, -1 - function pointer
+        uint32_t shift = 0;         // Value shift, used for split x86 doubles
+    };
+
+    struct Stub
+    {
+        ptr_t address = 0;              // Remote code
+        std::vector<uint8_t> image;     // Last written code
+        std::vector<Slot> slots;        // Relocation slots
+        size_t patchBegin = 0;          // Lowest slot offset
+        size_t patchEnd = 0;            // End of highest slot
+        bool valid = false;             // Signature can't be relocated if false
+    };
+
+    /// <summary>
+    /// Build signature key
+    /// </summary>
+    /// <returns>false if arguments can't be relocated</returns>
+    static bool MakeKey( const std::vector<AsmVariant>& args, eCalligConvention cc, eReturnType retType, bool x86, int bufferIdx, Key& key );
+
+    /// <summary>
+    /// Assemble stub and locate its relocation slots
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS Build( Stub& stub, const std::vector<AsmVariant>& args, eCalligConvention cc, eReturnType retType, bool x86 );
+
+    /// <summary>
+    /// Write new slot values into remote stub
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS Patch( Stub& stub, ptr_t pfn, const std::vector<AsmVariant>& args, bool force );
+
+    /// <summary>
+    /// Reserve remote executable memory for stub
+    /// </summary>
+    /// <param name="size">Stub size</param>
+    /// <returns>Stub address</returns>
+    call_result_t<ptr_t> Reserve( size_t size );
+
+    CallStubCache( const CallStubCache& ) = delete;
+    CallStubCache& operator =( const CallStubCache& ) = delete;
+
+private:
+    class RemoteExec& _remote;
+    class ProcessMemory& _memory;
+
+    std::map<Key, Stub> _stubs;         // Stubs by signature
+    std::vector<MemBlock> _pools;       // Stub code pages
+    size_t _poolUsed = 0;               // Used space in last pool
+    uint64_t _hits = 0;                 // Calls served by existing stub
+    uint64_t _misses = 0;               // Generated stubs
+};
+
+}
@@ -0,0 +1,202 @@
+#include "CallTrace.h"
+#include "../../Misc/PerfCounter.hpp"
+
+#include <stdio.h>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Get stage display name
+/// </summary>
+/// <param name="stage">Call stage</param>
+/// <returns>Stage name</returns>
+const wchar_t* CallTraceRecord::StageName( eCallStage stage )
+{
+    static const wchar_t* names[] =
+    {
+        L"Assemble",
+        L"Copy",
+        L"Dispatch",
+        L"Wait",
+        L"ReadBack",
+    };
+
+    static_assert(_countof( names ) == CallStage_Count, "Stage name table mismatch");
+    return stage < CallStage_Count ? names[stage] : L"Unknown";
+}
+
+/// <summary>
+/// Get mode display name
+/// </summary>
+/// <param name="mode">Execution mode</param>
+/// <returns>Mode name</returns>
+const wchar_t* CallTraceRecord::ModeName( eCallMode mode )
+{
+    static const wchar_t* names[] =
+    {
+        L"NewThread",
+        L"Worker",
+        L"Ring",
+        L"AnyThread",
+        L"Direct",
+    };
+
+    static_assert(_countof( names ) == CallMode_Count, "Mode name table mismatch");
+    return mode < CallMode_Count ? names[mode] : L"Unknown";
+}
+
+/// <summary>
+/// Start tracing. Previous records are discarded
+/// </summary>
+/// <param name="capacity">Number of records to keep</param>
+void CallTracer::Enable( size_t capacity /*= 4096*/ )
+{
+    CSLock lck( _lock );
+
+    _records.assign( max( capacity, size_t( 1 ) ), CallTraceRecord() );
+    _pending = CallTraceRecord();
+    _next = 0;
+    _count = 0;
+    _enabled = true;
+}
+
+/// <summary>
+/// Stop tracing. Records are kept until next Enable
+/// </summary>
+void CallTracer::Disable()
+{
+    CSLock lck( _lock );
+    _enabled = false;
+}
+
+/// <summary>
+/// Set argument payload size of the pending call
+/// </summary>
+/// <param name="size">Out-of-line argument data size</param>
+void CallTracer::SetPayload( size_t size )
+{
+    if (!_enabled)
+        return;
+
+    CSLock lck( _lock );
+    _pending.payload = size;
+}
+
+/// <summary>
+/// Store pending call record
+/// </summary>
+/// <param name="mode">Execution mode</param>
+/// <param name="status">Execution status</param>
+void CallTracer::Commit( eCallMode mode, NTSTATUS status )
+{
+    if (!_enabled)
+        return;
+
+    CSLock lck( _lock );
+
+    _pending.id = _count++;
+    _pending.mode = mode;
+    _pending.status = status;
+
+    _records[_next] = _pending;
+    _next = (_next + 1) % _records.size();
+    _pending = CallTraceRecord();
+}
+
+/// <summary>
+/// Drop pending call record of a call that failed before execution
+/// </summary>
+void CallTracer::Discard()
+{
+    if (!_enabled)
+        return;
+
+    CSLock lck( _lock );
+    _pending = CallTraceRecord();
+}
+
+/// <summary>
+/// Get stored records, oldest first
+/// </summary>
+/// <returns>Call records</returns>
+std::vector<CallTraceRecord> CallTracer::records()
+{
+    CSLock lck( _lock );
+
+    std::vector<CallTraceRecord> result;
+    if (_count < _records.size())
+    {
+        result.assign( _records.begin(), _records.begin() + static_cast<size_t>(_count) );
+    }
+    else
+    {
+        result.assign( _records.begin() + _next, _records.end() );
+        result.insert( result.end(), _records.begin(), _records.begin() + _next );
+    }
+
+    return result;
+}
+
+/// <summary>
+/// Write stored records into CSV file
+/// </summary>
+/// <param name="path">Output file path</param>
+/// <returns>Status code</returns>
+NTSTATUS CallTracer::Dump( const std::wstring& path )
+{
+    FILE* pFile = nullptr;
+    if (_wfopen_s( &pFile, path.c_str(), L"wt" ) != 0 || pFile == nullptr)
+        return STATUS_OBJECT_PATH_NOT_FOUND;
+
+    fwprintf_s( pFile, L"Id,Mode,Status,Payload,Total" );
+    for (int i = 0; i < CallStage_Count; i++)
+        fwprintf_s( pFile, L",%ls", CallTraceRecord::StageName( static_cast<eCallStage>(i) ) );
+
+    fwprintf_s( pFile, L"\n" );
+
+    for (auto& record : records())
+    {
+        fwprintf_s(
+            pFile, L"%llu,%ls,0x%08X,%llu,%llu",
+            record.id, CallTraceRecord::ModeName( record.mode ), record.status, record.payload, record.totalTime
+        );
+
+        for (auto time : record.stageTime)
+            fwprintf_s( pFile, L",%llu", time );
+
+        fwprintf_s( pFile, L"\n" );
+    }
+
+    fclose( pFile );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Add stage time
+/// </summary>
+/// <param name="stage">Call stage</param>
+/// <param name="start">Stage start tick</param>
+void CallTracer::Add( eCallStage stage, int64_t start )
+{
+    auto time = PerfCounter::toNanoseconds( PerfCounter::now() - start );
+
+    CSLock lck( _lock );
+    if (!_enabled)
+        return;
+
+    // Read-back follows execution, so call is already committed
+    auto& record = (stage == CallStage_ReadBack && _count > 0)
+        ? _records[(_next + _records.size() - 1) % _records.size()]
+        : _pending;
+
+    record.stageTime[stage] += time;
+    record.totalTime += time;
+}
+
+int64_t CallTracer::now() const
+{
+    return PerfCounter::now();
+}
+
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "../../Include/Winheaders.h"
+#include "../../Misc/Utils.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace blackbone
+{
+
+// Remote call stages
+enum eCallStage
+{
+    CallStage_Assemble,     // Call stub and thread wrapper generation
+    CallStage_Copy,         // Argument and code upload
+    CallStage_Dispatch,     // Thread creation, APC queueing, context switch or ring submit
+    CallStage_Wait,         // Waiting for remote code to finish
+    CallStage_ReadBack,     // Return value and output argument read
+
+    CallStage_Count
+};
+
+// Remote call execution modes
+enum eCallMode
+{
+    CallMode_NewThread,     // ExecInNewThread
+    CallMode_Worker,        // ExecInWorkerThread, APC worker
+    CallMode_Ring,          // ExecInWorkerThread, command ring worker
+    CallMode_AnyThread,     // ExecInAnyThread
+    CallMode_Direct,        // ExecDirect
+
+    CallMode_Count
+};
+
+using CallStageTimes = std::array<uint64_t, CallStage_Count>;
+
+/// <summary>
+/// Timings of a single remote call
+/// </summary>
+struct CallTraceRecord
+{
+    uint64_t id = 0;                     // Call sequence number
+    eCallMode mode = CallMode_NewThread; // Execution mode
+    NTSTATUS status = STATUS_SUCCESS;    // Execution status
+    uint64_t payload = 0;                // Out-of-line argument data size
+    uint64_t totalTime = 0;              // Sum of stage times, nanoseconds
+    CallStageTimes stageTime = { };      // Stage times, nanoseconds
+
+    /// <summary>
+    /// Get stage display name
+    /// </summary>
+    /// <param name="stage">Call stage</param>
+    /// <returns>Stage name</returns>
+    BLACKBONE_API static const wchar_t* StageName( eCallStage stage );
+
+    /// <summary>
+    /// Get mode display name
+    /// </summary>
+    /// <param name="mode">Execution mode</param>
+    /// <returns>Mode name</returns>
+    BLACKBONE_API static const wchar_t* ModeName( eCallMode mode );
+};
+
+/// <summary>
+/// Per-call stage timings for RemoteExec, kept in a fixed-size ring buffer.
+///
+/// Stages preceding execution are accumulated until the call is committed by the execution routine;
+/// read-back happens after that and is added to the last committed record.
+/// All calls are no-op unless tracing was enabled.
+/// </summary>
+class CallTracer
+{
+public:
+    /// <summary>
+    /// Scoped stage timer
+    /// </summary>
+    class StageGuard
+    {
+    public:
+        StageGuard( CallTracer* owner, eCallStage stage )
+            : _owner( owner )
+            , _stage( stage )
+            , _start( owner ? owner->now() : 0 ) { }
+
+        StageGuard( StageGuard&& rhs )
+            : _owner( rhs._owner )
+            , _stage( rhs._stage )
+            , _start( rhs._start ) { rhs._owner = nullptr; }
+
+        ~StageGuard()
+        {
+            if (_owner)
+                _owner->Add( _stage, _start );
+        }
+
+        /// <summary>
+        /// End current stage and start next one
+        /// </summary>
+        /// <param name="stage">Next stage</param>
+        void next( eCallStage stage )
+        {
+            if (_owner)
+            {
+                _owner->Add( _stage, _start );
+                _stage = stage;
+                _start = _owner->now();
+            }
+        }
+
+        /// <summary>
+        /// End current stage
+        /// </summary>
+        void end()
+        {
+            if (_owner)
+                _owner->Add( _stage, _start );
+
+            _owner = nullptr;
+        }
+
+    private:
+        StageGuard( const StageGuard& ) = delete;
+        StageGuard& operator =( const StageGuard& ) = delete;
+        StageGuard& operator =( StageGuard&& ) = delete;
+
+    private:
+        CallTracer* _owner;
+        eCallStage _stage;
+        int64_t _start;
+    };
+
+    /// <summary>
+    /// Scoped call record. Pending record is committed on scope exit, failed calls included
+    /// </summary>
+    class CallGuard
+    {
+    public:
+        CallGuard( CallTracer* owner, eCallMode mode )
+            : _owner( owner )
+            , _mode( mode ) { }
+
+        CallGuard( CallGuard&& rhs )
+            : _owner( rhs._owner )
+            , _mode( rhs._mode )
+            , _status( rhs._status ) { rhs._owner = nullptr; }
+
+        ~CallGuard()
+        {
+            if (_owner)
+                _owner->Commit( _mode, _status );
+        }
+
+        /// <summary>
+        /// Set call status
+        /// </summary>
+        /// <param name="status">Execution status</param>
+        /// <returns>Execution status</returns>
+        NTSTATUS result( NTSTATUS status )
+        {
+            _status = status;
+            return status;
+        }
+
+    private:
+        CallGuard( const CallGuard& ) = delete;
+        CallGuard& operator =( const CallGuard& ) = delete;
+        CallGuard& operator =( CallGuard&& ) = delete;
+
+    private:
+        CallTracer* _owner;
+        eCallMode _mode;
+        NTSTATUS _status = STATUS_UNSUCCESSFUL;
+    };
+
+public:
+    /// <summary>
+    /// Start tracing. Previous records are discarded
+    /// </summary>
+    /// <param name="capacity">Number of records to keep</param>
+    BLACKBONE_API void Enable( size_t capacity = 4096 );
+
+    /// <summary>
+    /// Stop tracing. Records are kept until next Enable
+    /// </summary>
+    BLACKBONE_API void Disable();
+
+    /// <summary>
+    /// Start stage timer
+    /// </summary>
+    /// <param name="stage">Call stage</param>
+    /// <returns>Scoped stage guard</returns>
+    BLACKBONE_API StageGuard Stage( eCallStage stage ) { return StageGuard( _enabled ? this : nullptr, stage ); }
+
+    /// <summary>
+    /// Start call record. Must be created before stage guards of the call, so stages end before commit
+    /// </summary>
+    /// <param name="mode">Execution mode</param>
+    /// <returns>Scoped call guard</returns>
+    BLACKBONE_API CallGuard Call( eCallMode mode ) { return CallGuard( _enabled ? this : nullptr, mode ); }
+
+    /// <summary>
+    /// Set argument payload size of the pending call
+    /// </summary>
+    /// <param name="size">Out-of-line argument data size</param>
+    BLACKBONE_API void SetPayload( size_t size );
+
+    /// <summary>
+    /// Store pending call record
+    /// </summary>
+    /// <param name="mode">Execution mode</param>
+    /// <param name="status">Execution status</param>
+    BLACKBONE_API void Commit( eCallMode mode, NTSTATUS status );
+
+    /// <summary>
+    /// Drop pending call record of a call that failed before execution
+    /// </summary>
+    BLACKBONE_API void Discard();
+
+    /// <summary>
+    /// Get stored records, oldest first
+    /// </summary>
+    /// <returns>Call records</returns>
+    BLACKBONE_API std::vector<CallTraceRecord> records();
+
+    /// <summary>
+    /// Write stored records into CSV file
+    /// </summary>
+    /// <param name="path">Output file path</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Dump( const std::wstring& path );
+
+    BLACKBONE_API bool enabled() const { return _enabled; }
+
+private:
+    /// <summary>
+    /// Add stage time
+    /// </summary>
+    /// <param name="stage">Call stage</param>
+    /// <param name="start">Stage start tick</param>
+    void Add( eCallStage stage, int64_t start );
+
+    int64_t now() const;
+
+private:
+    bool _enabled = false;                  // Tracing is active
+    std::vector<CallTraceRecord> _records;  // Ring buffer
+    size_t _next = 0;                       // Next ring slot
+    uint64_t _count = 0;                    // Committed records
+    CallTraceRecord _pending;               // Record of a call being executed
+    CriticalSection _lock;                  // Record lock
+};
+
+}
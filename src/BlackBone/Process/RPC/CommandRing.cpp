@@ -0,0 +1,448 @@
+#include "CommandRing.h"
+#include "../Process.h"
+#include "../../Asm/AsmFactory.h"
+#include "../../Misc/DynImport.h"
+
+namespace blackbone
+{
+
+CommandRing::CommandRing( Process& proc )
+    : _process( proc )
+{
+}
+
+CommandRing::~CommandRing()
+{
+    Stop();
+}
+
+/// <summary>
+/// Map ring into target and start worker thread
+/// </summary>
+/// <param name="workerSpin">Idle iterations before worker goes to sleep</param>
+/// <param name="hostSpin">Iterations host spins on completion before blocking</param>
+/// <returns>Status code</returns>
+NTSTATUS CommandRing::Start( uint32_t workerSpin /*= 20000*/, uint32_t hostSpin /*= 20000*/ )
+{
+    CSLock lck( _lock );
+
+    if (active())
+        return STATUS_SUCCESS;
+
+    // Ring pointers must be reachable by both sides
+    if (_process.barrier().type == wow_32_64)
+        return STATUS_NOT_SUPPORTED;
+
+    Stop();
+
+    _section = CreateFileMappingW( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, RingSize, nullptr );
+    if (!_section)
+        return LastNtStatus();
+
+    _header = reinterpret_cast<Header*>(MapViewOfFile( _section, FILE_MAP_ALL_ACCESS, 0, 0, RingSize ));
+    if (!_header)
+        return LastNtStatus();
+
+    // 32 bit worker can't address view above 4GB
+    PVOID base = nullptr;
+    SIZE_T viewSize = 0;
+    ULONG_PTR zeroBits = _process.barrier().type == wow_64_32 ? 0x7FFFFFFF : 0;
+
+    NTSTATUS status = SAFE_NATIVE_CALL(
+        NtMapViewOfSection, _section, _process.core().handle(), &base,
+        zeroBits, 0, nullptr, &viewSize, 2 /*ViewUnmap*/, 0, PAGE_READWRITE
+        );
+
+    if (!NT_SUCCESS( status ))
+    {
+        Stop();
+        return status;
+    }
+
+    _remoteView = reinterpret_cast<ptr_t>(base);
+
+    _workEvent = CreateEventW( nullptr, FALSE, FALSE, nullptr );
+    _doneEvent = CreateEventW( nullptr, FALSE, FALSE, nullptr );
+    if (!_workEvent || !_doneEvent)
+    {
+        status = LastNtStatus();
+        Stop();
+        return status;
+    }
+
+    _header->spin = workerSpin;
+    _header->sleepTimeout = -10 * 1000 * 50;
+    _header->workEvent = DuplicateToTarget( _workEvent );
+    _header->doneEvent = DuplicateToTarget( _doneEvent );
+    _hostSpin = hostSpin;
+
+    if (!_header->workEvent || !_header->doneEvent)
+        status = LastNtStatus();
+    else
+        status = CreateWorker();
+
+    if (!NT_SUCCESS( status ))
+        Stop();
+
+    return status;
+}
+
+/// <summary>
+/// Stop worker thread and unmap ring
+/// </summary>
+void CommandRing::Stop()
+{
+    CSLock lck( _lock );
+
+    if (_header)
+    {
+        _header->stop = 1;
+        MemoryBarrier();
+
+        if (_workEvent)
+            SetEvent( _workEvent );
+    }
+
+    // Worker checks stop flag at least once per sleep timeout
+    if (_thread)
+    {
+        if (!_thread->Join( 1000 ))
+        {
+            _thread->Terminate();
+            _thread->Join();
+        }
+
+        _thread.reset();
+    }
+
+    if (_header)
+    {
+        CloseInTarget( _header->workEvent );
+        CloseInTarget( _header->doneEvent );
+
+        UnmapViewOfFile( _header );
+        _header = nullptr;
+    }
+
+    if (_remoteView)
+    {
+        SAFE_NATIVE_CALL( NtUnmapViewOfSection, _process.core().handle(), reinterpret_cast<PVOID>(_remoteView) );
+        _remoteView = 0;
+    }
+
+    _code.Free();
+    _section.reset();
+    _workEvent.reset();
+    _doneEvent.reset();
+    _stats = CommandRingStats();
+}
+
+/// <summary>
+/// Push command into ring. Blocks while ring is full
+/// </summary>
+/// <param name="code">Remote code address</param>
+/// <param name="arg">Code argument</param>
+/// <returns>Command sequence number</returns>
+call_result_t<uint32_t> CommandRing::Submit( ptr_t code, ptr_t arg )
+{
+    CSLock lck( _lock );
+
+    if (!active())
+        return STATUS_NOT_FOUND;
+
+    // Ring is full, wait for oldest command
+    uint32_t seq = _header->head;
+    if (seq - _header->tail >= Capacity)
+    {
+        uint64_t result = 0;
+        auto status = Wait( seq - Capacity, result );
+        if (!NT_SUCCESS( status ))
+            return status;
+    }
+
+    auto& cmd = commands()[seq & (Capacity - 1)];
+    cmd.code = code;
+    cmd.arg = arg;
+
+    // Publish command. Full barrier orders head store before 'sleeping' load
+    InterlockedExchange( reinterpret_cast<volatile LONG*>(&_header->head), static_cast<LONG>(seq + 1) );
+    _stats.submitted++;
+
+    if (_header->sleeping)
+    {
+        _stats.wakeups++;
+        SetEvent( _workEvent );
+    }
+
+    return seq;
+}
+
+/// <summary>
+/// Wait for command completion.
+/// Concurrent waiters block until the current one returns, timeout doesn't cover that wait
+/// </summary>
+/// <param name="seq">Command sequence number</param>
+/// <param name="result">Code return value</param>
+/// <param name="timeout">Timeout, ms</param>
+/// <returns>Status code</returns>
+NTSTATUS CommandRing::Wait( uint32_t seq, uint64_t& result, uint32_t timeout /*= INFINITE*/ )
+{
+    if (!active())
+        return STATUS_NOT_FOUND;
+
+    // Command wasn't submitted
+    if (static_cast<int32_t>(_header->head - seq) <= 0)
+        return STATUS_INVALID_PARAMETER;
+
+    // Waiting flag and auto-reset done event can't wake more than one sleeper
+    CSLock lck( _waitLock );
+
+    auto deadline = GetTickCount64() + timeout;
+    for (uint32_t i = 0; !completed( seq ); i++)
+    {
+        if (i < _hostSpin)
+        {
+            YieldProcessor();
+            continue;
+        }
+
+        // Announce wait and re-check, otherwise completion may slip in between
+        InterlockedExchange( reinterpret_cast<volatile LONG*>(&_header->waiting), 1 );
+        if (completed( seq ))
+            break;
+
+        DWORD wait = INFINITE;
+        if (timeout != INFINITE)
+        {
+            auto now = GetTickCount64();
+            if (now >= deadline)
+            {
+                _header->waiting = 0;
+                return STATUS_TIMEOUT;
+            }
+
+            wait = static_cast<DWORD>(deadline - now);
+        }
+
+        _stats.waits++;
+
+        HANDLE handles[] = { _doneEvent, _thread->handle() };
+        auto res = WaitForMultipleObjects( ARRAYSIZE( handles ), handles, FALSE, wait );
+        if (res == WAIT_OBJECT_0 + 1)
+            return STATUS_THREAD_IS_TERMINATING;
+        if (res == WAIT_FAILED)
+            return LastNtStatus();
+    }
+
+    _header->waiting = 0;
+    MemoryBarrier();
+
+    // Slot could have been reused by newer command
+    auto& entry = completions()[seq & (Capacity - 1)];
+    result = entry.result;
+    MemoryBarrier();
+    if (entry.seq != seq)
+        return STATUS_NOT_FOUND;
+
+    if (_process.core().isWow64())
+        result &= 0xFFFFFFFF;
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Submit command and wait for its completion
+/// </summary>
+/// <param name="code">Remote code address</param>
+/// <param name="arg">Code argument</param>
+/// <param name="result">Code return value</param>
+/// <param name="timeout">Timeout, ms</param>
+/// <returns>Status code</returns>
+NTSTATUS CommandRing::Execute( ptr_t code, ptr_t arg, uint64_t& result, uint32_t timeout /*= INFINITE*/ )
+{
+    auto seq = Submit( code, arg );
+    if (!seq)
+        return seq.status;
+
+    return Wait( seq.result(), result, timeout );
+}
+
+/// <summary>
+/// Generate and start remote worker
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS CommandRing::CreateWorker()
+{
+    using namespace asmjit::host;
+
+    auto& mods = _process.modules();
+    auto pWait = mods.GetNtdllExport( "NtWaitForSingleObject", mt_default, Sections );
+    auto pSetEvent = mods.GetNtdllExport( "NtSetEvent", mt_default, Sections );
+    auto pExitThread = mods.GetNtdllExport( "NtTerminateThread", mt_default, Sections );
+    if (!pWait || !pSetEvent || !pExitThread)
+        return STATUS_NOT_FOUND;
+
+    bool x86 = _process.core().isWow64();
+    auto a = AsmFactory::GetAssembler( x86 );
+
+    auto l_loop = (*a)->newLabel();
+    auto l_idle = (*a)->newLabel();
+    auto l_sleep = (*a)->newLabel();
+    auto l_wake = (*a)->newLabel();
+    auto l_exit = (*a)->newLabel();
+
+    auto field = [&a]( size_t offset ) { return dword_ptr( (*a)->zbx, static_cast<int32_t>(offset) ); };
+
+    // zdx = ring base + (seq % Capacity) * 16. Command and completion entries have same size
+    auto slot = [&a]()
+    {
+        (*a)->mov( edx, edi );
+        (*a)->and_( edx, static_cast<int>(Capacity - 1) );
+        (*a)->shl( edx, 4 );
+        (*a)->add( (*a)->zdx, (*a)->zbx );
+    };
+
+    static_assert(sizeof( Command ) == 0x10 && sizeof( Completion ) == 0x10, "Invalid ring entry size");
+
+    /*
+        for (;;)
+        {
+            if (stop)
+                break;
+
+            if (tail != head)
+            {
+                completions[tail] = { commands[tail].code( commands[tail].arg ), tail };
+                tail++;
+                if (waiting)
+                    waiting = 0, NtSetEvent( doneEvent );
+            }
+            else if (++idle > spin)
+            {
+                sleeping = 1;
+                if (tail == head && !stop)
+                    NtWaitForSingleObject( workEvent, FALSE, &sleepTimeout );
+                sleeping = 0;
+            }
+        }
+    */
+    (*a)->mov( (*a)->zbx, _remoteView );
+    (*a)->xor_( esi, esi );
+
+    (*a)->bind( l_loop );
+    (*a)->cmp( field( offsetof( Header, stop ) ), 0 );
+    (*a)->jne( l_exit );
+    (*a)->mov( edi, field( offsetof( Header, tail ) ) );
+    (*a)->cmp( edi, field( offsetof( Header, head ) ) );
+    (*a)->je( l_idle );
+
+    // Execute command
+    slot();
+    (*a)->mov( (*a)->zax, (*a)->intptr_ptr( (*a)->zdx, CommandsOffset + offsetof( Command, code ) ) );
+    (*a)->mov( (*a)->zdx, (*a)->intptr_ptr( (*a)->zdx, CommandsOffset + offsetof( Command, arg ) ) );
+    a->GenCall( (*a)->zax, { (*a)->zdx } );
+    if (x86)
+        (*a)->add( esp, sizeof( uint32_t ) );
+
+    // Write completion, then publish it
+    slot();
+    (*a)->mov( (*a)->intptr_ptr( (*a)->zdx, CompletionsOffset + offsetof( Completion, result ) ), (*a)->zax );
+    (*a)->mov( dword_ptr( (*a)->zdx, CompletionsOffset + offsetof( Completion, seq ) ), edi );
+    (*a)->inc( edi );
+    (*a)->mov( field( offsetof( Header, tail ) ), edi );
+    (*a)->mfence();
+    (*a)->xor_( esi, esi );
+
+    (*a)->cmp( field( offsetof( Header, waiting ) ), 0 );
+    (*a)->je( l_loop );
+    (*a)->mov( field( offsetof( Header, waiting ) ), 0 );
+    a->GenCall( pSetEvent->procAddress, { (*a)->intptr_ptr( (*a)->zbx, offsetof( Header, doneEvent ) ), 0 } );
+    (*a)->jmp( l_loop );
+
+    // Spin
+    (*a)->bind( l_idle );
+    (*a)->inc( esi );
+    (*a)->cmp( esi, field( offsetof( Header, spin ) ) );
+    (*a)->jae( l_sleep );
+    (*a)->pause();
+    (*a)->jmp( l_loop );
+
+    // Announce sleep and re-check, xchg acts as full barrier
+    (*a)->bind( l_sleep );
+    (*a)->mov( eax, 1 );
+    (*a)->xchg( field( offsetof( Header, sleeping ) ), eax );
+    (*a)->cmp( edi, field( offsetof( Header, head ) ) );
+    (*a)->jne( l_wake );
+    (*a)->cmp( field( offsetof( Header, stop ) ), 0 );
+    (*a)->jne( l_wake );
+    a->GenCall( pWait->procAddress, {
+        (*a)->intptr_ptr( (*a)->zbx, offsetof( Header, workEvent ) ),
+        FALSE,
+        _remoteView + offsetof( Header, sleepTimeout )
+    } );
+
+    (*a)->bind( l_wake );
+    (*a)->mov( field( offsetof( Header, sleeping ) ), 0 );
+    (*a)->xor_( esi, esi );
+    (*a)->jmp( l_loop );
+
+    (*a)->bind( l_exit );
+    (*a)->xor_( eax, eax );
+    a->ExitThreadWithStatus( pExitThread->procAddress, 0 );
+
+    auto mem = _process.memory().Allocate( (*a)->getCodeSize() );
+    if (!mem)
+        return mem.status;
+
+    _code = std::move( mem.result() );
+
+    NTSTATUS status = _code.Write( 0, (*a)->getCodeSize(), (*a)->make() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    auto thd = _process.threads().CreateNew( _code.ptr(), _remoteView );
+    if (!thd)
+        return thd.status;
+
+    _thread = std::move( thd.result() );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Duplicate local handle into target process
+/// </summary>
+/// <param name="local">Local handle</param>
+/// <returns>Target handle, 0 on failure</returns>
+uint64_t CommandRing::DuplicateToTarget( HANDLE local )
+{
+    HANDLE hRemote = nullptr;
+    if (!DuplicateHandle( GetCurrentProcess(), local, _process.core().handle(), &hRemote, 0, FALSE, DUPLICATE_SAME_ACCESS ))
+        return 0;
+
+    return reinterpret_cast<uint64_t>(hRemote);
+}
+
+/// <summary>
+/// Close handle in target process
+/// </summary>
+/// <param name="remote">Target handle</param>
+void CommandRing::CloseInTarget( uint64_t remote )
+{
+    if (remote == 0)
+        return;
+
+    HANDLE hLocal = nullptr;
+    DuplicateHandle(
+        _process.core().handle(),
+        reinterpret_cast<HANDLE>(remote),
+        GetCurrentProcess(),
+        &hLocal,
+        0, FALSE,
+        DUPLICATE_CLOSE_SOURCE | DUPLICATE_SAME_ACCESS
+    );
+
+    if (hLocal)
+        CloseHandle( hLocal );
+}
+
+}
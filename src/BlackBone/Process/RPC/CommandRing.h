@@ -0,0 +1,170 @@
+#pragma once
+
+#include "../../Include/Winheaders.h"
+#include "../../Include/CallResult.h"
+#include "../../Include/HandleGuard.h"
+#include "../../Misc/Utils.h"
+#include "../Threads/Thread.h"
+#include "../MemBlock.h"
+
+namespace blackbone
+{
+
+/// <summary>
+/// Command ring counters
+/// </summary>
+struct CommandRingStats
+{
+    uint64_t submitted = 0;     // Commands pushed
+    uint64_t wakeups = 0;       // Worker was sleeping and had to be signaled
+    uint64_t waits = 0;         // Host spin expired and it blocked on done event
+};
+
+/// <summary>
+/// Single producer/single consumer command ring shared with target process.
+///
+/// Ring memory is a pagefile-backed section mapped both locally and into the target,
+/// so commands and completions are exchanged without any cross-process memory calls.
+/// Remote worker polls the ring, spins for a while when it runs dry and then sleeps on work event;
+/// host spins on completion index and then sleeps on done event. Events are signaled only
+/// when the other side announced it's going to sleep.
+/// Host side has a single 'waiting' flag and an auto-reset done event, so it can serve only
+/// one sleeping waiter at a time: concurrent Wait calls are serialized by the consumer lock.
+///
+/// Shared memory layout:
+/// --------------------------------------------------------------------------
+/// |  Header (0x40)  |  Commands [Capacity]  |  Completions [Capacity]        |
+/// --------------------------------------------------------------------------
+/// Command is { code, argument }, code is called as 'ptr_t __cdecl code( argument )'.
+/// Completion is { return value, sequence number }.
+/// </summary>
+class CommandRing
+{
+public:
+    static constexpr uint32_t Capacity = 64;
+
+    BLACKBONE_API CommandRing( class Process& proc );
+    BLACKBONE_API ~CommandRing();
+
+    /// <summary>
+    /// Map ring into target and start worker thread
+    /// </summary>
+    /// <param name="workerSpin">Idle iterations before worker goes to sleep</param>
+    /// <param name="hostSpin">Iterations host spins on completion before blocking</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Start( uint32_t workerSpin = 20000, uint32_t hostSpin = 20000 );
+
+    /// <summary>
+    /// Stop worker thread and unmap ring
+    /// </summary>
+    BLACKBONE_API void Stop();
+
+    /// <summary>
+    /// Push command into ring. Blocks while ring is full
+    /// </summary>
+    /// <param name="code">Remote code address</param>
+    /// <param name="arg">Code argument</param>
+    /// <returns>Command sequence number</returns>
+    BLACKBONE_API call_result_t<uint32_t> Submit( ptr_t code, ptr_t arg );
+
+    /// <summary>
+    /// Wait for command completion.
+    /// Concurrent waiters block until the current one returns, timeout doesn't cover that wait
+    /// </summary>
+    /// <param name="seq">Command sequence number</param>
+    /// <param name="result">Code return value</param>
+    /// <param name="timeout">Timeout, ms</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Wait( uint32_t seq, uint64_t& result, uint32_t timeout = INFINITE );
+
+    /// <summary>
+    /// Submit command and wait for its completion
+    /// </summary>
+    /// <param name="code">Remote code address</param>
+    /// <param name="arg">Code argument</param>
+    /// <param name="result">Code return value</param>
+    /// <param name="timeout">Timeout, ms</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Execute( ptr_t code, ptr_t arg, uint64_t& result, uint32_t timeout = INFINITE );
+
+    BLACKBONE_API bool active() const { return _header != nullptr && _thread != nullptr; }
+    BLACKBONE_API ThreadPtr thread() const { return _thread; }
+    BLACKBONE_API const CommandRingStats& stats() const { return _stats; }
+
+private:
+    struct Header
+    {
+        volatile uint32_t head;         // Next command sequence, written by host
+        volatile uint32_t tail;         // Completed command count, written by worker
+        volatile uint32_t sleeping;     // Worker is about to wait on work event
+        volatile uint32_t waiting;      // Host is about to wait on done event
+        volatile uint32_t stop;         // Worker exit request
+        uint32_t spin;                  // Worker idle spin count
+        uint64_t workEvent;             // Target handle of work event
+        uint64_t doneEvent;             // Target handle of done event
+        int64_t  sleepTimeout;          // Worker wait timeout, relative 100ns units
+        uint8_t  reserved[0x10];
+    };
+
+    struct Command
+    {
+        uint64_t code;
+        uint64_t arg;
+    };
+
+    struct Completion
+    {
+        uint64_t result;
+        uint32_t seq;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof( Header ) == 0x40, "Invalid ring header size");
+
+    static constexpr uint32_t CommandsOffset = sizeof( Header );
+    static constexpr uint32_t CompletionsOffset = CommandsOffset + Capacity * sizeof( Command );
+    static constexpr uint32_t RingSize = CompletionsOffset + Capacity * sizeof( Completion );
+
+    /// <summary>
+    /// Generate and start remote worker
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS CreateWorker();
+
+    /// <summary>
+    /// Duplicate local handle into target process
+    /// </summary>
+    /// <param name="local">Local handle</param>
+    /// <returns>Target handle, 0 on failure</returns>
+    uint64_t DuplicateToTarget( HANDLE local );
+
+    /// <summary>
+    /// Close handle in target process
+    /// </summary>
+    /// <param name="remote">Target handle</param>
+    void CloseInTarget( uint64_t remote );
+
+    bool completed( uint32_t seq ) const { return static_cast<int32_t>(_header->tail - seq) > 0; }
+
+    Command* commands() const { return reinterpret_cast<Command*>(reinterpret_cast<uint8_t*>(_header) + CommandsOffset); }
+    Completion* completions() const { return reinterpret_cast<Completion*>(reinterpret_cast<uint8_t*>(_header) + CompletionsOffset); }
+
+    CommandRing( const CommandRing& ) = delete;
+    CommandRing& operator =( const CommandRing& ) = delete;
+
+private:
+    class Process& _process;            // Target process
+    Handle _section;                    // Ring section
+    Handle _workEvent;                  // Signaled by host when worker sleeps
+    Handle _doneEvent;                  // Signaled by worker when host sleeps
+    Header* _header = nullptr;          // Local ring view
+    ptr_t _remoteView = 0;              // Target ring view
+    MemBlock _code;                     // Worker code
+    ThreadPtr _thread;                  // Worker thread
+    uint32_t _hostSpin = 0;             // Host completion spin count
+    CommandRingStats _stats;            // Counters
+    CriticalSection _lock;              // Producer lock
+    CriticalSection _waitLock;          // Consumer lock, single host waiter
+};
+
+}
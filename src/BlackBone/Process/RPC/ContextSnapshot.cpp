@@ -0,0 +1,201 @@
+#include "ContextSnapshot.h"
+#include "../ProcessMemory.h"
+#include "../Threads/Thread.h"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Copy overlapping part of source range into destination range
+/// </summary>
+/// <param name="dst">Destination range address</param>
+/// <param name="dstSize">Destination range size</param>
+/// <param name="pDst">Destination buffer</param>
+/// <param name="src">Source range address</param>
+/// <param name="srcSize">Source range size</param>
+/// <param name="pSrc">Source buffer</param>
+static void CopyOverlap( ptr_t dst, size_t dstSize, uint8_t* pDst, ptr_t src, size_t srcSize, const uint8_t* pSrc )
+{
+    ptr_t begin = max( dst, src );
+    ptr_t end = min( dst + dstSize, src + srcSize );
+
+    if (begin < end)
+        memcpy( pDst + (begin - dst), pSrc + (begin - src), static_cast<size_t>(end - begin) );
+}
+
+ContextSnapshot::ContextSnapshot( ProcessMemory& memory )
+    : _memory( memory )
+{
+}
+
+/// <summary>
+/// Read stack window and TEB fields of stopped thread. Previous snapshot is dropped
+/// </summary>
+/// <param name="thd">Stopped thread</param>
+/// <param name="sp">Thread stack pointer</param>
+/// <param name="window">Stack window size</param>
+/// <param name="x64Target">Target process is 64 bit</param>
+/// <returns>Status code</returns>
+NTSTATUS ContextSnapshot::Capture( Thread& thd, ptr_t sp, size_t window, bool x64Target )
+{
+    reset();
+
+    _teb64 = thd.teb( static_cast<_TEB64*>(nullptr) );
+    if (!x64Target)
+        _teb32 = thd.teb( static_cast<_TEB32*>(nullptr) );
+
+    // Stack window, native TEB up to last error, WOW64 TEB up to last error
+    std::vector<Region> regions( 3 );
+    regions[0].address = sp;
+    regions[0].data.resize( window );
+    regions[1].address = _teb64;
+    regions[1].data.resize( _teb64 ? FIELD_OFFSET( _TEB64, LastErrorValue ) + sizeof( DWORD ) : 0 );
+    regions[2].address = _teb32;
+    regions[2].data.resize( _teb32 ? FIELD_OFFSET( _TEB32, LastErrorValue ) + sizeof( DWORD ) : 0 );
+
+    std::vector<MemIoVec> ops;
+    for (auto& region : regions)
+    {
+        if (!region.data.empty())
+            ops.emplace_back( region.address, region.data.size(), region.data.data() );
+    }
+
+    _reads++;
+    NTSTATUS status = _memory.ReadV( ops );
+
+    for (auto& op : ops)
+    {
+        auto iter = std::find_if( regions.begin(), regions.end(), [&op]( const Region& region ) { return region.data.data() == op.buffer; } );
+        if (!NT_SUCCESS( op.status ))
+            iter->data.clear();
+    }
+
+    // Stack base of target bitness
+    if (x64Target && !regions[1].data.empty())
+        _stackBase = *reinterpret_cast<uint64_t*>(regions[1].data.data() + FIELD_OFFSET( _NT_TIB_T<DWORD64>, StackBase ));
+    else if (!x64Target && !regions[2].data.empty())
+        _stackBase = *reinterpret_cast<uint32_t*>(regions[2].data.data() + FIELD_OFFSET( _NT_TIB_T<DWORD>, StackBase ));
+
+    // Window crossed stack base into unmapped memory
+    if (regions[0].data.empty() && _stackBase > sp && _stackBase - sp < window)
+    {
+        regions[0].data.resize( static_cast<size_t>(_stackBase - sp) );
+
+        _reads++;
+        if (!NT_SUCCESS( _memory.Read( sp, regions[0].data.size(), regions[0].data.data() ) ))
+            regions[0].data.clear();
+    }
+
+    for (auto& region : regions)
+    {
+        if (!region.data.empty())
+            _regions.emplace_back( std::move( region ) );
+    }
+
+    return valid() ? STATUS_SUCCESS : status;
+}
+
+/// <summary>
+/// Read memory, deferred writes included
+/// </summary>
+/// <param name="address">Remote address</param>
+/// <param name="size">Data size</param>
+/// <param name="pResult">Output buffer</param>
+/// <returns>Status code</returns>
+NTSTATUS ContextSnapshot::Read( ptr_t address, size_t size, void* pResult )
+{
+    auto pDst = reinterpret_cast<uint8_t*>(pResult);
+
+    auto iter = std::find_if( _regions.begin(), _regions.end(), [&]( const Region& region ) { return region.contains( address, size ); } );
+    if (iter != _regions.end())
+    {
+        memcpy( pDst, iter->data.data() + (address - iter->address), size );
+    }
+    else
+    {
+        _reads++;
+        NTSTATUS status = _memory.Read( address, size, pResult );
+        if (!NT_SUCCESS( status ))
+            return status;
+    }
+
+    for (auto& write : _pending)
+        CopyOverlap( address, size, pDst, write.address, write.data.size(), write.data.data() );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Queue memory write until Flush
+/// </summary>
+/// <param name="address">Remote address</param>
+/// <param name="size">Data size</param>
+/// <param name="pData">Data to write</param>
+/// <returns>Status code</returns>
+NTSTATUS ContextSnapshot::Write( ptr_t address, size_t size, const void* pData )
+{
+    auto pSrc = reinterpret_cast<const uint8_t*>(pData);
+
+    for (auto& region : _regions)
+        CopyOverlap( region.address, region.data.size(), region.data.data(), address, size, pSrc );
+
+    // Rewrite of the last range or its continuation is merged
+    if (!_pending.empty())
+    {
+        auto& last = _pending.back();
+        if (last.contains( address, size ))
+        {
+            memcpy( last.data.data() + (address - last.address), pSrc, size );
+            return STATUS_SUCCESS;
+        }
+
+        if (address == last.address + last.data.size())
+        {
+            last.data.insert( last.data.end(), pSrc, pSrc + size );
+            return STATUS_SUCCESS;
+        }
+    }
+
+    Region write;
+    write.address = address;
+    write.data.assign( pSrc, pSrc + size );
+    _pending.emplace_back( std::move( write ) );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Apply deferred writes
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS ContextSnapshot::Flush()
+{
+    _writes = 0;
+    if (_pending.empty())
+        return STATUS_SUCCESS;
+
+    std::vector<MemIoVec> ops;
+    for (auto& write : _pending)
+        ops.emplace_back( write.address, write.data.size(), write.data.data() );
+
+    _writes++;
+    NTSTATUS status = _memory.WriteV( ops );
+
+    _pending.clear();
+    return status;
+}
+
+/// <summary>
+/// Drop snapshot and deferred writes
+/// </summary>
+void ContextSnapshot::reset()
+{
+    _regions.clear();
+    _pending.clear();
+    _teb32 = _teb64 = _stackBase = 0;
+    _reads = 0;
+}
+
+}
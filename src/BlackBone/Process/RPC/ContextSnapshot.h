@@ -0,0 +1,109 @@
+#pragma once
+
+#include "../../Config.h"
+#include "../../Include/Winheaders.h"
+#include "../../Include/Types.h"
+
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Remote memory snapshot of a thread stopped in debug event: stack window above stack pointer
+/// and TEB fields used by RemoteContext (stack base, last error, arbitrary user pointer).
+///
+/// Snapshot is taken with one vectored read. Reads inside it are served locally,
+/// reads outside of it go to process memory. Writes are deferred and applied by Flush
+/// with one vectored write, so they must be flushed before thread is resumed.
+/// </summary>
+class ContextSnapshot
+{
+public:
+    static constexpr size_t DefaultStackWindow = 0x200;
+
+public:
+    BLACKBONE_API ContextSnapshot( class ProcessMemory& memory );
+    BLACKBONE_API ~ContextSnapshot() = default;
+
+    /// <summary>
+    /// Read stack window and TEB fields of stopped thread. Previous snapshot is dropped
+    /// </summary>
+    /// <param name="thd">Stopped thread</param>
+    /// <param name="sp">Thread stack pointer</param>
+    /// <param name="window">Stack window size</param>
+    /// <param name="x64Target">Target process is 64 bit</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Capture( class Thread& thd, ptr_t sp, size_t window, bool x64Target );
+
+    /// <summary>
+    /// Read memory, deferred writes included
+    /// </summary>
+    /// <param name="address">Remote address</param>
+    /// <param name="size">Data size</param>
+    /// <param name="pResult">Output buffer</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Read( ptr_t address, size_t size, void* pResult );
+
+    /// <summary>
+    /// Queue memory write until Flush
+    /// </summary>
+    /// <param name="address">Remote address</param>
+    /// <param name="size">Data size</param>
+    /// <param name="pData">Data to write</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Write( ptr_t address, size_t size, const void* pData );
+
+    /// <summary>
+    /// Apply deferred writes
+    /// </summary>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Flush();
+
+    /// <summary>
+    /// Drop snapshot and deferred writes
+    /// </summary>
+    BLACKBONE_API void reset();
+
+    BLACKBONE_API bool valid() const { return !_regions.empty(); }
+    BLACKBONE_API ptr_t teb32() const { return _teb32; }
+    BLACKBONE_API ptr_t teb64() const { return _teb64; }
+    BLACKBONE_API ptr_t stackBase() const { return _stackBase; }
+
+    /// <summary>
+    /// Remote reads issued since last Capture, snapshot read included
+    /// </summary>
+    BLACKBONE_API uint32_t reads() const { return _reads; }
+
+    /// <summary>
+    /// Remote writes issued by last Flush
+    /// </summary>
+    BLACKBONE_API uint32_t writes() const { return _writes; }
+
+private:
+    struct Region
+    {
+        ptr_t address = 0;              // Remote address
+        std::vector<uint8_t> data;      // Local copy
+
+        bool contains( ptr_t ptr, size_t size ) const
+        {
+            return ptr >= address && ptr + size <= address + data.size();
+        }
+    };
+
+    ContextSnapshot( const ContextSnapshot& ) = delete;
+    ContextSnapshot& operator =( const ContextSnapshot& ) = delete;
+
+private:
+    class ProcessMemory& _memory;
+    std::vector<Region> _regions;       // Stack window and TEB copies
+    std::vector<Region> _pending;       // Deferred writes, in order
+    ptr_t _teb32 = 0;                   // WOW64 TEB, 0 for x64 target
+    ptr_t _teb64 = 0;                   // Native TEB
+    ptr_t _stackBase = 0;               // Stack base of target bitness
+    uint32_t _reads = 0;                // Remote reads since Capture
+    uint32_t _writes = 0;               // Remote writes by Flush
+};
+
+}
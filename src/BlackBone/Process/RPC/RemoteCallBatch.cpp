@@ -0,0 +1,173 @@
+#include "RemoteCallBatch.h"
+#include "../Process.h"
+#include "../../Asm/AsmFactory.h"
+
+namespace blackbone
+{
+
+RemoteCallBatch::RemoteCallBatch( Process& proc )
+    : _process( proc )
+    , _args( proc.memory() )
+{
+}
+
+/// <summary>
+/// Queue call
+/// </summary>
+/// <param name="pfn">Remote function pointer</param>
+/// <param name="args">Function arguments</param>
+/// <param name="cc">Calling convention</param>
+/// <param name="retType">Return type. Structures returned by value aren't supported</param>
+/// <returns>Call index in result array</returns>
+size_t RemoteCallBatch::Add(
+    ptr_t pfn,
+    const std::vector<AsmVariant>& args,
+    eCalligConvention cc /*= cc_stdcall*/,
+    eReturnType retType /*= rt_int32*/
+    )
+{
+    Call call;
+    call.pfn = pfn;
+    call.args = args;
+    call.cc = cc;
+    call.retType = retType;
+
+    // Copied structures must point to own buffer
+    for (auto& arg : call.args)
+        if (!arg.buf.empty())
+            arg.imm_val64 = reinterpret_cast<uint64_t>(arg.buf.data());
+
+    _calls.emplace_back( std::move( call ) );
+    return _calls.size() - 1;
+}
+
+/// <summary>
+/// Execute all queued calls
+/// </summary>
+/// <param name="contextThread">Execution thread, nullptr - new thread</param>
+/// <returns>Per-call results in queue order</returns>
+call_result_t<std::vector<BatchCallResult>> RemoteCallBatch::Execute( ThreadPtr contextThread /*= nullptr*/ )
+{
+    if (_calls.empty())
+        return std::vector<BatchCallResult>();
+
+    for (auto& call : _calls)
+        if (call.retType == rt_struct || call.pfn == 0)
+            return STATUS_NOT_SUPPORTED;
+
+    bool x86 = _process.core().isWow64();
+    auto& remote = _process.remote();
+
+    auto status = remote.CreateRPCEnvironment( Worker_None, contextThread != nullptr );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    // Result array goes first, followed by argument data of all calls
+    std::vector<std::vector<AsmVariant>*> lists;
+    lists.reserve( _calls.size() );
+    for (auto& call : _calls)
+        lists.emplace_back( &call.args );
+
+    if (!NT_SUCCESS( status = _args.Marshal( lists, x86, _calls.size() * sizeof( BatchCallResult ) ) ))
+        return status;
+
+    auto a = AsmFactory::GetAssembler( x86 );
+    Assemble( *a );
+
+    uint64_t tmpResult = 0;
+    if (!contextThread)
+        status = remote.ExecInNewThread( (*a)->make(), (*a)->getCodeSize(), tmpResult );
+    else if (contextThread == remote.getWorker())
+        status = remote.ExecInWorkerThread( (*a)->make(), (*a)->getCodeSize(), tmpResult );
+    else
+        status = remote.ExecInAnyThread( (*a)->make(), (*a)->getCodeSize(), tmpResult, contextThread );
+
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    // Single read for results and all output buffers
+    if (!NT_SUCCESS( status = _args.Unmarshal( lists ) ))
+        return status;
+
+    std::vector<BatchCallResult> results( _calls.size() );
+    memcpy( results.data(), _args.data(), results.size() * sizeof( BatchCallResult ) );
+
+    for (size_t i = 0; i < _calls.size(); i++)
+        if (_calls[i].retType == rt_int32 || _calls[i].retType == rt_float)
+            results[i].value &= 0xFFFFFFFF;
+
+    return results;
+}
+
+/// <summary>
+/// Generate batch stub
+/// </summary>
+/// <param name="a">Assembler</param>
+void RemoteCallBatch::Assemble( IAsmHelper& a )
+{
+    using namespace asmjit::host;
+
+    bool x86 = a.assembler()->getArch() == asmjit::kArchX86;
+
+    // TEB->LastErrorValue
+    auto lastError = [&a, x86]() -> asmjit::Mem
+    {
+        if (x86)
+        {
+            a->mov( edx, dword_ptr_abs( 0x18 ).setSegment( fs ) );
+            return dword_ptr( edx, 0x34 );
+        }
+
+        a->mov( rdx, dword_ptr_abs( 0x30 ).setSegment( gs ) );
+        return dword_ptr( rdx, 0x68 );
+    };
+
+    a.GenPrologue();
+    if (x86)
+    {
+        a->pusha();
+        a->pushf();
+    }
+
+    for (size_t i = 0; i < _calls.size(); i++)
+    {
+        auto& call = _calls[i];
+        ptr_t slot = _args.ptr() + i * sizeof( BatchCallResult );
+
+        a->mov( lastError(), 0 );
+        a.GenCall( call.pfn, call.args, call.cc );
+
+        a->mov( a->zcx, slot );
+        if (call.retType == rt_float || call.retType == rt_double)
+        {
+            if (x86)
+                a->fstp( asmjit::Mem( ecx, 0, call.retType * sizeof( float ) ) );
+            else if (call.retType == rt_double)
+                a->movsd( asmjit::Mem( rcx, 0 ), xmm0 );
+            else
+                a->movss( asmjit::Mem( rcx, 0 ), xmm0 );
+        }
+        else if (x86)
+        {
+            a->mov( dword_ptr( ecx ), eax );
+            if (call.retType == rt_int64)
+                a->mov( dword_ptr( ecx, 4 ), edx );
+        }
+        else
+            a->mov( qword_ptr( rcx ), rax );
+
+        a->mov( edx, lastError() );
+        a->mov( dword_ptr( a->zcx, offsetof( BatchCallResult, lastError ) ), edx );
+    }
+
+    _process.remote().AddReturnWithEvent( a, mt_default, rt_int32 );
+    if (x86)
+    {
+        a->popf();
+        a->popa();
+    }
+
+    a.GenEpilogue();
+}
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../../Include/Winheaders.h"
+#include "../../Include/CallResult.h"
+#include "../../Asm/IAsmHelper.h"
+#include "../Threads/Thread.h"
+#include "ArgumentArena.h"
+
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Result of single batched call
+/// </summary>
+struct BatchCallResult
+{
+    uint64_t value = 0;         // Return value. float/double are stored as raw bits
+    uint32_t lastError = 0;     // Thread last error after the call
+    uint32_t reserved = 0;
+};
+
+/// <summary>
+/// Queue of remote calls executed back to back by a single stub.
+/// All out-of-line argument data and result slots share one argument arena block,
+/// so whole batch costs one write, one execution and one read.
+/// dataPtr arguments must stay valid until Execute returns; they are updated from target memory afterwards.
+/// </summary>
+class RemoteCallBatch
+{
+public:
+    BLACKBONE_API RemoteCallBatch( class Process& proc );
+    BLACKBONE_API ~RemoteCallBatch() = default;
+
+    BLACKBONE_API RemoteCallBatch( RemoteCallBatch&& ) = default;
+
+    /// <summary>
+    /// Queue call
+    /// </summary>
+    /// <param name="pfn">Remote function pointer</param>
+    /// <param name="args">Function arguments</param>
+    /// <param name="cc">Calling convention</param>
+    /// <param name="retType">Return type. Structures returned by value aren't supported</param>
+    /// <returns>Call index in result array</returns>
+    BLACKBONE_API size_t Add(
+        ptr_t pfn,
+        const std::vector<AsmVariant>& args,
+        eCalligConvention cc = cc_stdcall,
+        eReturnType retType = rt_int32
+    );
+
+    /// <summary>
+    /// Execute all queued calls
+    /// </summary>
+    /// <param name="contextThread">Execution thread, nullptr - new thread</param>
+    /// <returns>Per-call results in queue order</returns>
+    BLACKBONE_API call_result_t<std::vector<BatchCallResult>> Execute( ThreadPtr contextThread = nullptr );
+
+    /// <summary>
+    /// Remove queued calls. Remote block is kept for next batch
+    /// </summary>
+    BLACKBONE_API void Clear() { _calls.clear(); }
+
+    BLACKBONE_API size_t size() const { return _calls.size(); }
+    BLACKBONE_API bool empty() const { return _calls.empty(); }
+
+private:
+    struct Call
+    {
+        ptr_t pfn = 0;
+        std::vector<AsmVariant> args;
+        eCalligConvention cc = cc_stdcall;
+        eReturnType retType = rt_int32;
+    };
+
+    /// <summary>
+    /// Generate batch stub
+    /// </summary>
+    /// <param name="a">Assembler</param>
+    void Assemble( IAsmHelper& a );
+
+    RemoteCallBatch( const RemoteCallBatch& ) = delete;
+    RemoteCallBatch& operator =( const RemoteCallBatch& ) = delete;
+
+private:
+    class Process& _process;            // Target process
+    std::vector<Call> _calls;           // Queued calls
+    ArgumentArena _args;                // Results and argument data
+};
+
+}
@@ -4,12 +4,14 @@
 #include "../ProcessMemory.h"
 #include "../Threads/Thread.h"
 #include "../../Include/Macro.h"
+#include "ContextSnapshot.h"
 
 namespace blackbone
 {
 
 /// <summary>
 /// Remote function context during hook breakpoint.
+/// If snapshot is provided, stack and TEB accesses are served from it and writes are deferred until snapshot flush
 /// </summary>
 class RemoteContext
 {
@@ -20,11 +22,13 @@ public:
         _CONTEXT64& ctx,
         ptr_t frame_ptr,
         BOOL x64,
-        int wordSize
+        int wordSize,
+        ContextSnapshot* snapshot = nullptr
         )
         : _memory( memory )
         , _thd( thd )
         , _ctx( ctx )
+        , _snapshot( snapshot )
         , _x64Target( x64 )
         , _wordSize( wordSize )
         , _frame_ptr( frame_ptr != 0 ? frame_ptr : ctx.Rsp )
@@ -47,6 +51,12 @@ public:
         return _ctx; 
     }
 
+    // Prefetched stack and TEB, nullptr if not used
+    BLACKBONE_API inline ContextSnapshot* snapshot()
+    {
+        return _snapshot;
+    }
+
     /// <summary>
     /// Get current process thread where exception occurred
     /// </summary>
@@ -63,7 +73,7 @@ public:
     BLACKBONE_API inline const ptr_t returnAddress() const
     { 
         ptr_t val = 0;
-        _memory.Read( _frame_ptr, _wordSize, &val );
+        ReadMem( _frame_ptr, _wordSize, &val );
 
         return val;
     }
@@ -75,7 +85,7 @@ public:
     /// <returns>true on success</returns>
     BLACKBONE_API inline bool returnAddress( ptr_t val ) const
     { 
-        return (_memory.Write( _frame_ptr, _wordSize, &val ) == STATUS_SUCCESS);
+        return (WriteMem( _frame_ptr, _wordSize, &val ) == STATUS_SUCCESS);
     }
  
     /// <summary>
@@ -140,13 +150,17 @@ public:
                 return _ctx.R9;
 
             default:
-                return _memory.Read<DWORD64>( _ctx.Rsp + 0x28 + (index - 4) * _wordSize ).result( 0 );
+            {
+                DWORD64 val = 0;
+                ReadMem( _ctx.Rsp + 0x28 + (index - 4) * _wordSize, sizeof( val ), &val );
+                return val;
+            }
             }
         }
         else
         {
             DWORD64 val = 0;
-            _memory.Read( _ctx.Rsp + 4 + index * _wordSize, _wordSize, &val );
+            ReadMem( _ctx.Rsp + 4 + index * _wordSize, _wordSize, &val );
             return val;
         }
     }
@@ -179,14 +193,14 @@ public:
                 break;
 
             default:
-                return (_memory.Write( _ctx.Rsp + 0x28 + (index - 4) * _wordSize, val ) == STATUS_SUCCESS);
+                return (WriteMem( _ctx.Rsp + 0x28 + (index - 4) * _wordSize, sizeof( val ), &val ) == STATUS_SUCCESS);
             }
 
             return true;
         }
         else
         {
-            return  (_memory.Write( _ctx.Rsp + 4 + index * _wordSize, _wordSize, &val ) == STATUS_SUCCESS);
+            return  (WriteMem( _ctx.Rsp + 4 + index * _wordSize, _wordSize, &val ) == STATUS_SUCCESS);
         }
     }
 
@@ -202,17 +216,18 @@ public:
 
         if( _x64Target )
         {
-            pteb = _thd.teb( (_TEB64*)nullptr );
+            pteb = teb64();
             offset = FIELD_OFFSET( _TEB64, LastErrorValue );
         }
         else
         {
-            pteb = _thd.teb( (_TEB32*)nullptr );
+            pteb = teb32();
             offset = FIELD_OFFSET( _TEB32, LastErrorValue );
         }
 
-        if (pteb)
-            return _memory.Read<DWORD>( pteb + offset ).result( 0xFFFFFFFF );
+        DWORD val = 0;
+        if (pteb && ReadMem( pteb + offset, sizeof( val ), &val ) == STATUS_SUCCESS)
+            return val;
 
         return 0xFFFFFFFF;
     }
@@ -228,19 +243,19 @@ public:
 
         if (_x64Target)
         {
-            pteb = _thd.teb( (_TEB64*)nullptr );
+            pteb = teb64();
             offset = FIELD_OFFSET( _TEB64, LastErrorValue );
         }
         else
         {
-            pteb = _thd.teb( (_TEB32*)nullptr );
+            pteb = teb32();
             offset = FIELD_OFFSET( _TEB32, LastErrorValue );
         }
 
         if (!pteb)
             return 0xFFFFFFFF;
 
-        return _memory.Write( pteb + offset, newError );
+        return WriteMem( pteb + offset, sizeof( newError ), &newError );
     }
 
 
@@ -250,11 +265,13 @@ public:
     /// <returns>Data value</returns>
     BLACKBONE_API ptr_t getUserContext()
     {
-        auto pteb = _thd.teb( (_TEB64*)nullptr );
+        auto pteb = teb64();
         if (!pteb)
             return 0;
-            
-        return _memory.Read<ptr_t>( pteb + FIELD_OFFSET( _NT_TIB_T<DWORD64>, ArbitraryUserPointer ) ).result( 0 );
+
+        ptr_t val = 0;
+        ReadMem( pteb + FIELD_OFFSET( _NT_TIB_T<DWORD64>, ArbitraryUserPointer ), sizeof( val ), &val );
+        return val;
     }
 
     /// <summary>
@@ -263,10 +280,10 @@ public:
     /// <returns>true on success</returns>
     BLACKBONE_API bool setUserContext( ptr_t context )
     {
-        auto pteb = _thd.teb( (_TEB64*)nullptr );
+        auto pteb = teb64();
         if(pteb)
         {
-            if (_memory.Write( pteb + FIELD_OFFSET( _NT_TIB_T<DWORD64>, ArbitraryUserPointer ), context ) == STATUS_SUCCESS)
+            if (WriteMem( pteb + FIELD_OFFSET( _NT_TIB_T<DWORD64>, ArbitraryUserPointer ), sizeof( context ), &context ) == STATUS_SUCCESS)
                 return true;
         }
 
@@ -275,13 +292,41 @@ public:
 
 
 private:
+    /// <summary>
+    /// Read thread memory, through snapshot if available
+    /// </summary>
+    /// <param name="address">Remote address</param>
+    /// <param name="size">Data size</param>
+    /// <param name="pResult">Output buffer</param>
+    /// <returns>Status code</returns>
+    NTSTATUS ReadMem( ptr_t address, size_t size, void* pResult ) const
+    {
+        return _snapshot ? _snapshot->Read( address, size, pResult ) : _memory.Read( address, size, pResult );
+    }
+
+    /// <summary>
+    /// Write thread memory, deferred if snapshot is available
+    /// </summary>
+    /// <param name="address">Remote address</param>
+    /// <param name="size">Data size</param>
+    /// <param name="pData">Data to write</param>
+    /// <returns>Status code</returns>
+    NTSTATUS WriteMem( ptr_t address, size_t size, const void* pData ) const
+    {
+        return _snapshot ? _snapshot->Write( address, size, pData ) : _memory.Write( address, size, pData );
+    }
+
+    ptr_t teb32() const { return _snapshot && _snapshot->valid() ? _snapshot->teb32() : _thd.teb( (_TEB32*)nullptr ); }
+    ptr_t teb64() const { return _snapshot && _snapshot->valid() ? _snapshot->teb64() : _thd.teb( (_TEB64*)nullptr ); }
+
     RemoteContext( const RemoteContext& ) = delete;
     RemoteContext& operator = ( const RemoteContext& ) = delete;
 
 private:
-    ProcessMemory& _memory; // Process memory routines
-    Thread& _thd;           // Current thread
-    _CONTEXT64& _ctx;       // Current thread context
+    ProcessMemory& _memory;         // Process memory routines
+    Thread& _thd;                   // Current thread
+    _CONTEXT64& _ctx;               // Current thread context
+    ContextSnapshot* _snapshot;     // Prefetched stack and TEB, nullptr if not used
 
     BOOL  _x64Target = FALSE;   // Target process is 64 bit
     int   _wordSize = 4;        // 4 for x86, 8 for x64
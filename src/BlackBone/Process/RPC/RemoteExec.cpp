@@ -17,6 +17,10 @@ RemoteExec::RemoteExec( Process& proc )
     , _memory( _process.memory() )
     , _threads( _process.threads() )
     , _hWaitEvent( NULL )
+    , _ring( proc )
+    , _args{ _memory, _memory }
+    , _stubs( *this, _memory )
+    , _pool( proc, *this )
     , _apcPatched( false )
     , _currentBufferIdx( 0 )
 {
@@ -45,8 +49,25 @@ NTSTATUS RemoteExec::ExecInNewThread(
 
     // Write code
     if (!NT_SUCCESS( status = CopyCode( pCode, size ) ))
+    {
+        _trace.Commit( CallMode_NewThread, status );
         return status;
+    }
+
+    return RunInNewThread( _userCode[_currentBufferIdx].ptr(), size, callResult, modeSwitch );
+}
 
+/// <summary>
+/// Create new thread and execute remote code in it. Wait until execution ends
+/// </summary>
+/// <param name="pCode">Remote code address</param>
+/// <param name="wrapperOffset">Offset in _userCode to place thread entry wrapper at</param>
+/// <param name="callResult">Code return value</param>
+/// <param name="modeSwitch">Switch wow64 thread to long mode upon creation</param>
+/// <returns>Status</returns>
+NTSTATUS RemoteExec::RunInNewThread( ptr_t pCode, size_t wrapperOffset, uint64_t& callResult, eThreadModeSwitch modeSwitch )
+{
+    NTSTATUS status = STATUS_SUCCESS;
     bool switchMode = false;
     switch (modeSwitch)
     {
@@ -59,6 +80,8 @@ NTSTATUS RemoteExec::ExecInNewThread(
         break;
     }
 
+    auto call = _trace.Call( CallMode_NewThread );
+    auto stage = _trace.Stage( CallStage_Assemble );
     auto a = switchMode ? AsmFactory::GetAssembler( AsmFactory::asm64 ) 
                         : AsmFactory::GetAssembler( _process.core().isWow64() );
 
@@ -81,24 +104,29 @@ NTSTATUS RemoteExec::ExecInNewThread(
         }
     }
 
-    a->GenCall( _userCode[_currentBufferIdx].ptr(), { } );
+    a->GenCall( pCode, { } );
     (*a)->mov( (*a)->zdx, _userData[_currentBufferIdx].ptr() + INTRET_OFFSET );
     (*a)->mov( asmjit::host::dword_ptr( (*a)->zdx ), (*a)->zax );
     a->GenEpilogue( switchMode, 4 );
 
     // Execute code in newly created thread
-    if (!NT_SUCCESS( status = _userCode[_currentBufferIdx].Write( size, (*a)->getCodeSize(), (*a)->make() ) ))
-        return status;
+    stage.next( CallStage_Copy );
+    if (!NT_SUCCESS( status = _userCode[_currentBufferIdx].Write( wrapperOffset, (*a)->getCodeSize(), (*a)->make() ) ))
+        return call.result( status );
 
-    auto thread = _threads.CreateNew( _userCode[_currentBufferIdx].ptr() + size, _userData[_currentBufferIdx].ptr()/*, HideFromDebug*/ );
+    stage.next( CallStage_Dispatch );
+    auto thread = _threads.CreateNew( _userCode[_currentBufferIdx].ptr() + wrapperOffset, _userData[_currentBufferIdx].ptr()/*, HideFromDebug*/ );
     if (!thread)
-        return thread.status;
+        return call.result( thread.status );
+
+    stage.next( CallStage_Wait );
     if (!(*thread)->Join())
-        return LastNtStatus();
+        return call.result( LastNtStatus() );
 
     callResult = _userData[_currentBufferIdx].Read<uint64_t>( INTRET_OFFSET, 0 );
     SwitchActiveBuffer();
-    return STATUS_SUCCESS;
+
+    return call.result( STATUS_SUCCESS );
 }
 
 /// <summary>
@@ -116,14 +144,49 @@ NTSTATUS RemoteExec::ExecInWorkerThread( PVOID pCode, size_t size, uint64_t& cal
     if (_hijackThread)
         return ExecInAnyThread( pCode, size, callResult, _hijackThread );
 
-    assert( _workerThread );
-    assert( _hWaitEvent != NULL );
-    if (!_workerThread || !_hWaitEvent)
-        return STATUS_INVALID_PARAMETER;
-
     // Write code
     if (!NT_SUCCESS( status = CopyCode( pCode, size ) ))
+    {
+        _trace.Commit( _ring.active() ? CallMode_Ring : CallMode_Worker, status );
         return status;
+    }
+
+    return RunInWorkerThread( _userCode[_currentBufferIdx].ptr(), callResult );
+}
+
+/// <summary>
+/// Execute remote code in context of our worker thread
+/// </summary>
+/// <param name="pCode">Remote code address</param>
+/// <param name="callResult">Execution result</param>
+/// <returns>Status</returns>
+NTSTATUS RemoteExec::RunInWorkerThread( ptr_t pCode, uint64_t& callResult )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    // Worker polls shared ring, no APC delivery involved
+    if (_ring.active())
+    {
+        uint64_t ringResult = 0;
+        auto call = _trace.Call( CallMode_Ring );
+        auto stage = _trace.Stage( CallStage_Dispatch );
+        auto seq = _ring.Submit( pCode, _userData[_currentBufferIdx].ptr() );
+
+        stage.next( CallStage_Wait );
+        status = seq ? _ring.Wait( seq.result(), ringResult, 30 * 1000 ) : seq.status;
+        if (NT_SUCCESS( status ))
+            callResult = _userData[_currentBufferIdx].Read<uint64_t>( RET_OFFSET, 0 );
+
+        SwitchActiveBuffer();
+        return call.result( status );
+    }
+
+    auto call = _trace.Call( CallMode_Worker );
+
+    assert( _workerThread );
+    assert( _hWaitEvent != NULL );
+    if (!_workerThread || !_hWaitEvent)
+        return call.result( STATUS_INVALID_PARAMETER );
 
     if (_hWaitEvent)
         ResetEvent( _hWaitEvent );
@@ -150,21 +213,20 @@ NTSTATUS RemoteExec::ExecInWorkerThread( PVOID pCode, size_t size, uint64_t& cal
             _apcPatched = true;
     }*/
 
-    auto pRemoteCode = _userCode[_currentBufferIdx].ptr();
-
     // Execute code in thread context
-    // TODO: Find out why am I passing pRemoteCode as an argument???
-    if (NT_SUCCESS( _process.core().native()->QueueApcT( _workerThread->handle(), pRemoteCode, pRemoteCode ) ))
+    // TODO: Find out why am I passing pCode as an argument???
+    auto stage = _trace.Stage( CallStage_Dispatch );
+    if (NT_SUCCESS( _process.core().native()->QueueApcT( _workerThread->handle(), pCode, pCode ) ))
     {
+        stage.next( CallStage_Wait );
         status = WaitForSingleObject( _hWaitEvent, 30 * 1000 /*wait 30s*/ );
         callResult = _userData[_currentBufferIdx].Read<uint64_t>( RET_OFFSET, 0 );
     }
     else
-        return LastNtStatus();
+        return call.result( LastNtStatus() );
 
     SwitchActiveBuffer();
-
-    return status;
+    return call.result( status );
 }
 
 /// <summary>
@@ -178,23 +240,50 @@ NTSTATUS RemoteExec::ExecInWorkerThread( PVOID pCode, size_t size, uint64_t& cal
 NTSTATUS RemoteExec::ExecInAnyThread( PVOID pCode, size_t size, uint64_t& callResult, ThreadPtr& thd )
 {
     NTSTATUS status = STATUS_SUCCESS;
-    _CONTEXT32 ctx32 = { 0 };
-    _CONTEXT64 ctx64 = { 0 };
 
     assert( _hWaitEvent != NULL );
     if (_hWaitEvent == NULL)
+    {
+        _trace.Commit( CallMode_AnyThread, STATUS_NOT_FOUND );
         return STATUS_NOT_FOUND;
+    }
     
     // Write code
     if (!NT_SUCCESS( status = CopyCode( pCode, size ) ))
+    {
+        _trace.Commit( CallMode_AnyThread, status );
         return status;
+    }
+
+    return RunInAnyThread( _userCode[_currentBufferIdx].ptr(), size, callResult, thd );
+}
+
+/// <summary>
+/// Execute remote code in context of any existing thread
+/// </summary>
+/// <param name="pCode">Remote code address</param>
+/// <param name="wrapperOffset">Offset in _userCode to place context switch wrapper at</param>
+/// <param name="callResult">Execution result</param>
+/// <param name="thd">Target thread</param>
+/// <returns>Status</returns>
+NTSTATUS RemoteExec::RunInAnyThread( ptr_t pCode, size_t wrapperOffset, uint64_t& callResult, ThreadPtr& thd )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    _CONTEXT32 ctx32 = { 0 };
+    _CONTEXT64 ctx64 = { 0 };
+
+    auto call = _trace.Call( CallMode_AnyThread );
+    if (_hWaitEvent == NULL)
+        return call.result( STATUS_NOT_FOUND );
 
     if (_hWaitEvent)
         ResetEvent( _hWaitEvent );
 
+    auto stage = _trace.Stage( CallStage_Dispatch );
     if (!thd->Suspend())
-        return LastNtStatus();
+        return call.result( LastNtStatus() );
 
+    stage.next( CallStage_Assemble );
     auto a = AsmFactory::GetAssembler( _process.core().isWow64() );
     if (!_process.core().isWow64())
     {
@@ -209,7 +298,7 @@ NTSTATUS RemoteExec::ExecInAnyThread( PVOID pCode, size_t size, uint64_t& callRe
         if (!NT_SUCCESS( status = thd->GetContext( ctx64, CONTEXT64_CONTROL, true ) ))
         {
             thd->Resume();
-            return status;
+            return call.result( status );
         }
 
         //
@@ -224,7 +313,7 @@ NTSTATUS RemoteExec::ExecInAnyThread( PVOID pCode, size_t size, uint64_t& callRe
         for (int i = 0; i < count; i++)
             (*a)->mov( asmjit::Mem( asmjit::host::rsp, i * sizeof( uint64_t ) ), regs[i] );
 
-        a->GenCall( _userCode[_currentBufferIdx].ptr(), { _userData[_currentBufferIdx].ptr() } );
+        a->GenCall( pCode, { _userData[_currentBufferIdx].ptr() } );
         AddReturnWithEvent( *a, mt_mod64, rt_int32, INTRET_OFFSET );
 
         // Restore registers
@@ -244,13 +333,13 @@ NTSTATUS RemoteExec::ExecInAnyThread( PVOID pCode, size_t size, uint64_t& callRe
         if (!NT_SUCCESS( status = thd->GetContext( ctx32, CONTEXT_CONTROL, true ) ))
         {
             thd->Resume();
-            return status;
+            return call.result( status );
         }
 
         (*a)->pusha();
         (*a)->pushf();
 
-        a->GenCall( _userCode[_currentBufferIdx].ptr(), { _userData[_currentBufferIdx].ptr() } );
+        a->GenCall( pCode, { _userData[_currentBufferIdx].ptr() } );
         (*a)->add( asmjit::host::esp, sizeof( uint32_t ) );
         AddReturnWithEvent( *a, mt_mod32, rt_int32, INTRET_OFFSET );
 
@@ -261,16 +350,18 @@ NTSTATUS RemoteExec::ExecInAnyThread( PVOID pCode, size_t size, uint64_t& callRe
         (*a)->ret();
     }
 
-    if (NT_SUCCESS( status = _userCode[_currentBufferIdx].Write( size, (*a)->getCodeSize(), (*a)->make() ) ))
+    stage.next( CallStage_Copy );
+    if (NT_SUCCESS( status = _userCode[_currentBufferIdx].Write( wrapperOffset, (*a)->getCodeSize(), (*a)->make() ) ))
     {
+        stage.next( CallStage_Dispatch );
         if (_process.core().isWow64())
         {
-            ctx32.Eip = static_cast<uint32_t>(_userCode[_currentBufferIdx].ptr() + size);
+            ctx32.Eip = static_cast<uint32_t>(_userCode[_currentBufferIdx].ptr() + wrapperOffset);
             status = thd->SetContext( ctx32, true );
         }     
         else
         {
-            ctx64.Rip = _userCode[_currentBufferIdx].ptr() + size;
+            ctx64.Rip = _userCode[_currentBufferIdx].ptr() + wrapperOffset;
             status = thd->SetContext( ctx64, true );
         }
     }
@@ -278,13 +369,13 @@ NTSTATUS RemoteExec::ExecInAnyThread( PVOID pCode, size_t size, uint64_t& callRe
     thd->Resume();
     if (NT_SUCCESS( status ))
     {
+        stage.next( CallStage_Wait );
         WaitForSingleObject( _hWaitEvent, 20 * 1000/*INFINITE*/ );
         status = _userData[_currentBufferIdx].Read( INTRET_OFFSET, callResult );
     }
 
     SwitchActiveBuffer();
-
-    return status;
+    return call.result( status );
 }
 
 
@@ -296,20 +387,47 @@ NTSTATUS RemoteExec::ExecInAnyThread( PVOID pCode, size_t size, uint64_t& callRe
 /// <returns>Thread exit code</returns>
 DWORD RemoteExec::ExecDirect( ptr_t pCode, ptr_t arg )
 {
+    auto call = _trace.Call( CallMode_Direct );
+    auto stage = _trace.Stage( CallStage_Dispatch );
     auto thread = _threads.CreateNew( pCode, arg/*, HideFromDebug*/ );
     if (!thread)
-        return thread.status;
+        return call.result( thread.status );
 
+    stage.next( CallStage_Wait );
     (*thread)->Join();
+
+    call.result( STATUS_SUCCESS );
     return (*thread)->ExitCode();
 }
 
+/// <summary>
+/// Execute code already present in target process, without copying it into codecave
+/// </summary>
+/// <param name="pCode">Remote code address</param>
+/// <param name="callResult">Execution result</param>
+/// <param name="contextThread">Execution thread, nullptr - new thread</param>
+/// <returns>Status</returns>
+NTSTATUS RemoteExec::ExecRemote( ptr_t pCode, uint64_t& callResult, ThreadPtr contextThread /*= nullptr*/ )
+{
+    if (!contextThread)
+        return RunInNewThread( pCode, 0, callResult, AutoSwitch );
+
+    if (contextThread != _workerThread)
+        return RunInAnyThread( pCode, 0, callResult, contextThread );
+
+    // Delegate to another thread
+    if (_hijackThread)
+        return RunInAnyThread( pCode, 0, callResult, _hijackThread );
+
+    return RunInWorkerThread( pCode, callResult );
+}
+
 /// <summary>
 /// Create environment for future remote procedure calls
 ///
 /// _userData layout (x86/x64):
 /// --------------------------------------------------------------------------------------------------------------------------
-/// | Internal return value | Return value |  Last Status code  |  Event handle   |  Space for copied arguments and strings  |
+/// | Internal return value | Return value |  Last Status code  |  Event handle   |  Space for structure return value        |
 /// -------------------------------------------------------------------------------------------------------------------------
 /// |       8/8 bytes       |   8/8 bytes  |      8/8 bytes     |    8/8 bytes    |                                          |
 /// --------------------------------------------------------------------------------------------------------------------------
@@ -359,6 +477,15 @@ NTSTATUS RemoteExec::CreateRPCEnvironment( WorkerThreadMode mode /*= Worker_None
 
         thdID = thd.result();
     }
+    // Create ring polling thread
+    else if (mode == Worker_Ring)
+    {
+        if (!NT_SUCCESS( status = _ring.Start() ))
+            return status;
+
+        _workerThread = _ring.thread();
+        thdID = _workerThread->id();
+    }
     // Get thread to hijack
     else if (mode == Worker_UseExisting)
     {
@@ -515,43 +642,128 @@ NTSTATUS RemoteExec::PrepareCallAssembly(
     eReturnType retType
     )
 {
-    uintptr_t data_offset = ARGS_OFFSET;
-
     // Invalid calling convention
     if (cc < cc_cdecl || cc > cc_fastcall)
         return STATUS_INVALID_PARAMETER_3;
 
-    // Copy structures and strings
-    for (auto& arg : args)
-    {
-        // Transform 64 bit imm values
-        if (arg.type == AsmVariant::imm && arg.size > sizeof( uint32_t ) && a.assembler()->getArch() == asmjit::kArchX86)
-        {
-            arg.type = AsmVariant::dataStruct;
-            arg.buf.resize( arg.size );
-            memcpy( arg.buf.data(), &arg.imm_val64, arg.size );
-            arg.imm_val64 = reinterpret_cast<uint64_t>(arg.buf.data());
-        }
+    NTSTATUS status = PrepareCallArguments( args, a.assembler()->getArch() == asmjit::kArchX86, retType );
+    if (!NT_SUCCESS( status ))
+        return status;
 
-        if (arg.type == AsmVariant::dataStruct || arg.type == AsmVariant::dataPtr)
-        {
-            _userData[_currentBufferIdx].Write( data_offset, arg.size, reinterpret_cast<const void*>(arg.imm_val) );
-            arg.new_imm_val = _userData[_currentBufferIdx].ptr() + data_offset;
+    return AssembleCall( a, pfn, args, cc, retType );
+}
 
-            // Add some padding after data
-            data_offset += arg.size + 0x10;
-        }
-    }
+/// <summary>
+/// Copy out-of-line argument data into argument arena and insert hidden arguments
+/// </summary>
+/// <param name="args">Function arguments</param>
+/// <param name="x86">Target code is 32 bit</param>
+/// <param name="retType">Return type</param>
+/// <returns>Status code</returns>
+NTSTATUS RemoteExec::PrepareCallArguments( std::vector<AsmVariant>& args, bool x86, eReturnType retType )
+{
+    auto stage = _trace.Stage( CallStage_Copy );
+    NTSTATUS status = PrepareCallArguments( args, x86, retType, _args[_currentBufferIdx], _userData[_currentBufferIdx].ptr() );
+
+    stage.end();
+    if (!NT_SUCCESS( status ))
+        _trace.Discard();
+    else
+        _trace.SetPayload( _args[_currentBufferIdx].used() );
+
+    return status;
+}
+
+/// <summary>
+/// Copy out-of-line argument data into custom argument arena and insert hidden arguments
+/// </summary>
+/// <param name="args">Function arguments</param>
+/// <param name="x86">Target code is 32 bit</param>
+/// <param name="retType">Return type</param>
+/// <param name="arena">Argument arena</param>
+/// <param name="userData">Remote user data block, see CreateRPCEnvironment</param>
+/// <returns>Status code</returns>
+NTSTATUS RemoteExec::PrepareCallArguments(
+    std::vector<AsmVariant>& args,
+    bool x86,
+    eReturnType retType,
+    ArgumentArena& arena,
+    ptr_t userData
+    )
+{
+    // Copy structures and strings
+    NTSTATUS status = arena.Marshal( args, x86 );
+    if (!NT_SUCCESS( status ))
+        return status;
 
     // Insert hidden variable if return type is struct.
     // This variable contains address of buffer in which return value is copied
     if (retType == rt_struct)
     {
-        args.emplace( args.begin(), AsmVariant( _userData[_currentBufferIdx].ptr<uintptr_t>() + ARGS_OFFSET ) );
+        args.emplace( args.begin(), AsmVariant( static_cast<uintptr_t>(userData + ARGS_OFFSET) ) );
         args.front().new_imm_val = args.front().imm_val;
         args.front().type = AsmVariant::structRet;
     }
-        
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Generate call stub for already prepared arguments
+/// </summary>
+/// <param name="a">Underlying assembler object</param>
+/// <param name="pfn">Remote function pointer</param>
+/// <param name="args">Function arguments, see PrepareCallArguments</param>
+/// <param name="cc">Calling convention</param>
+/// <param name="retType">Return type</param>
+/// <returns>Status code</returns>
+NTSTATUS RemoteExec::AssembleCall(
+    IAsmHelper& a,
+    ptr_t pfn,
+    const std::vector<AsmVariant>& args,
+    eCalligConvention cc,
+    eReturnType retType
+    )
+{
+    // Allocate block if missing
+    if (!_userData[_currentBufferIdx].valid())
+    {
+        auto mem = _memory.Allocate( 0x4000, PAGE_READWRITE );
+        if (!mem)
+            return mem.status;
+
+        _userData[_currentBufferIdx] = std::move( mem.result() );
+    }
+
+    auto stage = _trace.Stage( CallStage_Assemble );
+    NTSTATUS status = AssembleCall( a, pfn, args, cc, retType, _userData[_currentBufferIdx].ptr() );
+
+    stage.end();
+    if (!NT_SUCCESS( status ))
+        _trace.Discard();
+
+    return status;
+}
+
+/// <summary>
+/// Generate call stub for already prepared arguments, storing results in custom user data block
+/// </summary>
+/// <param name="a">Underlying assembler object</param>
+/// <param name="pfn">Remote function pointer</param>
+/// <param name="args">Function arguments, see PrepareCallArguments</param>
+/// <param name="cc">Calling convention</param>
+/// <param name="retType">Return type</param>
+/// <param name="userData">Remote user data block, see CreateRPCEnvironment</param>
+/// <returns>Status code</returns>
+NTSTATUS RemoteExec::AssembleCall(
+    IAsmHelper& a,
+    ptr_t pfn,
+    const std::vector<AsmVariant>& args,
+    eCalligConvention cc,
+    eReturnType retType,
+    ptr_t userData
+    )
+{
     a.GenPrologue();
     if (_process.core().isWow64())
     {
@@ -563,7 +775,7 @@ NTSTATUS RemoteExec::PrepareCallAssembly(
     // Retrieve result from XMM0 or ST0
     if (retType == rt_float || retType == rt_double)
     {
-        a->mov( a->zax, _userData[_currentBufferIdx].ptr<size_t>() + RET_OFFSET );
+        a->mov( a->zax, static_cast<size_t>(userData + RET_OFFSET) );
 
 #ifdef USE64
         if (retType == rt_double)
@@ -575,7 +787,11 @@ NTSTATUS RemoteExec::PrepareCallAssembly(
 #endif
     }
 
-    AddReturnWithEvent( a, mt_default, retType );
+    auto pSetEvent = _mods.GetNtdllExport( "NtSetEvent" );
+    if (!pSetEvent)
+        return pSetEvent.status;
+
+    a.SaveRetValAndSignalEvent( pSetEvent->procAddress, userData + RET_OFFSET, userData + EVENT_OFFSET, userData + ERR_OFFSET, retType );
     if (_process.core().isWow64())
     {
         a->popf();
@@ -586,6 +802,28 @@ NTSTATUS RemoteExec::PrepareCallAssembly(
     return STATUS_SUCCESS;
 }
 
+/// <summary>
+/// Get cached call stub for prepared arguments, patched with their values
+/// </summary>
+/// <param name="pfn">Remote function pointer</param>
+/// <param name="args">Function arguments, see PrepareCallArguments</param>
+/// <param name="cc">Calling convention</param>
+/// <param name="retType">Return type</param>
+/// <returns>Remote stub address, STATUS_NOT_SUPPORTED if call can't be cached</returns>
+call_result_t<ptr_t> RemoteExec::GetCallStub(
+    ptr_t pfn,
+    const std::vector<AsmVariant>& args,
+    eCalligConvention cc,
+    eReturnType retType
+    )
+{
+    if (cc < cc_cdecl || cc > cc_fastcall)
+        return STATUS_INVALID_PARAMETER_3;
+
+    auto stage = _trace.Stage( CallStage_Assemble );
+    return _stubs.Get( pfn, args, cc, retType, _process.core().isWow64(), _currentBufferIdx );
+}
+
 /// <summary>
 /// Copy executable code into remote codecave for future execution
 /// </summary>
@@ -594,6 +832,8 @@ NTSTATUS RemoteExec::PrepareCallAssembly(
 /// <returns>Status</returns>
 NTSTATUS RemoteExec::CopyCode( PVOID pCode, size_t size )
 {
+    auto stage = _trace.Stage( CallStage_Copy );
+
     if (!_userCode[_currentBufferIdx].valid())
     {
         auto mem = _memory.Allocate( size );
@@ -678,6 +918,13 @@ void RemoteExec::TerminateWorker()
         _hWaitEvent = NULL;
     }
 
+    // Stop ring worker
+    if (_ring.active())
+    {
+        _ring.Stop();
+        _workerThread.reset();
+    }
+
     // Stop thread
     if(_workerThread && _workerThread->valid())
     {
@@ -694,6 +941,7 @@ void RemoteExec::TerminateWorker()
 /// </summary>
 void RemoteExec::reset()
 {
+    _pool.Stop();
     TerminateWorker();
 
     _userCode[0].Reset();
@@ -701,6 +949,9 @@ void RemoteExec::reset()
     _userData[0].Reset();
     _userData[1].Reset();
     _workerCode.Reset();
+    _args[0].reset();
+    _args[1].reset();
+    _stubs.reset();
 
     _apcPatched = false;
 }
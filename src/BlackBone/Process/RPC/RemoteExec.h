@@ -4,6 +4,11 @@
 #include "../../Asm/AsmFactory.h"
 #include "../Threads/Threads.h"
 #include "../MemBlock.h"
+#include "CommandRing.h"
+#include "CallStubCache.h"
+#include "ArgumentArena.h"
+#include "RemoteWorkerPool.h"
+#include "CallTrace.h"
 
 // User data offsets
 #define INTRET_OFFSET   0x00
@@ -21,6 +26,7 @@ enum WorkerThreadMode
     Worker_None,            // No worker thread
     Worker_CreateNew,       // Create dedicated worker thread
     Worker_UseExisting,     // Hijack existing thread
+    Worker_Ring,            // Create dedicated worker thread polling shared memory command ring
 };
 
 class RemoteExec
@@ -36,7 +42,7 @@ public:
     ///
     /// _userData layout (x86/x64):
     /// --------------------------------------------------------------------------------------------------------------------------
-    /// | Internal return value | Return value |  Last Status code  |  Event handle   |  Space for copied arguments and strings  |
+    /// | Internal return value | Return value |  Last Status code  |  Event handle   |  Space for structure return value        |
     /// -------------------------------------------------------------------------------------------------------------------------
     /// |       8/8 bytes       |   8/8 bytes  |      8/8 bytes     |    8/8 bytes    |                                          |
     /// --------------------------------------------------------------------------------------------------------------------------
@@ -87,6 +93,15 @@ public:
     /// <returns>Thread exit code</returns>
     BLACKBONE_API DWORD ExecDirect( ptr_t pCode, ptr_t arg );
 
+    /// <summary>
+    /// Execute code already present in target process, without copying it into codecave
+    /// </summary>
+    /// <param name="pCode">Remote code address</param>
+    /// <param name="callResult">Execution result</param>
+    /// <param name="contextThread">Execution thread, nullptr - new thread</param>
+    /// <returns>Status</returns>
+    BLACKBONE_API NTSTATUS ExecRemote( ptr_t pCode, uint64_t& callResult, ThreadPtr contextThread = nullptr );
+
     /// <summary>
     /// Generate assembly code for remote call.
     /// </summary>
@@ -104,6 +119,96 @@ public:
         eReturnType retType
     );
 
+    /// <summary>
+    /// Copy out-of-line argument data into argument arena and insert hidden arguments
+    /// </summary>
+    /// <param name="args">Function arguments</param>
+    /// <param name="x86">Target code is 32 bit</param>
+    /// <param name="retType">Return type</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS PrepareCallArguments( std::vector<AsmVariant>& args, bool x86, eReturnType retType );
+
+    /// <summary>
+    /// Copy out-of-line argument data into custom argument arena and insert hidden arguments
+    /// </summary>
+    /// <param name="args">Function arguments</param>
+    /// <param name="x86">Target code is 32 bit</param>
+    /// <param name="retType">Return type</param>
+    /// <param name="arena">Argument arena</param>
+    /// <param name="userData">Remote user data block, see CreateRPCEnvironment</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS PrepareCallArguments(
+        std::vector<AsmVariant>& args,
+        bool x86,
+        eReturnType retType,
+        ArgumentArena& arena,
+        ptr_t userData
+    );
+
+    /// <summary>
+    /// Update dataPtr arguments after call
+    /// </summary>
+    /// <param name="args">Arguments prepared by PrepareCallArguments</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS ReadCallArguments( const std::vector<AsmVariant>& args )
+    {
+        auto stage = _trace.Stage( CallStage_ReadBack );
+
+        // Buffers have already been switched, see GetCallResult
+        return _args[1 - _currentBufferIdx].Unmarshal( args );
+    }
+
+    /// <summary>
+    /// Generate call stub for already prepared arguments
+    /// </summary>
+    /// <param name="a">Underlying assembler object</param>
+    /// <param name="pfn">Remote function pointer</param>
+    /// <param name="args">Function arguments, see PrepareCallArguments</param>
+    /// <param name="cc">Calling convention</param>
+    /// <param name="retType">Return type</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS AssembleCall(
+        IAsmHelper& a,
+        ptr_t pfn,
+        const std::vector<AsmVariant>& args,
+        eCalligConvention cc,
+        eReturnType retType
+    );
+
+    /// <summary>
+    /// Generate call stub for already prepared arguments, storing results in custom user data block
+    /// </summary>
+    /// <param name="a">Underlying assembler object</param>
+    /// <param name="pfn">Remote function pointer</param>
+    /// <param name="args">Function arguments, see PrepareCallArguments</param>
+    /// <param name="cc">Calling convention</param>
+    /// <param name="retType">Return type</param>
+    /// <param name="userData">Remote user data block, see CreateRPCEnvironment</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS AssembleCall(
+        IAsmHelper& a,
+        ptr_t pfn,
+        const std::vector<AsmVariant>& args,
+        eCalligConvention cc,
+        eReturnType retType,
+        ptr_t userData
+    );
+
+    /// <summary>
+    /// Get cached call stub for prepared arguments, patched with their values
+    /// </summary>
+    /// <param name="pfn">Remote function pointer</param>
+    /// <param name="args">Function arguments, see PrepareCallArguments</param>
+    /// <param name="cc">Calling convention</param>
+    /// <param name="retType">Return type</param>
+    /// <returns>Remote stub address, STATUS_NOT_SUPPORTED if call can't be cached</returns>
+    BLACKBONE_API call_result_t<ptr_t> GetCallStub(
+        ptr_t pfn,
+        const std::vector<AsmVariant>& args,
+        eCalligConvention cc,
+        eReturnType retType
+    );
+
     /// <summary>
     /// Generate return from function with event synchronization
     /// </summary>
@@ -138,6 +243,7 @@ public:
     {
         // This method is called after an RPC call, so the ping pong buffers have already been switched, so
         // we want to access the OTHER buffer here.
+        auto stage = _trace.Stage( CallStage_ReadBack );
         if constexpr (sizeof( T ) > sizeof( uint64_t ))
         {
             if constexpr (std::is_reference_v<T>)
@@ -175,6 +281,30 @@ public:
     /// <returns></returns>
     BLACKBONE_API ThreadPtr getExecThread() { return _hijackThread ? _hijackThread : _workerThread; }
 
+    /// <summary>
+    /// Get worker command ring. Active only in Worker_Ring mode
+    /// </summary>
+    /// <returns></returns>
+    BLACKBONE_API CommandRing& ring() { return _ring; }
+
+    /// <summary>
+    /// Get call stub cache
+    /// </summary>
+    /// <returns></returns>
+    BLACKBONE_API CallStubCache& stubs() { return _stubs; }
+
+    /// <summary>
+    /// Get remote worker pool used for asynchronous calls
+    /// </summary>
+    /// <returns></returns>
+    BLACKBONE_API RemoteWorkerPool& pool() { return _pool; }
+
+    /// <summary>
+    /// Get per-call stage tracer. Disabled by default
+    /// </summary>
+    /// <returns></returns>
+    BLACKBONE_API CallTracer& trace() { return _trace; }
+
     /// <summary>
     /// Ge memory routines
     /// </summary>
@@ -209,6 +339,34 @@ private:
     /// <returns>Status</returns>
     NTSTATUS CopyCode( PVOID pCode, size_t size );
 
+    /// <summary>
+    /// Create new thread and execute remote code in it. Wait until execution ends
+    /// </summary>
+    /// <param name="pCode">Remote code address</param>
+    /// <param name="wrapperOffset">Offset in _userCode to place thread entry wrapper at</param>
+    /// <param name="callResult">Code return value</param>
+    /// <param name="modeSwitch">Switch wow64 thread to long mode upon creation</param>
+    /// <returns>Status</returns>
+    NTSTATUS RunInNewThread( ptr_t pCode, size_t wrapperOffset, uint64_t& callResult, eThreadModeSwitch modeSwitch );
+
+    /// <summary>
+    /// Execute remote code in context of our worker thread
+    /// </summary>
+    /// <param name="pCode">Remote code address</param>
+    /// <param name="callResult">Execution result</param>
+    /// <returns>Status</returns>
+    NTSTATUS RunInWorkerThread( ptr_t pCode, uint64_t& callResult );
+
+    /// <summary>
+    /// Execute remote code in context of any existing thread
+    /// </summary>
+    /// <param name="pCode">Remote code address</param>
+    /// <param name="wrapperOffset">Offset in _userCode to place context switch wrapper at</param>
+    /// <param name="callResult">Execution result</param>
+    /// <param name="thd">Target thread</param>
+    /// <returns>Status</returns>
+    NTSTATUS RunInAnyThread( ptr_t pCode, size_t wrapperOffset, uint64_t& callResult, ThreadPtr& thd );
+
     void SwitchActiveBuffer()
     {
         // The ExecIn*() methods might return while the remote RPC code is still executing (it still has to
@@ -238,7 +396,12 @@ private:
     HANDLE    _hWaitEvent;      // APC sync event handle
     MemBlock  _workerCode;      // Worker thread address space
     MemBlock  _userCode[2];     // Codecave for code execution
-    MemBlock  _userData[2];     // Region to store copied structures and strings
+    MemBlock  _userData[2];     // Region to store return values
+    ArgumentArena _args[2];     // Copied structures and strings, paired with _userData
+    CommandRing _ring;          // Shared memory command ring for Worker_Ring mode
+    CallStubCache _stubs;       // Call stubs by signature
+    RemoteWorkerPool _pool;     // Workers for asynchronous calls
+    CallTracer _trace;          // Per-call stage timings
     bool      _apcPatched;      // KiUserApcDispatcher was patched
     int       _currentBufferIdx;// Index of the currently used _userCode/_userData block. See SwitchActiveBuffer().
 };
@@ -3,7 +3,9 @@
 #include "../../Include/CallResult.h"
 #include "../../Asm/IAsmHelper.h"
 #include "../Process.h"
+#include "RemoteCallBatch.h"
 
+#include <future>
 #include <type_traits>
 
 // TODO: Find more elegant way to deduce calling convention
@@ -68,56 +70,53 @@ public:
         ReturnType result = {};
         uint64_t tmpResult = 0;
         NTSTATUS status = STATUS_SUCCESS;
-        auto a = AsmFactory::GetAssembler( _process.core().isWow64() );
+        auto& remote = _process.remote();
 
         if (!contextThread)
             contextThread = _boundThread;
 
         // Ensure RPC environment exists
-        status = _process.remote().CreateRPCEnvironment( Worker_None, contextThread != nullptr );
+        status = remote.CreateRPCEnvironment( Worker_None, contextThread != nullptr );
         if (!NT_SUCCESS( status ))
             return call_result_t<ReturnType>( result, status );
 
-        // FPU check
-        constexpr bool isFloat = std::is_same_v<ReturnType, float>;
-        constexpr bool isDouble = std::is_same_v<ReturnType, double> || std::is_same_v<ReturnType, long double>;
-
-        // Deduce return type
-        eReturnType retType = rt_int32;
-
-        if constexpr (isFloat)
-            retType = rt_float;
-        else if constexpr (isDouble)
-            retType = rt_double;
-        else if constexpr (sizeof( ReturnType ) == sizeof( uint64_t ))
-            retType = rt_int64;
-        else if constexpr (!std::is_reference_v<ReturnType> && sizeof( ReturnType ) > sizeof( uint64_t ))
-            retType = rt_struct;
-
-        _process.remote().PrepareCallAssembly( *a, _ptr, args.arguments, Conv, retType );
+        status = remote.PrepareCallArguments( args.arguments, _process.core().isWow64(), returnType() );
+        if (!NT_SUCCESS( status ))
+            return call_result_t<ReturnType>( result, status );
 
-        // Choose execution thread
-        if (!contextThread)
+        // Reuse stub generated for same signature
+        auto stub = remote.GetCallStub( _ptr, args.arguments, Conv, returnType() );
+        if (stub)
         {
-            status = _process.remote().ExecInNewThread( (*a)->make(), (*a)->getCodeSize(), tmpResult );
-        }
-        else if (contextThread == _process.remote().getWorker())
-        {
-            status = _process.remote().ExecInWorkerThread( (*a)->make(), (*a)->getCodeSize(), tmpResult );
+            status = remote.ExecRemote( stub.result(), tmpResult, contextThread );
         }
         else
         {
-            status = _process.remote().ExecInAnyThread( (*a)->make(), (*a)->getCodeSize(), tmpResult, contextThread );
+            auto a = AsmFactory::GetAssembler( _process.core().isWow64() );
+            if (!NT_SUCCESS( status = remote.AssembleCall( *a, _ptr, args.arguments, Conv, returnType() ) ))
+                return call_result_t<ReturnType>( result, status );
+
+            // Choose execution thread
+            if (!contextThread)
+            {
+                status = remote.ExecInNewThread( (*a)->make(), (*a)->getCodeSize(), tmpResult );
+            }
+            else if (contextThread == remote.getWorker())
+            {
+                status = remote.ExecInWorkerThread( (*a)->make(), (*a)->getCodeSize(), tmpResult );
+            }
+            else
+            {
+                status = remote.ExecInAnyThread( (*a)->make(), (*a)->getCodeSize(), tmpResult, contextThread );
+            }
         }
 
         // Get function return value
-        if (!NT_SUCCESS( status ) || !NT_SUCCESS( status = _process.remote().GetCallResult( result ) ))
+        if (!NT_SUCCESS( status ) || !NT_SUCCESS( status = remote.GetCallResult( result ) ))
             return call_result_t<ReturnType>( result, status );
 
         // Update arguments
-        for (auto& arg : args.arguments)
-            if (arg.type == AsmVariant::dataPtr)
-                _process.memory().Read( arg.new_imm_val, arg.size, reinterpret_cast<void*>(arg.imm_val) );
+        remote.ReadCallArguments( args.arguments );
 
         return call_result_t<ReturnType>( result, STATUS_SUCCESS );
     }
@@ -161,6 +160,71 @@ public:
         return CallArguments( args, std::index_sequence_for<Args...>() ); 
     }
 
+    /// <summary>
+    /// Queue call into batch instead of executing it.
+    /// Pointer arguments must stay valid until batch is executed
+    /// </summary>
+    /// <param name="batch">Target batch</param>
+    /// <returns>Call index in batch results</returns>
+    size_t Batch( RemoteCallBatch& batch, const Args&... args )
+    {
+        CallArguments a( args... );
+        return batch.Add( _ptr, a.arguments, Conv, returnType() );
+    }
+
+    size_t Batch( RemoteCallBatch& batch, const std::initializer_list<AsmVariant>& args )
+    {
+        CallArguments a( args );
+        return batch.Add( _ptr, a.arguments, Conv, returnType() );
+    }
+
+    /// <summary>
+    /// Execute call in remote worker pool without blocking caller.
+    /// Pool is started on first use. Pointer arguments must stay valid until call is finished
+    /// </summary>
+    /// <param name="args">Function arguments</param>
+    /// <param name="timeout">Call timeout, ms</param>
+    /// <param name="cancel">Cancellation token</param>
+    /// <returns>Function return value</returns>
+    std::future<call_result_t<ReturnType>> CallAsync( const CallArguments& args, uint32_t timeout = INFINITE, CancelToken cancel = CancelToken() )
+    {
+        auto& pool = _process.remote().pool();
+
+        NTSTATUS status = pool.Start();
+        if (!NT_SUCCESS( status ))
+        {
+            std::promise<call_result_t<ReturnType>> failed;
+            failed.set_value( call_result_t<ReturnType>( ReturnType(), status ) );
+            return failed.get_future();
+        }
+
+        return pool.Call<ReturnType>( _ptr, args.arguments, Conv, returnType(), timeout, cancel );
+    }
+
+    std::future<call_result_t<ReturnType>> CallAsync( const std::initializer_list<AsmVariant>& args, uint32_t timeout = INFINITE, CancelToken cancel = CancelToken() )
+    {
+        CallArguments a( args );
+        return CallAsync( a, timeout, cancel );
+    }
+
+    /// <summary>
+    /// Deduce return type
+    /// </summary>
+    /// <returns>Return type</returns>
+    static constexpr eReturnType returnType()
+    {
+        if constexpr (std::is_same_v<ReturnType, float>)
+            return rt_float;
+        else if constexpr (std::is_same_v<ReturnType, double> || std::is_same_v<ReturnType, long double>)
+            return rt_double;
+        else if constexpr (sizeof( ReturnType ) == sizeof( uint64_t ))
+            return rt_int64;
+        else if constexpr (!std::is_reference_v<ReturnType> && sizeof( ReturnType ) > sizeof( uint64_t ))
+            return rt_struct;
+        else
+            return rt_int32;
+    }
+
     void BindToThread(ThreadPtr thread) { _boundThread = thread; }
 
     bool valid() const { return _ptr != 0; }
@@ -1,5 +1,6 @@
 #include "RemoteHook.h"
 #include "../Process.h"
+#include "../../Misc/Trace.hpp"
 
 #include <algorithm>
 
@@ -13,6 +14,8 @@ namespace blackbone
 RemoteHook::RemoteHook( class ProcessMemory& memory )
     : _memory( memory )
     , _core( _memory.core() )
+    , _stackWindow( ContextSnapshot::DefaultStackWindow )
+    , _snapshot( memory )
 {  
 }
 
@@ -130,11 +133,10 @@ NTSTATUS RemoteHook::ApplyP( eHookType type, uint64_t ptr, fnCallback newFn, con
     // Write int3
     else
     {
-        DWORD flOld = 0;
-        _memory.Protect( ptr, sizeof( uint8_t ), PAGE_EXECUTE_READWRITE, &flOld );
-        status = _memory.Write<uint8_t>( ptr, 0xCC );
-        _memory.Protect( ptr, sizeof( uint8_t ), flOld, nullptr );
+        auto patch = _memory.BeginPatch();
+        patch.Write( ptr, uint8_t( 0xCC ) );
 
+        status = patch.Commit();
         if (!NT_SUCCESS( status ))
             return status;
     }
@@ -212,10 +214,9 @@ void RemoteHook::Restore( const HookData &hook, uint64_t ptr )
     // Restore original byte
     else
     {
-        DWORD flOld = 0;
-        _memory.Protect( ptr, sizeof( uint8_t ), PAGE_EXECUTE_READWRITE, &flOld );
-        _memory.Write( ptr, hook.oldByte );
-        _memory.Protect( ptr, sizeof( uint8_t ), flOld, nullptr );
+        auto patch = _memory.BeginPatch();
+        patch.Write( ptr, hook.oldByte );
+        patch.Commit();
     }
 }
 
@@ -289,6 +290,13 @@ DWORD RemoteHook::EventThread()
                 break;
         }
 
+        // Apply RemoteContext writes before thread is resumed
+        NTSTATUS flushStatus = _snapshot.Flush();
+        if (!NT_SUCCESS( flushStatus ))
+            BLACKBONE_TRACE( L"RemoteHook: Failed to apply context writes of thread %d, status 0x%X", DebugEv.dwThreadId, flushStatus );
+
+        _snapshot.reset();
+
         ContinueDebugEvent( DebugEv.dwProcessId, DebugEv.dwThreadId, status );
         _lock.unlock();
     }
@@ -359,11 +367,14 @@ DWORD RemoteHook::OnBreakpoint( const DEBUG_EVENT& DebugEv )
             sp = ctx64.Rsp;
         }
         
+        // Prefetch stack and TEB for callback, at stack pointer RemoteContext uses
+        _snapshot.Capture( thd, ctx64.Rsp, _stackWindow, _x64Target != FALSE );
+
         // Get stack frame pointer
         std::vector<std::pair<ptr_t, ptr_t>> results;
         StackBacktrace( ip, sp, thd, results, 1 );
 
-        RemoteContext context( _memory, thd, ctx64, !results.empty() ? results.back().first : 0, _x64Target, _wordSize );
+        RemoteContext context( _memory, thd, ctx64, !results.empty() ? results.back().first : 0, _x64Target, _wordSize, &_snapshot );
 
         // Execute user callback
         auto& hook = _hooks[addr];
@@ -382,10 +393,9 @@ DWORD RemoteHook::OnBreakpoint( const DEBUG_EVENT& DebugEv )
         }
 
         // Resume execution
-        DWORD flOld = 0;
-        _memory.Protect( addr, sizeof( hook.oldByte ), PAGE_EXECUTE_READWRITE, &flOld );
-        _memory.Write( addr, hook.oldByte );
-        _memory.Protect( addr, sizeof( hook.oldByte ), flOld, nullptr );
+        auto patch = _memory.BeginPatch();
+        patch.Write( addr, hook.oldByte );
+        patch.Commit();
 
         _repatch[addr] = true;
         
@@ -444,11 +454,14 @@ DWORD RemoteHook::OnSinglestep( const DEBUG_EVENT& DebugEv )
 
     if (index < 4)
     {
+        // Prefetch stack and TEB for callback, at stack pointer RemoteContext uses
+        _snapshot.Capture( thd, ctx64.Rsp, _stackWindow, _x64Target != FALSE );
+
         // Get stack frame pointer
         std::vector<std::pair<ptr_t, ptr_t>> results;
         StackBacktrace( ip, sp, thd, results, 1 );
 
-        RemoteContext context( _memory, thd, ctx64, !results.empty() ? results.back().first : 0, _x64Target, _wordSize );
+        RemoteContext context( _memory, thd, ctx64, !results.empty() ? results.back().first : 0, _x64Target, _wordSize, &_snapshot );
 
         // Execute user callback
         if(_hooks.count( addr ))
@@ -494,7 +507,8 @@ DWORD RemoteHook::OnSinglestep( const DEBUG_EVENT& DebugEv )
     }
 
     // Restore pending hooks
-    for(auto place : _repatch)
+    auto patch = _memory.BeginPatch();
+    for(auto& place : _repatch)
     {
         if (place.second == true && _hooks.count( place.first ))
         {
@@ -506,16 +520,15 @@ DWORD RemoteHook::OnSinglestep( const DEBUG_EVENT& DebugEv )
             }
             else if (hook.type == int3)
             {
-                DWORD flOld = 0;
-                _memory.Protect( addr, sizeof( hook.oldByte ), PAGE_EXECUTE_READWRITE, &flOld );
-                _memory.Write( place.first, uint8_t( 0xCC ) );
-                _memory.Protect( addr, sizeof( hook.oldByte ), flOld, nullptr );
+                patch.Write( place.first, uint8_t( 0xCC ) );
             }
 
             place.second = false;
         }
     }
 
+    patch.Commit();
+
     return DBG_CONTINUE;
 }
 
@@ -547,11 +560,14 @@ DWORD RemoteHook::OnAccessViolation( const DEBUG_EVENT& DebugEv )
         sp = ctx32.Esp;
     }
 
+    // Prefetch stack and TEB for callback, at stack pointer RemoteContext uses
+    _snapshot.Capture( thd, ctx64.Rsp, _stackWindow, _x64Target != FALSE );
+
     // Get stack frame pointer
     std::vector<std::pair<ptr_t, ptr_t>> results;
     StackBacktrace( ip, sp, thd, results, 1 );
 
-    RemoteContext context( _memory, thd, ctx64, !results.empty() ? results.back().first : 0, _x64Target, _wordSize );
+    RemoteContext context( _memory, thd, ctx64, !results.empty() ? results.back().first : 0, _x64Target, _wordSize, &_snapshot );
 
     // Under AMD64 exception is thrown before 'ret' gets executed
     // Return must be detected manually
@@ -566,7 +582,7 @@ DWORD RemoteHook::OnAccessViolation( const DEBUG_EVENT& DebugEv )
 
         if (hook.flags & returnHook)
         {
-            RemoteContext fixedContext( _memory, thd, hook.entryCtx, !results.empty() ? results.back().first : 0, _x64Target, _wordSize );
+            RemoteContext fixedContext( _memory, thd, hook.entryCtx, !results.empty() ? results.back().first : 0, _x64Target, _wordSize, &_snapshot );
 
             if (hook.onReturn.classFn.classPtr && hook.onReturn.classFn.ptr != nullptr)
                 hook.onReturn.classFn.ptr( hook.onExecute.classFn.classPtr, fixedContext );
@@ -617,24 +633,27 @@ DWORD RemoteHook::OnAccessViolation( const DEBUG_EVENT& DebugEv )
 DWORD RemoteHook::StackBacktrace( ptr_t ip, ptr_t sp, Thread& thd, std::vector<std::pair<ptr_t, ptr_t>>& results, int depth /*= 100 */ )
 {
     int i = 0;
-    uint64_t stack_base = 0;
+    uint64_t stack_base = _snapshot.stackBase();
 
-    // Get stack base
-    if(_core.isWow64())
+    // Get stack base, unless prefetched
+    if (stack_base == 0)
     {
-        _TEB32 teb32 = { { 0 } };
-        if (thd.teb( &teb32 ) == 0)
-            return 0;
+        if (_core.isWow64())
+        {
+            _TEB32 teb32 = { { 0 } };
+            if (thd.teb( &teb32 ) == 0)
+                return 0;
 
-        stack_base = teb32.NtTib.StackBase;
-    }
-    else
-    {
-        _TEB64 teb64 = { { 0 } };
-        if (thd.teb( &teb64 ) == 0)
-            return 0;
+            stack_base = teb32.NtTib.StackBase;
+        }
+        else
+        {
+            _TEB64 teb64 = { { 0 } };
+            if (thd.teb( &teb64 ) == 0)
+                return 0;
 
-        stack_base = teb64.NtTib.StackBase;
+            stack_base = teb64.NtTib.StackBase;
+        }
     }
 
     // Store exception address
@@ -644,7 +663,7 @@ DWORD RemoteHook::StackBacktrace( ptr_t ip, ptr_t sp, Thread& thd, std::vector<s
     for (ptr_t stackPtr = sp; stackPtr < stack_base && i < depth; stackPtr += _wordSize)
     {
         ptr_t stack_val = 0;
-        _memory.Read( stackPtr, _wordSize, &stack_val );
+        _snapshot.Read( stackPtr, _wordSize, &stack_val );
         MEMORY_BASIC_INFORMATION64 meminfo = { 0 };
 
         ptr_t original = stack_val & 0x7FFFFFFFFFFFFFFF;
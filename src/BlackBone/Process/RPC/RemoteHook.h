@@ -141,6 +141,14 @@ public:
     /// </summary>
     BLACKBONE_API void reset();
 
+    /// <summary>
+    /// Set size of stack window prefetched on hook hit.
+    /// Stack arguments and return address inside the window are accessed without remote reads
+    /// </summary>
+    /// <param name="size">Window size in bytes, 0 - prefetch TEB fields only</param>
+    BLACKBONE_API void stackWindow( size_t size ) { _stackWindow = size; }
+    BLACKBONE_API size_t stackWindow() const { return _stackWindow; }
+
 private:
 
     /// <summary>
@@ -251,6 +259,8 @@ private:
     mapHook      _hooks;                // Hooked callbacks
     setAddresses _repatch;              // Pending repatch addresses
     mapAddress   _retHooks;             // Hooked return addresses
+    size_t       _stackWindow;          // Prefetched stack window size
+    ContextSnapshot _snapshot;          // Stack and TEB of current debug event
 };
 
 ENUM_OPS( RemoteHook::eHookFlags )
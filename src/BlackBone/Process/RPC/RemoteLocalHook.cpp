@@ -132,10 +132,9 @@ NTSTATUS RemoteLocalHook::SetHook( ptr_t address, asmjit::Assembler& hook )
 
 	delete[] heapHookCode;
 
-	DWORD flOld = 0;
-	mem.Protect( address, _ctx.hookJumpCodeSize, PAGE_EXECUTE_READWRITE, &flOld );
-	status = mem.Write( address, _ctx.hookJumpCodeSize, _ctx.hookJumpCode );
-	mem.Protect( address, _ctx.hookJumpCodeSize, flOld );
+	auto patch = mem.BeginPatch();
+	patch.Write( address, _ctx.hookJumpCodeSize, _ctx.hookJumpCode );
+	status = patch.Commit();
 
 	if (NT_SUCCESS( status ))
 		_hooked = true;
@@ -148,10 +147,9 @@ NTSTATUS RemoteLocalHook::Restore()
     NTSTATUS status = STATUS_SUCCESS;
 
 	if (_hooked) {
-		DWORD flOld = 0;
-		_process.memory().Protect( _ctx.address, _ctx.hookJumpCodeSize, PAGE_EXECUTE_READWRITE, &flOld );
-		status = _process.memory().Write( _ctx.address, _ctx.origCodeSize, _ctx.origCode );
-		_process.memory().Protect( _ctx.address, _ctx.hookJumpCodeSize, flOld );
+		auto patch = _process.memory().BeginPatch();
+		patch.Write( _ctx.address, _ctx.origCodeSize, _ctx.origCode );
+		status = patch.Commit();
 
 		if (!NT_SUCCESS( status )) {
 			return status;
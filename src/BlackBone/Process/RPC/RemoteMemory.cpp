@@ -2,6 +2,8 @@
 #include "../Process.h"
 #include "../../Misc/Trace.hpp"
 
+#include <algorithm>
+
 namespace blackbone
 {
 
@@ -34,7 +36,9 @@ NTSTATUS RemoteMemory::Map( bool mapSections )
 
     if (NT_SUCCESS( status ))
     {
+        CSLock lck( _mapGuard );
         std::swap( _mapDatabase, result.regions );
+        _lastHit = MappedRegion();
 
         _pSharedData = (PageContext*)result.hostSharedPage;
         _targetShare = result.targetSharedPage;
@@ -64,10 +68,32 @@ NTSTATUS RemoteMemory::Map( ptr_t base, uint32_t size )
     // Update regions
     if (NT_SUCCESS( status ))
     {
-        MapMemoryResult rgnRes = { };
+        // Driver reports only first region it has mapped
+        if (memRes.newPtr != 0 && memRes.originalPtr <= base && base < memRes.originalPtr + memRes.size)
+        {
+            CSLock lck( _mapGuard );
+
+            if (memRes.removedPtr != 0)
+            {
+                auto iter = FindRegion( memRes.removedPtr );
+                if (iter != _mapDatabase.end())
+                    _mapDatabase.erase( iter );
+            }
 
-        if (NT_SUCCESS( Driver().MapMemory( _process->pid(), _pipeName, false, rgnRes ) ))
-            std::swap( _mapDatabase, rgnRes.regions );
+            _mapDatabase[std::make_pair( memRes.originalPtr, memRes.size )] = memRes.newPtr;
+            _lastHit = MappedRegion();
+        }
+        else
+        {
+            MapMemoryResult rgnRes = { };
+
+            if (NT_SUCCESS( Driver().MapMemory( _process->pid(), _pipeName, false, rgnRes ) ))
+            {
+                CSLock lck( _mapGuard );
+                std::swap( _mapDatabase, rgnRes.regions );
+                _lastHit = MappedRegion();
+            }
+        }
     }
 
     return status;
@@ -83,7 +109,9 @@ NTSTATUS RemoteMemory::Unmap( )
 
     if (NT_SUCCESS( status ))
     {
+        CSLock lck( _mapGuard );
         _mapDatabase.clear();
+        _lastHit = MappedRegion();
 
         _pSharedData = nullptr;
         _targetShare = 0;
@@ -101,19 +129,18 @@ NTSTATUS RemoteMemory::Unmap( )
 /// <returns>Status code</returns>
 NTSTATUS RemoteMemory::Unmap( ptr_t base, uint32_t size )
 {
-    auto searchFn = [&base]( const decltype(_mapDatabase)::value_type& val )
-    {
-        return base >= val.first.first && base < val.first.first + val.first.second;
-    };
-
     NTSTATUS status = Driver().UnmapMemoryRegion( _process->pid(), base, size );
 
     if (NT_SUCCESS( status ))
     {
+        CSLock lck( _mapGuard );
+
         // Remove region
-        auto iter = std::find_if( _mapDatabase.begin(), _mapDatabase.end(), searchFn );
+        auto iter = FindRegion( base );
         if (iter != _mapDatabase.end())
             _mapDatabase.erase( iter );
+
+        _lastHit = MappedRegion();
     }
 
     return status;
@@ -128,22 +155,121 @@ NTSTATUS RemoteMemory::Unmap( ptr_t base, uint32_t size )
 /// <returns>Translated address</returns>
 blackbone::ptr_t RemoteMemory::TranslateAddress( ptr_t address, bool resolveFault /*= true */ )
 {
-    auto searchFn = [&address]( const decltype(_mapDatabase)::value_type& val )
+    MappedRegion region;
+    if (LookupRegion( address, resolveFault, region ))
+        return region.mapped + (address - region.base);
+
+    return 0;
+}
+
+/// <summary>
+/// Translate multiple target addresses accordingly to current address space
+/// </summary>
+/// <param name="addresses">Addresses to translate</param>
+/// <param name="resolveFault">If set to true, routine will try to map non-existing regions upon translation failure</param>
+/// <returns>Translated addresses, 0 for addresses that failed translation</returns>
+std::vector<ptr_t> RemoteMemory::TranslateAddress( const std::vector<ptr_t>& addresses, bool resolveFault /*= true*/ )
+{
+    std::vector<ptr_t> results( addresses.size() );
+    std::vector<size_t> order( addresses.size() );
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    // Sorted order lets neighbouring addresses hit the same region
+    std::sort( order.begin(), order.end(), [&addresses]( size_t l, size_t r ) { return addresses[l] < addresses[r]; } );
+
+    MappedRegion region;
+    bool found = false;
+
+    for (auto idx : order)
     {
-        return address >= val.first.first && address < val.first.first + val.first.second;
-    };
+        ptr_t address = addresses[idx];
+        if (!found || address < region.base || address >= region.base + region.size)
+            found = LookupRegion( address, resolveFault, region );
 
-    auto iter = std::find_if( _mapDatabase.begin(), _mapDatabase.end(), searchFn );
-                              
-    // Primitive Page fault. Try to resolve missing page
-    if (iter == _mapDatabase.end() && resolveFault && NT_SUCCESS( Map( address, 1 ) ))
-        // Second chance
-        iter = std::find_if( _mapDatabase.begin(), _mapDatabase.end(), searchFn );           
+        if (found)
+            results[idx] = region.mapped + (address - region.base);
+    }
 
-    if (iter != _mapDatabase.end())
-        return iter->second + (address - iter->first.first);    
+    return results;
+}
 
-    return 0;
+/// <summary>
+/// Translate target address range accordingly to current address space
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size</param>
+/// <param name="resolveFault">If set to true, routine will try to map non-existing region upon translation failure</param>
+/// <returns>Translated address, 0 if range isn't entirely inside one mapped region</returns>
+blackbone::ptr_t RemoteMemory::TranslateRange( ptr_t address, size_t size, bool resolveFault /*= true*/ )
+{
+    MappedRegion region;
+    if (!LookupRegion( address, resolveFault, region ))
+        return 0;
+
+    if (address + size > region.base + region.size)
+        return 0;
+
+    return region.mapped + (address - region.base);
+}
+
+/// <summary>
+/// Find mapped region containing address
+/// </summary>
+/// <param name="address">Target address</param>
+/// <returns>Region iterator, _mapDatabase.end() if not found</returns>
+mapMemoryMap::const_iterator RemoteMemory::FindRegion( ptr_t address )
+{
+    // Regions are ordered by base address
+    auto iter = _mapDatabase.upper_bound( std::make_pair( address, UINT32_MAX ) );
+    if (iter == _mapDatabase.begin())
+        return _mapDatabase.end();
+
+    --iter;
+    if (address < iter->first.first + iter->first.second)
+        return iter;
+
+    return _mapDatabase.end();
+}
+
+/// <summary>
+/// Find mapped region containing address, mapping it on demand
+/// </summary>
+/// <param name="address">Target address</param>
+/// <param name="resolveFault">If set to true, routine will try to map non-existing region</param>
+/// <param name="region">Found region</param>
+/// <returns>true if found</returns>
+bool RemoteMemory::LookupRegion( ptr_t address, bool resolveFault, MappedRegion& region )
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        {
+            CSLock lck( _mapGuard );
+
+            if (_lastHit.mapped != 0 && address >= _lastHit.base && address < _lastHit.base + _lastHit.size)
+            {
+                region = _lastHit;
+                return true;
+            }
+
+            auto iter = FindRegion( address );
+            if (iter != _mapDatabase.end())
+            {
+                _lastHit.base = iter->first.first;
+                _lastHit.size = iter->first.second;
+                _lastHit.mapped = iter->second;
+
+                region = _lastHit;
+                return true;
+            }
+        }
+
+        // Primitive Page fault. Try to resolve missing page
+        if (attempt != 0 || !resolveFault || !NT_SUCCESS( Map( address, 1 ) ))
+            break;
+    }
+
+    return false;
 }
 
 /// <summary>
@@ -262,7 +388,9 @@ void RemoteMemory::reset()
 
     if (!_mapDatabase.empty() && !NT_SUCCESS( Unmap() ))
     {
+        CSLock lck( _mapGuard );
         _mapDatabase.clear();
+        _lastHit = MappedRegion();
 
         _pSharedData = nullptr;
         _targetShare = 0;
@@ -2,13 +2,47 @@
 
 #include "../../Config.h"
 #include "../../DriverControl/DriverControl.h"
+#include "../../Include/CallResult.h"
+#include "../../Misc/Utils.h"
 
 #include <string>
 #include <map>
+#include <vector>
+#include <cassert>
 
 namespace blackbone
 {
 
+/// <summary>
+/// Typed view of target memory mapped into current process
+/// </summary>
+template<typename T>
+class MappedView
+{
+public:
+    MappedView() = default;
+
+    MappedView( T* data, size_t count )
+        : _data( data )
+        , _count( count ) { }
+
+    inline T* data() const { return _data; }
+    inline size_t size() const { return _count; }
+    inline bool empty() const { return _count == 0; }
+
+    inline T* begin() const { return _data; }
+    inline T* end() const { return _data + _count; }
+
+    inline T& operator []( size_t idx ) const
+    {
+        assert( idx < _count );
+        return _data[idx];
+    }
+
+private:
+    T* _data = nullptr;     // First element
+    size_t _count = 0;      // Element count
+};
 
 class RemoteMemory
 {
@@ -94,6 +128,44 @@ public:
     /// <returns>Translated address</returns>
     BLACKBONE_API ptr_t TranslateAddress( ptr_t address, bool resolveFault = true );
 
+    /// <summary>
+    /// Translate multiple target addresses accordingly to current address space
+    /// </summary>
+    /// <param name="addresses">Addresses to translate</param>
+    /// <param name="resolveFault">If set to true, routine will try to map non-existing regions upon translation failure</param>
+    /// <returns>Translated addresses, 0 for addresses that failed translation</returns>
+    BLACKBONE_API std::vector<ptr_t> TranslateAddress( const std::vector<ptr_t>& addresses, bool resolveFault = true );
+
+    /// <summary>
+    /// Translate target address range accordingly to current address space
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size</param>
+    /// <param name="resolveFault">If set to true, routine will try to map non-existing region upon translation failure</param>
+    /// <returns>Translated address, 0 if range isn't entirely inside one mapped region</returns>
+    BLACKBONE_API ptr_t TranslateRange( ptr_t address, size_t size, bool resolveFault = true );
+
+    /// <summary>
+    /// Get typed view of mapped target memory
+    /// View is valid until region is unmapped
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <param name="count">Element count</param>
+    /// <param name="resolveFault">If set to true, routine will try to map non-existing region upon translation failure</param>
+    /// <returns>Memory view</returns>
+    template<typename T>
+    call_result_t<MappedView<T>> View( ptr_t address, size_t count = 1, bool resolveFault = true )
+    {
+        if (count == 0 || count > SIZE_MAX / sizeof( T ))
+            return STATUS_INVALID_PARAMETER;
+
+        auto local = TranslateRange( address, count * sizeof( T ), resolveFault );
+        if (local == 0)
+            return STATUS_INVALID_ADDRESS;
+
+        return MappedView<T>( reinterpret_cast<T*>(local), count );
+    }
+
     /// <summary>
     /// Setup one of the 4 possible memory hooks:
     /// </summary>
@@ -119,6 +191,17 @@ public:
     /// </summary>
     BLACKBONE_API void reset();
 
+private:
+    /// <summary>
+    /// Target region mapped into current process
+    /// </summary>
+    struct MappedRegion
+    {
+        ptr_t base = 0;
+        uint32_t size = 0;
+        ptr_t mapped = 0;
+    };
+
 private:
     /// <summary>
     /// Hook thread wrapper
@@ -146,9 +229,27 @@ private:
     /// <param name="pOriginalLocal">Original function address in local address space</param>
     void BuildTrampoline( OperationType opType, uintptr_t pOriginal, uint8_t* pOriginalLocal );
 
+    /// <summary>
+    /// Find mapped region containing address
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <returns>Region iterator, _mapDatabase.end() if not found</returns>
+    mapMemoryMap::const_iterator FindRegion( ptr_t address );
+
+    /// <summary>
+    /// Find mapped region containing address, mapping it on demand
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <param name="resolveFault">If set to true, routine will try to map non-existing region</param>
+    /// <param name="region">Found region</param>
+    /// <returns>true if found</returns>
+    bool LookupRegion( ptr_t address, bool resolveFault, MappedRegion& region );
+
 private:
     class Process* _process = nullptr;      // Target process
     mapMemoryMap _mapDatabase;              // Region map
+    MappedRegion _lastHit;                  // Last translated region
+    CriticalSection _mapGuard;              // Region map guard
     std::wstring _pipeName;                 // Pipe name used to gather hook data
     Handle _hPipe;                          // Hook pipe handle
     HANDLE _targetPipe = NULL;              // Hook pipe handle in target process
@@ -0,0 +1,347 @@
+#include "RemoteWorkerPool.h"
+#include "RemoteExec.h"
+#include "../Process.h"
+
+namespace blackbone
+{
+
+// Cancellation token polling interval, ms
+constexpr uint32_t CancelPollInterval = 10;
+
+RemoteWorkerPool::RemoteWorkerPool( Process& proc, RemoteExec& remote )
+    : _process( proc )
+    , _remote( remote )
+    , _host( 1 )
+{
+}
+
+RemoteWorkerPool::~RemoteWorkerPool()
+{
+    Stop();
+}
+
+/// <summary>
+/// Start remote workers. Does nothing if pool is already running
+/// </summary>
+/// <param name="workers">Number of workers, 0 - DefaultWorkers</param>
+/// <returns>Status code</returns>
+NTSTATUS RemoteWorkerPool::Start( size_t workers /*= 0*/ )
+{
+    CSLock lck( _lock );
+
+    if (!_workers.empty())
+        return STATUS_SUCCESS;
+
+    if (workers == 0)
+        workers = DefaultWorkers;
+
+    for (size_t i = 0; i < workers; i++)
+    {
+        auto& worker = _workers.emplace_back( std::make_unique<Worker>( _process, _process.memory() ) );
+
+        auto mem = _process.memory().Allocate( 0x1000, PAGE_READWRITE );
+        if (!mem)
+        {
+            Stop();
+            return mem.status;
+        }
+
+        worker->data = std::move( mem.result() );
+
+        // Call stub signals event upon return, so it must be valid
+        Handle hEvent( CreateEventW( nullptr, FALSE, FALSE, nullptr ) );
+        HANDLE hRemote = nullptr;
+        if (!hEvent || !DuplicateHandle( GetCurrentProcess(), hEvent, _process.core().handle(), &hRemote, 0, FALSE, DUPLICATE_SAME_ACCESS ))
+        {
+            NTSTATUS status = LastNtStatus();
+            Stop();
+            return status;
+        }
+
+        worker->event = reinterpret_cast<uintptr_t>(hRemote);
+        worker->data.Write( EVENT_OFFSET, worker->event );
+
+        NTSTATUS status = worker->ring.Start();
+        if (!NT_SUCCESS( status ))
+        {
+            Stop();
+            return status;
+        }
+    }
+
+    // One local waiter per remote worker
+    _host.Resize( workers );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Cancel pending calls, wait for local waiters and stop all workers
+/// </summary>
+void RemoteWorkerPool::Stop()
+{
+    // No new calls after this point
+    {
+        CSLock lck( _lock );
+        _stopping = true;
+    }
+
+    // Waiters check stop flag, so calls with infinite timeout return too.
+    // Lock isn't held, calls being finished don't need it
+    _host.Wait();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    {
+        CSLock lck( _lock );
+        workers.swap( _workers );
+        _stopping = false;
+    }
+
+    for (auto& worker : workers)
+    {
+        worker->ring.Stop();
+
+        // Close remote event handle
+        if (worker->event)
+        {
+            HANDLE hLocal = nullptr;
+            DuplicateHandle(
+                _process.core().handle(),
+                reinterpret_cast<HANDLE>(worker->event),
+                GetCurrentProcess(),
+                &hLocal,
+                0, FALSE,
+                DUPLICATE_CLOSE_SOURCE | DUPLICATE_SAME_ACCESS
+            );
+
+            if (hLocal)
+                CloseHandle( hLocal );
+        }
+    }
+}
+
+/// <summary>
+/// Check if workers are running
+/// </summary>
+/// <returns>true if running</returns>
+bool RemoteWorkerPool::active()
+{
+    CSLock lck( _lock );
+    return !_workers.empty();
+}
+
+/// <summary>
+/// Get number of workers
+/// </summary>
+/// <returns>Number of workers</returns>
+size_t RemoteWorkerPool::size()
+{
+    CSLock lck( _lock );
+    return _workers.size();
+}
+
+/// <summary>
+/// Get summary counters
+/// </summary>
+/// <returns>Counters</returns>
+RemoteWorkerStats RemoteWorkerPool::stats()
+{
+    CSLock lck( _lock );
+    RemoteWorkerStats total;
+
+    for (auto& worker : _workers)
+    {
+        CSLock wlck( worker->lock );
+        total.calls += worker->stats.calls;
+        total.timeouts += worker->stats.timeouts;
+        total.cancelled += worker->stats.cancelled;
+    }
+
+    return total;
+}
+
+/// <summary>
+/// Get worker thread
+/// </summary>
+/// <param name="idx">Worker index</param>
+/// <returns>Worker thread, nullptr if not found</returns>
+ThreadPtr RemoteWorkerPool::thread( size_t idx )
+{
+    CSLock lck( _lock );
+    if (idx >= _workers.size())
+        return nullptr;
+
+    return _workers[idx]->ring.thread();
+}
+
+/// <summary>
+/// Pick least loaded worker and account new call. Must be called under pool lock
+/// </summary>
+/// <returns>Worker</returns>
+call_result_t<RemoteWorkerPool::Worker*> RemoteWorkerPool::Acquire()
+{
+    CSLock lck( _lock );
+
+    if (_stopping)
+        return STATUS_CANCELLED;
+
+    if (_workers.empty())
+        return STATUS_NOT_FOUND;
+
+    Worker* best = nullptr;
+    for (auto& worker : _workers)
+    {
+        if (!best || worker->load < best->load)
+            best = worker.get();
+    }
+
+    best->load++;
+    return best;
+}
+
+/// <summary>
+/// Execute call on worker
+/// </summary>
+/// <param name="worker">Target worker</param>
+/// <param name="pfn">Remote function pointer</param>
+/// <param name="args">Function arguments</param>
+/// <param name="cc">Calling convention</param>
+/// <param name="retType">Return type</param>
+/// <param name="result">Return value buffer</param>
+/// <param name="resultSize">Return value size</param>
+/// <param name="deadline">Tick count deadline, 0 - no deadline</param>
+/// <param name="cancel">Cancellation token</param>
+/// <returns>Status code</returns>
+NTSTATUS RemoteWorkerPool::Execute(
+    Worker& worker,
+    ptr_t pfn,
+    std::vector<AsmVariant>& args,
+    eCalligConvention cc,
+    eReturnType retType,
+    void* result,
+    size_t resultSize,
+    uint64_t deadline,
+    const CancelToken& cancel
+    )
+{
+    CSLock lck( worker.lock );
+
+    // Queued call is accounted until it's finished
+    auto release = [&worker]( NTSTATUS status )
+    {
+        worker.load--;
+        return status;
+    };
+
+    NTSTATUS status = STATUS_SUCCESS;
+
+    // Buffers are still used by abandoned call
+    if (worker.abandoned)
+    {
+        if (!NT_SUCCESS( status = WaitCommand( worker, deadline, cancel ) ))
+            return release( status );
+
+        // Abandoned call has returned, drop its load
+        worker.abandoned = false;
+        worker.load--;
+    }
+
+    if (cancel.cancelled() || _stopping)
+        return release( STATUS_CANCELLED );
+
+    // Arguments were copied, so are structure pointers
+    for (auto& arg : args)
+    {
+        if (!arg.buf.empty())
+            arg.imm_val64 = reinterpret_cast<uint64_t>(arg.buf.data());
+    }
+
+    bool x86 = _process.core().isWow64();
+    if (!NT_SUCCESS( status = _remote.PrepareCallArguments( args, x86, retType, worker.args, worker.data.ptr() ) ))
+        return release( status );
+
+    auto a = AsmFactory::GetAssembler( x86 );
+    if (!NT_SUCCESS( status = _remote.AssembleCall( *a, pfn, args, cc, retType, worker.data.ptr() ) ))
+        return release( status );
+
+    // Copy stub, reallocate for larger code
+    size_t size = (*a)->getCodeSize();
+    if (!worker.code.valid())
+    {
+        auto mem = _process.memory().Allocate( max( size, size_t( 0x1000 ) ) );
+        if (!mem)
+            return release( mem.status );
+
+        worker.code = std::move( mem.result() );
+    }
+    else if (size > worker.code.size())
+    {
+        auto res = worker.code.Realloc( size );
+        if (!res)
+            return release( res.status );
+    }
+
+    if (!NT_SUCCESS( status = worker.code.Write( 0, size, (*a)->make() ) ))
+        return release( status );
+
+    auto seq = worker.ring.Submit( worker.code.ptr(), worker.data.ptr() );
+    if (!seq)
+        return release( seq.status );
+
+    worker.seq = seq.result();
+    if (!NT_SUCCESS( status = WaitCommand( worker, deadline, cancel ) ))
+    {
+        // Abandoned call is still running, so it stays in worker load
+        if (status == STATUS_TIMEOUT || status == STATUS_CANCELLED)
+        {
+            worker.abandoned = true;
+            worker.load++;
+            if (status == STATUS_TIMEOUT)
+                worker.stats.timeouts++;
+            else
+                worker.stats.cancelled++;
+        }
+
+        return release( status );
+    }
+
+    // Same layout as RemoteExec::GetCallResult
+    uint32_t offset = resultSize > sizeof( uint64_t ) ? ARGS_OFFSET : RET_OFFSET;
+    if (!NT_SUCCESS( status = worker.data.Read( offset, resultSize, result ) ))
+        return release( status );
+
+    worker.stats.calls++;
+    return release( worker.args.Unmarshal( args ) );
+}
+
+/// <summary>
+/// Wait for worker command, polling cancellation token and pool stop flag
+/// </summary>
+/// <param name="worker">Target worker</param>
+/// <param name="deadline">Tick count deadline, 0 - no deadline</param>
+/// <param name="cancel">Cancellation token</param>
+/// <returns>Status code</returns>
+NTSTATUS RemoteWorkerPool::WaitCommand( Worker& worker, uint64_t deadline, const CancelToken& cancel )
+{
+    for (;;)
+    {
+        uint32_t wait = CancelPollInterval;
+        if (deadline != 0)
+        {
+            auto now = GetTickCount64();
+            if (now >= deadline)
+                return STATUS_TIMEOUT;
+
+            wait = static_cast<uint32_t>(min( deadline - now, uint64_t( CancelPollInterval ) ));
+        }
+
+        uint64_t ringResult = 0;
+        NTSTATUS status = worker.ring.Wait( worker.seq, ringResult, wait );
+        if (status != STATUS_TIMEOUT)
+            return status;
+
+        if (cancel.cancelled() || _stopping)
+            return STATUS_CANCELLED;
+    }
+}
+
+}
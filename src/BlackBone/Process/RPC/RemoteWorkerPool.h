@@ -0,0 +1,221 @@
+#pragma once
+
+#include "../../Include/Winheaders.h"
+#include "../../Include/CallResult.h"
+#include "../../Asm/AsmVariant.hpp"
+#include "../../Misc/ThreadPool.h"
+#include "../../Include/HandleGuard.h"
+#include "../../Misc/Utils.h"
+#include "../MemBlock.h"
+#include "CommandRing.h"
+#include "ArgumentArena.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Cancellation flag shared between caller and pending remote call
+/// </summary>
+class CancelToken
+{
+public:
+    CancelToken()
+        : _flag( std::make_shared<std::atomic<bool>>( false ) ) { }
+
+    void cancel() { *_flag = true; }
+    bool cancelled() const { return *_flag; }
+
+private:
+    std::shared_ptr<std::atomic<bool>> _flag;
+};
+
+/// <summary>
+/// Remote worker pool counters
+/// </summary>
+struct RemoteWorkerStats
+{
+    uint64_t calls = 0;         // Finished calls
+    uint64_t timeouts = 0;      // Calls abandoned after timeout
+    uint64_t cancelled = 0;     // Calls abandoned after cancel request
+};
+
+/// <summary>
+/// Pool of remote worker threads for concurrent remote calls.
+///
+/// Every worker is a command ring thread with its own code, user data and argument blocks,
+/// so calls dispatched to different workers run in parallel. Each call goes to the least loaded worker;
+/// calls dispatched to the same worker are executed in order.
+///
+/// Timeout and cancellation are per call. Remote code can't be interrupted safely, so abandoned call
+/// keeps running in the target and its worker accepts next call only after abandoned one returns.
+/// Abandoned call stays in worker load until then, so new calls are routed to other workers first.
+/// Stop cancels calls that are still pending, so they finish with STATUS_CANCELLED.
+/// </summary>
+class RemoteWorkerPool
+{
+public:
+    static constexpr size_t DefaultWorkers = 4;
+
+    BLACKBONE_API RemoteWorkerPool( class Process& proc, class RemoteExec& remote );
+    BLACKBONE_API ~RemoteWorkerPool();
+
+    /// <summary>
+    /// Start remote workers. Does nothing if pool is already running
+    /// </summary>
+    /// <param name="workers">Number of workers, 0 - DefaultWorkers</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Start( size_t workers = 0 );
+
+    /// <summary>
+    /// Cancel pending calls, wait for local waiters and stop all workers
+    /// </summary>
+    BLACKBONE_API void Stop();
+
+    /// <summary>
+    /// Queue remote call.
+    /// Memory referenced by pointer arguments must stay valid until call is finished
+    /// </summary>
+    /// <param name="pfn">Remote function pointer</param>
+    /// <param name="args">Function arguments</param>
+    /// <param name="cc">Calling convention</param>
+    /// <param name="retType">Return type</param>
+    /// <param name="timeout">Call timeout, ms</param>
+    /// <param name="cancel">Cancellation token</param>
+    /// <returns>Function return value</returns>
+    template<typename T>
+    std::future<call_result_t<T>> Call(
+        ptr_t pfn,
+        std::vector<AsmVariant> args,
+        eCalligConvention cc,
+        eReturnType retType,
+        uint32_t timeout = INFINITE,
+        CancelToken cancel = CancelToken()
+        )
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Return type must be trivially copyable");
+
+        // Stop must not miss call that acquired worker but isn't queued yet
+        CSLock lck( _lock );
+
+        auto worker = Acquire();
+        if (!worker)
+        {
+            std::promise<call_result_t<T>> failed;
+            failed.set_value( call_result_t<T>( T(), worker.status ) );
+            return failed.get_future();
+        }
+
+        // Time spent in queue counts towards timeout
+        uint64_t deadline = timeout != INFINITE ? GetTickCount64() + timeout : 0;
+
+        return _host.Submit( [this, w = worker.result(), pfn, args = std::move( args ), cc, retType, deadline, cancel]() mutable
+        {
+            T result = {};
+            NTSTATUS status = Execute( *w, pfn, args, cc, retType, &result, sizeof( result ), deadline, cancel );
+            return call_result_t<T>( result, status );
+        } );
+    }
+
+    /// <summary>
+    /// Check if workers are running
+    /// </summary>
+    /// <returns>true if running</returns>
+    BLACKBONE_API bool active();
+
+    /// <summary>
+    /// Get number of workers
+    /// </summary>
+    /// <returns>Number of workers</returns>
+    BLACKBONE_API size_t size();
+
+    /// <summary>
+    /// Get summary counters
+    /// </summary>
+    /// <returns>Counters</returns>
+    BLACKBONE_API RemoteWorkerStats stats();
+
+    /// <summary>
+    /// Get worker thread
+    /// </summary>
+    /// <param name="idx">Worker index</param>
+    /// <returns>Worker thread, nullptr if not found</returns>
+    BLACKBONE_API ThreadPtr thread( size_t idx );
+
+private:
+    struct Worker
+    {
+        Worker( class Process& proc, class ProcessMemory& memory )
+            : ring( proc )
+            , args( memory ) { }
+
+        CommandRing ring;                // Command ring and its thread
+        MemBlock code;                   // Call stub
+        MemBlock data;                   // Return values, see RemoteExec::CreateRPCEnvironment
+        ArgumentArena args;              // Copied structures and strings
+        std::atomic<uint32_t> load{ 0 }; // Queued and running calls, abandoned one included
+        uint64_t event = 0;              // Target handle of call completion event
+        uint32_t seq = 0;                // Last submitted command
+        bool abandoned = false;          // Last command wasn't waited for
+        RemoteWorkerStats stats;         // Counters
+        CriticalSection lock;            // Single call at a time
+    };
+
+    /// <summary>
+    /// Pick least loaded worker and account new call. Must be called under pool lock
+    /// </summary>
+    /// <returns>Worker</returns>
+    BLACKBONE_API call_result_t<Worker*> Acquire();
+
+    /// <summary>
+    /// Execute call on worker
+    /// </summary>
+    /// <param name="worker">Target worker</param>
+    /// <param name="pfn">Remote function pointer</param>
+    /// <param name="args">Function arguments</param>
+    /// <param name="cc">Calling convention</param>
+    /// <param name="retType">Return type</param>
+    /// <param name="result">Return value buffer</param>
+    /// <param name="resultSize">Return value size</param>
+    /// <param name="deadline">Tick count deadline, 0 - no deadline</param>
+    /// <param name="cancel">Cancellation token</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Execute(
+        Worker& worker,
+        ptr_t pfn,
+        std::vector<AsmVariant>& args,
+        eCalligConvention cc,
+        eReturnType retType,
+        void* result,
+        size_t resultSize,
+        uint64_t deadline,
+        const CancelToken& cancel
+    );
+
+    /// <summary>
+    /// Wait for worker command, polling cancellation token and pool stop flag
+    /// </summary>
+    /// <param name="worker">Target worker</param>
+    /// <param name="deadline">Tick count deadline, 0 - no deadline</param>
+    /// <param name="cancel">Cancellation token</param>
+    /// <returns>Status code</returns>
+    NTSTATUS WaitCommand( Worker& worker, uint64_t deadline, const CancelToken& cancel );
+
+    RemoteWorkerPool( const RemoteWorkerPool& ) = delete;
+    RemoteWorkerPool& operator =( const RemoteWorkerPool& ) = delete;
+
+private:
+    class Process& _process;
+    class RemoteExec& _remote;
+
+    std::vector<std::unique_ptr<Worker>> _workers;  // Remote workers
+    ThreadPool _host;                               // Local threads waiting for remote calls
+    std::atomic<bool> _stopping{ false };           // Stop requested, pending calls are cancelled
+    CriticalSection _lock;                          // Worker list lock
+};
+
+}
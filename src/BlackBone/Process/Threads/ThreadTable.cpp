@@ -0,0 +1,248 @@
+#include "ThreadTable.h"
+#include "../ProcessCore.h"
+#include "../../Include/Macro.h"
+#include "../../Misc/DynImport.h"
+
+namespace blackbone
+{
+
+// SystemExtendedProcessInformation, provides Win32 start address and TEB
+constexpr auto threadTableInfoClass = static_cast<SYSTEM_INFORMATION_CLASS>(57);
+
+ThreadTable::ThreadTable( ProcessCore& core )
+    : _core( core )
+{
+}
+
+/// <summary>
+/// Update table from new system snapshot
+/// </summary>
+/// <param name="pDelta">Optional changes since last refresh</param>
+/// <returns>Status code</returns>
+NTSTATUS ThreadTable::Refresh( ThreadTableDelta* pDelta /*= nullptr*/ )
+{
+    CSLock lck( _lock );
+
+    auto status = Query();
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    using info_t = _SYSTEM_PROCESS_INFORMATION_T<DWORD_PTR>;
+
+    const info_t* pInfo = nullptr;
+    for (auto pEntry = reinterpret_cast<const info_t*>(_buffer.data());;)
+    {
+        if (pEntry->UniqueProcessId == _core.pid())
+        {
+            pInfo = pEntry;
+            break;
+        }
+
+        if (pEntry->NextEntryOffset == 0)
+            break;
+
+        pEntry = reinterpret_cast<const info_t*>(reinterpret_cast<const uint8_t*>(pEntry) + pEntry->NextEntryOffset);
+    }
+
+    // Process is gone
+    if (pInfo == nullptr)
+    {
+        if (pDelta)
+            for (auto& entry : _entries)
+                pDelta->exited.emplace_back( entry.first );
+
+        _entries.clear();
+        _opened.clear();
+        return STATUS_NOT_FOUND;
+    }
+
+    std::map<DWORD, ThreadEntry> current;
+    for (ULONG i = 0; i < pInfo->NumberOfThreads; i++)
+    {
+        auto& thd = pInfo->Threads[i];
+        ThreadEntry entry;
+
+        entry.tid = static_cast<DWORD>(thd.ThreadInfo.ClientId.UniqueThread);
+        entry.createTime = thd.ThreadInfo.CreateTime.QuadPart;
+        entry.kernelTime = thd.ThreadInfo.KernelTime.QuadPart;
+        entry.userTime = thd.ThreadInfo.UserTime.QuadPart;
+        entry.startAddress = thd.Win32StartAddress;
+        entry.teb = thd.TebBase;
+        entry.state = thd.ThreadInfo.ThreadState;
+        entry.waitReason = thd.ThreadInfo.WaitReason;
+        entry.contextSwitches = thd.ThreadInfo.ContextSwitches;
+        entry.priority = thd.ThreadInfo.Priority;
+
+        // Same ID with different creation time is a new thread
+        auto iter = _entries.find( entry.tid );
+        bool known = iter != _entries.end() && iter->second.createTime == entry.createTime;
+        if (!known)
+        {
+            _opened.erase( entry.tid );
+            if (pDelta)
+                pDelta->created.emplace_back( entry.tid );
+        }
+
+        current.emplace( entry.tid, entry );
+    }
+
+    for (auto& entry : _entries)
+    {
+        auto iter = current.find( entry.first );
+        if (iter == current.end() || iter->second.createTime != entry.second.createTime)
+        {
+            if (iter == current.end())
+                _opened.erase( entry.first );
+
+            if (pDelta)
+                pDelta->exited.emplace_back( entry.first );
+        }
+    }
+
+    _entries = std::move( current );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Get table entries
+/// </summary>
+/// <returns>Entries sorted by thread ID</returns>
+std::vector<ThreadEntry> ThreadTable::entries()
+{
+    CSLock lck( _lock );
+
+    std::vector<ThreadEntry> result;
+    result.reserve( _entries.size() );
+
+    for (auto& entry : _entries)
+        result.emplace_back( entry.second );
+
+    return result;
+}
+
+/// <summary>
+/// Get thread entry
+/// </summary>
+/// <param name="tid">Thread ID</param>
+/// <returns>Entry, STATUS_NOT_FOUND if thread isn't in the table</returns>
+call_result_t<ThreadEntry> ThreadTable::entry( DWORD tid )
+{
+    CSLock lck( _lock );
+
+    auto iter = _entries.find( tid );
+    if (iter == _entries.end())
+        return STATUS_NOT_FOUND;
+
+    return iter->second;
+}
+
+/// <summary>
+/// Get thread object. Handle is opened on first request
+/// </summary>
+/// <param name="tid">Thread ID</param>
+/// <returns>Thread object, nullptr if thread isn't in the table</returns>
+ThreadPtr ThreadTable::get( DWORD tid )
+{
+    CSLock lck( _lock );
+
+    if (_entries.count( tid ) == 0)
+        return nullptr;
+
+    auto& thread = _opened[tid];
+    if (!thread)
+        thread = std::make_shared<Thread>( tid, &_core );
+
+    return thread;
+}
+
+/// <summary>
+/// Get thread with earliest creation time
+/// </summary>
+/// <returns>Thread object, nullptr if table is empty</returns>
+ThreadPtr ThreadTable::getMain()
+{
+    return Select( []( const ThreadEntry& a, const ThreadEntry& b ) { return a.createTime < b.createTime; } );
+}
+
+/// <summary>
+/// Get thread with least kernel + user time
+/// </summary>
+/// <returns>Thread object, nullptr if table is empty</returns>
+ThreadPtr ThreadTable::getLeastExecuted()
+{
+    return Select( []( const ThreadEntry& a, const ThreadEntry& b ) { return a.execTime() < b.execTime(); } );
+}
+
+/// <summary>
+/// Get thread with most kernel + user time, except current thread
+/// </summary>
+/// <returns>Thread object, nullptr if table is empty</returns>
+ThreadPtr ThreadTable::getMostExecuted()
+{
+    DWORD self = GetCurrentThreadId();
+    return Select( [self]( const ThreadEntry& a, const ThreadEntry& b )
+    {
+        if (b.tid == self)
+            return a.tid != self;
+
+        return a.tid != self && a.execTime() >= b.execTime();
+    } );
+}
+
+/// <summary>
+/// Drop table and opened handles
+/// </summary>
+void ThreadTable::Reset()
+{
+    CSLock lck( _lock );
+
+    _entries.clear();
+    _opened.clear();
+    _buffer.clear();
+    _buffer.shrink_to_fit();
+}
+
+/// <summary>
+/// Query system snapshot into reused buffer
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS ThreadTable::Query()
+{
+    if (_buffer.empty())
+        _buffer.resize( 0x10000 );
+
+    for (;;)
+    {
+        ULONG returnLength = 0;
+        NTSTATUS status = SAFE_NATIVE_CALL(
+            NtQuerySystemInformation, threadTableInfoClass,
+            _buffer.data(), static_cast<ULONG>(_buffer.size()), &returnLength
+            );
+
+        if (status != STATUS_INFO_LENGTH_MISMATCH)
+            return status;
+
+        // Leave room for threads created in between
+        _buffer.resize( max( static_cast<size_t>(returnLength) + returnLength / 8, _buffer.size() * 2 ) );
+    }
+}
+
+/// <summary>
+/// Pick entry by predicate and open it
+/// </summary>
+/// <param name="better">Returns true if first entry is better than second</param>
+/// <returns>Thread object, nullptr if table is empty</returns>
+template<typename Fn>
+ThreadPtr ThreadTable::Select( Fn better )
+{
+    CSLock lck( _lock );
+
+    const ThreadEntry* pBest = nullptr;
+    for (auto& entry : _entries)
+        if (pBest == nullptr || better( entry.second, *pBest ))
+            pBest = &entry.second;
+
+    return pBest ? get( pBest->tid ) : nullptr;
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "../../Include/Winheaders.h"
+#include "../../Include/Types.h"
+#include "../../Misc/Utils.h"
+#include "Thread.h"
+
+#include <map>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Thread info from system snapshot
+/// </summary>
+struct ThreadEntry
+{
+    DWORD tid = 0;                      // Thread ID
+    uint64_t createTime = 0;            // Creation time
+    uint64_t kernelTime = 0;            // Kernel mode time
+    uint64_t userTime = 0;              // User mode time
+    ptr_t startAddress = 0;             // Win32 start address
+    ptr_t teb = 0;                      // TEB address
+    uint32_t state = 0;                 // KTHREAD_STATE
+    uint32_t waitReason = 0;            // KWAIT_REASON
+    uint32_t contextSwitches = 0;       // Context switch count
+    LONG priority = 0;                  // Current priority
+
+    inline uint64_t execTime() const { return kernelTime + userTime; }
+};
+
+/// <summary>
+/// Thread table changes between two refreshes
+/// </summary>
+struct ThreadTableDelta
+{
+    std::vector<DWORD> created;         // New threads
+    std::vector<DWORD> exited;          // Terminated threads
+
+    inline bool empty() const { return created.empty() && exited.empty(); }
+};
+
+/// <summary>
+/// Process thread table built from a single SystemExtendedProcessInformation query.
+/// Thread handles are opened only when thread object is requested and kept until thread exits.
+/// </summary>
+class ThreadTable
+{
+public:
+    BLACKBONE_API ThreadTable( class ProcessCore& core );
+    BLACKBONE_API ~ThreadTable() = default;
+
+    /// <summary>
+    /// Update table from new system snapshot
+    /// </summary>
+    /// <param name="pDelta">Optional changes since last refresh</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Refresh( ThreadTableDelta* pDelta = nullptr );
+
+    /// <summary>
+    /// Get table entries
+    /// </summary>
+    /// <returns>Entries sorted by thread ID</returns>
+    BLACKBONE_API std::vector<ThreadEntry> entries();
+
+    /// <summary>
+    /// Get thread entry
+    /// </summary>
+    /// <param name="tid">Thread ID</param>
+    /// <returns>Entry, STATUS_NOT_FOUND if thread isn't in the table</returns>
+    BLACKBONE_API call_result_t<ThreadEntry> entry( DWORD tid );
+
+    /// <summary>
+    /// Get thread object. Handle is opened on first request
+    /// </summary>
+    /// <param name="tid">Thread ID</param>
+    /// <returns>Thread object, nullptr if thread isn't in the table</returns>
+    BLACKBONE_API ThreadPtr get( DWORD tid );
+
+    /// <summary>
+    /// Get thread with earliest creation time
+    /// </summary>
+    /// <returns>Thread object, nullptr if table is empty</returns>
+    BLACKBONE_API ThreadPtr getMain();
+
+    /// <summary>
+    /// Get thread with least kernel + user time
+    /// </summary>
+    /// <returns>Thread object, nullptr if table is empty</returns>
+    BLACKBONE_API ThreadPtr getLeastExecuted();
+
+    /// <summary>
+    /// Get thread with most kernel + user time, except current thread
+    /// </summary>
+    /// <returns>Thread object, nullptr if table is empty</returns>
+    BLACKBONE_API ThreadPtr getMostExecuted();
+
+    /// <summary>
+    /// Drop table and opened handles
+    /// </summary>
+    BLACKBONE_API void Reset();
+
+    BLACKBONE_API size_t size() const { return _entries.size(); }
+
+private:
+    /// <summary>
+    /// Query system snapshot into reused buffer
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS Query();
+
+    /// <summary>
+    /// Pick entry by predicate and open it
+    /// </summary>
+    /// <param name="better">Returns true if first entry is better than second</param>
+    /// <returns>Thread object, nullptr if table is empty</returns>
+    template<typename Fn>
+    ThreadPtr Select( Fn better );
+
+    ThreadTable( const ThreadTable& ) = delete;
+    ThreadTable& operator =( const ThreadTable& ) = delete;
+
+private:
+    class ProcessCore& _core;                   // Core process functions
+    std::map<DWORD, ThreadEntry> _entries;      // Thread ID -> info
+    std::map<DWORD, ThreadPtr> _opened;         // Opened threads
+    std::vector<uint8_t> _buffer;               // Snapshot buffer, reused between refreshes
+    CriticalSection _lock;                      // Table lock
+};
+
+}
@@ -11,6 +11,7 @@ namespace blackbone
     
 ProcessThreads::ProcessThreads( ProcessCore& core )
     : _core( core )
+    , _table( core )
 {
 }
 
@@ -53,23 +54,12 @@ call_result_t<ThreadPtr> ProcessThreads::CreateNew( ptr_t threadProc, ptr_t arg,
 std::vector<ThreadPtr> ProcessThreads::getAll() const
 {
     std::vector<ThreadPtr> result;
-    auto hThreadSnapshot = Handle( CreateToolhelp32Snapshot( TH32CS_SNAPTHREAD, 0 ) );
-    if (!hThreadSnapshot)
+    if (!NT_SUCCESS( _table.Refresh() ))
         return result;
-   
-    THREADENTRY32 tEntry = { 0 };
-    tEntry.dwSize = sizeof( THREADENTRY32 );
-
-    // Iterate threads
-    for (BOOL success = Thread32First( hThreadSnapshot, &tEntry );
-        success != FALSE;
-        success = Thread32Next( hThreadSnapshot, &tEntry ))
-    {
-        if (tEntry.th32OwnerProcessID != _core.pid())
-            continue;
 
-        result.emplace_back( std::make_shared<Thread>( tEntry.th32ThreadID, &_core ) );
-    }
+    for (auto& entry : _table.entries())
+        if (auto thread = _table.get( entry.tid ))
+            result.emplace_back( thread );
 
     return result;
 }
@@ -80,21 +70,7 @@ std::vector<ThreadPtr> ProcessThreads::getAll() const
 /// <returns>Pointer to thread object, nullptr if failed</returns>
 ThreadPtr ProcessThreads::getMain() const
 {
-    uint64_t mintime = MAXULONG64_2;
-    auto threads = getAll();
-    ThreadPtr result = !threads.empty() ? threads.front() : nullptr;
-
-    for (const auto& thread : threads)
-    {
-        uint64_t time = thread->startTime();
-        if (time < mintime)
-        {
-            mintime = time;
-            result = thread;
-        }
-    }
-
-    return result;
+    return NT_SUCCESS( _table.Refresh() ) ? _table.getMain() : nullptr;
 }
 
 /// <summary>
@@ -103,21 +79,7 @@ ThreadPtr ProcessThreads::getMain() const
 /// <returns>Pointer to thread object, nullptr if failed</returns>
 ThreadPtr ProcessThreads::getLeastExecuted() const
 {
-    uint64_t mintime = MAXULONG64_2;
-    auto threads = getAll();
-    ThreadPtr result = !threads.empty() ? threads.front() : nullptr;
-
-    for (const auto& thread : threads)
-    {
-        uint64_t time = thread->execTime();
-        if (time < mintime)
-        {
-            mintime = time;
-            result = thread;
-        }
-    }
-
-    return result;
+    return NT_SUCCESS( _table.Refresh() ) ? _table.getLeastExecuted() : nullptr;
 }
 
 /// <summary>
@@ -126,24 +88,7 @@ ThreadPtr ProcessThreads::getLeastExecuted() const
 /// <returns>Pointer to thread object, nullptr if failed</returns>
 ThreadPtr ProcessThreads::getMostExecuted() const
 {
-    uint64_t maxtime = 0;
-    auto threads = getAll();
-    ThreadPtr result = !threads.empty() ? threads.front() : nullptr;
-
-    for (const auto& thread : threads)
-    {
-        if (thread->id() == GetCurrentThreadId())
-            continue;
-
-        uint64_t time = thread->execTime();
-        if (thread->id() != GetCurrentThreadId() && time >= maxtime)
-        {
-            maxtime = time;
-            result = thread;
-        }
-    }
-
-    return result;
+    return NT_SUCCESS( _table.Refresh() ) ? _table.getMostExecuted() : nullptr;
 }
 
 /// <summary>
@@ -152,14 +97,17 @@ ThreadPtr ProcessThreads::getMostExecuted() const
 /// <returns>Pointer to thread object, nullptr if failed</returns>
 ThreadPtr ProcessThreads::getRandom() const
 {
-    auto threads = getAll();
+    if (!NT_SUCCESS( _table.Refresh() ))
+        return nullptr;
+
+    auto threads = _table.entries();
     if (threads.empty())
         return nullptr;
 
     static std::random_device rd;
     std::uniform_int_distribution<size_t> dist( 0, threads.size() - 1 );
 
-    return threads[dist(rd)];
+    return _table.get( threads[dist(rd)].tid );
 }
 
 /// <summary>
@@ -169,10 +117,10 @@ ThreadPtr ProcessThreads::getRandom() const
 /// <returns>Pointer to thread object, nullptr if failed</returns>
 ThreadPtr ProcessThreads::get( DWORD id ) const
 {
-    auto threads = getAll();
-    auto iter = std::find_if( threads.begin(), threads.end(), [id]( const auto& thread ) { return thread->id() == id; } );
+    if (!NT_SUCCESS( _table.Refresh() ))
+        return nullptr;
 
-    return iter != threads.end() ? *iter : nullptr;
+    return _table.get( id );
 }
 
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "../../Include/Winheaders.h"
 #include "Thread.h"
+#include "ThreadTable.h"
 
 #include <vector>
 #include <mutex>
@@ -68,8 +69,20 @@ public:
     /// <returns>Pointer to thread object, nullptr if failed</returns>
     BLACKBONE_API ThreadPtr get( DWORD id ) const;
 
+    /// <summary>
+    /// Get thread table. Refreshed by every thread lookup
+    /// </summary>
+    /// <returns>Thread table</returns>
+    BLACKBONE_API ThreadTable& table() { return _table; }
+
+    /// <summary>
+    /// Drop thread table and opened handles
+    /// </summary>
+    BLACKBONE_API void reset() { _table.Reset(); }
+
 private:
     class ProcessCore& _core;   // Core process functions
+    mutable ThreadTable _table; // Thread snapshot
 };
 
 }
\ No newline at end of file
@@ -3,7 +3,9 @@
 #include "../Misc/DynImport.h"
 #include "../Misc/Trace.hpp"
 #include "../Include/Macro.h"
+#include "../Misc/ThreadPool.h"
 
+#include <algorithm>
 #include <type_traits>
 #include <Psapi.h>
 
@@ -12,6 +14,7 @@ namespace blackbone
 
 Native::Native( HANDLE hProcess, bool x86OS /*= false*/ )
     : _hProcess( hProcess )
+    , _regions( this )
 {
     SYSTEM_INFO info = { { 0 } };
     GetNativeSystemInfo( &info );
@@ -397,30 +400,14 @@ ptr_t Native::getTEB( HANDLE hThread, _TEB64* pteb )
 }
 
 /// <summary>
-/// Enumerate valid memory regions
+/// Enumerate valid memory regions.
+/// Whole range enumeration rebuilds region map, so result is live and map is refreshed for partial queries
 /// </summary>
 /// <param name="includeFree">If true - non-allocated regions will be included in list</param>
 /// <returns>Found regions</returns>
 std::vector<MEMORY_BASIC_INFORMATION64> Native::EnumRegions( bool includeFree /*= false*/ )
 {
-    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
-    std::vector<MEMORY_BASIC_INFORMATION64> results;
-
-    for (ptr_t memptr = minAddr(); memptr < maxAddr(); memptr = mbi.BaseAddress + mbi.RegionSize)
-    {
-        auto status = VirtualQueryExT( memptr, &mbi );
-
-        if (status == STATUS_INVALID_PARAMETER || status == STATUS_ACCESS_DENIED)
-            break;
-        else if (status != STATUS_SUCCESS)
-            continue;
-
-        // Filter, if required
-        if (includeFree || mbi.State & (MEM_COMMIT | MEM_RESERVE))
-            results.emplace_back( mbi );
-    }
-
-    return results;
+    return _regions.Enumerate( minAddr(), maxAddr(), includeFree );
 }
 
 /// <summary>
@@ -569,91 +556,156 @@ std::vector<ModuleDataPtr> Native::EnumSections()
 /// <returns>Sections count</returns>
 std::vector<ModuleDataPtr> Native::EnumPEHeaders()
 {
-    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
-    uint8_t buf[0x1000];
-    ptr_t lastBase = 0;
-    std::vector<ModuleDataPtr> result;
+    return ScanPEHeaders( PEScanAll );
+}
 
-    for (ptr_t memptr = minAddr(); memptr < maxAddr(); memptr = mbi.BaseAddress + mbi.RegionSize)
+/// <summary>
+/// Scan address space for PE headers.
+/// Only DOS header is read for each allocation, NT headers are read for DOS header hits only.
+/// </summary>
+/// <param name="filter">Allocation filter, combination of ePEScanFilter flags</param>
+/// <param name="threads">Number of scanning threads, 0 - number of logical CPUs</param>
+/// <returns>Found images</returns>
+std::vector<ModuleDataPtr> Native::ScanPEHeaders( uint32_t filter /*= PEScanAll*/, size_t threads /*= 0*/ )
+{
+    struct Candidate
     {
-        auto status = VirtualQueryExT( memptr, &mbi );
+        ptr_t base;
+        DWORD type;
+        bool executable;
+        ModuleDataPtr image;
+    };
 
-        if (status == STATUS_INVALID_PARAMETER || status == STATUS_ACCESS_DENIED || status == STATUS_PROCESS_IS_TERMINATING)
-            break;
-        else if (status != STATUS_SUCCESS)
+    constexpr DWORD execMask = PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+
+    // Collect allocation bases
+    std::vector<Candidate> candidates;
+    for (auto& mbi : _regions.Enumerate( minAddr(), maxAddr() ))
+    {
+        if (mbi.State != MEM_COMMIT || mbi.AllocationProtect == PAGE_NOACCESS || mbi.AllocationProtect & PAGE_GUARD)
             continue;
 
-        // Filter regions
-        if (mbi.State != MEM_COMMIT ||
-            mbi.AllocationProtect == PAGE_NOACCESS ||
-            mbi.AllocationProtect & PAGE_GUARD ||
-            lastBase == mbi.AllocationBase)
+        bool executable = (mbi.Protect & execMask) != 0;
+        if (!candidates.empty() && candidates.back().base == mbi.AllocationBase)
         {
+            candidates.back().executable |= executable;
             continue;
         }
 
-        ModuleData data;
+        candidates.push_back( { mbi.AllocationBase, mbi.Type, executable, nullptr } );
+    }
 
-        IMAGE_DOS_HEADER* phdrDos = reinterpret_cast<PIMAGE_DOS_HEADER>(buf);
-        IMAGE_NT_HEADERS32 *phdrNt32 = nullptr;
-        IMAGE_NT_HEADERS64 *phdrNt64 = nullptr;
+    // Filter before any reads
+    candidates.erase( std::remove_if( candidates.begin(), candidates.end(), [filter]( const Candidate& val )
+    {
+        return ((filter & PEScanExecutable) && !val.executable) || ((filter & PEScanPrivate) && val.type != MEM_PRIVATE);
+    } ), candidates.end() );
 
-        if (ReadProcessMemoryT( mbi.AllocationBase, buf, 0x1000 ) != STATUS_SUCCESS)
-            continue;
+    auto scan = [this, &candidates]( size_t from, size_t to )
+    {
+        for (size_t i = from; i < to; i++)
+            candidates[i].image = ProbePEHeader( candidates[i].base, candidates[i].type );
+    };
 
-        phdrNt32 = reinterpret_cast<PIMAGE_NT_HEADERS32>(buf + phdrDos->e_lfanew);
-        phdrNt64 = reinterpret_cast<PIMAGE_NT_HEADERS64>(phdrNt32);
+    // Small batches aren't worth thread startup
+    if (threads == 0)
+        threads = max( std::thread::hardware_concurrency(), 1u );
 
-        if (phdrDos->e_magic != IMAGE_DOS_SIGNATURE || phdrNt32->Signature != IMAGE_NT_SIGNATURE)
-            continue;
+    threads = min( threads, (candidates.size() + 63) / 64 );
+    if (threads <= 1)
+    {
+        scan( 0, candidates.size() );
+    }
+    else
+    {
+        ThreadPool pool( threads );
+        std::vector<std::future<void>> tasks;
 
-        if (phdrNt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
-        {
-            data.size = phdrNt32->OptionalHeader.SizeOfImage;
-            data.type = mt_mod32;
-        }
-        else if (phdrNt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
-        {
-            data.size = phdrNt64->OptionalHeader.SizeOfImage;
-            data.type = mt_mod64;
-        }
+        size_t chunk = (candidates.size() + threads - 1) / threads;
+        for (size_t i = 0; i < candidates.size(); i += chunk)
+            tasks.emplace_back( pool.Submit( [&scan, &candidates, i, chunk]() { scan( i, min( i + chunk, candidates.size() ) ); } ) );
 
-        data.baseAddress = mbi.AllocationBase;
-        data.ldrPtr = 0;
-        data.manual = false;
+        for (auto& task : tasks)
+            task.get();
+    }
 
-        // Try to get section name
-        _UNICODE_STRING_T<DWORD64>* ustr = (decltype(ustr))buf;
-        status = VirtualQueryExT( mbi.AllocationBase, MemorySectionName, ustr, sizeof(buf) );
+    std::vector<ModuleDataPtr> result;
+    for (auto& candidate : candidates)
+        if (candidate.image)
+            result.emplace_back( std::move( candidate.image ) );
 
-        if (status == STATUS_SUCCESS)
-        {
-            // Hack for x86 OS
-            if (_wowBarrier.x86OS == true)
-            {
-                _UNICODE_STRING_T<DWORD>* ustr32 = reinterpret_cast<_UNICODE_STRING_T<DWORD>*>(ustr);
-                data.fullPath = Utils::ToLower( reinterpret_cast<wchar_t*>((uintptr_t)ustr32->Buffer) );
-            }
-            else
-                data.fullPath = Utils::ToLower( reinterpret_cast<wchar_t*>((uintptr_t)ustr->Buffer) );
+    return result;
+}
 
-            data.name = Utils::StripPath( data.fullPath );
-        }
-        else
-        {
-            wchar_t name[64] = { 0 };
-            wsprintfW( name, L"Unknown_0x%I64x", data.baseAddress );
+/// <summary>
+/// Check if allocation starts with valid PE headers
+/// </summary>
+/// <param name="base">Allocation base</param>
+/// <param name="type">Allocation type</param>
+/// <returns>Image info, nullptr if not an image</returns>
+ModuleDataPtr Native::ProbePEHeader( ptr_t base, DWORD type )
+{
+    IMAGE_DOS_HEADER hdrDos = { 0 };
+    IMAGE_NT_HEADERS32 hdrNt = { 0 };
 
-            data.fullPath = name;
-            data.name = data.fullPath;
+    if (ReadProcessMemoryT( base, &hdrDos, sizeof( hdrDos ) ) != STATUS_SUCCESS || hdrDos.e_magic != IMAGE_DOS_SIGNATURE)
+        return nullptr;
+
+    // Headers must fit into first page
+    if (hdrDos.e_lfanew <= 0 || static_cast<size_t>(hdrDos.e_lfanew) > 0x1000 - sizeof( hdrNt ))
+        return nullptr;
+
+    // SizeOfImage offset is the same in 32 and 64 bit optional headers
+    if (ReadProcessMemoryT( base + hdrDos.e_lfanew, &hdrNt, sizeof( hdrNt ) ) != STATUS_SUCCESS || hdrNt.Signature != IMAGE_NT_SIGNATURE)
+        return nullptr;
+
+    ModuleData data;
+    if (hdrNt.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+    {
+        data.size = hdrNt.OptionalHeader.SizeOfImage;
+        data.type = mt_mod32;
+    }
+    else if (hdrNt.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+    {
+        data.size = reinterpret_cast<IMAGE_NT_HEADERS64*>(&hdrNt)->OptionalHeader.SizeOfImage;
+        data.type = mt_mod64;
+    }
+
+    data.baseAddress = base;
+    data.ldrPtr = 0;
+    data.manual = false;
+
+    // Private memory is never backed by section
+    NTSTATUS status = STATUS_INVALID_ADDRESS;
+    uint8_t buf[0x1000];
+    _UNICODE_STRING_T<DWORD64>* ustr = (decltype(ustr))buf;
+
+    if (type != MEM_PRIVATE)
+        status = VirtualQueryExT( base, MemorySectionName, ustr, sizeof( buf ) );
+
+    if (status == STATUS_SUCCESS)
+    {
+        // Hack for x86 OS
+        if (_wowBarrier.x86OS == true)
+        {
+            _UNICODE_STRING_T<DWORD>* ustr32 = reinterpret_cast<_UNICODE_STRING_T<DWORD>*>(ustr);
+            data.fullPath = Utils::ToLower( reinterpret_cast<wchar_t*>((uintptr_t)ustr32->Buffer) );
         }
+        else
+            data.fullPath = Utils::ToLower( reinterpret_cast<wchar_t*>((uintptr_t)ustr->Buffer) );
 
-        result.emplace_back( std::make_shared<const ModuleData>( data ) );
+        data.name = Utils::StripPath( data.fullPath );
+    }
+    else
+    {
+        wchar_t name[64] = { 0 };
+        wsprintfW( name, L"Unknown_0x%I64x", data.baseAddress );
 
-        lastBase = mbi.AllocationBase;
+        data.fullPath = name;
+        data.name = data.fullPath;
     }
 
-    return result;
+    return std::make_shared<const ModuleData>( data );
 }
 
 /// <summary>
@@ -3,6 +3,7 @@
 #include "../Include/Winheaders.h"
 #include "../Include/Types.h"
 #include "../Include/Macro.h"
+#include "RegionMap.h"
 
 #include <string>
 #include <list>
@@ -210,6 +211,15 @@ public:
     /// <returns>Module count</returns>
     BLACKBONE_API std::vector<ModuleDataPtr> EnumModules( eModSeachType search = LdrList, eModType mtype = mt_default );
 
+    /// <summary>
+    /// Scan address space for PE headers.
+    /// Only DOS header is read for each allocation, NT headers are read for DOS header hits only.
+    /// </summary>
+    /// <param name="filter">Allocation filter, combination of ePEScanFilter flags</param>
+    /// <param name="threads">Number of scanning threads, 0 - number of logical CPUs</param>
+    /// <returns>Found images</returns>
+    BLACKBONE_API std::vector<ModuleDataPtr> ScanPEHeaders( uint32_t filter = PEScanAll, size_t threads = 0 );
+
     /// <summary>
     /// Get lowest possible valid address value
     /// </summary>
@@ -233,6 +243,12 @@ public:
     /// </summary>
     /// <returns>Address value</returns>
     BLACKBONE_API inline uint32_t pageSize() const { return _pageSize; }
+
+    /// <summary>
+    /// Get cached address space layout
+    /// </summary>
+    /// <returns>Region map</returns>
+    BLACKBONE_API inline RegionMap& regions() { return _regions; }
 private:
 
     /// <summary>
@@ -257,10 +273,19 @@ private:
     /// <returns>Sections count</returns>
     std::vector<ModuleDataPtr> EnumPEHeaders();
 
+    /// <summary>
+    /// Check if allocation starts with valid PE headers
+    /// </summary>
+    /// <param name="base">Allocation base</param>
+    /// <param name="type">Allocation type</param>
+    /// <returns>Image info, nullptr if not an image</returns>
+    ModuleDataPtr ProbePEHeader( ptr_t base, DWORD type );
+
 protected:
     HANDLE _hProcess;           // Process handle
     Wow64Barrier _wowBarrier;   // WOW64 barrier info
     uint32_t _pageSize;
+    RegionMap _regions;         // Address space layout
 };
 
 }
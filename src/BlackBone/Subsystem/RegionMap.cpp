@@ -0,0 +1,280 @@
+#include "RegionMap.h"
+#include "NativeSubsystem.h"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Check if two regions can be represented by single entry
+/// </summary>
+/// <param name="lhs">First region</param>
+/// <param name="rhs">Second region</param>
+/// <returns>true if attributes match</returns>
+static bool SameAttributes( const MEMORY_BASIC_INFORMATION64& lhs, const MEMORY_BASIC_INFORMATION64& rhs )
+{
+    return lhs.AllocationBase == rhs.AllocationBase &&
+           lhs.AllocationProtect == rhs.AllocationProtect &&
+           lhs.State == rhs.State &&
+           lhs.Protect == rhs.Protect &&
+           lhs.Type == rhs.Type;
+}
+
+RegionMap::RegionMap( Native* native )
+    : _native( native )
+{
+}
+
+/// <summary>
+/// Get info about region containing address.
+/// Result has the same layout as VirtualQueryEx output:
+/// BaseAddress is address rounded down to page and RegionSize is counted from it.
+/// </summary>
+/// <param name="address">Address to query</param>
+/// <param name="mbi">Region info</param>
+/// <returns>Status code</returns>
+NTSTATUS RegionMap::Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi )
+{
+    CSLock lck( _lock );
+    Update();
+
+    auto iter = Find( address );
+    if (iter == _regions.end())
+        return _native->VirtualQueryExT( address, &mbi );
+
+    ptr_t page = address & ~static_cast<ptr_t>(0xFFF);
+
+    mbi = iter->second;
+    mbi.RegionSize -= page - mbi.BaseAddress;
+    mbi.BaseAddress = page;
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Get regions intersecting address range.
+/// Range covering whole address space rebuilds the map
+/// </summary>
+/// <param name="begin">Range start</param>
+/// <param name="end">Range end</param>
+/// <param name="includeFree">If true - non-allocated regions will be included in list</param>
+/// <returns>Found regions</returns>
+std::vector<MEMORY_BASIC_INFORMATION64> RegionMap::Enumerate( ptr_t begin, ptr_t end, bool includeFree /*= false*/ )
+{
+    std::vector<MEMORY_BASIC_INFORMATION64> results;
+
+    CSLock lck( _lock );
+
+    // Full snapshot costs the same as full rebuild, so don't risk returning stale one
+    if (begin <= _native->minAddr() && end >= _native->maxAddr())
+        _built = false;
+
+    Update();
+
+    auto iter = Find( begin );
+    if (iter == _regions.end())
+        iter = _regions.lower_bound( begin );
+
+    for (; iter != _regions.end() && iter->first < end; ++iter)
+    {
+        if (includeFree || iter->second.State & (MEM_COMMIT | MEM_RESERVE))
+            results.emplace_back( iter->second );
+    }
+
+    return results;
+}
+
+/// <summary>
+/// Mark range as changed. It will be queried again on next access
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size. If 0 - whole allocation starting at address</param>
+void RegionMap::MarkDirty( ptr_t address, size_t size /*= 0*/ )
+{
+    CSLock lck( _lock );
+    if (!_built)
+        return;
+
+    if (size != 0)
+    {
+        _dirty.emplace_back( address, address + size );
+        return;
+    }
+
+    ptr_t end = address + 0x1000;
+    for (auto iter = _regions.lower_bound( address ); iter != _regions.end() && iter->second.AllocationBase == address; ++iter)
+        end = iter->first + iter->second.RegionSize;
+
+    _dirty.emplace_back( address, end );
+}
+
+/// <summary>
+/// Rebuild whole map
+/// </summary>
+void RegionMap::Resync()
+{
+    CSLock lck( _lock );
+
+    _built = false;
+    Update();
+}
+
+/// <summary>
+/// Drop map, it will be rebuilt on next access
+/// </summary>
+void RegionMap::Reset()
+{
+    CSLock lck( _lock );
+
+    _built = false;
+    _regions.clear();
+    _dirty.clear();
+}
+
+/// <summary>
+/// Build map or refresh dirty ranges
+/// </summary>
+void RegionMap::Update()
+{
+    if (_built && _maxAge != 0 && GetTickCount64() - _buildTime > _maxAge)
+        _built = false;
+
+    if (!_built)
+    {
+        _regions.clear();
+        _dirty.clear();
+
+        Refresh( _native->minAddr(), _native->maxAddr() );
+
+        _built = true;
+        _buildTime = GetTickCount64();
+        return;
+    }
+
+    if (_dirty.empty())
+        return;
+
+    // Merge overlapping ranges
+    std::sort( _dirty.begin(), _dirty.end() );
+
+    ptr_t begin = _dirty.front().first, end = _dirty.front().second;
+    for (auto& range : _dirty)
+    {
+        if (range.first > end)
+        {
+            Refresh( begin, end );
+            begin = range.first;
+        }
+
+        end = max( end, range.second );
+    }
+
+    Refresh( begin, end );
+    _dirty.clear();
+}
+
+/// <summary>
+/// Query range again and replace stale entries
+/// </summary>
+/// <param name="begin">Range start</param>
+/// <param name="end">Range end</param>
+void RegionMap::Refresh( ptr_t begin, ptr_t end )
+{
+    begin &= ~static_cast<ptr_t>(0xFFF);
+    end = (end + 0xFFF) & ~static_cast<ptr_t>(0xFFF);
+
+    // Extend range to whole entries
+    auto first = Find( begin );
+    if (first != _regions.end())
+        begin = first->first;
+
+    auto last = Find( end - 1 );
+    if (last != _regions.end())
+        end = last->first + last->second.RegionSize;
+
+    _regions.erase( _regions.lower_bound( begin ), _regions.lower_bound( end ) );
+
+    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+    for (ptr_t memptr = begin; memptr < end; memptr = mbi.BaseAddress + mbi.RegionSize)
+    {
+        auto status = _native->VirtualQueryExT( memptr, &mbi );
+
+        if (status == STATUS_INVALID_PARAMETER || status == STATUS_ACCESS_DENIED || status == STATUS_PROCESS_IS_TERMINATING)
+            break;
+
+        if (status != STATUS_SUCCESS || mbi.RegionSize == 0)
+        {
+            mbi.BaseAddress = memptr;
+            mbi.RegionSize = 0x1000;
+            continue;
+        }
+
+        // Region has grown over following entries, cut them
+        ptr_t regionEnd = mbi.BaseAddress + mbi.RegionSize;
+        for (auto iter = _regions.lower_bound( memptr ); iter != _regions.end() && iter->first < regionEnd;)
+        {
+            auto tail = iter->second;
+            iter = _regions.erase( iter );
+
+            if (tail.BaseAddress + tail.RegionSize > regionEnd)
+            {
+                tail.RegionSize = tail.BaseAddress + tail.RegionSize - regionEnd;
+                tail.BaseAddress = regionEnd;
+                _regions.emplace( regionEnd, tail );
+                break;
+            }
+        }
+
+        Insert( mbi );
+    }
+}
+
+/// <summary>
+/// Insert region merging it with identical neighbours
+/// </summary>
+/// <param name="mbi">Region info</param>
+void RegionMap::Insert( const MEMORY_BASIC_INFORMATION64& mbi )
+{
+    auto region = mbi;
+    auto next = _regions.lower_bound( region.BaseAddress );
+
+    if (next != _regions.begin())
+    {
+        auto prev = std::prev( next );
+        if (prev->first + prev->second.RegionSize == region.BaseAddress && SameAttributes( prev->second, region ))
+        {
+            region.BaseAddress = prev->first;
+            region.RegionSize += prev->second.RegionSize;
+            _regions.erase( prev );
+        }
+    }
+
+    if (next != _regions.end() && next->first == region.BaseAddress + region.RegionSize && SameAttributes( next->second, region ))
+    {
+        region.RegionSize += next->second.RegionSize;
+        _regions.erase( next );
+    }
+
+    _regions.emplace( region.BaseAddress, region );
+}
+
+/// <summary>
+/// Find region containing address
+/// </summary>
+/// <param name="address">Address</param>
+/// <returns>Region iterator, _regions.end() if not found</returns>
+RegionMap::mapRegions::iterator RegionMap::Find( ptr_t address )
+{
+    auto iter = _regions.upper_bound( address );
+    if (iter == _regions.begin())
+        return _regions.end();
+
+    --iter;
+    if (address < iter->first + iter->second.RegionSize)
+        return iter;
+
+    return _regions.end();
+}
+
+}
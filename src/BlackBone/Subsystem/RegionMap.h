@@ -0,0 +1,118 @@
+#pragma once
+
+#include "../Include/Winheaders.h"
+#include "../Include/Types.h"
+#include "../Misc/Utils.h"
+
+#include <map>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Cached layout of process address space.
+/// Regions never overlap, so ordered map keyed by region start serves as interval tree.
+/// Map is built on first use and afterwards only dirty ranges are queried again.
+/// Changes made by target process itself are not tracked, so map older than maxAge
+/// and whole address space enumeration are served by a full rebuild.
+/// Use MarkDirty or Resync to pick such changes up earlier.
+/// </summary>
+class RegionMap
+{
+public:
+    static constexpr uint32_t DefaultMaxAge = 1000;
+
+public:
+    BLACKBONE_API RegionMap( class Native* native );
+    BLACKBONE_API ~RegionMap() = default;
+
+    /// <summary>
+    /// Get info about region containing address.
+    /// Result has the same layout as VirtualQueryEx output:
+    /// BaseAddress is address rounded down to page and RegionSize is counted from it.
+    /// </summary>
+    /// <param name="address">Address to query</param>
+    /// <param name="mbi">Region info</param>
+    /// <returns>Status code</returns>
+    BLACKBONE_API NTSTATUS Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi );
+
+    /// <summary>
+    /// Get regions intersecting address range.
+    /// Range covering whole address space rebuilds the map
+    /// </summary>
+    /// <param name="begin">Range start</param>
+    /// <param name="end">Range end</param>
+    /// <param name="includeFree">If true - non-allocated regions will be included in list</param>
+    /// <returns>Found regions</returns>
+    BLACKBONE_API std::vector<MEMORY_BASIC_INFORMATION64> Enumerate( ptr_t begin, ptr_t end, bool includeFree = false );
+
+    /// <summary>
+    /// Mark range as changed. It will be queried again on next access
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size. If 0 - whole allocation starting at address</param>
+    BLACKBONE_API void MarkDirty( ptr_t address, size_t size = 0 );
+
+    /// <summary>
+    /// Rebuild whole map
+    /// </summary>
+    BLACKBONE_API void Resync();
+
+    /// <summary>
+    /// Drop map, it will be rebuilt on next access
+    /// </summary>
+    BLACKBONE_API void Reset();
+
+    /// <summary>
+    /// Set max map age. Older map is rebuilt on next access
+    /// </summary>
+    /// <param name="ms">Age in milliseconds, 0 to disable automatic rebuild</param>
+    BLACKBONE_API void maxAge( uint32_t ms ) { _maxAge = ms; }
+
+    BLACKBONE_API uint32_t maxAge() const { return _maxAge; }
+    BLACKBONE_API bool built() const { return _built; }
+    BLACKBONE_API size_t size() const { return _regions.size(); }
+
+private:
+    using mapRegions = std::map<ptr_t, MEMORY_BASIC_INFORMATION64>;
+
+    /// <summary>
+    /// Build map or refresh dirty ranges
+    /// </summary>
+    void Update();
+
+    /// <summary>
+    /// Query range again and replace stale entries
+    /// </summary>
+    /// <param name="begin">Range start</param>
+    /// <param name="end">Range end</param>
+    void Refresh( ptr_t begin, ptr_t end );
+
+    /// <summary>
+    /// Insert region merging it with identical neighbours
+    /// </summary>
+    /// <param name="mbi">Region info</param>
+    void Insert( const MEMORY_BASIC_INFORMATION64& mbi );
+
+    /// <summary>
+    /// Find region containing address
+    /// </summary>
+    /// <param name="address">Address</param>
+    /// <returns>Region iterator, _regions.end() if not found</returns>
+    mapRegions::iterator Find( ptr_t address );
+
+    RegionMap( const RegionMap& ) = delete;
+    RegionMap& operator =( const RegionMap& ) = delete;
+
+private:
+    class Native* _native;                          // Native API wrapper
+    mapRegions _regions;                            // Regions, keyed by base address
+    std::vector<std::pair<ptr_t, ptr_t>> _dirty;    // Ranges to refresh
+    bool _built = false;                            // Map was built
+    uint32_t _maxAge = DefaultMaxAge;               // Max map age, ms
+    uint64_t _buildTime = 0;                        // Last full build tick
+    CriticalSection _lock;                          // Map lock
+};
+
+}
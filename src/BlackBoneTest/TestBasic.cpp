@@ -77,6 +77,338 @@ namespace Testing
             baseProc.Terminate();
         }
 
+        TEST_METHOD( VectoredIO )
+        {
+            uint8_t data[0x3000] = { };
+            for (size_t i = 0; i < sizeof( data ); i++)
+                data[i] = static_cast<uint8_t>(i);
+
+            uint32_t a = 0, b = 0, c = 0;
+            auto base = reinterpret_cast<ptr_t>(data);
+
+            std::vector<MemIoVec> ops =
+            {
+                { base + 0x2000, sizeof( c ), &c },
+                { base, sizeof( a ), &a },
+                { base + 0x10, sizeof( b ), &b },
+                { 0, sizeof( a ), &a }
+            };
+
+            AssertEx::AreEqual( STATUS_INVALID_ADDRESS, _proc.memory().ReadV( ops ) );
+            AssertEx::NtSuccess( ops[0].status );
+            AssertEx::NtSuccess( ops[1].status );
+            AssertEx::NtSuccess( ops[2].status );
+            AssertEx::AreEqual( *reinterpret_cast<uint32_t*>(data + 0x2000), c );
+            AssertEx::AreEqual( *reinterpret_cast<uint32_t*>(data), a );
+            AssertEx::AreEqual( *reinterpret_cast<uint32_t*>(data + 0x10), b );
+
+            uint32_t x = 0x11111111, y = 0x22222222;
+            std::vector<MemIoVec> writes =
+            {
+                { base + 4, sizeof( y ), &y },
+                { base, sizeof( x ), &x }
+            };
+
+            AssertEx::NtSuccess( _proc.memory().WriteV( writes ) );
+            AssertEx::AreEqual( x, *reinterpret_cast<uint32_t*>(data) );
+            AssertEx::AreEqual( y, *reinterpret_cast<uint32_t*>(data + 4) );
+        }
+
+        TEST_METHOD( PageCache )
+        {
+            alignas(0x1000) static uint8_t data[0x2000] = { 1, 2, 3, 4 };
+            auto base = reinterpret_cast<ptr_t>(data);
+            auto& cache = _proc.memory().cache();
+
+            cache.Enable( 0x10000 );
+            cache.resetStats();
+
+            AssertEx::AreEqual( 1, static_cast<int>(_proc.memory().Read<uint8_t>( base ).result( 0 )) );
+
+            // Served from cache, target change is invisible until next epoch
+            data[0] = 5;
+            AssertEx::AreEqual( 1, static_cast<int>(_proc.memory().Read<uint8_t>( base ).result( 0 )) );
+            AssertEx::AreEqual( uint64_t( 1 ), cache.stats().hits );
+            AssertEx::AreEqual( uint64_t( 1 ), cache.stats().misses );
+
+            cache.BeginEpoch();
+            AssertEx::AreEqual( 5, static_cast<int>(_proc.memory().Read<uint8_t>( base ).result( 0 )) );
+
+            // Write-through
+            AssertEx::NtSuccess( _proc.memory().Write<uint8_t>( base + 1, 7 ) );
+            AssertEx::AreEqual( 7, static_cast<int>(_proc.memory().Read<uint8_t>( base + 1 ).result( 0 )) );
+
+            // Volatile range bypasses cache
+            cache.AddVolatile( base + 0x1000, 0x1000 );
+            data[0x1000] = 9;
+            _proc.memory().Read<uint8_t>( base + 0x1000 );
+            data[0x1000] = 10;
+            AssertEx::AreEqual( 10, static_cast<int>(_proc.memory().Read<uint8_t>( base + 0x1000 ).result( 0 )) );
+            AssertEx::AreEqual( uint64_t( 2 ), cache.stats().bypassed );
+
+            cache.Disable();
+        }
+
+        TEST_METHOD( PageCacheReattach )
+        {
+            Process host;
+            AssertEx::NtSuccess( host.CreateAndAttach( GetTestHelperHost() ) );
+
+            // Same address in both processes, different content
+            auto remote = host.memory().Allocate( 0x2000, PAGE_READWRITE );
+            AssertEx::IsTrue( remote.success() );
+            auto base = remote->ptr();
+
+            auto local = reinterpret_cast<uint8_t*>(VirtualAlloc( reinterpret_cast<LPVOID>(base), 0x2000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ));
+            AssertEx::IsNotZero( local );
+            local[0] = 1;
+            local[0x1000] = 2;
+            AssertEx::NtSuccess( host.memory().Write<uint8_t>( base, 3 ) );
+            AssertEx::NtSuccess( host.memory().Write<uint8_t>( base + 0x1000, 4 ) );
+
+            auto& cache = _proc.memory().cache();
+            cache.Enable( 0x10000 );
+            cache.resetStats();
+
+            // One miss per page, even if pages are read at once
+            uint8_t buf[0x1001] = { };
+            AssertEx::NtSuccess( _proc.memory().Read( base, sizeof( buf ), buf ) );
+            AssertEx::AreEqual( 1, static_cast<int>(buf[0]) );
+            AssertEx::AreEqual( 2, static_cast<int>(buf[0x1000]) );
+            AssertEx::AreEqual( uint64_t( 2 ), cache.stats().misses );
+
+            AssertEx::NtSuccess( _proc.Detach() );
+            AssertEx::NtSuccess( _proc.Attach( host.pid() ) );
+            AssertEx::IsTrue( cache.enabled() );
+
+            // Pages cached for previous process must not leak into new one
+            AssertEx::NtSuccess( _proc.memory().Read( base, sizeof( buf ), buf ) );
+            AssertEx::AreEqual( 3, static_cast<int>(buf[0]) );
+            AssertEx::AreEqual( 4, static_cast<int>(buf[0x1000]) );
+            AssertEx::AreEqual( uint64_t( 4 ), cache.stats().misses );
+
+            cache.Disable();
+            VirtualFree( local, 0, MEM_RELEASE );
+            host.Terminate();
+        }
+
+        TEST_METHOD( RegionLayout )
+        {
+            auto& regions = _proc.memory().regions();
+            regions.Resync();
+            AssertEx::IsTrue( regions.built() );
+
+            auto block = _proc.memory().Allocate( 0x3000, PAGE_READWRITE, 0, false );
+            AssertEx::IsTrue( block.success() );
+            auto ptr = block->ptr();
+
+            MEMORY_BASIC_INFORMATION64 mbi = { };
+            AssertEx::NtSuccess( regions.Query( ptr + 0x1000, mbi ) );
+            AssertEx::AreEqual( static_cast<DWORD>(MEM_COMMIT), mbi.State );
+            AssertEx::AreEqual( ptr + 0x1000, mbi.BaseAddress );
+            AssertEx::IsTrue( mbi.RegionSize >= 0x2000 );
+
+            AssertEx::NtSuccess( block->Free() );
+            AssertEx::NtSuccess( regions.Query( ptr, mbi ) );
+            AssertEx::AreEqual( static_cast<DWORD>(MEM_FREE), mbi.State );
+        }
+
+        TEST_METHOD( SparseRead )
+        {
+            auto block = _proc.memory().Allocate( 0x3000, PAGE_READWRITE );
+            AssertEx::IsTrue( block.success() );
+
+            auto ptr = block->ptr();
+            memset( reinterpret_cast<void*>(ptr), 0xAB, 0x3000 );
+            AssertEx::NtSuccess( block->Protect( PAGE_NOACCESS, 0x1000, 0x1000 ) );
+
+            std::vector<bool> valid;
+            auto buf = std::make_unique<uint8_t[]>( 0x2800 );
+            auto status = _proc.memory().ReadSparse( ptr + 0x800, 0x2800, buf.get(), valid );
+
+            AssertEx::AreEqual( STATUS_PARTIAL_COPY, status );
+            AssertEx::AreEqual( size_t( 3 ), valid.size() );
+            AssertEx::IsTrue( valid[0] );
+            AssertEx::IsFalse( valid[1] );
+            AssertEx::IsTrue( valid[2] );
+            AssertEx::AreEqual( 0xAB, static_cast<int>(buf[0]) );
+            AssertEx::AreEqual( 0, static_cast<int>(buf[0x1000]) );
+            AssertEx::AreEqual( 0xAB, static_cast<int>(buf[0x27FF]) );
+        }
+
+        TEST_METHOD( BatchedPatch )
+        {
+            auto block = _proc.memory().Allocate( 0x2000, PAGE_EXECUTE_READ );
+            AssertEx::IsTrue( block.success() );
+
+            auto ptr = block->ptr();
+            auto patch = _proc.memory().BeginPatch();
+            patch.Write( ptr + 0xFFE, uint32_t( 0x11223344 ) );
+            patch.Write( ptr + 0x1000, uint8_t( 0x55 ) );
+            AssertEx::NtSuccess( patch.Commit() );
+
+            AssertEx::AreEqual( 0x55u, static_cast<uint32_t>(*reinterpret_cast<uint8_t*>(ptr + 0x1000)) );
+            AssertEx::AreEqual( 0x3344u, static_cast<uint32_t>(*reinterpret_cast<uint16_t*>(ptr + 0xFFE)) );
+
+            // Original protection must be restored
+            MEMORY_BASIC_INFORMATION64 mbi = { };
+            AssertEx::NtSuccess( _proc.memory().Query( ptr + 0x1000, &mbi ) );
+            AssertEx::AreEqual( static_cast<DWORD>(PAGE_EXECUTE_READ), mbi.Protect );
+
+            AssertEx::NtSuccess( patch.Rollback() );
+            AssertEx::IsZero( *reinterpret_cast<uint32_t*>(ptr + 0xFFE) );
+
+            // Uncommitted page fails whole transaction
+            auto patch2 = _proc.memory().BeginPatch();
+            patch2.Write( ptr, uint8_t( 0x90 ) );
+            patch2.Write( ptr + 0x2000, uint8_t( 0x90 ) );
+            AssertEx::IsFalse( NT_SUCCESS( patch2.Commit() ) );
+            AssertEx::IsZero( *reinterpret_cast<uint8_t*>(ptr) );
+        }
+
+        TEST_METHOD( WatchChanges )
+        {
+            alignas(0x1000) static uint8_t data[0x2000] = { };
+            auto base = reinterpret_cast<ptr_t>(data);
+            auto& watch = _proc.memory().watch();
+
+            auto id = watch.Add( base + 0x800, 0x1000, 50, true );
+            AssertEx::IsNotZero( id );
+
+            // Baseline
+            AssertEx::IsTrue( watch.Poll( true ).empty() );
+
+            data[0x810] = 1;
+            data[0x811] = 2;
+            data[0x1004] = 3;
+
+            auto changes = watch.Poll( true );
+            AssertEx::AreEqual( size_t( 2 ), changes.size() );
+            AssertEx::AreEqual( id, changes[0].id );
+            AssertEx::AreEqual( base, changes[0].page );
+            AssertEx::AreEqual( size_t( 1 ), changes[0].spans.size() );
+            AssertEx::AreEqual( base + 0x810, changes[0].spans[0].first );
+            AssertEx::AreEqual( size_t( 2 ), changes[0].spans[0].second );
+            AssertEx::AreEqual( base + 0x1004, changes[1].spans[0].first );
+
+            // Outside of watched range
+            data[0x1900] = 4;
+            AssertEx::IsTrue( watch.Poll( true ).empty() );
+
+            AssertEx::IsTrue( watch.Remove( id ) );
+
+            // Reference XXH64 values, last one covers 32-byte stripe loop and tail
+            const char text[] = "Nobody inspects the spammish repetition";
+            AssertEx::AreEqual( uint64_t( 0xEF46DB3751D8E999 ), MemoryWatch::Hash( "", 0 ) );
+            AssertEx::AreEqual( uint64_t( 0x44BC2CF5AD770999 ), MemoryWatch::Hash( "abc", 3 ) );
+            AssertEx::AreEqual( uint64_t( 0xFBCEA83C8A378BF1 ), MemoryWatch::Hash( text, sizeof( text ) - 1 ) );
+        }
+
+        TEST_METHOD( AsyncIO )
+        {
+            alignas(0x1000) static uint32_t data[0x800] = { 1, 2, 3 };
+            auto base = reinterpret_cast<ptr_t>(data);
+            auto& async = _proc.memory().async();
+            async.resetStats();
+
+            auto first = _proc.memory().ReadAsync( base, sizeof( uint32_t ) );
+            auto second = _proc.memory().ReadAsync( base + 4, sizeof( uint32_t ) );
+            auto query = _proc.memory().QueryAsync( base );
+
+            AssertEx::AreEqual( 1u, first.get_as<uint32_t>().result( 0 ) );
+            AssertEx::AreEqual( 2u, second.get_as<uint32_t>().result( 0 ) );
+            AssertEx::IsTrue( query.get().success() );
+            AssertEx::AreEqual( static_cast<DWORD>(MEM_COMMIT), query.get().result().State );
+
+            // Read issued after pending write of the same page must see written data
+            uint32_t value = 7;
+            auto write = _proc.memory().WriteAsync( base + 8, sizeof( value ), &value );
+            auto afterWrite = _proc.memory().ReadAsync( base + 8, sizeof( value ) );
+            AssertEx::AreEqual( 7u, afterWrite.get_as<uint32_t>().result( 0 ) );
+            AssertEx::NtSuccess( write.get() );
+            AssertEx::AreEqual( 7u, data[2] );
+
+            // Read issued before write must not see it
+            value = 9;
+            auto beforeWrite = _proc.memory().ReadAsync( base + 12, sizeof( value ) );
+            write = _proc.memory().WriteAsync( base + 12, sizeof( value ), &value );
+            AssertEx::AreEqual( 0u, beforeWrite.get_as<uint32_t>().result( 1 ) );
+            AssertEx::NtSuccess( write.get() );
+            AssertEx::AreEqual( 9u, data[3] );
+
+            AssertEx::AreEqual( STATUS_INVALID_ADDRESS, _proc.memory().ReadAsync( 0, 4 ).get().status );
+
+            async.Wait();
+            AssertEx::AreEqual( uint64_t( 4 ), async.stats().reads );
+        }
+
+        TEST_METHOD( ThreadSnapshot )
+        {
+            ThreadTableDelta delta;
+            AssertEx::NtSuccess( _proc.threads().table().Refresh( &delta ) );
+
+            auto self = _proc.threads().table().entry( GetCurrentThreadId() );
+            AssertEx::IsTrue( self.success() );
+            AssertEx::IsNotZero( self->createTime );
+            AssertEx::IsNotZero( self->teb );
+            AssertEx::AreEqual( _proc.threads().table().size(), delta.created.size() );
+
+            // New thread must be reported as created, then as exited
+            Handle stop( CreateEventW( nullptr, TRUE, FALSE, nullptr ) );
+            std::thread worker( [&stop]() { WaitForSingleObject( stop, INFINITE ); } );
+            DWORD workerId = GetThreadId( worker.native_handle() );
+
+            delta = ThreadTableDelta();
+            AssertEx::NtSuccess( _proc.threads().table().Refresh( &delta ) );
+            AssertEx::IsTrue( std::find( delta.created.begin(), delta.created.end(), workerId ) != delta.created.end() );
+
+            auto thread = _proc.threads().get( workerId );
+            AssertEx::IsNotNull( thread.get() );
+            AssertEx::AreEqual( thread.get(), _proc.threads().get( workerId ).get() );
+
+            SetEvent( stop );
+            worker.join();
+
+            delta = ThreadTableDelta();
+            AssertEx::NtSuccess( _proc.threads().table().Refresh( &delta ) );
+            AssertEx::IsTrue( std::find( delta.exited.begin(), delta.exited.end(), workerId ) != delta.exited.end() );
+            AssertEx::IsNull( _proc.threads().table().get( workerId ).get() );
+
+            auto main = _proc.threads().getMain();
+            AssertEx::IsNotNull( main.get() );
+        }
+
+        TEST_METHOD( HandleFiltering )
+        {
+            Handle hEvent( CreateEventW( nullptr, FALSE, FALSE, nullptr ) );
+            Handle hSection( CreateFileMappingW( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, 0x2000, nullptr ) );
+            AssertEx::IsNotNull( hEvent.get() );
+            AssertEx::IsNotNull( hSection.get() );
+
+            HandleFilter filter;
+            filter.types = { L"Event" };
+            filter.names = false;
+
+            auto events = _proc.EnumHandles( filter );
+            AssertEx::IsTrue( events.success() );
+            AssertEx::IsFalse( events->empty() );
+            AssertEx::IsTrue( std::all_of( events->begin(), events->end(), []( const auto& info ) { return info.typeName == L"Event"; } ) );
+            AssertEx::IsTrue( std::any_of( events->begin(), events->end(), [&hEvent]( const auto& info ) { return info.handle == hEvent.get(); } ) );
+
+            filter.types = { L"Section" };
+            filter.access = SECTION_MAP_WRITE;
+            filter.names = true;
+
+            auto sections = _proc.EnumHandles( filter );
+            AssertEx::IsTrue( sections.success() );
+
+            auto iter = std::find_if( sections->begin(), sections->end(), [&hSection]( const auto& info ) { return info.handle == hSection.get(); } );
+            AssertEx::IsTrue( iter != sections->end() );
+            AssertEx::IsNotNull( iter->section.get() );
+            AssertEx::AreEqual( ptr_t( 0x2000 ), iter->section->size );
+            AssertEx::IsTrue( std::all_of( sections->begin(), sections->end(), []( const auto& info ) { return (info.access & SECTION_MAP_WRITE) != 0; } ) );
+        }
+
     private:
         Process _proc;
     };
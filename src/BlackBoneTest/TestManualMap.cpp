@@ -65,6 +65,180 @@ namespace Testing
             MapFromMemory( GetTestHelperHost64(), GetTestHelperDll64() );
         }
 
+        TEST_METHOD( Stats )
+        {
+            Process proc;
+            NTSTATUS status = proc.CreateAndAttach( GetTestHelperHost() );
+            AssertEx::NtSuccess( status );
+            proc.EnsureInit();
+
+            MapStats stats;
+            auto image = proc.mmap().MapImage( GetTestHelperDll(), ManualImports, &MapCallback, nullptr, nullptr, &stats );
+            proc.Terminate();
+
+            AssertEx::IsTrue( image.success() );
+            AssertEx::IsFalse( stats.images.empty() );
+            AssertEx::IsNotZero( stats.totalTime );
+            AssertEx::IsNotZero( stats.memory.writes );
+            AssertEx::IsNotZero( stats.images.front().dependencies );
+
+            uint64_t phaseTotal = 0;
+            for (auto time : stats.phaseTime)
+                phaseTotal += time;
+
+            AssertEx::IsTrue( phaseTotal <= stats.totalTime );
+        }
+
+        TEST_METHOD( Reload )
+        {
+            Process proc;
+            NTSTATUS status = proc.CreateAndAttach( GetTestHelperHost() );
+            AssertEx::NtSuccess( status );
+            proc.EnsureInit();
+
+            auto image = proc.mmap().MapImage( GetTestHelperDll(), ManualImports, &MapCallback );
+            AssertEx::IsTrue( image.success() );
+
+            // Same image must not produce any changed pages
+            auto pages = proc.mmap().ReloadImage( image.result(), GetTestHelperDll() );
+            proc.Terminate();
+
+            AssertEx::NtSuccess( pages.status );
+            AssertEx::IsZero( pages.result() );
+        }
+
+        TEST_METHOD( ReloadChanged )
+        {
+            // Only header page differs in new build
+            DWORD timestamp = 0;
+            auto newPath = WritePatchedImage( GetTestHelperDll(), [&timestamp]( PIMAGE_NT_HEADERS pHeaders )
+            {
+                timestamp = ++pHeaders->FileHeader.TimeDateStamp;
+            } );
+            AssertEx::IsFalse( newPath.empty() );
+
+            Process proc;
+            NTSTATUS status = proc.CreateAndAttach( GetTestHelperHost() );
+            AssertEx::NtSuccess( status );
+            proc.EnsureInit();
+
+            auto image = proc.mmap().MapImage( GetTestHelperDll(), ManualImports, &MapCallback );
+            AssertEx::IsTrue( image.success() );
+
+            auto pages = proc.mmap().ReloadImage( image.result(), newPath );
+
+            auto dosHeader = proc.memory().Read<IMAGE_DOS_HEADER>( image.result()->baseAddress );
+            AssertEx::IsTrue( dosHeader.success() );
+
+            auto fileHeader = proc.memory().Read<IMAGE_FILE_HEADER>( 
+                image.result()->baseAddress + dosHeader->e_lfanew + FIELD_OFFSET( IMAGE_NT_HEADERS, FileHeader ) 
+                );
+
+            proc.Terminate();
+            DeleteFileW( newPath.c_str() );
+
+            AssertEx::NtSuccess( pages.status );
+            AssertEx::AreEqual( 1u, pages.result() );
+            AssertEx::IsTrue( fileHeader.success() );
+            AssertEx::AreEqual( timestamp, fileHeader->TimeDateStamp );
+        }
+
+        TEST_METHOD( ReloadMismatch )
+        {
+            // Changed section characteristics require a remap
+            auto newPath = WritePatchedImage( GetTestHelperDll(), []( PIMAGE_NT_HEADERS pHeaders )
+            {
+                IMAGE_FIRST_SECTION( pHeaders )->Characteristics ^= IMAGE_SCN_MEM_WRITE;
+            } );
+            AssertEx::IsFalse( newPath.empty() );
+
+            Process proc;
+            NTSTATUS status = proc.CreateAndAttach( GetTestHelperHost() );
+            AssertEx::NtSuccess( status );
+            proc.EnsureInit();
+
+            auto image = proc.mmap().MapImage( GetTestHelperDll(), ManualImports, &MapCallback );
+            AssertEx::IsTrue( image.success() );
+
+            auto pages = proc.mmap().ReloadImage( image.result(), newPath );
+            proc.Terminate();
+            DeleteFileW( newPath.c_str() );
+
+            AssertEx::AreEqual( static_cast<NTSTATUS>(STATUS_REVISION_MISMATCH), pages.status );
+        }
+
+        TEST_METHOD( LazyBinding )
+        {
+            Process proc;
+            NTSTATUS status = proc.CreateAndAttach( GetTestHelperHost() );
+            AssertEx::NtSuccess( status );
+            proc.EnsureInit();
+
+            MapStats stats;
+            auto image = proc.mmap().MapImage( GetTestHelperDll(), LazyBinding, nullptr, nullptr, nullptr, &stats );
+            AssertEx::IsTrue( image.success() );
+            AssertEx::IsNotZero( stats.images.front().lazyImports );
+
+            auto g_loadDataPtr = proc.modules().GetExport( image.result(), "g_LoadData" );
+            AssertEx::IsTrue( g_loadDataPtr.success() );
+
+            auto g_loadData = proc.memory().Read<DllLoadData>( g_loadDataPtr->procAddress );
+            AssertEx::IsTrue( g_loadData.success() );
+
+            proc.Terminate();
+
+            ValidateDllLoad( g_loadData.result() );
+        }
+
+        TEST_METHOD( ExceptionTable )
+        {
+            Process proc;
+            AssertEx::NtSuccess( proc.Attach( GetCurrentProcessId() ) );
+
+            // More modules than fit into single table page, added in reverse order
+            MExcept except;
+            std::vector<ptr_t> published;
+            auto current = [&]() { return proc.memory().Read<ptr_t>( except.table() ).result( 0 ); };
+
+            for (ptr_t i = 0; i < 300; i++)
+            {
+                ModuleData mod = { };
+                mod.baseAddress = 0x10000000 + (299 - i) * 0x10000;
+                mod.size = 0x1000;
+                mod.type = mt_mod64;
+
+                AssertEx::NtSuccess( except.CreateVEH( proc, mod, true ) );
+                published.emplace_back( current() );
+            }
+
+            for (ptr_t i = 0; i < 300; i += 3)
+            {
+                AssertEx::NtSuccess( except.RemoveModule( proc, 0x10000000 + i * 0x10000 ) );
+                published.emplace_back( current() );
+            }
+
+            // Tables are reused instead of growing remote memory with every update
+            std::sort( published.begin(), published.end() );
+            published.erase( std::unique( published.begin(), published.end() ), published.end() );
+            AssertEx::IsTrue( published.size() <= 4 );
+
+            auto count = proc.memory().Read<ptr_t>( current() ).result( 0 );
+            AssertEx::AreEqual( ptr_t( 200 ), count );
+
+            std::vector<ExceptionModule> entries( static_cast<size_t>(count) );
+            AssertEx::NtSuccess( proc.memory().Read( current() + FIELD_OFFSET( ModuleTable, entry ), entries.size() * sizeof( ExceptionModule ), entries.data() ) );
+
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                AssertEx::AreEqual( ptr_t( 0x1000 ), entries[i].size );
+                AssertEx::IsNotZero( ((entries[i].base - 0x10000000) / 0x10000) % 3 );
+                if (i != 0)
+                    AssertEx::IsTrue( entries[i - 1].base < entries[i].base );
+            }
+
+            except.reset();
+        }
+
     private:
         void MapFromFile( const std::wstring& hostPath, const std::wstring& dllPath )
         {
@@ -145,6 +319,36 @@ namespace Testing
             return std::pair<std::unique_ptr<uint8_t[]>, uint32_t>();
         }
 
+        /// <summary>
+        /// Write patched copy of image into temporary directory
+        /// </summary>
+        /// <param name="path">Source image path</param>
+        /// <param name="patch">Patch routine</param>
+        /// <returns>Patched image path, empty on failure</returns>
+        std::wstring WritePatchedImage( const std::wstring& path, const std::function<void( PIMAGE_NT_HEADERS )>& patch )
+        {
+            auto[buf, size] = GetFileData( path );
+            if (size == 0)
+                return std::wstring();
+
+            auto pDosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(buf.get());
+            patch( reinterpret_cast<PIMAGE_NT_HEADERS>(buf.get() + pDosHeader->e_lfanew) );
+
+            wchar_t tempDir[MAX_PATH] = { };
+            GetTempPathW( _countof( tempDir ), tempDir );
+            std::wstring newPath = std::wstring( tempDir ) + L"BlackBoneReload.dll";
+
+            auto hFile = Handle( CreateFileW( newPath.c_str(), FILE_GENERIC_WRITE, 0x7, nullptr, CREATE_ALWAYS, 0, nullptr ) );
+            if (!hFile)
+                return std::wstring();
+
+            DWORD bytes = 0;
+            if (!WriteFile( hFile, buf.get(), size, &bytes, nullptr ) || bytes != size)
+                return std::wstring();
+
+            return newPath;
+        }
+
     private:
         static inline std::set<std::wstring> nativeMods, modList;
     };
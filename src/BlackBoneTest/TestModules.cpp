@@ -36,6 +36,51 @@ public:
         AssertEx::AreEqual( byLdrList->name, byHeaders->name );
     }
 
+    TEST_METHOD( EnumAfterSectionScan )
+    {
+        auto contains = []( const ProcessModules::mapModules& mods, const wchar_t* name )
+        {
+            return std::any_of( mods.begin(), mods.end(), [name]( const auto& mod ) { return mod.second->name == name; } );
+        };
+
+        // Section scan replaces cached entries, loader list must restore them without loader changes
+        _proc.modules().GetAllModules( LdrList );
+        _proc.modules().GetAllModules( Sections );
+        auto& mods = _proc.modules().GetAllModules( LdrList );
+
+        AssertEx::IsTrue( contains( mods, L"ntdll.dll" ) );
+        AssertEx::IsTrue( contains( mods, L"kernel32.dll" ) );
+
+        auto kernel32 = _proc.modules().GetModule( L"kernel32.dll", LdrList );
+        AssertEx::IsNotNull( kernel32.get() );
+        ValidateModule( *kernel32, reinterpret_cast<module_t>(GetModuleHandleW( L"kernel32.dll" )) );
+    }
+
+    TEST_METHOD( HeaderScan )
+    {
+        auto base = reinterpret_cast<module_t>(GetModuleHandleW( L"kernel32.dll" ));
+        auto native = _proc.core().native();
+
+        auto contains = [base]( const std::vector<ModuleDataPtr>& mods )
+        {
+            return std::any_of( mods.begin(), mods.end(), [base]( const auto& mod ) { return mod->baseAddress == base; } );
+        };
+
+        auto all = native->ScanPEHeaders( PEScanAll );
+        auto serial = native->ScanPEHeaders( PEScanAll, 1 );
+        auto executable = native->ScanPEHeaders( PEScanExecutable );
+        auto priv = native->ScanPEHeaders( PEScanPrivate );
+
+        AssertEx::AreEqual( serial.size(), all.size() );
+        AssertEx::IsTrue( contains( all ) );
+        AssertEx::IsTrue( contains( executable ) );
+        AssertEx::IsFalse( contains( priv ) );
+        AssertEx::IsTrue( executable.size() <= all.size() );
+
+        auto iter = std::find_if( all.begin(), all.end(), [base]( const auto& mod ) { return mod->baseAddress == base; } );
+        AssertEx::AreEqual( std::wstring( L"kernel32.dll" ), (*iter)->name );
+    }
+
     void ValidateModule( const ModuleData& mod, module_t expectedBase )
     {
         AssertEx::AreEqual( expectedBase, mod.baseAddress );
@@ -61,6 +106,68 @@ public:
         AssertEx::AreEqual( reinterpret_cast<ptr_t>(expected), result->procAddress );
     }
 
+    TEST_METHOD( LoaderChanges )
+    {
+        auto& loader = _proc.modules().loader();
+        std::vector<ModuleDataPtr> loaded, unloaded;
+        auto id = loader.Subscribe( [&]( const LoaderDelta& delta )
+        {
+            loaded.insert( loaded.end(), delta.loaded.begin(), delta.loaded.end() );
+            unloaded.insert( unloaded.end(), delta.unloaded.begin(), delta.unloaded.end() );
+        } );
+
+        auto initial = loader.Update();
+        AssertEx::IsTrue( initial.success() );
+        AssertEx::IsFalse( initial->loaded.empty() );
+
+        loaded.clear();
+        AssertEx::IsTrue( loader.Update()->empty() );
+
+        auto path = GetTestHelperDll();
+        auto name = Utils::ToLower( Utils::StripPath( path ) );
+        auto hMod = LoadLibraryW( path.c_str() );
+        AssertEx::IsNotNull( hMod );
+        AssertEx::IsTrue( loader.Update().success() );
+        AssertEx::IsTrue( std::any_of( loaded.begin(), loaded.end(), [&]( const auto& mod ) { return mod->name == name; } ) );
+        AssertEx::IsNotNull( _proc.modules().GetModule( name ).get() );
+
+        FreeLibrary( hMod );
+        AssertEx::IsTrue( loader.Update().success() );
+        AssertEx::IsTrue( std::any_of( unloaded.begin(), unloaded.end(), [&]( const auto& mod ) { return mod->name == name; } ) );
+
+        loader.Unsubscribe( id );
+    }
+
+    TEST_METHOD( BatchInject )
+    {
+        auto path = GetTestHelperDll();
+        wchar_t kernel32[MAX_PATH] = { 0 };
+        GetModuleFileNameW( GetModuleHandleW( L"kernel32.dll" ), kernel32, _countof( kernel32 ) );
+
+        std::vector<std::wstring> paths = { path, L"C:\\nonexistent\\missing.dll", kernel32 };
+
+        auto results = _proc.modules().Inject( paths );
+        AssertEx::NtSuccess( results.status );
+        AssertEx::AreEqual( paths.size(), results->size() );
+
+        auto hMod = GetModuleHandleW( path.c_str() );
+        AssertEx::IsNotNull( hMod );
+
+        auto& injected = results.result()[0];
+        AssertEx::NtSuccess( injected.status );
+        ValidateModule( *injected.result(), reinterpret_cast<module_t>(hMod) );
+        AssertEx::IsNotZero( injected.result()->ldrPtr );
+
+        AssertEx::IsFalse( results.result()[1].success() );
+        AssertEx::AreEqual( static_cast<NTSTATUS>(STATUS_IMAGE_ALREADY_LOADED), results.result()[2].status );
+
+        // Cache is updated without loader list walk
+        auto name = Utils::ToLower( Utils::StripPath( path ) );
+        AssertEx::AreEqual( injected.result().get(), _proc.modules().GetModule( name ).get() );
+
+        AssertEx::IsTrue( FreeLibrary( hMod ) != FALSE );
+    }
+
 private:
     Process _proc;
 };
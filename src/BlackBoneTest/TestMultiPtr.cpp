@@ -105,6 +105,41 @@ namespace Testing
             AssertEx::AreEqual( newVal, pVal_ex->fval, 0.001f );
         }
 
+        TEST_METHOD( RemoteChainSet )
+        {
+            Process proc;
+            AssertEx::NtSuccess( proc.Attach( GetCurrentProcessId() ) );
+
+            PointerChainSet set( proc.memory() );
+            auto fval = set.Add( _objectPtr, { off[0], off[1], off[2], static_cast<intptr_t>(offsetOf( &s_end::fval )) } );
+            auto ival = set.Add( _objectPtr, { off[0], off[1], off[2], static_cast<intptr_t>(offsetOf( &s_end::ival )) } );
+
+            multi_ptr_ex<s_end*> ptr_ex( &proc, _objectPtr, { off[0], off[1], off[2] } );
+            ptr_ex.bind( set );
+
+            // Shared prefix is stored once
+            AssertEx::AreEqual( size_t( 4 ), set.nodes() );
+
+            AssertEx::NtSuccess( set.Resolve() );
+            AssertEx::AreEqual( reinterpret_cast<ptr_t>(&_guard->pS2->pS1->pEnd->fval), set.address( fval ) );
+            AssertEx::AreEqual( reinterpret_cast<ptr_t>(&_guard->pS2->pS1->pEnd->ival), set.address( ival ) );
+
+            auto pVal_ex = ptr_ex.get();
+            AssertEx::IsNotNull( pVal_ex );
+            AssertEx::AreEqual( _guard->pS2->pS1->pEnd->ival, pVal_ex->ival );
+
+            // Intermediate nodes are reused until next generation
+            set.resetStats();
+            AssertEx::NtSuccess( set.Resolve() );
+            AssertEx::AreEqual( uint64_t( 3 ), set.stats().reused );
+
+            set.NextGeneration();
+            set.resetStats();
+            AssertEx::NtSuccess( set.Resolve() );
+            AssertEx::IsZero( set.stats().reused );
+            AssertEx::AreEqual( uint64_t( 4 ), set.stats().reads );
+        }
+
     private:
         s3 * _object;
         std::unique_ptr<s3> _guard;
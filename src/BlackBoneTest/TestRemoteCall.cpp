@@ -22,6 +22,18 @@ namespace Testing
         return static_cast<int>(a1 + a5);
     }
 
+    DWORD SlowFn( DWORD delay, DWORD value )
+    {
+        Sleep( delay );
+        return value;
+    }
+
+    void ReverseFn( uint8_t* dst, const uint8_t* src, size_t size )
+    {
+        for (size_t i = 0; i < size; i++)
+            dst[i] = src[size - i - 1];
+    }
+
     TEST_CLASS( RemoteCall )
     {
     public:
@@ -119,6 +131,41 @@ namespace Testing
             AssertEx::IsZero( memcmp( &_input, &_output, sizeof( _input ) ) );
         }
 
+        TEST_METHOD( BatchedCalls )
+        {
+            Process process;
+            AssertEx::NtSuccess( process.Attach( GetCurrentProcessId() ) );
+
+            auto pFN = MakeRemoteFunction<decltype(&TestFn)>( process, &TestFn );
+            auto pSetLastError = MakeRemoteFunction<decltype(&SetLastError)>( process, &SetLastError );
+            double d[4] = { };
+
+            _input.ival = 0xDEAD;
+            _input.fval = 1337.0f;
+            _input.uval = 0xDEADC0DEA4DBEEFull;
+
+            RemoteCallBatch batch( process );
+            for (int i = 0; i < 4; i++)
+                pFN.Batch( batch, { i, 2.0f, 3.0, &d[i], 5ll, _cbuf, _wbuf, &_output, _input } );
+
+            auto errIdx = pSetLastError.Batch( batch, ERROR_ACCESS_DENIED );
+
+            auto results = batch.Execute();
+            AssertEx::NtSuccess( results.status );
+            AssertEx::AreEqual( batch.size(), results->size() );
+
+            for (int i = 0; i < 4; i++)
+            {
+                AssertEx::AreEqual( static_cast<uint64_t>(i + 5), results.result()[i].value );
+                AssertEx::AreEqual( 3.0 + 2.0f, d[i], 0.001 );
+            }
+
+            AssertEx::AreEqual( static_cast<uint32_t>(ERROR_ACCESS_DENIED), results.result()[errIdx].lastError );
+            AssertEx::AreEqual( _cbuf, g_string );
+            AssertEx::AreEqual( _wbuf, g_wstring );
+            AssertEx::IsZero( memcmp( &_input, &_output, sizeof( _input ) ) );
+        }
+
         TEST_METHOD( CallLoop )
         {
             Process process;
@@ -142,6 +189,133 @@ namespace Testing
             }
         }
 
+        TEST_METHOD( CachedStubs )
+        {
+            Process process;
+            AssertEx::NtSuccess( process.Attach( GetCurrentProcessId() ) );
+            AssertEx::NtSuccess( process.remote().CreateRPCEnvironment( Worker_CreateNew, true ) );
+
+            auto pFN = MakeRemoteFunction<decltype(&TestFn)>( process, &TestFn );
+            auto worker = process.remote().getWorker();
+
+            _input.ival = 0xDEAD;
+            _input.fval = 1337.0f;
+            _input.uval = 0xDEADC0DEA4DBEEFull;
+
+            // Same signature, different values each time
+            for (auto i = 0; i < 20; i++)
+            {
+                double d = 0.0;
+                _input.ival = i;
+
+                auto [status, result] = pFN.Call( { i, 2.0f * i, 3.0, &d, 5ll * i, _cbuf, _wbuf, &_output, _input }, worker );
+                AssertEx::NtSuccess( status );
+                AssertEx::AreEqual( i + 5 * i, result.value() );
+                AssertEx::AreEqual( 3.0 + 2.0f * i, d, 0.001 );
+                AssertEx::AreEqual( static_cast<uint32_t>(i), _output.ival );
+            }
+
+            // One stub per user buffer
+            auto& stubs = process.remote().stubs();
+            AssertEx::AreEqual( size_t( 2 ), stubs.size() );
+            AssertEx::AreEqual( uint64_t( 2 ), stubs.misses() );
+            AssertEx::AreEqual( uint64_t( 18 ), stubs.hits() );
+        }
+
+        TEST_METHOD( LargeArguments )
+        {
+            Process process;
+            AssertEx::NtSuccess( process.Attach( GetCurrentProcessId() ) );
+            AssertEx::NtSuccess( process.remote().CreateRPCEnvironment( Worker_CreateNew, true ) );
+
+            auto pFN = MakeRemoteFunction<decltype(&ReverseFn)>( process, &ReverseFn );
+            auto worker = process.remote().getWorker();
+
+            // Argument block must grow past default user buffer size
+            for (size_t size : { 0x100, 0x10000, 0x3000, 0x40001 })
+            {
+                std::vector<uint8_t> src( size ), dst( size );
+                for (size_t i = 0; i < size; i++)
+                    src[i] = static_cast<uint8_t>(i * 7);
+
+                auto [status, result] = pFN.Call( { AsmVariant( dst.data(), size ), AsmVariant( src.data(), size ), size }, worker );
+                AssertEx::NtSuccess( status );
+                AssertEx::AreEqual( src.front(), dst.back() );
+                AssertEx::AreEqual( src.back(), dst.front() );
+                AssertEx::IsTrue( std::equal( src.begin(), src.end(), dst.rbegin() ) );
+            }
+        }
+
+        TEST_METHOD( AsyncCalls )
+        {
+            Process process;
+            AssertEx::NtSuccess( process.Attach( GetCurrentProcessId() ) );
+            AssertEx::NtSuccess( process.remote().pool().Start( 4 ) );
+
+            auto pFN = MakeRemoteFunction<decltype(&SlowFn)>( process, &SlowFn );
+
+            // Calls run in parallel on different workers
+            auto start = GetTickCount64();
+            std::vector<std::future<call_result_t<DWORD>>> calls;
+            for (DWORD i = 0; i < 4; i++)
+                calls.emplace_back( pFN.CallAsync( { 200ul, i } ) );
+
+            for (DWORD i = 0; i < 4; i++)
+            {
+                auto result = calls[i].get();
+                AssertEx::NtSuccess( result.status );
+                AssertEx::AreEqual( i, result.result() );
+            }
+
+            AssertEx::IsTrue( GetTickCount64() - start < 4 * 200 );
+
+            // Timed out call is abandoned, worker is reused after it returns
+            auto timedOut = pFN.CallAsync( { 500ul, 1ul }, 50 );
+            AssertEx::AreEqual( static_cast<NTSTATUS>(STATUS_TIMEOUT), timedOut.get().status );
+
+            CancelToken cancel;
+            auto cancelled = pFN.CallAsync( { 500ul, 2ul }, INFINITE, cancel );
+            cancel.cancel();
+            AssertEx::AreEqual( static_cast<NTSTATUS>(STATUS_CANCELLED), cancelled.get().status );
+
+            for (DWORD i = 0; i < 8; i++)
+                calls.emplace_back( pFN.CallAsync( { 0ul, i } ) );
+
+            for (DWORD i = 0; i < 8; i++)
+                AssertEx::AreEqual( i, calls[4 + i].get().result() );
+
+            auto stats = process.remote().pool().stats();
+            AssertEx::AreEqual( uint64_t( 1 ), stats.timeouts );
+            AssertEx::AreEqual( uint64_t( 1 ), stats.cancelled );
+
+            // Stop doesn't wait for calls without timeout
+            auto pending = pFN.CallAsync( { 500ul, 3ul } );
+            process.remote().pool().Stop();
+            AssertEx::AreEqual( static_cast<NTSTATUS>(STATUS_CANCELLED), pending.get().status );
+            AssertEx::IsFalse( process.remote().pool().active() );
+        }
+
+        TEST_METHOD( RingWorker )
+        {
+            Process process;
+            AssertEx::NtSuccess( process.Attach( GetCurrentProcessId() ) );
+            AssertEx::NtSuccess( process.remote().CreateRPCEnvironment( Worker_Ring, true ) );
+
+            auto pFN = MakeRemoteFunction<decltype(&TestFn)>( process, &TestFn );
+            auto worker = process.remote().getWorker();
+            auto submitted = process.remote().ring().stats().submitted;
+            double d = 0.0;
+
+            for (auto i = 0; i < 4; i++)
+            {
+                auto [status, result] = pFN.Call( { i, 2.0f, 3.0, &d, 5ll, _cbuf, _wbuf, &_output, _input }, worker );
+                AssertEx::NtSuccess( status );
+                AssertEx::AreEqual( i + 5, result.value() );
+            }
+
+            AssertEx::AreEqual( submitted + 4, process.remote().ring().stats().submitted );
+        }
+
         TEST_METHOD( BoundThread )
         {
             Process process;
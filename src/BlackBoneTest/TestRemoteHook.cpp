@@ -38,8 +38,24 @@ namespace Testing
             calls++;
         }
 
+        void HookNtAllocateVirtualMemorySnapshot( RemoteContext& context )
+        {
+            for (int i = 0; i < 6; i++)
+                context.getArg( i );
+
+            context.returnAddress();
+            context.lastError();
+
+            // Applied before thread is resumed
+            context.setArg( 5, PAGE_READWRITE );
+
+            snapshotReads = context.snapshot() ? context.snapshot()->reads() : 0;
+            calls++;
+        }
+
         Process process;
         int calls = 0;
+        uint32_t snapshotReads = 0;
     };
 
     TEST_CLASS( RemoteHooking )
@@ -105,5 +121,41 @@ namespace Testing
 
             AssertEx::AreEqual( 1, hooker.calls );
         }
+
+        TEST_METHOD( PrefetchedContext )
+        {
+            HookClass hooker;
+
+            auto path = GetTestHelperHost();
+            AssertEx::IsFalse( path.empty() );
+
+            // Give process some time to initialize
+            AssertEx::NtSuccess( hooker.process.CreateAndAttach( path ) );
+            Sleep( 100 );
+
+            auto pHookFn = hooker.process.modules().GetNtdllExport( "NtAllocateVirtualMemory" );
+            AssertEx::IsTrue( pHookFn.success() );
+
+            PVOID base = nullptr;
+            SIZE_T size = 0x1000;
+            auto NtAllocateVirtualMemory = MakeRemoteFunction<NTSTATUS( __stdcall * )(HANDLE, PVOID*, ULONG_PTR, PSIZE_T, ULONG, ULONG)>( hooker.process, pHookFn->procAddress );
+
+            AssertEx::NtSuccess( hooker.process.hooks().Apply( RemoteHook::hwbp, pHookFn->procAddress, &HookClass::HookNtAllocateVirtualMemorySnapshot, hooker ) );
+            auto result = NtAllocateVirtualMemory.Call( { GetCurrentProcess(), &base, 0, &size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE } );
+
+            MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+            auto queryStatus = hooker.process.memory().Query( reinterpret_cast<ptr_t>(base), &mbi );
+
+            hooker.process.Terminate();
+
+            AssertEx::IsTrue( result.success() );
+            AssertEx::NtSuccess( result.result() );
+            AssertEx::NtSuccess( queryStatus );
+            AssertEx::AreEqual( 1, hooker.calls );
+
+            // Arguments, return address and last error come from single prefetch read
+            AssertEx::AreEqual( 1u, hooker.snapshotReads );
+            AssertEx::AreEqual( static_cast<DWORD>(PAGE_READWRITE), mbi.Protect );
+        }
     };
 }
\ No newline at end of file
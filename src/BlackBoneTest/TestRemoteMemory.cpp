@@ -29,6 +29,16 @@ namespace Testing
             auto translated = proc.memory().TranslateAddress( addr );
             AssertEx::IsNotZero( translated );
 
+            // Batch translation must agree with single one
+            auto batch = proc.memory().TranslateAddress( std::vector<ptr_t>{ addr + 0x10, addr } );
+            AssertEx::AreEqual( translated + 0x10, batch[0] );
+            AssertEx::AreEqual( translated, batch[1] );
+
+            // Typed view of mapped header
+            auto dosHdr = proc.memory().View<IMAGE_DOS_HEADER>( addr );
+            AssertEx::IsTrue( dosHdr.success() );
+            AssertEx::AreEqual( static_cast<WORD>(IMAGE_DOS_SIGNATURE), dosHdr->data()->e_magic );
+
             AssertEx::NtSuccess( proc.memory().SetupHook( RemoteMemory::MemVirtualAlloc ) );
             AssertEx::NtSuccess( proc.memory().SetupHook( RemoteMemory::MemVirtualFree ) );
             AssertEx::NtSuccess( proc.memory().SetupHook( RemoteMemory::MemMapSection ) );